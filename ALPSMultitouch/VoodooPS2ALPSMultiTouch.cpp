@@ -73,6 +73,8 @@ bool ApplePS2ALPSMultiTouch::init( OSDictionary * properties )
     _device                    = 0;
     _interruptHandlerInstalled = false;
     _packetByteCount           = 0;
+    _packetTime                = 0;
+    _packetStartTime           = 0;
     _resolution                = (100) << 16; // (100 dpi, 4 counts/mm) On init should be on default
     _touchPadModeByte          = kTapEnabled;
     _scrolling                 = SCROLL_NONE;
@@ -141,6 +143,16 @@ ApplePS2ALPSMultiTouch::probe( IOService * provider, SInt32 * score )
 
     if ( !request ) return 0;
 
+    // The E7 report is chained to the E6 report, so both are fetched in a
+    // single request.
+    PS2Request * requestE7 = _device->allocateRequest();
+    if ( !requestE7 )
+    {
+        _device->freeRequest(request);
+        return 0;
+    }
+    request->nextSegment = requestE7;
+
     // "E6 report"
     request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
     request->commands[0].inOrOut = kDP_SetMouseResolution;
@@ -163,44 +175,40 @@ ApplePS2ALPSMultiTouch::probe( IOService * provider, SInt32 * score )
     request->commands[8].command = kPS2C_ReadDataPort;
     request->commands[8].inOrOut = 0;
     request->commandsCount = 9;
-    _device->submitRequestAndBlock(request);
-
-    // result is "E6 Report"
-    Byte1 = request->commands[6].inOrOut;
-    Byte2 = request->commands[7].inOrOut;
-    Byte3 = request->commands[8].inOrOut;
-    _device->freeRequest(request);
-    DEBUG_LOG("E6 Report: [ 0x%02x, 0x%02x, 0x%02x ]\n", Byte1, Byte2, Byte3);
- 
-    request = _device->allocateRequest();
-    if (!request) return 0;
 
     // Now fetch "E7 Report"
-    request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut = kDP_SetMouseResolution;
-    request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[1].inOrOut = 0;
+    requestE7->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[0].inOrOut = kDP_SetMouseResolution;
+    requestE7->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[1].inOrOut = 0;
 
     // 3X set mouse scaling 2 to 1
-    request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut = kDP_SetMouseScaling2To1;
-    request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut = kDP_SetMouseScaling2To1;
-    request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[4].inOrOut = kDP_SetMouseScaling2To1;
-    request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[5].inOrOut = kDP_GetMouseInformation;
-    request->commands[6].command = kPS2C_ReadDataPort;
-    request->commands[6].inOrOut = 0;
-    request->commands[7].command = kPS2C_ReadDataPort;
-    request->commands[7].inOrOut = 0;
-    request->commands[8].command = kPS2C_ReadDataPort;
-    request->commands[8].inOrOut = 0;
-    request->commandsCount = 9;
+    requestE7->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[2].inOrOut = kDP_SetMouseScaling2To1;
+    requestE7->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[3].inOrOut = kDP_SetMouseScaling2To1;
+    requestE7->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[4].inOrOut = kDP_SetMouseScaling2To1;
+    requestE7->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[5].inOrOut = kDP_GetMouseInformation;
+    requestE7->commands[6].command = kPS2C_ReadDataPort;
+    requestE7->commands[6].inOrOut = 0;
+    requestE7->commands[7].command = kPS2C_ReadDataPort;
+    requestE7->commands[7].inOrOut = 0;
+    requestE7->commands[8].command = kPS2C_ReadDataPort;
+    requestE7->commands[8].inOrOut = 0;
+    requestE7->commandsCount = 9;
     _device->submitRequestAndBlock(request);
+
+    // result is "E6 Report"
     Byte1 = request->commands[6].inOrOut;
     Byte2 = request->commands[7].inOrOut;
     Byte3 = request->commands[8].inOrOut;
+    DEBUG_LOG("E6 Report: [ 0x%02x, 0x%02x, 0x%02x ]\n", Byte1, Byte2, Byte3);
+
+    Byte1 = requestE7->commands[6].inOrOut;
+    Byte2 = requestE7->commands[7].inOrOut;
+    Byte3 = requestE7->commands[8].inOrOut;
     _device->freeRequest(request);
 
     DEBUG_LOG("E7 Report: [ 0x%02x, 0x%02x, 0x%02x ]\n", Byte1, Byte2, Byte3);
@@ -344,15 +352,15 @@ bool ApplePS2ALPSMultiTouch::start( IOService * provider )
     // Install our driver's interrupt handler, for asynchronous data delivery.
     //
 
-    _device->installInterruptAction(this,
-        OSMemberFunctionCast(PS2InterruptAction,this,&ApplePS2ALPSMultiTouch::interruptOccurred));
+    _device->installInterruptBatchAction(this,
+        OSMemberFunctionCast(PS2InterruptBatchAction,this,&ApplePS2ALPSMultiTouch::interruptOccurred));
     _interruptHandlerInstalled = true;
 
     //
     // Enable the mouse clock (should already be so) and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+    _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 
     //
     // Finally, we enable the trackpad itself, so that it may start reporting
@@ -384,6 +392,12 @@ void ApplePS2ALPSMultiTouch::stop( IOService * provider )
 
     assert(_device == provider);
 
+    //
+    // Drop whatever requests are still outstanding; the pad may be gone.
+    //
+
+    _device->cancelRequests();
+
     //
     // Disable the mouse itself, so that it may stop reporting mouse events.
     //
@@ -394,7 +408,7 @@ void ApplePS2ALPSMultiTouch::stop( IOService * provider )
     // Disable the mouse clock and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
+    _device->setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
 
     //
     // Uninstall the interrupt handler.
@@ -432,12 +446,34 @@ void ApplePS2ALPSMultiTouch::free()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2ALPSMultiTouch::interruptOccurred( UInt8 data )
+void ApplePS2ALPSMultiTouch::interruptOccurred( const UInt8 * data, const UInt64 * times, UInt32 count )
 {
     //
     // This will be invoked automatically from our device when asynchronous
     // events need to be delivered. Process the trackpad data. Do NOT issue
     // any BLOCKING commands to our device in this context.
+    //
+    // Each packet is timed by the arrival of its first byte.
+    //
+
+    UInt64 now = mach_absolute_time();
+
+    while (count--)
+    {
+        if (_packetByteCount == 0)
+        {
+            _packetTime      = *times;
+            _packetStartTime = now;
+        }
+        packetByteOccurred(*data++);
+        times++;
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2ALPSMultiTouch::packetByteOccurred( UInt8 data )
+{
     //
     // Ignore all bytes until we see the start of a packet, otherwise the
     // packets may get out of sequence and things will get very confusing.
@@ -478,14 +514,22 @@ void ApplePS2ALPSMultiTouch::interruptOccurred( UInt8 data )
 	*/
 	if(_packetByteCount == 4) // IntelliMouse Mode
 	{
+		UInt64 complete = mach_absolute_time();
+
+		_device->recordLatency(kLS_Packet, _packetStartTime, complete);
 		dispatchRelativePointerEventWithPacket(_packetBuffer,4);
+		_device->recordLatency(kLS_Dispatch, complete, mach_absolute_time());
 		_packetByteCount = 0;
 		return;
 	}
 	
 	if(_packetByteCount == 6) // Absolute mode
 	{
+		UInt64 complete = mach_absolute_time();
+
+		_device->recordLatency(kLS_Packet, _packetStartTime, complete);
 		dispatchAbsolutePointerEventWithPacket(_packetBuffer,6);
+		_device->recordLatency(kLS_Dispatch, complete, mach_absolute_time());
 		_packetByteCount = 0;
 		return;
 	}
@@ -557,11 +601,7 @@ void ApplePS2ALPSMultiTouch::dispatchAbsolutePointerEventWithPacket(UInt8* packe
 			  (unsigned int)packet[3], (unsigned int)packet[4], (unsigned int)packet[5]);
 	//IOSleep(20);
 
-#if APPLESDK
-	clock_get_uptime(&now);
-#else 
-	clock_get_uptime((uint64_t*)&now);
-#endif
+	*(uint64_t*)&now = _packetTime;
     
     left  |= (packet[3]) & 1;
     right |= (packet[3] >> 1) & 1;
@@ -874,11 +914,7 @@ void ApplePS2ALPSMultiTouch::dispatchRelativePointerEventWithPacket( UInt8 * pac
     if ( (packet[0] & 0x4) ) buttons |= 0x4;  // middle button (bit 2 in packet)
     dx = ((packet[0] & 0x10) ? 0xffffff00 : 0 ) | packet[1];
     dy = -(((packet[0] & 0x20) ? 0xffffff00 : 0 ) | packet[2]);
-#if APPLESDK
-	clock_get_uptime(&now);
-#else 
-	clock_get_uptime((uint64_t*)&now);
-#endif
+	*(uint64_t*)&now = _packetTime;
     dispatchRelativePointerEvent(dx, dy, buttons, now);
 
   if ( packetSize > 3 )
@@ -1094,84 +1130,28 @@ void ApplePS2ALPSMultiTouch::setSampleRateAndResolution( void )
 {
     PS2Request * request = _device->allocateRequest();
     if ( !request ) return;
+    // No need to disable data reporting first: nothing is read back but
+    // acknowledges, which the controller keeps apart from packets.
     request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut = kDP_SetDefaultsAndDisable;           // 0xF5, Disable data reporting 
+    request->commands[0].inOrOut = kDP_SetMouseSampleRate;              // 0xF3
     request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[1].inOrOut = kDP_SetMouseSampleRate;              // 0xF3
+    request->commands[1].inOrOut = 0x64;                                // 100 dpi
     request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut = 0x64;                                // 100 dpi
+    request->commands[2].inOrOut = kDP_SetMouseResolution;              // 0xE8
     request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut = kDP_SetMouseResolution;              // 0xE8
+    request->commands[3].inOrOut = 0x03;                                // 0x03 = 8 counts/mm
     request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[4].inOrOut = 0x03;                                // 0x03 = 8 counts/mm
+    request->commands[4].inOrOut = kDP_SetMouseScaling1To1;             // 0xE6
+    // (the status knock in getStatus leaves reporting off)
     request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[5].inOrOut = kDP_SetMouseScaling1To1;             // 0xE6
-    request->commands[6].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[6].inOrOut = kDP_Enable;                          // 0xF4, Enable Data Reporting
-    request->commandsCount = 7;
+    request->commands[5].inOrOut = kDP_Enable;                          // 0xF4, Enable Data Reporting
+    request->commandsCount = 6;
     _device->submitRequestAndBlock(request);
     _device->freeRequest(request);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2ALPSMultiTouch::setCommandByte( UInt8 setBits, UInt8 clearBits )
-{
-    //
-    // Sets the bits setBits and clears the bits clearBits "atomically" in the
-    // controller's Command Byte.   Since the controller does not provide such
-    // a read-modify-write primitive, we resort to a test-and-set try loop.
-    //
-    // Do NOT issue this request from the interrupt/completion context.
-    //
-
-    UInt8        commandByte;
-    UInt8        commandByteNew;
-    PS2Request * request = _device->allocateRequest();
-
-    if ( !request ) return;
-
-    do
-    {
-        // (read command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPort;
-        request->commands[1].inOrOut = 0;
-        request->commandsCount = 2;
-        _device->submitRequestAndBlock(request);
-
-        //
-        // Modify the command byte as requested by caller.
-        //
-
-        commandByte    = request->commands[1].inOrOut;
-        commandByteNew = (commandByte | setBits) & (~clearBits);
-
-        // ("test-and-set" command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-        request->commands[1].inOrOut = commandByte;
-        request->commands[2].command = kPS2C_WriteCommandPort;
-        request->commands[2].inOrOut = kCP_SetCommandByte;
-        request->commands[3].command = kPS2C_WriteDataPort;
-        request->commands[3].inOrOut = commandByteNew;
-        request->commandsCount = 4;
-        _device->submitRequestAndBlock(request);
-
-        //
-        // Repeat this loop if last command failed, that is, if the
-        // old command byte was modified since we first read it.
-        //
-
-    } while (request->commandsCount != 4);  
-
-    _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 IOReturn ApplePS2ALPSMultiTouch::setParamProperties( OSDictionary * dict )
 {
     OSNumber * clicking = OSDynamicCast( OSNumber, dict->getObject("Clicking") );
@@ -1281,8 +1261,9 @@ void ApplePS2ALPSMultiTouch::setDevicePowerState( UInt32 whatToDo )
 
         case kPS2C_EnableDevice:
 		case 2:  //Slice :)
+        case kPS2C_ResetDevice:         // (recovered port, no power cycle)
 			
-			IOSleep(1000);
+			if ( whatToDo != kPS2C_ResetDevice )  IOSleep(1000);
 
             setTapEnable( _touchPadModeByte );
 
@@ -1292,7 +1273,7 @@ void ApplePS2ALPSMultiTouch::setDevicePowerState( UInt32 whatToDo )
             // mouse IRQ line.
             //
 
-            setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+            _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 
 			DEBUG_LOG(" ABMod Waking up Touchpad setting setTapEnable to %d\n",_touchPadModeByte);
 
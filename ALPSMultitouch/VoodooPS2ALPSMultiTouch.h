@@ -52,6 +52,8 @@ private:
     UInt32                _powerControlHandlerInstalled:1;
     UInt8                 _packetBuffer[6];
     UInt32                _packetByteCount;
+    UInt64                _packetTime;            // first byte's arrival
+    UInt64                _packetStartTime;       // first byte's delivery
     IOFixed               _resolution;
     UInt16                _touchPadVersion;
     UInt8                 _touchPadModeByte;
@@ -113,7 +115,6 @@ protected:
     virtual void   getMouseInformation();
     virtual void   getStatus(ALPSStatus_t *status);
     virtual int    insideScrollArea(int x,int y);
-    virtual void   setCommandByte( UInt8 setBits, UInt8 clearBits );
     virtual void   setSampleRateAndResolution( void );
     virtual void   setTapEnable( bool enable );
     virtual void   setTouchPadEnable( bool enable );
@@ -123,7 +124,8 @@ protected:
                                         bool  enableStreamMode = false );
 #endif
     virtual void   free();
-    virtual void   interruptOccurred( UInt8 data );
+    virtual void   interruptOccurred( const UInt8 * data, const UInt64 * times, UInt32 count );
+    virtual void   packetByteOccurred( UInt8 data );
     virtual void   setDevicePowerState(UInt32 whatToDo);
 
 protected:
@@ -70,6 +70,7 @@
 #define kCP_ReadControllerRAMBase      0x21 //
 #define kCP_SetCommandByte             0x60 // (keyboard+mouse)
 #define kCP_WriteControllerRAMBase     0x61 //
+#define kCP_TransmitToMuxPortBase      0x90 // (mouse, plus aux port number)
 #define kCP_TestPassword               0xA4 //
 #define kCP_GetPassword                0xA5 //
 #define kCP_VerifyPassword             0xA6 //
@@ -125,6 +126,7 @@
 #define kSC_Extend              0xE0    // marker for "extended" sequence
 #define kSC_Pause               0xE1    // marker for pause key sequence
 #define kSC_Resend              0xFE    // request to resend keybd cmd
+#define kSC_Error               0xFC    // command byte could not be taken
 #define kSC_Reset               0xAA    // the keyboard/mouse has reset
 #define kSC_UpBit               0x80    // OR'd in if key below is released
 
@@ -168,6 +170,12 @@
 //    o  Description: Writes the byte in the In Field to the command port (64h).
 //    o  In Field:    Holds byte that should be written.
 //
+// o  kPS2C_ModifyCommandByte:
+//    o  Description: Sets and clears bits in the controller's Command Byte.
+//                    The new value is worked out when the step runs, from
+//                    the Command Byte as the steps before it left it.
+//    o  In Fields:   setBits and clearBits.
+//
 
 enum PS2CommandEnum
 {
@@ -175,14 +183,23 @@ enum PS2CommandEnum
   kPS2C_ReadDataPortAndCompare,
   kPS2C_WriteDataPort,
   kPS2C_WriteCommandPort,
-  kPS2C_SendMouseCommandAndCompareAck
+  kPS2C_SendMouseCommandAndCompareAck,
+  kPS2C_ModifyCommandByte
 };
 typedef enum PS2CommandEnum PS2CommandEnum;
 
 struct PS2Command
 {
   PS2CommandEnum command;
-  UInt8          inOrOut;
+  union
+  {
+    UInt8        inOrOut;
+    struct
+    {
+      UInt8      setBits;
+      UInt8      clearBits;
+    };
+  };
 };
 typedef struct PS2Command PS2Command;
 
@@ -217,6 +234,14 @@ typedef struct PS2Command PS2Command;
 //       over the keyboard input stream for a given command sequence. It
 //       does not depend on which driver it came from, rest assurred. If
 //       the mouse driver so chose, it could send keyboard commands.
+//    o  Where a command expects kSC_Acknowledge and the device answers with
+//       kSC_Resend or kSC_Error instead, the request processor sends the
+//       last data byte again, a few times over, before it counts the
+//       command as failed.  Drivers need not retry for that themselves.
+//    o  The mouse driver's interrupt routine and power control action run
+//       on a work loop of their own, so a mouse driver blocked on a request
+//       does not hold up keyboard input, nor the other way around.  Its
+//       synchronous requests wait in the queue like anybody else's.
 //
 // o  commands:
 //    o  Description:  Holds list of commands that controller should execute.
@@ -225,6 +250,57 @@ typedef struct PS2Command PS2Command;
 // o  commandsCount:
 //    o  Description:  Holds the number of commands in the command list.
 //    o  Comments:     Number of commands should never exceed kMaxCommands.
+//                     Longer command lists are split across segments, see
+//                     nextSegment.
+//
+// o  nextSegment:
+//    o  Description:  Optional request holding the continuation of the
+//                     command list.   Segments are executed back to back as
+//                     one atomic program, so a long sequence costs a single
+//                     trip through the controller.
+//    o  Comments:     Only the first segment's completion routine is used.
+//                     If a command fails, the commandsCount field of the
+//                     segment it is in holds its index, and every segment
+//                     after it has commandsCount set to zero.  freeRequest
+//                     deallocates the whole chain.  Do not submit a segment
+//                     on its own while it is chained.
+//
+// o  priority:
+//    o  Description:  Scheduling class of the request, see PS2RequestPriority.
+//                     Queued requests of a more urgent class run first, so
+//                     that interactive feedback is not held up behind long
+//                     configuration sequences.
+//    o  Comments:     Defaults to kRP_Normal.  Requests from one device in one
+//                     class run in the order submitted, but a more urgent
+//                     request may overtake the device's own queued requests,
+//                     so only mark requests that are safe to reorder.  A
+//                     request that has started is never preempted, and a
+//                     less urgent class is not passed over indefinitely.
+//
+// o  flags:
+//    o  Description:  Request options.  kRF_QuietWindow has the controller
+//                     stop the mouse's stream just for the duration of the
+//                     request, and restart it afterwards if it was streaming,
+//                     whether or not the request succeeded.  Any stream bytes
+//                     already on their way are delivered to the driver in
+//                     order.  Meant for queries that read unframed data, like
+//                     kDP_GetMouseInformation, in place of a separate
+//                     disable/enable pair around them.
+//                     On completion, the controller sets kRF_Cancelled if
+//                     the request was cancelled, or kRF_Expired if it ran
+//                     out of time; commandsCount then tells the step it had
+//                     reached.
+//    o  Comments:     Defaults to none.  Only applies to requests whose first
+//                     device command goes to the mouse.  A failure to restart
+//                     the stream is not reported in commandsCount.
+//
+// o  timeLimit:
+//    o  Description:  Milliseconds the request may take, counted from when
+//                     it is submitted.  Once they are up, the request stops
+//                     at the step it has reached and completes as failed.
+//                     A quiet window still restarts the stream, untimed.
+//    o  Comments:     Defaults to zero, for no limit: every step then still
+//                     has its own timeout.
 //
 // o  completionRoutineTarget, Action, and Param:
 //    o  Description:  Object and method of the completion routine, which is
@@ -244,6 +320,21 @@ typedef struct PS2Command PS2Command;
 
 typedef void (*PS2CompletionAction)(void * target, void * param);
 
+typedef enum
+{
+  kRP_Normal,                           // configuration and probing
+  kRP_Interactive                       // user visible feedback, e.g. LEDs
+} PS2RequestPriority;
+
+#define kRequestPriorities 2
+
+enum
+{
+  kRF_QuietWindow = 0x01,               // stop mouse streaming around request
+  kRF_Cancelled   = 0x40,               // (on completion) see cancelRequests
+  kRF_Expired     = 0x80                // (on completion) timeLimit ran out
+};
+
 struct PS2Request
 {
   UInt8               commandsCount;
@@ -251,7 +342,10 @@ struct PS2Request
   void *              completionTarget;
   PS2CompletionAction completionAction;
   void *              completionParam;
-  queue_chain_t       chain;
+  PS2Request *        nextSegment;
+  UInt8               priority;
+  UInt8               flags;
+  UInt16              timeLimit;
 };
 typedef struct PS2Request PS2Request;
 
@@ -279,9 +373,45 @@ typedef struct PS2Request PS2Request;
 //                     any request sent down to your device from the interrupt
 //                     routine.  Obey, or deadlock.
 //
+// o  installInterruptBatchAction:
+//    o  Description:   Same as installInterruptAction, except that bytes read
+//                      together off the input data stream are delivered in a
+//                      single call.
+//    o  In Fields:     Target/action of completion routine.
+//
+// o  installInterruptBatchAction Interrupt Routine:
+//    o  Description:  Delivers newly read bytes from the input data stream,
+//                     oldest first.
+//    o  Prototype:    void interruptOccurred(void * target,
+//                                            const UInt8 * data,
+//                                            const UInt64 * times,
+//                                            UInt32 count);
+//    o  In Fields:    Bytes that were read, the uptime (absolute time units)
+//                     at which each byte arrived, and how many.
+//    o  Comments:     The arrival time is stamped when the controller raises
+//                     the interrupt for the byte, so it does not include any
+//                     work loop latency; use the time of a packet's first
+//                     byte when timestamping the events decoded from it.
+//                     The bytes are only valid for the duration of the call.
+//                     Same restrictions as the installInterruptAction
+//                     interrupt routine.
+//
 // o  uninstallInterruptHandler:
 //    o  Description:  Ask the device to stop delivering asynchronous data.
 //
+// o  recordLatency:
+//    o  Description:  Add a sample to the controller's input latency histogram
+//                     for this device.
+//    o  In Fields:    Latency stage, start and end uptime (absolute time).
+//    o  Comments:     Only call from the interrupt routine.  The histograms
+//                     are published on the controller as "InputLatency".
+//
+// o  countEvent:
+//    o  Description:  Count an error or recovery event against this device.
+//    o  In Fields:    Event counter.
+//    o  Comments:     May be called from any context.  The counters are
+//                     published on the controller as "Statistics".
+//
 // o  allocateRequest:
 //    o  Description:  Allocate a request structure, blocks until successful.
 //    o  Result:       Request structure pointer.
@@ -295,15 +425,73 @@ typedef struct PS2Request PS2Request;
 //    o  Description:  Submit the request to the controller for processing.
 //    o  In Fields:    Request structure pointer.
 //    o  Result:       kern_return_t queueing status.
+//    o  Comments:     Always succeeds; however many requests are waiting
+//                     already, the request is queued.
 //
 // o  submitRequestAndBlock:
 //    o  Description:  Submit the request to the controller for processing, then
 //                     block the calling thread until the request completes.
 //    o  In Fields:    Request structure pointer.
 //
+// o  cancelRequests:
+//    o  Description:  Abort all requests submitted for the device so far,
+//                     whether queued or under way, and complete them with
+//                     kRF_Cancelled set.  Returns once they have completed.
+//    o  Comments:     Meant for stop and for a device that has gone away, so
+//                     that nothing waits on a dead device.  A request under
+//                     way stops at the step it has reached; commandsCount
+//                     tells which.  Queued requests have commandsCount set
+//                     to zero.  A quiet window is still closed, waiting
+//                     only briefly for the device to acknowledge.
+//
+// o  setResumeSnapshot:
+//    o  Description:  Leave the controller what it needs to bring the device
+//                     back on wake without the driver: the bytes the device
+//                     answers kDP_GetId with, and the commands that restore
+//                     its current configuration.  On wake, the controller
+//                     asks for the ID and, if it still matches, runs those
+//                     commands and calls the power control action with
+//                     kPS2C_ResumeDevice rather than kPS2C_EnableDevice.
+//                     The driver then only has to enable the device.
+//    o  In Fields:    ID bytes (at most kMaxIdentityBytes) and their count;
+//                     request holding the restore commands, or null to drop
+//                     the snapshot.
+//    o  Comments:     The commands are copied; the request stays the
+//                     caller's.  Only its first segment is used.  Call again
+//                     whenever the configuration changes.  Same restrictions
+//                     as submitRequestAndBlock.  On a multiplexing controller
+//                     only the mouse nub for aux port 0 keeps a snapshot.
+//
+// o  setPacketFraming:
+//    o  Description:  (Mouse only.)  Describe the packets the device streams,
+//                     so that the controller can tell packet bytes that turn
+//                     up during a request from the answers it is waiting for
+//                     and pass them on in order.  With this in place, the
+//                     driver may query the device while it is streaming.
+//    o  In Fields:    Packet length (zero to forget), and the mask and value
+//                     that the first byte of every packet matches.
+//    o  Comments:     Set it while the device is not streaming, and again
+//                     whenever the packet format changes.  Each aux port of
+//                     a multiplexing controller has its own.
+//
+// o  setCommandByte:
+//    o  Description:  Set and clear bits in the controller's Command Byte, as
+//                     one atomic operation with respect to all requests.
+//                     Blocks the calling thread until done.
+//    o  In Fields:    Bits to set, bits to clear.
+//    o  Comments:     Goes through the request queue as a kPS2C_ModifyCommandByte
+//                     request, in order with the requests submitted before
+//                     it.  Called from the keyboard's interrupt or power
+//                     control action, it is queued and does not block.
+//
 
 typedef void (*PS2InterruptAction)(void * target, UInt8 data);
 
+typedef void (*PS2InterruptBatchAction)(void *         target,
+                                        const UInt8 *  data,
+                                        const UInt64 * times,
+                                        UInt32         count);
+
 //
 // Defines the prototype of an action registered by a PS/2 device driver to
 // intercept power changes on the PS/2 controller, and to manage the device
@@ -313,14 +501,65 @@ typedef void (*PS2InterruptAction)(void * target, UInt8 data);
 typedef void (*PS2PowerControlAction)(void * target, UInt32 whatToDo);
 
 //
-// Enumeration of 'whatToDo' values passed to power control action.
+// Enumeration of 'whatToDo' values passed to power control action.  The
+// controller passes kPS2C_ResetDevice to a mouse driver, outside any power
+// change, once it has recovered the stalled aux port: the device was set
+// back to its defaults and, if it was streaming, enabled again.  Its driver
+// should configure it anew.  A keyboard driver is never passed it.
 //
 
 enum {
   kPS2C_DisableDevice,
-  kPS2C_EnableDevice
+  kPS2C_EnableDevice,
+  kPS2C_ResumeDevice,                   // enable, configuration was restored
+  kPS2C_ResetDevice                     // port recovered, device at defaults
 };
 
+//
+// Longest device identity kept for setResumeSnapshot.
+//
+
+#define kMaxIdentityBytes 2
+
+//
+// Stages of input latency kept in the controller's histograms.  The first is
+// measured by the controller itself, per byte; the others are reported by the
+// drivers, per packet, starting from when the packet's first byte reached the
+// driver on the work loop.
+//
+
+typedef enum
+{
+  kLS_Interrupt,                        // IRQ to read on the work loop
+  kLS_Packet,                           // first byte to packet complete
+  kLS_Dispatch                          // packet complete to HID dispatch
+} PS2LatencyStage;
+
+#define kLatencyStages 3
+
+//
+// Error and recovery events counted by the controller for each device.  All
+// but kEC_Resync are counted by the controller itself.
+//
+
+typedef enum
+{
+  kEC_Timeout,                          // no byte for a read step in time
+  kEC_SecondChance,                     // out-of-order byte set aside, then
+                                        // the expected byte arrived
+  kEC_CompareFailed,                    // read step got an unexpected byte
+  kEC_Resync,                           // driver lost packet sync and reset
+  kEC_OfflineDrop,                      // byte arrived with the port offline
+  kEC_DeliveryOverrun,                  // driver fell too far behind, byte
+                                        // dropped
+  kEC_Resend,                           // byte sent again on device request
+  kEC_Stall,                            // port stalled, mid-packet or with
+                                        // the input buffer stuck full
+  kEC_Recovery                          // stalled port recovered
+} PS2EventCounter;
+
+#define kEventCounters 9
+
 //Slice - it should be here
 #if 0
 #include <architecture/i386/pio.h>
@@ -33,6 +33,7 @@ class ApplePS2MouseDevice : public IOService
 
 private:
   ApplePS2Controller * _controller;
+  UInt8                _auxPort;          // aux port we stand for
 
 protected:
   struct ExpansionData { /* */ };
@@ -45,7 +46,12 @@ public:
   // Interrupt Handling Routines
 
   virtual void installInterruptAction(OSObject *, PS2InterruptAction);
+  virtual void installInterruptBatchAction(OSObject *, PS2InterruptBatchAction);
   virtual void uninstallInterruptAction();
+  virtual void recordLatency(PS2LatencyStage stage,
+                             UInt64          startTime,
+                             UInt64          endTime);
+  virtual void countEvent(PS2EventCounter counter);
 
   // Request Submission Routines
 
@@ -53,11 +59,22 @@ public:
   virtual void         freeRequest(PS2Request * request);
   virtual bool         submitRequest(PS2Request * request);
   virtual void         submitRequestAndBlock(PS2Request * request);
+  virtual void         cancelRequests();
+
+  // Controller Command Byte Routines
+
+  virtual void setCommandByte(UInt8 setBits, UInt8 clearBits);
 
   // Power Control Handling Routines
 
   virtual void installPowerControlAction(OSObject *, PS2PowerControlAction);
   virtual void uninstallPowerControlAction();
+  virtual void setResumeSnapshot(const UInt8 *      identity,
+                                 UInt32             identityLength,
+                                 const PS2Request * restore);
+  virtual void setPacketFraming(UInt8 packetLength,
+                                UInt8 syncMask,
+                                UInt8 syncValue);
 
   OSMetaClassDeclareReservedUnused(ApplePS2MouseDevice, 0);
   OSMetaClassDeclareReservedUnused(ApplePS2MouseDevice, 1);
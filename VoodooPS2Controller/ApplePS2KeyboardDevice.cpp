@@ -63,6 +63,14 @@ void ApplePS2KeyboardDevice::installInterruptAction(OSObject *         target,
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2KeyboardDevice::installInterruptBatchAction(OSObject *              target,
+                                                          PS2InterruptBatchAction action)
+{
+  _controller->installInterruptBatchAction(kDT_Keyboard, target, action);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2KeyboardDevice::uninstallInterruptAction()
 {
   _controller->uninstallInterruptAction(kDT_Keyboard);
@@ -70,6 +78,22 @@ void ApplePS2KeyboardDevice::uninstallInterruptAction()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2KeyboardDevice::recordLatency(PS2LatencyStage stage,
+                                            UInt64          startTime,
+                                            UInt64          endTime)
+{
+  _controller->recordLatency(kDT_Keyboard, stage, startTime, endTime);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2KeyboardDevice::countEvent(PS2EventCounter counter)
+{
+  _controller->countEvent(kDT_Keyboard, counter);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2KeyboardDevice::installPowerControlAction(
                                                 OSObject *            target,
                                                 PS2PowerControlAction action)
@@ -86,6 +110,15 @@ void ApplePS2KeyboardDevice::uninstallPowerControlAction()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2KeyboardDevice::setResumeSnapshot(const UInt8 *      identity,
+                                               UInt32             identityLength,
+                                               const PS2Request * restore)
+{
+  _controller->setResumeSnapshot(kDT_Keyboard, identity, identityLength, restore);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 PS2Request * ApplePS2KeyboardDevice::allocateRequest()
 {
   return _controller->allocateRequest();
@@ -102,14 +135,28 @@ void ApplePS2KeyboardDevice::freeRequest(PS2Request * request)
 
 bool ApplePS2KeyboardDevice::submitRequest(PS2Request * request)
 {
-  return _controller->submitRequest(request);
+  return _controller->submitRequest(request, kDT_Keyboard);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 void ApplePS2KeyboardDevice::submitRequestAndBlock(PS2Request * request)
 {
-  _controller->submitRequestAndBlock(request);
+  _controller->submitRequestAndBlock(request, kDT_Keyboard);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2KeyboardDevice::cancelRequests()
+{
+  _controller->cancelRequests(kDT_Keyboard);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2KeyboardDevice::setCommandByte(UInt8 setBits, UInt8 clearBits)
+{
+  _controller->setCommandByte(setBits, clearBits);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -45,7 +45,12 @@ public:
   // Interrupt Handling Routines
 
   virtual void installInterruptAction(OSObject *, PS2InterruptAction);
+  virtual void installInterruptBatchAction(OSObject *, PS2InterruptBatchAction);
   virtual void uninstallInterruptAction();
+  virtual void recordLatency(PS2LatencyStage stage,
+                             UInt64          startTime,
+                             UInt64          endTime);
+  virtual void countEvent(PS2EventCounter counter);
 
   // Request Submission Routines
 
@@ -53,11 +58,19 @@ public:
   virtual void         freeRequest(PS2Request * request);
   virtual bool         submitRequest(PS2Request * request);
   virtual void         submitRequestAndBlock(PS2Request * request);
+  virtual void         cancelRequests();
+
+  // Controller Command Byte Routines
+
+  virtual void setCommandByte(UInt8 setBits, UInt8 clearBits);
 
   // Power Control Handling Routines
 
   virtual void installPowerControlAction(OSObject *, PS2PowerControlAction);
   virtual void uninstallPowerControlAction();
+  virtual void setResumeSnapshot(const UInt8 *      identity,
+                                 UInt32             identityLength,
+                                 const PS2Request * restore);
 
   OSMetaClassDeclareReservedUnused(ApplePS2KeyboardDevice, 0);
   OSMetaClassDeclareReservedUnused(ApplePS2KeyboardDevice, 1);
@@ -33,12 +33,20 @@ OSDefineMetaClassAndStructors(ApplePS2MouseDevice, IOService);
 
 bool ApplePS2MouseDevice::attach(IOService * provider)
 {
+  OSNumber * auxPort;
+
   if( !super::attach(provider) )  return false;
 
   assert(_controller == 0);
   _controller = (ApplePS2Controller *)provider;
   _controller->retain();
 
+  // The controller tells us which aux port we stand for in multiplexing
+  // mode; everything we pass on to it is for that port.
+
+  auxPort  = OSDynamicCast(OSNumber, getProperty(kAuxPortKey));
+  _auxPort = auxPort ? auxPort->unsigned8BitValue() : 0;
+
   return true;
 }
 
@@ -58,14 +66,39 @@ void ApplePS2MouseDevice::detach( IOService * provider )
 void ApplePS2MouseDevice::installInterruptAction(OSObject *         target,
                                                  PS2InterruptAction action)
 {
-  _controller->installInterruptAction(kDT_Mouse, target, action);
+  _controller->installInterruptAction(kDT_Mouse, target, action, _auxPort);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2MouseDevice::installInterruptBatchAction(OSObject *              target,
+                                                       PS2InterruptBatchAction action)
+{
+  _controller->installInterruptBatchAction(kDT_Mouse, target, action,
+                                           _auxPort);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 void ApplePS2MouseDevice::uninstallInterruptAction()
 {
-  _controller->uninstallInterruptAction(kDT_Mouse);
+  _controller->uninstallInterruptAction(kDT_Mouse, _auxPort);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2MouseDevice::recordLatency(PS2LatencyStage stage,
+                                         UInt64          startTime,
+                                         UInt64          endTime)
+{
+  _controller->recordLatency(kDT_Mouse, stage, startTime, endTime);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2MouseDevice::countEvent(PS2EventCounter counter)
+{
+  _controller->countEvent(kDT_Mouse, counter);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -73,14 +106,34 @@ void ApplePS2MouseDevice::uninstallInterruptAction()
 void ApplePS2MouseDevice::installPowerControlAction(OSObject *            target,
                                                     PS2PowerControlAction action)
 {
-  _controller->installPowerControlAction(kDT_Mouse, target, action);
+  _controller->installPowerControlAction(kDT_Mouse, target, action, _auxPort);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 void ApplePS2MouseDevice::uninstallPowerControlAction()
 {
-  _controller->uninstallPowerControlAction(kDT_Mouse);
+  _controller->uninstallPowerControlAction(kDT_Mouse, _auxPort);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2MouseDevice::setResumeSnapshot(const UInt8 *      identity,
+                                            UInt32             identityLength,
+                                            const PS2Request * restore)
+{
+  _controller->setResumeSnapshot(kDT_Mouse, identity, identityLength, restore,
+                                 _auxPort);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2MouseDevice::setPacketFraming(UInt8 packetLength,
+                                           UInt8 syncMask,
+                                           UInt8 syncValue)
+{
+  _controller->setPacketFraming(kDT_Mouse, packetLength, syncMask, syncValue,
+                                _auxPort);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -101,14 +154,28 @@ void ApplePS2MouseDevice::freeRequest(PS2Request * request)
 
 bool ApplePS2MouseDevice::submitRequest(PS2Request * request)
 {
-  return _controller->submitRequest(request);
+  return _controller->submitRequest(request, kDT_Mouse, _auxPort);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 void ApplePS2MouseDevice::submitRequestAndBlock(PS2Request * request)
 {
-  _controller->submitRequestAndBlock(request);
+  _controller->submitRequestAndBlock(request, kDT_Mouse, _auxPort);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2MouseDevice::cancelRequests()
+{
+  _controller->cancelRequests(kDT_Mouse, _auxPort);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2MouseDevice::setCommandByte(UInt8 setBits, UInt8 clearBits)
+{
+  _controller->setCommandByte(setBits, clearBits);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <IOKit/assert.h>
+#include <IOKit/IOMemoryDescriptor.h>
+#include "ApplePS2TraceUserClient.h"
+#include "VoodooPS2Controller.h"
+
+#if FLIGHT_RECORDER_SUPPORT
+
+// =============================================================================
+// ApplePS2TraceUserClient Class Implementation
+//
+
+#define super IOUserClient
+OSDefineMetaClassAndStructors(ApplePS2TraceUserClient, IOUserClient);
+
+bool ApplePS2TraceUserClient::initWithTask(task_t         owningTask,
+                                           void *         securityID,
+                                           UInt32         type,
+                                           OSDictionary * properties)
+{
+  //
+  // The capture tells when every mouse byte arrived and what it was, and
+  // when every key was struck, so it is not for just anyone.
+  //
+
+  if (type != kTraceUserClientType)  return false;
+
+  if (clientHasPrivilege(owningTask, kIOClientPrivilegeAdministrator) !=
+      kIOReturnSuccess)
+    return false;
+
+  _controller = 0;
+  return super::initWithTask(owningTask, securityID, type, properties);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2TraceUserClient::start(IOService * provider)
+{
+  if (!super::start(provider))  return false;
+
+  assert(_controller == 0);
+  _controller = OSDynamicCast(ApplePS2Controller, provider);
+  if (_controller == 0)  return false;
+  _controller->retain();
+
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2TraceUserClient::stop(IOService * provider)
+{
+  if (_controller)
+  {
+    _controller->release();
+    _controller = 0;
+  }
+
+  super::stop(provider);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2TraceUserClient::clientClose()
+{
+  terminate();
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2TraceUserClient::externalMethod(
+                                        UInt32                      selector,
+                                        IOExternalMethodArguments * arguments,
+                                        IOExternalMethodDispatch *  dispatch,
+                                        OSObject *                  target,
+                                        void *                      reference)
+{
+  //
+  // kTraceMethodCopy: copy a capture into the caller's output structure,
+  // which must be large enough to hold a full ring.  Small outputs come in
+  // the arguments themselves, large ones by memory descriptor.
+  //
+
+  OSData *    trace;
+  IOByteCount length;
+  IOReturn    result = kIOReturnSuccess;
+
+  if (selector != kTraceMethodCopy || _controller == 0)
+    return kIOReturnBadArgument;
+
+  trace = _controller->copyTrace();
+  if (trace == 0)  return kIOReturnNoMemory;
+
+  length = trace->getLength();
+
+  if (arguments->structureOutputDescriptor)
+  {
+    if (arguments->structureOutputDescriptor->getLength() < length)
+      result = kIOReturnNoSpace;
+    else
+    {
+      arguments->structureOutputDescriptor->writeBytes(0,
+                                                       trace->getBytesNoCopy(),
+                                                       length);
+      arguments->structureOutputDescriptorSize = (UInt32) length;
+    }
+  }
+  else if (arguments->structureOutputSize < length)
+    result = kIOReturnNoSpace;
+  else
+  {
+    bcopy(trace->getBytesNoCopy(), arguments->structureOutput, length);
+    arguments->structureOutputSize = (UInt32) length;
+  }
+
+  trace->release();
+  return result;
+}
+
+#endif //FLIGHT_RECORDER_SUPPORT
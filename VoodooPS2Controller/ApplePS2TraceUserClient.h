@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ * 
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2TRACEUSERCLIENT_H
+#define _APPLEPS2TRACEUSERCLIENT_H
+
+#include <IOKit/IOUserClient.h>
+
+class ApplePS2Controller;
+
+//
+// Hands the flight recorder capture to user space, and only to
+// administrators; see kTraceUserClientType.
+//
+
+class ApplePS2TraceUserClient : public IOUserClient
+{
+  OSDeclareDefaultStructors(ApplePS2TraceUserClient);
+
+private:
+  ApplePS2Controller * _controller;
+
+public:
+  virtual bool     initWithTask(task_t         owningTask,
+                                void *         securityID,
+                                UInt32         type,
+                                OSDictionary * properties);
+  virtual bool     start(IOService * provider);
+  virtual void     stop(IOService * provider);
+  virtual IOReturn clientClose();
+  virtual IOReturn externalMethod(UInt32                      selector,
+                                  IOExternalMethodArguments * arguments,
+                                  IOExternalMethodDispatch *  dispatch,
+                                  OSObject *                  target,
+                                  void *                      reference);
+};
+
+#endif /* _APPLEPS2TRACEUSERCLIENT_H */
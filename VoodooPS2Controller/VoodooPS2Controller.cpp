@@ -22,11 +22,10 @@
 
 #include <IOKit/assert.h>
 #include <IOKit/IOService.h>
-//#include <IOKit/IOSyncer.h>
 #include <IOKit/IOWorkLoop.h>
-#include "IOSyncer.h"
 #include "ApplePS2KeyboardDevice.h"
 #include "ApplePS2MouseDevice.h"
+#include "ApplePS2TraceUserClient.h"
 #include "VoodooPS2Controller.h"
 
 extern "C"
@@ -60,9 +59,11 @@ static void interruptHandlerMouse(OSObject *, void *, IOService *, int)
   //
   // Wake our workloop to service the interrupt.    This is an edge-triggered
   // interrupt, so returning from this routine without clearing the interrupt
-  // condition is perfectly normal.
+  // condition is perfectly normal.  The time is noted here, so that the byte
+  // reaches the driver stamped with its true arrival time.
   //
 
+  gApplePS2Controller->noteInterruptTime(kDT_Mouse, mach_absolute_time());
   gApplePS2Controller->_interruptSourceMouse->interruptOccurred(0, 0, 0);
 }
 
@@ -88,7 +89,7 @@ static void interruptHandlerKeyboard(OSObject *, void *, IOService *, int)
 
   // Verify that data is available on the controller's input port.
 
-  if ( ((status = inb(kCommandPort)) & kOutputReady) )
+  if ( ((status = gApplePS2Controller->inPort(kCommandPort)) & kOutputReady) )
   {
     // Verify that the data is keyboard data, otherwise call mouse handler.
     // This case should never really happen, but if it does, we handle it.
@@ -101,7 +102,7 @@ static void interruptHandlerKeyboard(OSObject *, void *, IOService *, int)
     {
       // Retrieve the keyboard data on the controller's input port.
 
-      key = inb(kDataPort);
+      key = gApplePS2Controller->inPort(kDataPort);
 
       // Call the debugger-key-sequence checking code (if a debugger sequence
       // completes, the debugger function will be invoked immediately within
@@ -126,14 +127,97 @@ static void interruptHandlerKeyboard(OSObject *, void *, IOService *, int)
   //
   // Wake our workloop to service the interrupt.    This is an edge-triggered
   // interrupt, so returning from this routine without clearing the interrupt
-  // condition is perfectly normal.
+  // condition is perfectly normal.  The time is noted as for the mouse.
   //
 
+    gApplePS2Controller->noteInterruptTime(kDT_Keyboard, mach_absolute_time());
     gApplePS2Controller->_interruptSourceKeyboard->interruptOccurred(0, 0, 0);
 
 #endif //DEBUGGER_SUPPORT
 }
 
+#if PORT_IO_BACKEND_SUPPORT
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Default port I/O backend, which talks to the real i8042.
+//
+
+static UInt8 hardwarePortRead(void *, UInt16 port)
+{
+  return inb(port);
+}
+
+static void hardwarePortWrite(void *, UInt16 port, UInt8 byte)
+{
+  outb(port, byte);
+}
+
+static void hardwarePortDelay(void *, UInt32 microseconds)
+{
+  IODelay(microseconds);
+}
+
+static const PS2PortBackend hardwarePortBackend =
+{
+  0, hardwarePortRead, hardwarePortWrite, hardwarePortDelay
+};
+
+#endif //PORT_IO_BACKEND_SUPPORT
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Microseconds from now until the given uptime, or zero if it has passed.
+//
+
+static UInt32 microsecondsUntil(UInt64 deadline, UInt64 now)
+{
+  UInt64 nanoseconds;
+
+  if (deadline <= now)  return 0;
+
+  absolutetime_to_nanoseconds(deadline - now, &nanoseconds);
+  return (UInt32)(nanoseconds / 1000);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Latency histogram helpers, see kLatencyBuckets.
+//
+
+static unsigned latencyBucket(UInt64 startTime, UInt64 endTime)
+{
+  UInt64   nanoseconds;
+  UInt64   microseconds;
+  unsigned bucket = 0;
+
+  if (endTime > startTime)
+  {
+    absolutetime_to_nanoseconds(endTime - startTime, &nanoseconds);
+
+    for (microseconds = nanoseconds / 1000;
+         microseconds && bucket < kLatencyBuckets - 1;
+         microseconds >>= 1)
+      bucket++;
+  }
+
+  return bucket;
+}
+
+static OSArray * createLatencyArray(const UInt32 * histogram)
+{
+  OSArray * buckets = OSArray::withCapacity(kLatencyBuckets);
+
+  if (buckets == 0)  return 0;
+
+  for (unsigned bucket = 0; bucket < kLatencyBuckets; bucket++)
+  {
+    OSNumber * count = OSNumber::withNumber(histogram[bucket], 32);
+    if (count == 0)  break;
+    buckets->setObject(count);
+    count->release();
+  }
+
+  return buckets;
+}
+
 // =============================================================================
 // ApplePS2Controller Class Implementation
 //
@@ -150,31 +234,144 @@ bool ApplePS2Controller::init(OSDictionary * properties)
   //
 
   _workLoop                = 0;
+  _auxWorkLoop             = 0;
+  _auxInputSource          = 0;
+  _auxInputHead            = 0;
+  _auxInputTail            = 0;
+  _auxInputSignal          = false;
 
   _interruptSourceKeyboard = 0;
   _interruptSourceMouse    = 0;
 
   _interruptTargetKeyboard = 0;
-  _interruptTargetMouse    = 0;
-
   _interruptActionKeyboard = NULL;
-  _interruptActionMouse    = NULL;
-
+  _interruptBatchActionKeyboard = NULL;
   _interruptInstalledKeyboard = false;
   _interruptInstalledMouse    = false;
 
-  _mouseDevice    = 0;
+  bzero(_interruptTargetMouse,      sizeof(_interruptTargetMouse));
+  bzero(_interruptActionMouse,      sizeof(_interruptActionMouse));
+  bzero(_interruptBatchActionMouse, sizeof(_interruptBatchActionMouse));
+  bzero(_auxPortInstalled,          sizeof(_auxPortInstalled));
+  bzero(_auxInputFrom,              sizeof(_auxInputFrom));
+
+  _interruptBatchCount[kDT_Keyboard] = 0;
+  _interruptBatchCount[kDT_Mouse]    = 0;
+  _interruptBatching                 = false;
+
+  _interruptTime[kDT_Keyboard] = 0;
+  _interruptTime[kDT_Mouse]    = 0;
+  _dataPortReads               = 0;
+
+  bzero(_latencyHistogram, sizeof(_latencyHistogram));
+  _statisticsTimer       = 0;
+
+  bzero((void *) _eventCounters, sizeof(_eventCounters));
+  _statisticsPublishPending = 0;
+
+  _pollTimer          = 0;
+  _polling            = false;
+  _pollInterval       = kPollIntervalMin;
+  _pollWatching       = true;
+  _pollWatchFull      = false;
+  _pollLastTime       = 0;
+  _pollCount          = 0;
+  _pollHits           = 0;
+  _pollGapTotal       = 0;
+  _pollGapMaximum     = 0;
+
+  _watchdogTimer = 0;
+  _watchdogArmed = false;
+  bzero(_lastInputTime,    sizeof(_lastInputTime));
+  bzero(_stallTime,        sizeof(_stallTime));
+  bzero(_recoveryAttempts, sizeof(_recoveryAttempts));
+  bzero(_recoveryTotal,    sizeof(_recoveryTotal));
+  bzero(_recoveryMaximum,  sizeof(_recoveryMaximum));
+  _recoveryRequest = 0;
+  _recoveryCall    = 0;
+  _recoveryNotify  = 0;
+
+#if FLIGHT_RECORDER_SUPPORT
+  bzero(_traceRing, sizeof(_traceRing));
+  _traceHead       = 0;
+  _traceLastStatus = 0;
+  _traceToMouse    = false;
+#endif
+
+  bzero(_mouseDevices, sizeof(_mouseDevices));
   _keyboardDevice = 0;
   
   _suppressTimeout = false;
 
+#if PORT_IO_BACKEND_SUPPORT
+  _portBackend = hardwarePortBackend;
+#endif
+
 #if !defined(SNOW_LEO) && !defined(TIGER)
   _newIRQLayout = false;	// turbo
 #endif
 
-  queue_init(&_requestQueue);
+  for (unsigned index = 0; index < kRequestRingSize; index++)
+  {
+    _requestRing[index].sequence = index;
+    _requestRing[index].request  = 0;
+  }
+  _requestRingHead = 0;
+  _requestRingTail = 0;
+
+  _requestOverflowHead  = 0;
+  _requestOverflowTail  = 0;
+  _requestOverflowCount = 0;
+  _requestOverflowTotal = 0;
+
+  _requestEntriesFree = 0;
+  for (unsigned index = 0; index < kRequestRingSize; index++)
+  {
+    _requestEntries[index].next = _requestEntriesFree;
+    _requestEntriesFree         = &_requestEntries[index];
+  }
+  bzero(_requestQueueHead,  sizeof(_requestQueueHead));
+  bzero(_requestQueueTail,  sizeof(_requestQueueTail));
+  bzero(_requestPassedOver, sizeof(_requestPassedOver));
+  bzero(_requestLastDevice, sizeof(_requestLastDevice));
+  bzero(_requestLatencyHistogram, sizeof(_requestLatencyHistogram));
+
+  _requestPool          = 0;
+  _requestPoolHead      = 0;
+  _requestPoolInUse     = 0;
+  _requestPoolHighWater = 0;
+  _requestPoolExhausted = 0;
+
+  bzero(&_requestContext, sizeof(_requestContext));
+  _requestTimer = 0;
+
+  _commandByte         = 0;
+  _lastCommandPortByte = 0;
+  _prefixDropped       = false;
+
+  bzero(_mouseStreaming, sizeof(_mouseStreaming));
+  _muxActive     = false;
+  _auxPortError  = false;
+  bzero(_auxPortPresent, sizeof(_auxPortPresent));
+  _auxPortPresent[0] = true;            // (the one aux port, unless multiplexing)
+  _muxVersion    = 0;
+  _inputAuxPort  = 0;
+  _outputAuxPort = 0;
+
+  _responseKey                  = kResponseTimerController;
+  _responseParameter            = false;
+  bzero(_responseSilent, sizeof(_responseSilent));
+  bzero(_responseTimers, sizeof(_responseTimers));
 
   _currentPowerState = kPS2PowerStateNormal;
+  bzero(_resumeSnapshot, sizeof(_resumeSnapshot));
+  bzero(_framing, sizeof(_framing));
+
+  _requestWaitLock = IOLockAlloc();
+  if (!_requestWaitLock) return false;
+
+  _requestOverflowLock = IOSimpleLockAlloc();
+  if (!_requestOverflowLock) return false;
   
 #if DEBUGGER_SUPPORT
   _extendedState = false;
@@ -201,6 +398,21 @@ void ApplePS2Controller::free(void)
         _controllerLock = 0;
     }
 #endif
+    if (_requestPool)
+    {
+        IOFree(_requestPool, kRequestPoolSize * sizeof(PS2Request));
+        _requestPool = 0;
+    }
+    if (_requestWaitLock)
+    {
+        IOLockFree(_requestWaitLock);
+        _requestWaitLock = 0;
+    }
+    if (_requestOverflowLock)
+    {
+        IOSimpleLockFree(_requestOverflowLock);
+        _requestOverflowLock = 0;
+    }
     super::free();
 }
 
@@ -211,6 +423,8 @@ bool ApplePS2Controller::start(IOService * provider)
   //
   // The driver has been instructed to start.  Allocate all our resources.
   //
+  bool mouseNubs = false;
+
  if (!super::start(provider))  return false;
 
 #if DEBUGGER_SUPPORT
@@ -233,101 +447,97 @@ bool ApplePS2Controller::start(IOService * provider)
                 KeyboardQueueElement *, chain);
 #endif //DEBUGGER_SUPPORT
 
-#if !defined(SNOW_LEO) && !defined(TIGER)
-  if (provider->getProperty("newIRQLayout")) {	// turbo
-   IOLog("Using new IRQ layout 0,1\n");
-   _newIRQLayout = true;
-  }
-#endif
-
-  _suppressTimeout = true;
-  UInt8 commandByte;
-
-  // Disable keyboard and mouse
-  writeCommandPort(kCP_DisableKeyboardClock);
-  writeCommandPort(kCP_DisableMouseClock);
-  // Flush any data
-   while ( inb(kCommandPort) & kOutputReady )
-  {
-    IODelay(kDataDelay);
-    inb(kDataPort);
-    IODelay(kDataDelay);
-  }
-  writeCommandPort(kCP_EnableMouseClock);
-  // Read current command
-  writeCommandPort(kCP_GetCommandByte);
-  commandByte  =  readDataPort(kDT_Keyboard);
-  // Issue Test Controller to try to reset device
-  writeCommandPort(kCP_TestController);
-  readDataPort(kDT_Keyboard);
-  readDataPort(kDT_Mouse);
-  // Issue Test Keyboard Port to try to reset device
-  writeCommandPort(kCP_TestKeyboardPort);
-  readDataPort(kDT_Keyboard);
-  // Issue Test Mouse Port to try to reset device
-  writeCommandPort(kCP_TestMousePort);
-  readDataPort(kDT_Mouse);
-  _suppressTimeout = false;
-
   //
-  // Initialize the mouse and keyboard hardware to a known state --  the IRQs
-  // are disabled (don't want interrupts), the clock line is enabled (want to
-  // be able to send commands), and the device itself is disabled (don't want
-  // asynchronous data arrival for key/mouse events).  We call the read/write
-  // port routines directly, since no other thread will conflict with us.
+  // Preallocate the request pool and thread all of it onto the free list.
   //
-  commandByte &= ~(kCB_EnableMouseIRQ | kCB_DisableMouseClock);
-  writeCommandPort(kCP_SetCommandByte);
-  writeDataPort(commandByte);
 
-  writeDataPort(kDP_SetDefaultsAndDisable);
-  readDataPort(kDT_Keyboard);       // (discard acknowledge; success irrelevant)
+  _requestPool = (PS2Request *) IOMalloc(kRequestPoolSize * sizeof(PS2Request));
+  if (!_requestPool)  goto fail;
 
-  writeCommandPort(kCP_TransmitToMouse);
-  writeDataPort(kDP_SetDefaultsAndDisable);
-  readDataPort(kDT_Mouse);          // (discard acknowledge; success irrelevant)
+  for (int index = 0; index < kRequestPoolSize; index++)
+    _requestPoolNext[index] = (index + 1 < kRequestPoolSize) ? index + 2 : 0;
+  _requestPoolHead = 1;
 
-  //
-  // Clear out garbage in the controller's input streams, before starting up
-  // the work loop.
-  //
+  setProperty("RequestPoolSize", kRequestPoolSize, 32);
+  publishRequestPoolStatistics();
 
-  while ( inb(kCommandPort) & kOutputReady )
-  {
-    IODelay(kDataDelay);
-    inb(kDataPort);
-    IODelay(kDataDelay);
+#if !defined(SNOW_LEO) && !defined(TIGER)
+  if (provider->getProperty("newIRQLayout")) {	// turbo
+   IOLog("Using new IRQ layout 0,1\n");
+   _newIRQLayout = true;
   }
+#endif
 
   //
-  // Use a spin lock to protect the client async request queue.
+  // Bring the controller and the devices behind it to a known state.
   //
 
-  _requestQueueLock = IOSimpleLockAlloc();
-  if (!_requestQueueLock) goto fail;
+  initializeHardware(getProperty(kFastInitKey) == kOSBooleanTrue);
 
   //
   // Initialize our work loop, our command gate, and our interrupt event
   // sources.  The work loop can accept requests after this step.
   //
+  // The mouse driver gets a work loop of its own, fed with the bytes that
+  // ours reads off the aux port, so either driver can block on a request
+  // without stalling input to the other.
+  //
 
   _workLoop                = IOWorkLoop::workLoop();
+  _auxWorkLoop             = IOWorkLoop::workLoop();
+  _auxInputSource          = IOInterruptEventSource::interruptEventSource( this,
+			OSMemberFunctionCast(IOInterruptEventAction, this, &ApplePS2Controller::auxInputOccurred));
   _interruptSourceMouse    = IOInterruptEventSource::interruptEventSource( this,
 			OSMemberFunctionCast(IOInterruptEventAction, this, &ApplePS2Controller::interruptOccurred));
   _interruptSourceKeyboard = IOInterruptEventSource::interruptEventSource( this,
 			OSMemberFunctionCast(IOInterruptEventAction, this, &ApplePS2Controller::interruptOccurred));
   _interruptSourceQueue    = IOInterruptEventSource::interruptEventSource( this,
 			OSMemberFunctionCast(IOInterruptEventAction, this, &ApplePS2Controller::processRequestQueue));
+  _requestTimer            = IOTimerEventSource::timerEventSource( this,
+			OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2Controller::requestTimerFired));
+  _statisticsTimer            = IOTimerEventSource::timerEventSource( this,
+			OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2Controller::statisticsTimerFired));
+  _pollTimer               = IOTimerEventSource::timerEventSource( this,
+			OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2Controller::pollTimerFired));
+  _watchdogTimer           = IOTimerEventSource::timerEventSource( this,
+			OSMemberFunctionCast(IOTimerEventSource::Action, this, &ApplePS2Controller::watchdogTimerFired));
+  _recoveryCall            = thread_call_allocate( &ApplePS2Controller::recoveryCallFired, this );
 
   if ( !_workLoop                ||
+       !_auxWorkLoop             ||
+       !_auxInputSource          ||
        !_interruptSourceMouse    ||
        !_interruptSourceKeyboard ||
-       !_interruptSourceQueue )  goto fail;
+       !_interruptSourceQueue    ||
+       !_requestTimer            ||
+       !_statisticsTimer         ||
+       !_pollTimer               ||
+       !_watchdogTimer           ||
+       !_recoveryCall )  goto fail;
 
   if ( _workLoop->addEventSource(_interruptSourceQueue) != kIOReturnSuccess )
     goto fail;
 
+  if ( _auxWorkLoop->addEventSource(_auxInputSource) != kIOReturnSuccess )
+    goto fail;
+
+  if ( _workLoop->addEventSource(_requestTimer) != kIOReturnSuccess )
+    goto fail;
+
+  if ( _workLoop->addEventSource(_statisticsTimer) != kIOReturnSuccess )
+    goto fail;
+
+  if ( _workLoop->addEventSource(_pollTimer) != kIOReturnSuccess )
+    goto fail;
+
+  if ( _workLoop->addEventSource(_watchdogTimer) != kIOReturnSuccess )
+    goto fail;
+
+  publishLatency();
+  publishEventCounters();
+
   _interruptSourceQueue->enable();
+  _auxInputSource->enable();
 
   //
   // Since there is a calling path from the PS/2 driver stack to power
@@ -360,7 +570,9 @@ bool ApplePS2Controller::start(IOService * provider)
   //
   // Create the keyboard nub and the mouse nub. The keyboard and mouse drivers
   // will query these nubs to determine the existence of the keyboard or mouse,
-  // and should they exist, will attach themselves to the nub as clients.
+  // and should they exist, will attach themselves to the nub as clients.  In
+  // multiplexing mode there is a mouse nub for every aux port that answered
+  // the probe, each with its port number in kAuxPortKey.
   //
   #undef  RELEASE
   #define RELEASE(x) do { if(x) { (x)->release(); (x) = 0; } } while(0)
@@ -375,13 +587,24 @@ bool ApplePS2Controller::start(IOService * provider)
 	  RELEASE(_interruptSourceKeyboard);	_interruptSourceMouse = NULL;
   }
 
-  _mouseDevice = new ApplePS2MouseDevice;
+  for (unsigned port = 0; port < (_muxActive ? kMaxAuxPorts : 1); port++)
+  {
+    if (!_auxPortPresent[port])  continue;
+
+    _mouseDevices[port] = new ApplePS2MouseDevice;
+
+    if ( !_mouseDevices[port]                                    ||
+         !_mouseDevices[port]->init()                            ||
+         !_mouseDevices[port]->setProperty(kAuxPortKey, port, 8) ||
+         !_mouseDevices[port]->attach(this) )
+    {
+      RELEASE(_mouseDevices[port]);
+    }
+    else  mouseNubs = true;
+  }
 
-  if ( !_mouseDevice               ||
-       !_mouseDevice->init()       ||
-       !_mouseDevice->attach(this) )
+  if (!mouseNubs)
   {
-	  RELEASE(_mouseDevice);				_mouseDevice = NULL;
 	  RELEASE(_interruptSourceMouse);		_interruptSourceMouse = NULL;
   }
 	   
@@ -389,8 +612,20 @@ bool ApplePS2Controller::start(IOService * provider)
 
   if (_keyboardDevice)
 	_keyboardDevice->registerService();
-  if (_mouseDevice)
-	_mouseDevice->registerService();
+  for (unsigned port = 0; port < kMaxAuxPorts; port++)
+    if (_mouseDevices[port])
+      _mouseDevices[port]->registerService();
+
+  //
+  // Start watching for interrupts that never arrive, or poll right away if
+  // the personality says this machine needs it.
+  //
+
+  if (getProperty(kPollingModeKey) == kOSBooleanTrue)
+    startPolling();
+  else
+    publishPolling();
+  armPollTimer();
 
   return true; // success
 
@@ -401,6 +636,154 @@ fail:
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2Controller::initializeHardware(bool fast)
+{
+  //
+  // Initialize the mouse and keyboard hardware to a known state --  the IRQs
+  // are disabled (don't want interrupts), the clock line is enabled (want to
+  // be able to send commands), and the device itself is disabled (don't want
+  // asynchronous data arrival for key/mouse events).  We call the read/write
+  // port routines directly, since no other thread will conflict with us.
+  //
+  // The controller and port self tests also reset the devices, but cost a
+  // full timeout for every answer that does not come, which adds up where a
+  // port is absent.  In fast mode they are skipped if firmware has clearly
+  // been here first: the controller answers for its command byte at once,
+  // and the system flag in it says POST passed.  Otherwise we fall back to
+  // the full sequence.
+  //
+
+  static const char * phaseNames[kBootPhases] =
+    { "Flush", "SelfTest", "Devices", "Drain" };
+
+  UInt64         phaseEnd[kBootPhases];
+  UInt64         startTime = mach_absolute_time();
+  UInt64         nanoseconds;
+  UInt64         time;
+  UInt8          commandByte = 0;
+  UInt8          byte;
+  OSDictionary * bootTime;
+
+  _suppressTimeout = true;
+
+  // Disable keyboard and mouse
+  writeCommandPort(kCP_DisableKeyboardClock);
+  writeCommandPort(kCP_DisableMouseClock);
+  // Flush any data
+  while ( inPort(kCommandPort) & kOutputReady )
+  {
+    portDelay(kDataDelay);
+    inPort(kDataPort);
+    portDelay(kDataDelay);
+  }
+  writeCommandPort(kCP_EnableMouseClock);
+  phaseEnd[kBP_Flush] = mach_absolute_time();
+
+  // Read current command
+  writeCommandPort(kCP_GetCommandByte);
+  if (!fast ||
+      !waitDataPort(kDT_Keyboard, &commandByte, &time, kFastInitTimeout))
+  {
+    fast        = false;
+    commandByte = readDataPort(kDT_Keyboard);
+  }
+  else if (!(commandByte & kCB_SystemFlag))
+  {
+    fast = false;
+  }
+
+  if (!fast)
+  {
+    // Issue Test Controller to try to reset device
+    writeCommandPort(kCP_TestController);
+    readDataPort(kDT_Keyboard);
+    readDataPort(kDT_Mouse);
+    // Issue Test Keyboard Port to try to reset device
+    writeCommandPort(kCP_TestKeyboardPort);
+    readDataPort(kDT_Keyboard);
+    // Issue Test Mouse Port to try to reset device
+    writeCommandPort(kCP_TestMousePort);
+    readDataPort(kDT_Mouse);
+  }
+  _suppressTimeout = false;
+  phaseEnd[kBP_SelfTest] = mach_absolute_time();
+
+  commandByte &= ~(kCB_EnableMouseIRQ | kCB_DisableMouseClock);
+  writeCommandPort(kCP_SetCommandByte);
+  writeDataPort(commandByte);
+
+  // (discard acknowledges; success irrelevant)
+
+  writeDataPort(kDP_SetDefaultsAndDisable);
+  if (fast)  waitDataPort(kDT_Keyboard, &byte, &time, kFastInitAckTimeout);
+  else       readDataPort(kDT_Keyboard);
+
+  writeCommandPort(kCP_TransmitToMouse);
+  writeDataPort(kDP_SetDefaultsAndDisable);
+  if (fast)  waitDataPort(kDT_Mouse, &byte, &time, kFastInitAckTimeout);
+  else       readDataPort(kDT_Mouse);
+
+  // Switch to active multiplexing if the personality asks for it and the
+  // controller can, then quiet the devices behind every aux port, noting
+  // which ports have one.
+
+  if (getProperty(kMuxModeKey) == kOSBooleanTrue && enableMux())
+  {
+    IOLog("%s: Active multiplexing, version %d.%d\n", getName(),
+          _muxVersion >> 4, _muxVersion & 0x0F);
+    setProperty(kMuxVersionPropertyKey, _muxVersion, 8);
+
+    probeAuxPorts();
+  }
+  phaseEnd[kBP_Devices] = mach_absolute_time();
+
+  //
+  // Clear out garbage in the controller's input streams, before starting up
+  // the work loop.
+  //
+
+  while ( inPort(kCommandPort) & kOutputReady )
+  {
+    portDelay(kDataDelay);
+    inPort(kDataPort);
+    portDelay(kDataDelay);
+  }
+
+  // The self test and the multiplexing knock may each have changed the
+  // command byte; start out from what the controller really has.
+
+  readCommandByte();
+  phaseEnd[kBP_Drain] = mach_absolute_time();
+
+  //
+  // Publish the time taken by each phase, in microseconds.
+  //
+
+  bootTime = OSDictionary::withCapacity(kBootPhases + 2);
+  if (bootTime == 0)  return;
+
+  for (unsigned phase = 0; phase <= kBootPhases; phase++)
+  {
+    UInt64     begin = (phase == 0 || phase == kBootPhases) ?
+                       startTime : phaseEnd[phase - 1];
+    UInt64     end   = phaseEnd[(phase == kBootPhases) ? phase - 1 : phase];
+    OSNumber * value;
+
+    absolutetime_to_nanoseconds(end - begin, &nanoseconds);
+    value = OSNumber::withNumber(nanoseconds / 1000, 32);
+    if (value == 0)  break;
+    bootTime->setObject((phase == kBootPhases) ? "Total" : phaseNames[phase],
+                        value);
+    value->release();
+  }
+
+  bootTime->setObject(kFastInitKey, fast ? kOSBooleanTrue : kOSBooleanFalse);
+  setProperty(kBootTimePropertyKey, bootTime);
+  bootTime->release();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2Controller::stop(IOService * provider)
 {
   #undef  RELEASE
@@ -416,11 +799,59 @@ void ApplePS2Controller::stop(IOService * provider)
   assert(_interruptInstalledKeyboard    == false);
   assert(_interruptInstalledMouse       == false);
   assert(_powerControlInstalledKeyboard == false);
-  assert(_powerControlInstalledMouse    == false);
+  for (unsigned port = 0; port < kMaxAuxPorts; port++)
+    assert(_powerControlInstalledMouse[port] == false);
 
   // Free the nubs we created.
   RELEASE(_keyboardDevice);
-  RELEASE(_mouseDevice);
+  for (unsigned port = 0; port < kMaxAuxPorts; port++)
+    RELEASE(_mouseDevices[port]);
+
+  // Free the request timer.
+  if (_requestTimer)
+  {
+    _requestTimer->cancelTimeout();
+    if (_workLoop)  _workLoop->removeEventSource(_requestTimer);
+    RELEASE(_requestTimer);
+  }
+
+  // Free the statistics timer.
+  if (_statisticsTimer)
+  {
+    _statisticsTimer->cancelTimeout();
+    if (_workLoop)  _workLoop->removeEventSource(_statisticsTimer);
+    RELEASE(_statisticsTimer);
+  }
+
+  // Free the poll timer.
+  if (_pollTimer)
+  {
+    _pollTimer->cancelTimeout();
+    if (_workLoop)  _workLoop->removeEventSource(_pollTimer);
+    RELEASE(_pollTimer);
+  }
+
+  // Free the watchdog timer.
+  if (_watchdogTimer)
+  {
+    _watchdogTimer->cancelTimeout();
+    if (_workLoop)  _workLoop->removeEventSource(_watchdogTimer);
+    RELEASE(_watchdogTimer);
+  }
+
+  // Free the recovery notice.
+  if (_recoveryCall)
+  {
+    thread_call_cancel(_recoveryCall);
+    thread_call_free(_recoveryCall);
+    _recoveryCall = 0;
+  }
+
+  // Free the aux work loop and its input source.
+  if (_auxInputSource && _auxWorkLoop)
+    _auxWorkLoop->removeEventSource(_auxInputSource);
+  RELEASE(_auxInputSource);
+  RELEASE(_auxWorkLoop);
 
   // Free the work loop.
   RELEASE(_workLoop);
@@ -430,14 +861,14 @@ void ApplePS2Controller::stop(IOService * provider)
   RELEASE(_interruptSourceMouse);
   RELEASE(_interruptSourceQueue);
 
-  // Free the request queue lock and empty out the request queue.
-  if (_requestQueueLock)
+  // Empty out the request ring.
+  _hardwareOffline = true;
+  if (_requestContext.parked)
   {
-    _hardwareOffline = true;
-    processRequestQueue(0, 0);
-    IOSimpleLockFree(_requestQueueLock);
-    _requestQueueLock = 0;
+    _requestContext.parked = false;
+    runRequest(&_requestContext, false);
   }
+  drainRequestQueue(false);
 
   // Free the power management thread call.
   if (_powerChangeThreadCall)
@@ -469,31 +900,17 @@ IOWorkLoop * ApplePS2Controller::getWorkLoop() const
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-IOSyncer *ApplePS2Controller::CreateIOSyncer(bool twoRetains)
-{
-    IOSyncer *me = new IOSyncer;
-
-    if ((me) && (!me->init(twoRetains)))
-	{
-        me->release();
-
-        return(0);
-    }
-	
-    return(me);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 void ApplePS2Controller::installInterruptAction(PS2DeviceType      deviceType,
                                                 OSObject *         target, 
-                                                PS2InterruptAction action)
+                                                PS2InterruptAction action,
+                                                UInt8              auxPort)
 {
   //
-  // Install the keyboard or mouse interrupt handler.
+  // Install the keyboard or mouse interrupt handler.  A mouse handler is
+  // installed for one aux port; the mouse IRQ is hooked along with the first.
   //
-  // This method assumes only one possible mouse and only one possible
-  // keyboard client (ie. callers), and assumes two distinct interrupt
+  // This method assumes only one possible keyboard client and one mouse
+  // client per aux port (ie. callers), and assumes distinct interrupt
   // handlers for each, hence needs no protection against races.
   //
 
@@ -520,37 +937,70 @@ void ApplePS2Controller::installInterruptAction(PS2DeviceType      deviceType,
     
     _interruptInstalledKeyboard = true;
   }
-  else if (deviceType == kDT_Mouse && _interruptInstalledMouse == false && _interruptSourceMouse != NULL)
+  else if (deviceType == kDT_Mouse && auxPort < kMaxAuxPorts &&
+           _auxPortInstalled[auxPort] == false && _interruptSourceMouse != NULL)
   {
     target->retain();
-    _interruptTargetMouse = target;
-    _interruptActionMouse = action;
-    _workLoop->addEventSource(_interruptSourceMouse);
+    _auxWorkLoop->closeGate();
+    _interruptTargetMouse[auxPort] = target;
+    _interruptActionMouse[auxPort] = action;
+    _auxPortInstalled[auxPort]     = true;
+    _auxWorkLoop->openGate();
+
+    if (_interruptInstalledMouse == false)
+    {
+      _workLoop->addEventSource(_interruptSourceMouse);
 #if !defined(SNOW_LEO) && !defined(TIGER)
-    if (_newIRQLayout) {		// turbo
-     getProvider()->registerInterrupt(1, 0, interruptHandlerMouse);
-     getProvider()->enableInterrupt(1);
-    } else {
+      if (_newIRQLayout) {		// turbo
+       getProvider()->registerInterrupt(1, 0, interruptHandlerMouse);
+       getProvider()->enableInterrupt(1);
+      } else {
 #endif
-     getProvider()->registerInterrupt(kIRQ_Mouse, 0, interruptHandlerMouse);
-     getProvider()->enableInterrupt(kIRQ_Mouse);
+       getProvider()->registerInterrupt(kIRQ_Mouse, 0, interruptHandlerMouse);
+       getProvider()->enableInterrupt(kIRQ_Mouse);
 #if !defined(SNOW_LEO) && !defined(TIGER)
-    }
+      }
 #endif
 
-    _interruptInstalledMouse = true;
+      _interruptInstalledMouse = true;
+    }
   }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::uninstallInterruptAction(PS2DeviceType deviceType)
+void ApplePS2Controller::installInterruptBatchAction(
+                                          PS2DeviceType           deviceType,
+                                          OSObject *              target,
+                                          PS2InterruptBatchAction action,
+                                          UInt8                   auxPort)
+{
+  //
+  // Install the keyboard or mouse interrupt handler, in its batched form.
+  // The batch action is put in place before the interrupt is enabled, and
+  // takes precedence over the (null) single byte action.
+  //
+
+  if (deviceType == kDT_Keyboard && _interruptInstalledKeyboard == false)
+    _interruptBatchActionKeyboard = action;
+  else if (deviceType == kDT_Mouse && auxPort < kMaxAuxPorts &&
+           _auxPortInstalled[auxPort] == false)
+    _interruptBatchActionMouse[auxPort] = action;
+
+  installInterruptAction(deviceType, target, NULL, auxPort);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::uninstallInterruptAction(PS2DeviceType deviceType,
+                                                  UInt8         auxPort)
 {
   //
-  // Uninstall the keyboard or mouse interrupt handler.
+  // Uninstall the keyboard or mouse interrupt handler.  The mouse IRQ is
+  // unhooked along with the handler for the last aux port.
   //
-  // This method assumes only one possible mouse and only one possible
-  // keyboard client (ie. callers), and assumes two distinct interrupt
+  // This method assumes only one possible keyboard client and one mouse
+  // client per aux port (ie. callers), and assumes distinct interrupt
   // handlers for each, hence needs no protection against races.
   //
 
@@ -564,19 +1014,35 @@ void ApplePS2Controller::uninstallInterruptAction(PS2DeviceType deviceType)
     _workLoop->removeEventSource(_interruptSourceKeyboard);
     _interruptInstalledKeyboard = false;
     _interruptActionKeyboard = NULL;
+    _interruptBatchActionKeyboard = NULL;
     _interruptTargetKeyboard->release();
     _interruptTargetKeyboard = 0;
   }
 
-  else if (deviceType == kDT_Mouse && _interruptInstalledMouse == true)
+  else if (deviceType == kDT_Mouse && auxPort < kMaxAuxPorts &&
+           _auxPortInstalled[auxPort] == true)
   {
-    getProvider()->disableInterrupt(kIRQ_Mouse);
-    getProvider()->unregisterInterrupt(kIRQ_Mouse);
-    _workLoop->removeEventSource(_interruptSourceMouse);
-    _interruptInstalledMouse = false;
-    _interruptActionMouse = NULL;
-    _interruptTargetMouse->release();
-    _interruptTargetMouse = 0;
+    bool lastPort = true;
+
+    for (unsigned port = 0; port < kMaxAuxPorts; port++)
+      if (port != auxPort && _auxPortInstalled[port])  lastPort = false;
+
+    if (lastPort)
+    {
+      getProvider()->disableInterrupt(kIRQ_Mouse);
+      getProvider()->unregisterInterrupt(kIRQ_Mouse);
+      _workLoop->removeEventSource(_interruptSourceMouse);
+    }
+
+    // (the handler is called on the aux work loop; wait until it is out)
+    _auxWorkLoop->closeGate();
+    if (lastPort)  _interruptInstalledMouse = false;
+    _auxPortInstalled[auxPort] = false;
+    _interruptActionMouse[auxPort] = NULL;
+    _interruptBatchActionMouse[auxPort] = NULL;
+    _interruptTargetMouse[auxPort]->release();
+    _interruptTargetMouse[auxPort] = 0;
+    _auxWorkLoop->openGate();
   }
 }
 
@@ -588,34 +1054,114 @@ PS2Request * ApplePS2Controller::allocateRequest()
   // Allocate a request structure.  Blocks until successful.  Request structure
   // is guaranteed to be zeroed.
   //
+  // The request comes off the pool's free list if there is one to spare,
+  // and from IOMalloc otherwise.
+  //
 
-  PS2Request * request = (PS2Request *) IOMalloc(sizeof(PS2Request));
-  bzero(request, sizeof(PS2Request));
-  return request; 
-}
+  PS2Request * request = 0;
+  UInt32       head;
+  UInt32       next;
+  SInt32       inUse;
 
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+  do
+  {
+    head = _requestPoolHead;
+    if ((head & kRequestPoolIndexMask) == 0)  break;     // pool is empty
 
-void ApplePS2Controller::freeRequest(PS2Request * request)
-{
-  //
-  // Deallocate a request structure.
-  //
+    request = &_requestPool[(head & kRequestPoolIndexMask) - 1];
+    next    = ((head + kRequestPoolGeneration) & ~kRequestPoolIndexMask) |
+              _requestPoolNext[(head & kRequestPoolIndexMask) - 1];
+  }
+  while (!OSCompareAndSwap(head, next, &_requestPoolHead));
 
-  IOFree(request, sizeof(PS2Request));
-}
+  if ((head & kRequestPoolIndexMask) == 0)
+  {
+    OSIncrementAtomic(&_requestPoolExhausted);
+    publishRequestPoolStatistics();
+    request = (PS2Request *) IOMalloc(sizeof(PS2Request));
+  }
+  else
+  {
+    inUse = OSIncrementAtomic(&_requestPoolInUse) + 1;
+    if (inUse > _requestPoolHighWater)
+    {
+      _requestPoolHighWater = inUse;
+      publishRequestPoolStatistics();
+    }
+  }
+
+  bzero(request, sizeof(PS2Request));
+  return request; 
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::freeRequest(PS2Request * request)
+{
+  //
+  // Deallocate a request structure, along with any segments chained to it.
+  //
+
+  UInt32   head;
+  UInt32   next;
+  unsigned index;
+
+  if (request->nextSegment)
+  {
+    freeRequest(request->nextSegment);
+    request->nextSegment = 0;
+  }
+
+  if (request < _requestPool || request >= _requestPool + kRequestPoolSize)
+  {
+    IOFree(request, sizeof(PS2Request));
+    return;
+  }
+
+  // Push it back onto the pool's free list.
+
+  index = request - _requestPool;
+
+  do
+  {
+    head = _requestPoolHead;
+    _requestPoolNext[index] = head & kRequestPoolIndexMask;
+    next = ((head + kRequestPoolGeneration) & ~kRequestPoolIndexMask) |
+           (index + 1);
+  }
+  while (!OSCompareAndSwap(head, next, &_requestPoolHead));
+
+  OSDecrementAtomic(&_requestPoolInUse);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::publishRequestPoolStatistics()
+{
+  //
+  // Reflect the pool counters in the registry.  Only called when one of them
+  // moves in a way worth noting, so the common paths stay allocation-free.
+  //
+
+  setProperty("RequestPoolHighWater", _requestPoolHighWater, 32);
+  setProperty("RequestPoolExhausted", _requestPoolExhausted, 32);
+  setProperty("RequestRingOverflows", _requestOverflowTotal, 32);
+}
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-bool ApplePS2Controller::submitRequest(PS2Request * request)
+bool ApplePS2Controller::submitRequest(PS2Request *  request,
+                                       PS2DeviceType deviceType,
+                                       UInt8         auxPort)
 {
   //
   // Submit the request to the controller for processing, asynchronously.
+  // Never fails: should the request ring be full, the request waits on the
+  // overflow list instead.
   //
 
-  IOSimpleLockLock(_requestQueueLock);
-  queue_enter(&_requestQueue, request, PS2Request *, chain);
-  IOSimpleLockUnlock(_requestQueueLock);
+  if (!enqueueRequest(request, deviceType, auxPort))
+    overflowRequest(request, deviceType, auxPort);
 
   _interruptSourceQueue->interruptOccurred(0, 0, 0);
 
@@ -624,7 +1170,9 @@ bool ApplePS2Controller::submitRequest(PS2Request * request)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::submitRequestAndBlock(PS2Request * request)
+void ApplePS2Controller::submitRequestAndBlock(PS2Request *  request,
+                                               PS2DeviceType deviceType,
+                                               UInt8         auxPort)
 {
   //
   // Submit the request to the controller for processing, synchronously.
@@ -634,46 +1182,93 @@ void ApplePS2Controller::submitRequestAndBlock(PS2Request * request)
   {
     //
     // Special case to allow PS/2 device drivers to issue synchronous
-    // requests from their interrupt handlers. Must process the queue
-    // first to process any queued async requests.
+    // requests from their interrupt handlers. Must finish the parked
+    // request and process the queue first to process any queued async
+    // requests, all of it without parking.
     //
 
     request->completionTarget = this;
     request->completionAction = submitRequestAndBlockCompletion;
     request->completionParam  = 0;
 
-    processRequestQueue(0, 0);
-    processRequest(request);
+    flushRequestQueue();
+    startRequest(request, deviceType, auxPort, mach_absolute_time(), false);
   }
   else
   {
-    IOSyncer * completionSyncer = CreateIOSyncer(true);
+    //
+    // The completion flag lives on our stack, and the completion routine
+    // wakes us through it under _requestWaitLock, so nothing is allocated
+    // per request.
+    //
+
+    volatile bool completed = false;
 
-    assert(completionSyncer);
     request->completionTarget = this;
     request->completionAction = submitRequestAndBlockCompletion;
-    request->completionParam  = completionSyncer;
+    request->completionParam  = (void *) &completed;
 
-    submitRequest(request);
+    if (!enqueueRequest(request, deviceType, auxPort))
+      overflowRequest(request, deviceType, auxPort);
+    _interruptSourceQueue->interruptOccurred(0, 0, 0);
 
-    completionSyncer->wait();                               // wait 'till done
+    IOLockLock(_requestWaitLock);                           // wait 'till done
+    while (!completed)
+      IOLockSleep(_requestWaitLock, (void *) &completed, THREAD_UNINT);
+    IOLockUnlock(_requestWaitLock);
   }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::submitRequestAndBlockCompletion(void *, void * param)
+void ApplePS2Controller::submitRequestAndBlockCompletion(void * target,
+                                                         void * param)
 {                                                      // PS2CompletionAction
   if (param)
   {
-    IOSyncer * completionSyncer = (IOSyncer *) param;
-    completionSyncer->signal();
+    ApplePS2Controller * me        = (ApplePS2Controller *) target;
+    volatile bool *      completed = (volatile bool *) param;
+
+    IOLockLock(me->_requestWaitLock);
+    *completed = true;
+    IOLockWakeup(me->_requestWaitLock, param, true);
+    IOLockUnlock(me->_requestWaitLock);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::setCommandByte(UInt8 setBits, UInt8 clearBits)
+{
+  //
+  // Sets the bits setBits and clears the bits clearBits atomically in the
+  // controller's Command Byte.  This goes through the request queue, in
+  // order with the requests submitted before it.  Blocks until done, except
+  // on the work loop itself, where the request is left in the queue: it is
+  // still done before any request submitted after it.
+  //
+
+  PS2Request * request = allocateRequest();
+
+  request->commands[0].command   = kPS2C_ModifyCommandByte;
+  request->commands[0].setBits   = setBits;
+  request->commands[0].clearBits = clearBits;
+  request->commandsCount         = 1;
+
+  if (_workLoop->inGate())
+  {
+    submitRequest(request, kDT_Keyboard, 0);    // (fire-and-forget)
+  }
+  else
+  {
+    submitRequestAndBlock(request, kDT_Keyboard, 0);
+    freeRequest(request);
   }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::interruptOccurred(IOInterruptEventSource *, int)
+void ApplePS2Controller::interruptOccurred(IOInterruptEventSource * source, int)
 {                                                      // IOInterruptEventAction
   //
   // Our work loop has informed us of an interrupt, that is, asynchronous
@@ -687,10 +1282,31 @@ void ApplePS2Controller::interruptOccurred(IOInterruptEventSource *, int)
   {
     // Toss any asynchronous data received. The interrupt event source may
     // have been signalled before the PS/2 port was offline.
+    countEvent((source == _interruptSourceMouse) ? kDT_Mouse : kDT_Keyboard,
+               kEC_OfflineDrop);
     return;
   }
 
-  UInt8 status;
+  //
+  // Bytes for drivers with a batch action are collected while we drain the
+  // input stream, and handed over in one call per driver at the end.
+  //
+
+  _interruptBatching = true;
+
+  //
+  // An interrupt got here, so they are arriving; stop watching for them.
+  //
+
+  if (_pollWatching)
+  {
+    _pollWatching = false;
+    _pollTimer->cancelTimeout();
+  }
+
+  UInt8  status;
+  UInt64 time;
+  UInt32 tag;
 #if DEBUGGER_SUPPORT
   int state;
   lockController(&state);              // (lock out interrupt + access to queue)
@@ -700,20 +1316,28 @@ void ApplePS2Controller::interruptOccurred(IOInterruptEventSource *, int)
     // we do not read keyboard data from the real data port if it should
     // be available. 
 
-    if (dequeueKeyboardData(&status))
+    if (dequeueKeyboardData(&status, &time))
     {
       unlockController(state);
-      dispatchDriverInterrupt(kDT_Keyboard, status);
+      recordLatency(kDT_Keyboard, kLS_Interrupt, time, mach_absolute_time());
+      routeInputByte(kDT_Keyboard, status, time);
       lockController(&state);
     }
 
     // See if data is available on the mouse input stream (off real port).
 
-    else if ( (inb(kCommandPort) & (kOutputReady | kMouseData)) ==
+    else if ( ((status = inPort(kCommandPort)) & (kOutputReady | kMouseData)) ==
                                    (kOutputReady | kMouseData))
     {
+      bool error = muxError(status);
+
+      decodeStatus(status);
+      status = inPort(kDataPort);
+      tag    = _dataPortReads - 1;
       unlockController(state);
-      dispatchDriverInterrupt(kDT_Mouse, inb(kDataPort));
+      time = takeInterruptTime(kDT_Mouse, tag);
+      if (error)   muxErrorOccurred();
+      else         routeInputByte(kDT_Mouse, status, time);
       lockController(&state);
     }
     else break; // out of loop
@@ -722,484 +1346,2829 @@ void ApplePS2Controller::interruptOccurred(IOInterruptEventSource *, int)
 #else
   // Loop only while there is data currently on the input stream.
 
-  while ( ((status = inb(kCommandPort)) & kOutputReady) )
+  while ( ((status = inPort(kCommandPort)) & kOutputReady) )
   {
     // Read in and dispatch the data, but only if it isn't what is required
-    // by the active command.
+    // by the parked request.
+
+    PS2DeviceType deviceType = decodeStatus(status);
+    bool          error      = muxError(status);
 
-    dispatchDriverInterrupt((status&kMouseData)?kDT_Mouse:kDT_Keyboard,
-                            inb(kDataPort));
+    status = inPort(kDataPort);
+    tag    = _dataPortReads - 1;
+    time   = takeInterruptTime(deviceType, tag);
+    if (error)   muxErrorOccurred();
+    else         routeInputByte(deviceType, status, time);
   }
 #endif //DEBUGGER_SUPPORT
+
+  _interruptBatching = false;
+  flushDriverInterrupts();
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 void ApplePS2Controller::dispatchDriverInterrupt(PS2DeviceType deviceType,
-                                                 UInt8         data)
+                                                 UInt8         data,
+                                                 UInt64        time)
 {
   //
   // The supplied data is passed onto the interrupt handler in the appropriate
   // driver, if one is registered, otherwise the data byte is thrown away.
+  // Only batch actions are told the byte's arrival time.
+  //
+  // If the driver installed a batch action and we are draining the input
+  // stream, the byte is held back until flushDriverInterrupts.  Mouse bytes
+  // are handed over to the aux work loop instead, for the driver of the aux
+  // port in _inputAuxPort.
   //
   // This method should only be called from our single-threaded work loop.
   //
 
+  unsigned channel = inputChannel(deviceType, _inputAuxPort);
+
+  // (a device that sends anything is there, whether or not it answered)
+  _responseSilent[channel] = 0;
+
+  trackFraming(channel, data);
+
+  // Have the watchdog check that the rest of a packet follows.
+
+  _lastInputTime[channel] = time;
+  if (framingContinues(channel) && !_watchdogArmed && _watchdogTimer)
+  {
+    _watchdogArmed = true;
+    _watchdogTimer->setTimeoutMS(kStallTimeout);
+  }
+
   if ( deviceType == kDT_Mouse )
   {
     // Dispatch the data to the mouse driver.
-    if (_interruptInstalledMouse)
-      (*_interruptActionMouse)(_interruptTargetMouse, data);
+    if (_auxPortInstalled[_inputAuxPort] == false)  return;
+
+    queueAuxInput(data, time);
   }
   else if ( deviceType == kDT_Keyboard )
   {
     // Dispatch the data to the keyboard driver.
-    if (_interruptInstalledKeyboard)       
+    if (_interruptInstalledKeyboard == false)  return;
+
+    if (_interruptBatchActionKeyboard == NULL)
       (*_interruptActionKeyboard)(_interruptTargetKeyboard, data);
+    else if (_interruptBatching)
+      batchDriverInterrupt(kDT_Keyboard, data, time);
+    else
+      (*_interruptBatchActionKeyboard)(_interruptTargetKeyboard, &data, &time, 1);
   }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::processRequest(PS2Request * request)
+void ApplePS2Controller::batchDriverInterrupt(PS2DeviceType deviceType,
+                                              UInt8         data,
+                                              UInt64        time)
 {
   //
-  // Our work loop has informed us of a request submission. Process
-  // the request.  Note that this code "figures out" when the mouse
-  // input stream should be read over the keyboard input stream.
+  // Hold a byte for the driver's batch action, delivering the batch early
+  // if it is full.
   //
   // This method should only be called from our single-threaded work loop.
   //
 
-  UInt8         byte;
-  PS2DeviceType deviceMode      = kDT_Keyboard;
-  bool          failed          = false;
-  bool          transmitToMouse = false;
-  unsigned      index;
+  _interruptBatchTime[deviceType][_interruptBatchCount[deviceType]] = time;
+  _interruptBatch[deviceType][_interruptBatchCount[deviceType]++]   = data;
 
-  if (_hardwareOffline)
-  {
-    failed = true;
-    index  = 0;
-    goto hardware_offline;
-  }
+  if (_interruptBatchCount[deviceType] == kInterruptBatchSize)
+    flushDriverInterrupts();
+}
 
-  // Process each of the commands in the list.
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-  for (index = 0; index < request->commandsCount; index++)
-  {
-    switch (request->commands[index].command)
-    {
-      case kPS2C_ReadDataPort:
-        request->commands[index].inOrOut = readDataPort(deviceMode);
-        break;
+void ApplePS2Controller::flushDriverInterrupts()
+{
+  //
+  // Deliver the bytes held for the keyboard driver's batch action, and wake
+  // the aux work loop for the mouse bytes handed over meanwhile.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
 
-      case kPS2C_ReadDataPortAndCompare:
-#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
-        byte = readDataPort(deviceMode, request->commands[index].inOrOut);
-#else 
-        byte = readDataPort(deviceMode);
-#endif
-        failed = (byte != request->commands[index].inOrOut);
-        break;
+  UInt32 count;
 
-      case kPS2C_WriteDataPort:
-        writeDataPort(request->commands[index].inOrOut);
-        if (transmitToMouse)     // next reads from mouse input stream
-        {
-          deviceMode      = kDT_Mouse;
-          transmitToMouse = false;
-        }
-        else
-        {
-           deviceMode   = kDT_Keyboard;
-        }
-        break;
+  if ((count = _interruptBatchCount[kDT_Keyboard]))
+  {
+    _interruptBatchCount[kDT_Keyboard] = 0;
+    if (_interruptInstalledKeyboard && _interruptBatchActionKeyboard)
+      (*_interruptBatchActionKeyboard)(_interruptTargetKeyboard,
+                                       _interruptBatch[kDT_Keyboard],
+                                       _interruptBatchTime[kDT_Keyboard],
+                                       count);
+  }
 
-      case kPS2C_WriteCommandPort:
-        writeCommandPort(request->commands[index].inOrOut);
-        if (request->commands[index].inOrOut == kCP_TransmitToMouse)
-          transmitToMouse = true; // preparing to transmit data to mouse
-        break;
+  if (_auxInputSignal)
+  {
+    _auxInputSignal = false;
+    _auxInputSource->interruptOccurred(0, 0, 0);
+  }
+}
 
-      //
-      // Send a composite mouse command that is equivalent to the following
-      // (frequently used) command sequence:
-      //
-      // 1. kPS2C_WriteCommandPort( kCP_TransmitToMouse )
-      // 2. kPS2C_WriteDataPort( command )
-      // 3. kPS2C_ReadDataPortAndCompare( kSC_Acknowledge )
-      //
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-      case kPS2C_SendMouseCommandAndCompareAck:
-        writeCommandPort(kCP_TransmitToMouse);
-        writeDataPort(request->commands[index].inOrOut);
-        deviceMode = kDT_Mouse;
-#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
-        byte = readDataPort(kDT_Mouse, kSC_Acknowledge);
-#else 
-        byte = readDataPort(kDT_Mouse);
-#endif
-        failed = (byte != kSC_Acknowledge);
-        break;
-    }
+void ApplePS2Controller::queueAuxInput(UInt8 data, UInt64 time)
+{
+  //
+  // Hand a mouse byte over to the aux work loop, noting the aux port it came
+  // from.  We never wait for it to make room, as it may itself be waiting on
+  // us; if it is that far behind, the byte is dropped and counted.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
 
-    if (failed) break;
+  UInt32 head = _auxInputHead;
+
+  if (head - _auxInputTail == kAuxInputSize)
+  {
+    countEvent(kDT_Mouse, kEC_DeliveryOverrun);
+    return;
   }
 
-hardware_offline:
+  _auxInput[head & (kAuxInputSize - 1)]     = data;
+  _auxInputTime[head & (kAuxInputSize - 1)] = time;
+  _auxInputFrom[head & (kAuxInputSize - 1)] = _inputAuxPort;
+  OSMemoryBarrier();
+  _auxInputHead = head + 1;
 
-  // If a command failed and stopped the request processing, store its
-  // index into the commandsCount field.
+  if (_interruptBatching)
+    _auxInputSignal = true;
+  else
+    _auxInputSource->interruptOccurred(0, 0, 0);
+}
 
-  if (failed) request->commandsCount = index;
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-  // Invoke the completion routine, if one was supplied.
+void ApplePS2Controller::auxInputOccurred(IOInterruptEventSource *, int)
+{
+  //
+  // Deliver the mouse bytes handed over by our work loop to the mouse driver
+  // of the aux port each came from, a batch (of one port's bytes) at a time.
+  //
+  // This method should only be called from our aux work loop.
+  //
 
-  if (request->completionTarget && request->completionAction)
-  {
-    (*request->completionAction)(request->completionTarget,
-                                 request->completionParam);
-  }
-  else
+  UInt8  data[kInterruptBatchSize];
+  UInt64 times[kInterruptBatchSize];
+  UInt32 count;
+  UInt32 tail = _auxInputTail;
+  UInt32 head;
+  UInt8  port;
+
+  while ((head = _auxInputHead) != tail)
   {
-    freeRequest(request);
+    OSMemoryBarrier();
+
+    port = _auxInputFrom[tail & (kAuxInputSize - 1)];
+    for (count = 0;
+         count < kInterruptBatchSize && tail != head &&
+         _auxInputFrom[tail & (kAuxInputSize - 1)] == port;
+         count++, tail++)
+    {
+      data[count]  = _auxInput[tail & (kAuxInputSize - 1)];
+      times[count] = _auxInputTime[tail & (kAuxInputSize - 1)];
+    }
+
+    OSMemoryBarrier();
+    _auxInputTail = tail;
+
+    if (_auxPortInstalled[port] == false)  continue;
+
+    if (_interruptBatchActionMouse[port])
+    {
+      (*_interruptBatchActionMouse[port])(_interruptTargetMouse[port],
+                                          data, times, count);
+    }
+    else
+    {
+      for (UInt32 index = 0; index < count; index++)
+        (*_interruptActionMouse[port])(_interruptTargetMouse[port],
+                                       data[index]);
+    }
   }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::processRequestQueue(IOInterruptEventSource *, int)
+void ApplePS2Controller::startRequest(PS2Request *  request,
+                                      PS2DeviceType deviceType,
+                                      UInt8         auxPort,
+                                      UInt64        submitTime,
+                                      bool          mayPark)
 {
-  queue_head_t localQueue;
+  //
+  // Begin processing a request.  If mayPark is set, the request may be left
+  // parked in _requestContext, waiting for a response byte, when this method
+  // returns; it is then advanced by routeInputByte or the request timer.
+  // Otherwise the request runs to completion before we return.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
 
-  // Transfer queued (async) requests to a local queue.
+  PS2RequestContext   localContext;
+  PS2RequestContext * context = mayPark ? &_requestContext : &localContext;
 
-  IOSimpleLockLock(_requestQueueLock);
+  assert(context->request == 0 || context == &localContext);
 
-  if (!queue_empty(&_requestQueue))
+  bzero(context, sizeof(PS2RequestContext));
+  context->request    = request;
+  context->segment    = request;
+  context->deviceType = deviceType;
+  context->auxPort    = (deviceType == kDT_Mouse) ? auxPort : 0;
+  context->deviceMode = kDT_Keyboard;
+  context->submitTime = submitTime;
+  context->priority   = (request->priority < kRequestPriorities) ?
+                        request->priority : kRP_Normal;
+
+  request->flags &= ~(kRF_Cancelled | kRF_Expired);
+
+  if (request->timeLimit)
+  {
+    nanoseconds_to_absolutetime((UInt64) request->timeLimit * 1000000ULL,
+                                &context->requestDeadline);
+    context->requestDeadline += submitTime;
+  }
+
+  //
+  // A quiet window brackets the request with segments of its own that stop
+  // the mouse's stream, and restart it if it was streaming.  The stream is
+  // stopped whatever we believe: a mouse that missed the write that should
+  // have quieted it, or that was plugged in since, streams all the same.
+  //
+
+  if ((request->flags & kRF_QuietWindow) && requestTargetsMouse(request))
   {
-    queue_assign(&localQueue, &_requestQueue, PS2Request *, chain);
-    queue_init(&_requestQueue);
+    PS2Request * suspend = &context->suspendSegment;
+    PS2Request * resume  = &context->resumeSegment;
+
+    suspend->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+    suspend->commands[0].inOrOut = kDP_SetDefaultsAndDisable;
+    suspend->commandsCount       = 1;
+    suspend->nextSegment         = request;
+
+    resume->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
+    resume->commands[0].inOrOut  = kDP_Enable;
+    resume->commandsCount        = 1;
+
+    context->segment     = suspend;
+    context->quietResume = _mouseStreaming[context->auxPort];
   }
-  else queue_init(&localQueue);
 
-  IOSimpleLockUnlock(_requestQueueLock);
+  recordRequestLatency(context, kRL_Started, mach_absolute_time());
+
+  runRequest(context, mayPark);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-  // Process each request in order.
+bool ApplePS2Controller::requestTargetsMouse(PS2Request * request)
+{
+  //
+  // Returns true if the first byte the request sends to a device goes to
+  // the mouse, judging by the same commands runRequest goes by.
+  //
 
-  while (!queue_empty(&localQueue))
+  for (PS2Request * segment = request; segment; segment = segment->nextSegment)
   {
-    PS2Request * request;
-    queue_remove_first(&localQueue, request, PS2Request *, chain);
-    processRequest(request);
+    for (unsigned index = 0; index < segment->commandsCount; index++)
+    {
+      PS2Command * command = &segment->commands[index];
+
+      if (command->command == kPS2C_SendMouseCommandAndCompareAck)
+        return true;
+      if (command->command == kPS2C_WriteCommandPort &&
+          command->inOrOut == kCP_TransmitToMouse)
+        return true;
+      if (command->command == kPS2C_WriteDataPort)
+        return false;
+    }
   }
+
+  return false;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType)
+bool ApplePS2Controller::runRequest(PS2RequestContext * context, bool mayPark)
 {
   //
-  // Blocks until keyboard or mouse data is available from the controller
-  // and returns that data. Note, if mouse data is requested but keyboard
-  // data is what is available,  the data is delivered to the appropriate
-  // driver interrupt routine immediately (effectively, the request is
-  // "preempted" temporarily).
+  // Execute the request's commands, starting from where the context left
+  // off.  Note that this code "figures out" when the mouse input stream
+  // should be read over the keyboard input stream.
   //
-  // There is a built-in timeout for this command of (timeoutCounter X
-  // kDataDelay) microseconds, approximately. 
+  // Every read step waits for its byte in one of two ways.  When mayPark is
+  // clear, we spin on the status port as readDataPort always did.  When it
+  // is set, we only take bytes that are already there; if there are none,
+  // the request is parked and we return false, leaving the work loop free
+  // until the interrupt for that byte (or the request timer) comes around.
+  //
+  // A request's chained segments run as a continuation of its own command
+  // list, with nothing else allowed in between.
+  //
+  // Returns true once the request has completed.
   //
   // This method should only be called from our single-threaded work loop.
   //
 
-  UInt8  readByte;
-  UInt8  status;
-  UInt32 timeoutCounter = 10000;    // (timeoutCounter * kDataDelay = 70 ms)
+  UInt8  byte;
+  UInt64 time;
 
-  while (1)
+  _outputAuxPort = context->auxPort;    // (where kCP_TransmitToMouse goes)
+
+  for (;;)
   {
-#if DEBUGGER_SUPPORT
-    int state;
-    lockController(&state);            // (lock out interrupt + access to queue)
-    if (deviceType == kDT_Keyboard && dequeueKeyboardData(&readByte))
+    PS2Request * segment = context->segment;
+
+    // Step into the next segment once this one is exhausted.
+
+    if (context->index >= segment->commandsCount)
     {
-      unlockController(state);
-      return readByte;
+      if (segment->nextSegment == 0 && context->quietResume)
+      {
+        context->quietResume = false;
+        context->segment     = &context->resumeSegment;
+        context->index       = 0;
+        continue;
+      }
+
+      if (segment->nextSegment == 0)  break;
+
+      context->segment = segment->nextSegment;
+      context->index   = 0;
+      continue;
     }
-#endif //DEBUGGER_SUPPORT
 
     //
-    // Wait for the controller's output buffer to become ready.
+    // An aux port other than the first is gone once the controller has
+    // left multiplexing mode; its bytes would reach the device on port 0.
     //
 
-    while (timeoutCounter && !((status = inb(kCommandPort)) & kOutputReady))
+    if (_hardwareOffline || (context->auxPort && !_muxActive))
     {
-      timeoutCounter--;
-      IODelay(kDataDelay);
+      context->failed = true;
+      break;
     }
 
     //
-    // If we timed out, something went awfully wrong; return a fake value.
+    // A cancelled or overdue request stops where it is.  A quiet window's
+    // closing segment still runs, as the device must get its stream back;
+    // it is neither cancelled nor timed by the request.
     //
 
-    if (timeoutCounter == 0)
+    if (segment != &context->resumeSegment)
     {
-#if DEBUGGER_SUPPORT
-      unlockController(state);  // (release interrupt lockout + access to queue)
-#endif //DEBUGGER_SUPPORT
+      if (context->requestDeadline && !context->cancelled &&
+          mach_absolute_time() >= context->requestDeadline)
+      {
+        context->expired = true;
+      }
 
-	  if (!_suppressTimeout)
-		IOLog("%s: Timed out on %s input stream.\n", getName(),
-                          (deviceType == kDT_Keyboard) ? "keyboard" : "mouse");
-      return 0;
+      if (context->cancelled || context->expired)
+      {
+        context->failed = true;
+        if (closeQuietWindow(context))  continue;
+        break;
+      }
     }
 
-    //
-    // For older machines, it is necessary to wait a while after the controller
-    // has asserted the output buffer bit before reading the data port. No more
-    // data will be available if this wait is not performed.
-    //
+    PS2Command * command = &segment->commands[context->index];
 
-    IODelay(kDataDelay);
+    switch (command->command)
+    {
+      case kPS2C_WriteDataPort:
+        if (context->transmitToMouse)     // next reads from mouse input stream
+        {
+          context->deviceMode      = kDT_Mouse;
+          context->transmitToMouse = false;
+        }
+        else
+        {
+          context->deviceMode      = kDT_Keyboard;
+        }
+        if (!writeDataPort(command->inOrOut))
+        {
+          context->failed      = true;  // (ends the request below)
+          context->stepStarted = true;
+          context->stepDone    = true;
+          break;
+        }
+        context->resendValid   = true;
+        context->resendToMouse = (context->deviceMode == kDT_Mouse);
+        context->resendByte    = command->inOrOut;
+        context->resendCount   = 0;
+        context->streamQuiet   = false;
+        context->index++;
+        continue;
 
-    //
-    // Read in the data.  We return the data, however, only if it arrived on
-    // the requested input stream.
-    //
+      case kPS2C_WriteCommandPort:
+        writeCommandPort(command->inOrOut);
+        context->resendValid = false;     // (not a byte for the device)
+        if (command->inOrOut == kCP_TransmitToMouse)
+          context->transmitToMouse = true; // preparing to transmit data to mouse
+        context->index++;
+        continue;
 
-    readByte = inb(kDataPort);
+      //
+      // The new command byte is worked out from _commandByte now, so that it
+      // takes in whatever the steps and requests ahead of it changed.
+      // writeDataPort updates _commandByte, and only if the byte went out.
+      //
 
-#if DEBUGGER_SUPPORT
-    unlockController(state);    // (release interrupt lockout + access to queue)
-#endif //DEBUGGER_SUPPORT
+      case kPS2C_ModifyCommandByte:
+      {
+        UInt8 commandByte = (_commandByte | command->setBits) &
+                            ~command->clearBits;
 
-	if (_suppressTimeout)		// startup mode w/o interrupts
-		return readByte;
+        context->resendValid = false;     // (not a byte for the device)
+        if (commandByte != _commandByte)
+        {
+          writeCommandPort(kCP_SetCommandByte);
+          if (!writeDataPort(commandByte))
+          {
+            context->failed      = true;  // (ends the request below)
+            context->stepStarted = true;
+            context->stepDone    = true;
+            break;
+          }
+        }
+        context->index++;
+        continue;
+      }
 
-    if ( (status & kMouseData) )
-    {
-      if (deviceType == kDT_Mouse)  return readByte;
-    }
+      //
+      // Send a composite mouse command that is equivalent to the following
+      // (frequently used) command sequence:
+      //
+      // 1. kPS2C_WriteCommandPort( kCP_TransmitToMouse )
+      // 2. kPS2C_WriteDataPort( command )
+      // 3. kPS2C_ReadDataPortAndCompare( kSC_Acknowledge )
+      //
+
+      case kPS2C_SendMouseCommandAndCompareAck:
+        if (!context->stepStarted)
+        {
+          writeCommandPort(kCP_TransmitToMouse);
+          if (!writeDataPort(command->inOrOut))
+          {
+            context->failed   = true;     // (ends the request below)
+            context->stepDone = true;
+          }
+          context->deviceMode    = kDT_Mouse;
+          context->resendValid   = true;
+          context->resendToMouse = true;
+          context->resendByte    = command->inOrOut;
+          context->resendCount   = 0;
+          context->streamQuiet   = false;
+        }
+        break;
+
+      case kPS2C_ReadDataPort:
+      case kPS2C_ReadDataPortAndCompare:
+        break;
+    }
+
+    //
+    // This step reads from the input stream.  The timeout runs from the
+    // moment the step first started, however many times it is parked.
+    //
+
+    if (!context->stepStarted)
+    {
+      context->stepStarted   = true;
+      context->stepStartTime = mach_absolute_time();
+      context->stepTimeout   = responseTimeout(context->deviceMode);
+      if (context->cancelled && context->stepTimeout > kResponseProbeTimeout)
+        context->stepTimeout = kResponseProbeTimeout;
+      clock_interval_to_deadline(context->stepTimeout, kMillisecondScale,
+                                 &context->deadline);
+
+      if (context->requestDeadline &&
+          context->requestDeadline < context->deadline &&
+          context->segment != &context->resumeSegment)
+      {
+        UInt64 nanoseconds;
+
+        absolutetime_to_nanoseconds(context->requestDeadline -
+                                    context->stepStartTime, &nanoseconds);
+        context->deadline    = context->requestDeadline;
+        context->stepTimeout = (UInt32)(nanoseconds / 1000000) + 1;
+      }
+    }
+
+    while (!context->stepDone)
+    {
+      if (context->cancelled && context->segment != &context->resumeSegment)
+      {
+        releaseHeldBytes(context);
+        context->failed   = true;
+        context->stepDone = true;
+        break;
+      }
+
+      if (context->resendPending)
+      {
+        if (mayPark && mach_absolute_time() < context->resendTime)
+        {
+          parkRequest(context);
+          return false;
+        }
+
+        retransmitByte(context, mayPark);
+        continue;
+      }
+
+      if (mayPark ? pollDataPort(context->deviceMode, &byte, &time) :
+                    waitDataPort(context->deviceMode, &byte, &time,
+                                 context->stepTimeout))
+      {
+        resolveReadStep(context, byte, time);
+      }
+      else if (_auxPortError)
+      {
+        errorReadStep(context);
+      }
+      else if (!mayPark || mach_absolute_time() >= context->deadline)
+      {
+        timeoutReadStep(context);
+      }
+      else
+      {
+        parkRequest(context);
+        return false;
+      }
+    }
+
+    context->stepStarted   = false;
+    context->stepDone      = false;
+    context->heldCount     = 0;
+    context->passedThrough = false;
+    context->resendPending = false;
+
+    if (context->failed && closeQuietWindow(context))  continue;
+
+    if (context->failed) break;
+
+    context->index++;
+  }
+
+  finishRequest(context);
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::closeQuietWindow(PS2RequestContext * context)
+{
+  //
+  // The request failed, was cancelled or ran out of time.  If it had stopped
+  // the mouse's stream for a quiet window, move on to the segment that
+  // restarts it, remembering where the request failed, for finishRequest.
+  // Returns false if there is nothing to restart: no quiet window, or its
+  // opening segment never got through.
+  //
+
+  if (!context->quietResume || context->segment == &context->suspendSegment)
+    return false;
+
+  context->quietFailed  = true;
+  context->failSegment  = context->segment;
+  context->failIndex    = context->index;
+  context->failed       = false;
+  context->quietResume  = false;
+  context->segment      = &context->resumeSegment;
+  context->index        = 0;
+  context->stepStarted  = false;
+  context->stepDone     = false;
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::resolveReadStep(PS2RequestContext * context,
+                                         UInt8               byte,
+                                         UInt64              time)
+{
+  //
+  // Apply a byte received from the input stream to the current read step.
+  //
+#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
+  //
+  // If the value that should be read from the (appropriate) input stream
+  // is not what is expected, we make these assumptions:
+  //
+  // (a) the data byte we did get was  "asynchronous" data being sent by
+  //     the device, which has not figured out that it has to respond to
+  //     the command we just sent to it.
+  // (b) that the real  "expected" response will be among the next few
+  //     bytes in the stream;  so what we do is put aside what we read, up
+  //     to kReorderBufferSize bytes, until the expected value comes along;
+  //     then we dispatch the bytes put aside to the driver's interrupt
+  //     handler, in order, and accept the expected byte.  The caller will
+  //     have never known that asynchronous data arrived at a very bad time.
+  // (c) that the real "expected" response will arrive before the step
+  //     times out.
+  //
+  // Where the driver described its packets with setPacketFraming, a byte
+  // that can only be the rest of a packet already under way goes straight
+  // to the driver instead, and a plain kPS2C_ReadDataPort step, which has no
+  // expected value to go by, is protected the same way until the device has
+  // acknowledged a command (after which it sends nothing unasked).
+  //
+#endif
+
+  PS2Command * command = &context->segment->commands[context->index];
+  unsigned     channel = inputChannel(context->deviceMode, context->auxPort);
+  UInt8        expectedByte;
+
+  if (command->command == kPS2C_ReadDataPort)
+  {
+#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
+    if (!context->streamQuiet && framingContinues(channel))
+    {
+      // (a packet's worth of bytes let through is still one correction)
+      dispatchDriverInterrupt(context->deviceMode, byte, time);
+      if (!context->passedThrough)
+        countEvent(context->deviceMode, kEC_SecondChance);
+      context->passedThrough = true;
+      return;
+    }
+#endif
+    recordResponse(context->deviceMode, context->stepStartTime, time);
+    command->inOrOut  = byte;
+    context->stepDone = true;
+    return;
+  }
+
+  expectedByte = (command->command == kPS2C_SendMouseCommandAndCompareAck) ?
+                 kSC_Acknowledge : command->inOrOut;
+
+#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
+  if (byte != expectedByte && framingContinues(channel))
+  {
+    //
+    // The byte belongs to a packet the device had under way; the driver
+    // gets it right now.  Packet bytes take any value, kSC_Resend and
+    // kSC_Error included.
+    //
+
+    dispatchDriverInterrupt(context->deviceMode, byte, time);
+    return;
+  }
+#endif
+
+  //
+  // A device asks for the byte it was just sent again with kSC_Resend, or
+  // with kSC_Error once it is unhappy with it.  Where an acknowledge was
+  // expected, and no packet is being assembled, send the byte again after a
+  // pause that doubles every time, and only take the answer as a failure
+  // when we are out of retries.
+  //
+
+  if ( (byte == kSC_Resend || byte == kSC_Error) &&
+       expectedByte == kSC_Acknowledge           &&
+       context->resendValid                      &&
+       context->resendCount < kRequestResendLimit )
+  {
+    releaseHeldBytes(context);        // (then they were asynchronous data)
+
+    recordResponse(context->deviceMode, context->stepStartTime, time);
+
+    clock_interval_to_deadline(kRequestResendBackoff << context->resendCount,
+                               kMicrosecondScale, &context->resendTime);
+    context->resendCount++;
+    context->resendPending = true;
+    return;
+  }
+
+#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
+  if (byte == expectedByte)
+  {
+    recordResponse(context->deviceMode, context->stepStartTime, time);
+
+    //
+    // If bytes were put aside, our assumption was correct.  Dispatch them
+    // to the interrupt handler, where they were meant to go.
+    //
+
+    if (context->heldCount)
+    {
+      releaseHeldBytes(context);
+      countEvent(context->deviceMode, kEC_SecondChance);
+    }
+
+    //
+    // A device that acknowledged a command has dropped whatever packet it
+    // was sending, and stays quiet until the request is through with it.
+    //
+
+    if (expectedByte == kSC_Acknowledge)
+    {
+      context->streamQuiet = true;
+      _framing[channel].position = 0;
+    }
+  }
+  else if ((byte == kSC_Resend || byte == kSC_Error) &&
+           expectedByte == kSC_Acknowledge)
+  {
+    //
+    // The device refused the byte once too often (or it cannot be sent
+    // again).  That is the answer; the refusal is not stream data, so it is
+    // neither put aside nor handed to the driver.
+    //
+
+    releaseHeldBytes(context);
+    countEvent(context->deviceMode, kEC_CompareFailed);
+    context->failed = true;
+  }
+  else if (context->heldCount < kReorderBufferSize)
+  {
+    //
+    // The byte does not match the byte we are expecting.  Put it aside
+    // for the moment.
+    //
+
+    context->held[context->heldCount]     = byte;
+    context->heldTime[context->heldCount] = time;
+    context->heldCount++;
+    return;
+  }
+  else
+  {
+    //
+    // More bytes mismatched than any packet is long; this is the answer.
+    // The bytes put aside go to the driver after all.  No error logged.
+    //
+
+    releaseHeldBytes(context);
+    dispatchDriverInterrupt(context->deviceMode, byte, time);
+    countEvent(context->deviceMode, kEC_CompareFailed);
+    context->failed = true;
+  }
+#else
+  context->failed = (byte != expectedByte);
+  if (context->failed)  countEvent(context->deviceMode, kEC_CompareFailed);
+  else  recordResponse(context->deviceMode, context->stepStartTime, time);
+#endif
+
+  context->stepDone = true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::timeoutReadStep(PS2RequestContext * context)
+{
+  //
+  // No byte arrived for the current read step in time.  If we were holding
+  // mismatched bytes for a second chance, that is our answer and the step
+  // fails quietly, handing them to the driver; otherwise something went
+  // awfully wrong.
+  //
+
+  PS2Command * command = &context->segment->commands[context->index];
+
+  if (context->requestDeadline &&
+      context->segment != &context->resumeSegment &&
+      mach_absolute_time() >= context->requestDeadline)
+  {
+    //
+    // It is the request that ran out of time, not necessarily the device.
+    //
+
+    releaseHeldBytes(context);
+    context->expired  = true;
+    context->failed   = true;
+    context->stepDone = true;
+    return;
+  }
+
+  if (context->heldCount)
+  {
+    releaseHeldBytes(context);
+    countEvent(context->deviceMode, kEC_CompareFailed);
+  }
+  else if (!_suppressTimeout)
+  {
+    IOLog("%s: Timed out on %s input stream.\n", getName(),
+          (context->deviceMode == kDT_Keyboard) ? "keyboard" : "mouse");
+    countEvent(context->deviceMode, kEC_Timeout);
+    recordResponseTimeout(context->deviceMode, context->stepTimeout);
+  }
+
+  if (command->command == kPS2C_ReadDataPort)
+    command->inOrOut = 0;
+  else
+    context->failed  = true;
+
+  context->stepDone = true;
+}
+
+void ApplePS2Controller::errorReadStep(PS2RequestContext * context)
+{
+  //
+  // The aux port the current read step waits on answered with an error code:
+  // there is nothing (working) behind it, so no answer is coming.  The step
+  // fails right away, whatever its kind.
+  //
+
+  releaseHeldBytes(context);
+  _auxPortError     = false;
+  context->failed   = true;
+  context->stepDone = true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::releaseHeldBytes(PS2RequestContext * context)
+{
+  //
+  // Hand the bytes put aside during the current read step to the driver,
+  // in the order they arrived.  They all came from the request's aux port.
+  //
+
+  UInt8 inputAuxPort = _inputAuxPort;
+
+  _inputAuxPort = context->auxPort;
+  for (unsigned i = 0; i < context->heldCount; i++)
+    dispatchDriverInterrupt(context->deviceMode, context->held[i],
+                            context->heldTime[i]);
+  _inputAuxPort = inputAuxPort;
+
+  context->heldCount = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::trackFraming(unsigned channel, UInt8 data)
+{
+  //
+  // Follow the packets the driver is handed, the way the driver itself does:
+  // a packet starts with a byte that carries the sync bits (an acknowledge
+  // never does), and ends packetLength bytes later.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  PS2PacketFraming * framing = &_framing[channel];
+
+  if (framing->length == 0)  return;
+
+  if (framing->position == 0 &&
+      (data == kSC_Acknowledge ||
+       (data & framing->syncMask) != framing->syncValue))
+    return;
+
+  if (++framing->position == framing->length)  framing->position = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::framingContinues(unsigned channel)
+{
+  //
+  // Returns true if the next byte on the given input channel can only be the
+  // rest of a packet the driver has the start of.
+  //
+
+  return (_framing[channel].length && _framing[channel].position);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::retransmitByte(PS2RequestContext * context,
+                                        bool                mayPark)
+{
+  //
+  // Send the last byte written to the device again, once its pause is over.
+  // When we may not park, we sit out what is left of the pause here.  The
+  // answer gets a full timeout of its own.
+  //
+
+  UInt32 pause = microsecondsUntil(context->resendTime, mach_absolute_time());
+
+  if (!mayPark && pause)  portDelay(pause + 1);
+
+  if (context->resendToMouse)  writeCommandPort(kCP_TransmitToMouse);
+  writeDataPort(context->resendByte);
+
+  context->resendPending = false;
+  context->stepStartTime = mach_absolute_time();
+  clock_interval_to_deadline(context->stepTimeout, kMillisecondScale,
+                             &context->deadline);
+
+  countEvent(context->deviceMode, kEC_Resend);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::parkRequest(PS2RequestContext * context)
+{
+  //
+  // Leave the request waiting for its next byte.  If the interrupt for that
+  // input stream is live, it will bring the byte and the timer only guards
+  // the deadline; otherwise the timer polls the port at a modest rate.  A
+  // request waiting to send a byte again is woken when it is time.  A time
+  // that has already passed wakes it right away.
+  //
+
+  UInt64 now = mach_absolute_time();
+
+  context->parked = true;
+
+  if (context->resendPending)
+  {
+    _requestTimer->setTimeoutUS(microsecondsUntil(context->resendTime, now) + 1);
+  }
+  else if (interruptLive(context->deviceMode))
+  {
+    _requestTimer->setTimeoutUS(microsecondsUntil(context->deadline, now) + 1);
+  }
+  else
+  {
+    _requestTimer->setTimeoutUS(kRequestPollInterval);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::resumeRequest()
+{
+  //
+  // Continue the parked request, if any.  Once it completes, carry on with
+  // the requests that queued up behind it.
+  //
+
+  if (_requestContext.request == 0 || _requestContext.parked == false)  return;
+
+  _requestTimer->cancelTimeout();
+  _requestContext.parked = false;
+
+  if (runRequest(&_requestContext, true))
+    drainRequestQueue(true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::requestTimerFired(OSObject *, IOTimerEventSource *)
+{                                                    // IOTimerEventSource::Action
+  //
+  // Poll for the parked request's byte, or time it out.  runRequest does
+  // both, as it looks at the port before it checks the deadline.
+  //
+  // A byte already waiting for a request whose interrupt is live means that
+  // interrupt did not bring it; watch for interrupts again, in case they
+  // have stopped arriving.
+  //
+
+  if (_requestContext.request && _requestContext.parked &&
+      _requestContext.resendPending == false &&
+      _pollWatching == false && _hardwareOffline == false &&
+      interruptLive(_requestContext.deviceMode) &&
+      (inPort(kCommandPort) & kOutputReady))
+  {
+    _pollWatching = true;
+    armPollTimer();
+  }
+
+  resumeRequest();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::finishRequest(PS2RequestContext * context)
+{
+  PS2Request * request = context->request;
+
+  // The outcome of a quiet window's closing segment is not the request's;
+  // report the request's own.
+
+  if (context->segment == &context->resumeSegment)
+  {
+    context->failed  = context->quietFailed;
+    context->segment = context->failSegment;
+    context->index   = context->failIndex;
+  }
+
+  // If a command failed and stopped the request processing, store its
+  // index into the commandsCount field of its segment, and mark all the
+  // segments after it as not run.
+
+  if (context->failed)
+  {
+    PS2Request * segment = context->segment;
+
+    segment->commandsCount = context->index;
+    while ((segment = segment->nextSegment))
+      segment->commandsCount = 0;
+  }
+
+  if (context->cancelled)  request->flags |= kRF_Cancelled;
+  if (context->expired)    request->flags |= kRF_Expired;
+
+  // Deliver any input held for the drivers first, so that the keyboard
+  // driver sees it in the order it arrived with respect to the completion.
+  // (The mouse driver's is only handed over, as it runs on its own loop.)
+
+  releaseHeldBytes(context);
+  flushDriverInterrupts();
+
+  // Release the context before the completion routine has a chance to
+  // submit another request.
+
+  context->request = 0;
+  context->parked  = false;
+
+  recordRequestLatency(context, kRL_Completed, mach_absolute_time());
+
+  // Invoke the completion routine, if one was supplied.
+
+  if (request->completionTarget && request->completionAction)
+  {
+    (*request->completionAction)(request->completionTarget,
+                                 request->completionParam);
+  }
+  else
+  {
+    freeRequest(request);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::processRequestQueue(IOInterruptEventSource *, int)
+{
+  drainRequestQueue(true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::drainRequestQueue(bool mayPark)
+{
+  //
+  // Process queued (async) requests, most urgent first.  Requests are atomic
+  // with respect to each other, so nothing is started while one is parked.
+  //
+
+  while (_requestContext.request == 0)
+  {
+    UInt64        submitTime;
+    PS2DeviceType deviceType;
+    UInt8         auxPort;
+    PS2Request *  request = dequeueRequest(&submitTime, &deviceType, &auxPort);
+
+    if (request == 0)  break;
+
+    startRequest(request, deviceType, auxPort, submitTime, mayPark);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::flushRequestQueue()
+{
+  //
+  // Run the parked request and all queued requests to completion, without
+  // parking, so that the caller may touch the controller next.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  if (_requestContext.parked)
+  {
+    _requestTimer->cancelTimeout();
+    _requestContext.parked = false;
+    runRequest(&_requestContext, false);
+  }
+
+  drainRequestQueue(false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::enqueueRequest(PS2Request *  request,
+                                        PS2DeviceType deviceType,
+                                        UInt8         auxPort)
+{
+  //
+  // Claim the next position in the request ring and publish the request
+  // into its slot.  Any number of threads may do this at once; a position
+  // is claimed by advancing _requestRingHead past it.  Returns false if the
+  // ring is full, or requests are waiting on the overflow list.
+  //
+
+  UInt32           position = _requestRingHead;
+  PS2RequestSlot * slot;
+
+  if (_requestOverflowCount)  return false;
+
+  for (;;)
+  {
+    slot = &_requestRing[position & (kRequestRingSize - 1)];
+
+    SInt32 lag = (SInt32)(slot->sequence - position);
+
+    if (lag == 0)
+    {
+      if (OSCompareAndSwap(position, position + 1, &_requestRingHead))
+        break;
+    }
+    else if (lag < 0)
+    {
+      return false;      // slot still holds a request from the last lap
+    }
+
+    position = _requestRingHead;
+  }
+
+  slot->request    = request;
+  slot->deviceType = deviceType;
+  slot->auxPort    = auxPort;
+  slot->submitTime = mach_absolute_time();
+  OSMemoryBarrier();
+  slot->sequence = position + 1;
+
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::overflowRequest(PS2Request *  request,
+                                         PS2DeviceType deviceType,
+                                         UInt8         auxPort)
+{
+  //
+  // Put a request that found no room in the ring on the overflow list.
+  //
+
+  PS2OverflowRequest * entry;
+
+  entry = (PS2OverflowRequest *) IOMalloc(sizeof(PS2OverflowRequest));
+  entry->next            = 0;
+  entry->slot.request    = request;
+  entry->slot.deviceType = deviceType;
+  entry->slot.auxPort    = auxPort;
+  entry->slot.submitTime = mach_absolute_time();
+
+  IOSimpleLockLock(_requestOverflowLock);
+  if (_requestOverflowTail)
+    _requestOverflowTail->next = entry;
+  else
+    _requestOverflowHead = entry;
+  _requestOverflowTail = entry;
+  _requestOverflowCount++;
+  IOSimpleLockUnlock(_requestOverflowLock);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::pullRequestRing()
+{
+  //
+  // Move the published requests off the request ring and onto the queues of
+  // their priority class and device, as long as there are queue entries to
+  // spare.  A producer that has claimed a position but not yet published it
+  // holds up the ring until it does; it is never more than a few
+  // instructions.  Once the ring is empty, the overflow list is next.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  while (_requestEntriesFree)
+  {
+    UInt32               position = _requestRingTail;
+    PS2RequestSlot *     slot = &_requestRing[position & (kRequestRingSize - 1)];
+    PS2OverflowRequest * overflow = 0;
+    PS2QueuedRequest *   entry;
+    unsigned             priority;
+    unsigned             device;
+
+    if (slot->sequence == position + 1)
+    {
+      OSMemoryBarrier();
+    }
+    else if (_requestOverflowCount && position == _requestRingHead)
+    {
+      IOSimpleLockLock(_requestOverflowLock);
+      overflow             = _requestOverflowHead;
+      _requestOverflowHead = overflow->next;
+      if (_requestOverflowHead == 0)  _requestOverflowTail = 0;
+      _requestOverflowCount--;
+      IOSimpleLockUnlock(_requestOverflowLock);
+
+      slot = &overflow->slot;
+      _requestOverflowTotal++;
+      publishRequestPoolStatistics();
+    }
+    else
+    {
+      break;
+    }
+
+    entry               = _requestEntriesFree;
+    _requestEntriesFree = entry->next;
+    entry->next         = 0;
+    entry->request      = slot->request;
+    entry->auxPort      = slot->auxPort;
+    entry->submitTime   = slot->submitTime;
+    device              = (slot->deviceType == kDT_Mouse) ? kDT_Mouse :
+                                                            kDT_Keyboard;
+
+    if (overflow)
+    {
+      IOFree(overflow, sizeof(PS2OverflowRequest));
+    }
+    else
+    {
+      slot->request = 0;
+      OSMemoryBarrier();
+      slot->sequence = position + kRequestRingSize;
+
+      _requestRingTail = position + 1;
+    }
+
+    priority = entry->request->priority;
+    if (priority >= kRequestPriorities)  priority = kRP_Normal;
+
+    if (_requestQueueTail[priority][device])
+      _requestQueueTail[priority][device]->next = entry;
+    else
+      _requestQueueHead[priority][device] = entry;
+    _requestQueueTail[priority][device] = entry;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+PS2Request * ApplePS2Controller::dequeueRequest(UInt64 *        submitTime,
+                                                PS2DeviceType * deviceType,
+                                                UInt8 *         auxPort)
+{
+  //
+  // Take the next request to run off the queues, if any: the oldest one of
+  // the most urgent class that has any, unless a less urgent class has been
+  // passed over too often, in which case that class goes first.  Within a
+  // class the devices take turns.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  PS2QueuedRequest * entry;
+  PS2Request *       request;
+  int                chosen = -1;
+  unsigned           device;
+
+  pullRequestRing();
+
+  for (int priority = kRequestPriorities - 1; priority >= 0; priority--)
+  {
+    if (_requestQueueHead[priority][kDT_Keyboard] == 0 &&
+        _requestQueueHead[priority][kDT_Mouse]    == 0)  continue;
+
+    if (chosen < 0 || _requestPassedOver[priority] >= kRequestStarvationLimit)
+      chosen = priority;
+  }
+
+  if (chosen < 0)  return 0;
+
+  for (int priority = 0; priority < kRequestPriorities; priority++)
+  {
+    if (priority == chosen)
+      _requestPassedOver[priority] = 0;
+    else if (_requestQueueHead[priority][kDT_Keyboard] ||
+             _requestQueueHead[priority][kDT_Mouse])
+      _requestPassedOver[priority]++;
+  }
+
+  device = _requestLastDevice[chosen] ^ 1;
+  if (_requestQueueHead[chosen][device] == 0)  device ^= 1;
+  _requestLastDevice[chosen] = device;
+
+  entry = _requestQueueHead[chosen][device];
+  _requestQueueHead[chosen][device] = entry->next;
+  if (entry->next == 0)  _requestQueueTail[chosen][device] = 0;
+
+  request     = entry->request;
+  *submitTime = entry->submitTime;
+  *deviceType = (PS2DeviceType) device;
+  *auxPort    = entry->auxPort;
+
+  entry->request      = 0;
+  entry->next         = _requestEntriesFree;
+  _requestEntriesFree = entry;
+
+  return request;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::cancelRequests(PS2DeviceType deviceType,
+                                        UInt8         auxPort)
+{
+  //
+  // Abort every request the given device (on the given aux port, for the
+  // mouse) has submitted so far, queued or under way.  Returns once they
+  // have all completed.
+  //
+
+  if (_workLoop->inGate())
+    cancelRequestsAction(this, (void *)(uintptr_t) deviceType,
+                         (void *)(uintptr_t) auxPort, 0, 0);
+  else
+    _workLoop->runAction(cancelRequestsAction, this,
+                         (void *)(uintptr_t) deviceType,
+                         (void *)(uintptr_t) auxPort);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::cancelRequestsAction(OSObject * target,
+                                                  void * arg0, void * arg1,
+                                                  void * arg2, void * arg3)
+{
+  ApplePS2Controller * me         = (ApplePS2Controller *) target;
+  unsigned             deviceType = (uintptr_t) arg0;
+  UInt8                auxPort    = (deviceType == kDT_Mouse) ?
+                                    (uintptr_t) arg1 : 0;
+  PS2QueuedRequest *   cancelled  = 0;
+  PS2QueuedRequest **  cancelledTail = &cancelled;
+  PS2QueuedRequest *   entry;
+
+  //
+  // Take the device's queued requests off the queues first, so that a
+  // completion routine that submits again is not cancelled in turn.  The
+  // mouse queues are shared by all aux ports; only the given port's
+  // requests are taken.
+  //
+
+  me->pullRequestRing();
+
+  for (unsigned priority = 0; priority < kRequestPriorities; priority++)
+  {
+    PS2QueuedRequest ** link = &me->_requestQueueHead[priority][deviceType];
+
+    me->_requestQueueTail[priority][deviceType] = 0;
+
+    while ((entry = *link))
+    {
+      if (entry->auxPort == auxPort)
+      {
+        *link          = entry->next;
+        entry->next    = 0;
+        *cancelledTail = entry;
+        cancelledTail  = &entry->next;
+      }
+      else
+      {
+        me->_requestQueueTail[priority][deviceType] = entry;
+        link = &entry->next;
+      }
+    }
+  }
+
+  //
+  // The request under way stops at the step it has reached: right away if
+  // it is parked, else at its next step.  A parked one is run to completion
+  // here and now, without parking again, so that it is done when we return;
+  // the quiet window's closing segment only gets a short wait for its
+  // acknowledge, as the device may well be gone.
+  //
+
+  PS2RequestContext * context = &me->_requestContext;
+
+  if (context->request                 &&
+      context->deviceType == deviceType &&
+      context->auxPort    == auxPort)
+  {
+    context->cancelled = true;
+
+    if (context->parked)
+    {
+      me->_requestTimer->cancelTimeout();
+      context->parked = false;
+
+      if (context->stepTimeout > kResponseProbeTimeout)
+        context->stepTimeout = kResponseProbeTimeout;
+
+      me->runRequest(context, false);
+      me->drainRequestQueue(true);
+    }
+  }
+
+  while ((entry = cancelled))
+  {
+    PS2Request * request = entry->request;
+
+    cancelled               = entry->next;
+    entry->request          = 0;
+    entry->next             = me->_requestEntriesFree;
+    me->_requestEntriesFree = entry;
+
+    for (PS2Request * segment = request; segment; segment = segment->nextSegment)
+      segment->commandsCount = 0;
+    request->flags |= kRF_Cancelled;
+
+    if (request->completionTarget && request->completionAction)
+      (*request->completionAction)(request->completionTarget,
+                                   request->completionParam);
+    else
+      me->freeRequest(request);
+  }
+
+  //
+  // Requests of the other device may have waited behind the cancelled one.
+  //
+
+  me->drainRequestQueue(true);
+
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::routeInputByte(PS2DeviceType deviceType,
+                                        UInt8         data,
+                                        UInt64        time)
+{
+  //
+  // Hand a byte read off the input stream to the parked request, if it is
+  // waiting on that stream (and aux port), and otherwise to the driver.  A
+  // request pausing before it sends a byte again is not waiting on anything.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  if (_requestContext.parked && _requestContext.resendPending == false &&
+      _requestContext.deviceMode == deviceType &&
+      (deviceType == kDT_Keyboard || _requestContext.auxPort == _inputAuxPort))
+  {
+    resolveReadStep(&_requestContext, data, time);
+    resumeRequest();
+  }
+  else
+  {
+    dispatchDriverInterrupt(deviceType, data, time);
+  }
+}
+
+void ApplePS2Controller::muxErrorOccurred()
+{
+  //
+  // The aux port in _inputAuxPort answered with an error code.  If the parked
+  // request is waiting on that port, fail its read step now rather than let
+  // it time out.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  if (_requestContext.parked && _requestContext.deviceMode == kDT_Mouse &&
+      _requestContext.auxPort == _inputAuxPort)
+  {
+    errorReadStep(&_requestContext);
+    resumeRequest();
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt64 ApplePS2Controller::takeInterruptTime(PS2DeviceType deviceType,
+                                             UInt32        tag)
+{
+  //
+  // Returns the arrival time of the byte just read off the given input
+  // stream, as noted by the primary interrupt handler, and consumes it.  The
+  // tag is _dataPortReads as it stood when that byte was read.  A byte that
+  // raised no interrupt (its IRQ is masked, or it was read before the handler
+  // ran), or whose stamp was left over from a byte read elsewhere, such as a
+  // flush or an init-time poll, is stamped with the current time instead.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  UInt64 stamp = _interruptTime[deviceType];
+  UInt64 now   = mach_absolute_time();
+  UInt64 time;
+
+  if (stamp == 0 || (stamp & kInterruptTagMask) != (tag & kInterruptTagMask))
+    return now;
+
+  // (a stamp the handler has meanwhile noted for the next byte stays put)
+  OSCompareAndSwap64(stamp, 0, &_interruptTime[deviceType]);
+
+  time = stamp & ~kInterruptTagMask;
+  recordLatency(deviceType, kLS_Interrupt, time, now);
+
+  return time;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::recordLatency(PS2DeviceType   deviceType,
+                                       PS2LatencyStage stage,
+                                       UInt64          startTime,
+                                       UInt64          endTime)
+{
+  //
+  // Count a latency sample in its log2 bucket.  Publishing the histograms is
+  // left to the statistics timer, so this costs a conversion and an increment.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  _latencyHistogram[deviceType][stage][latencyBucket(startTime, endTime)]++;
+  scheduleStatistics();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::recordRequestLatency(PS2RequestContext * context,
+                                              unsigned            stage,
+                                              UInt64              endTime)
+{
+  //
+  // Same as recordLatency, for the request latency histogram of the context's
+  // priority class.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  _requestLatencyHistogram[context->priority][stage]
+                          [latencyBucket(context->submitTime, endTime)]++;
+  scheduleStatistics();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::countEvent(PS2DeviceType   deviceType,
+                                    PS2EventCounter counter)
+{
+  //
+  // Count an error or recovery event.  Safe from any context; publishing the
+  // counters is left to the statistics timer.
+  //
+
+  OSIncrementAtomic(&_eventCounters[deviceType][counter]);
+  scheduleStatistics();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::scheduleStatistics()
+{
+  //
+  // Arm the statistics timer, unless a publication is already pending.  What
+  // is counted before the timer exists shows up with the first publication.
+  //
+
+  if (_statisticsTimer && OSCompareAndSwap(0, 1, &_statisticsPublishPending))
+    _statisticsTimer->setTimeoutMS(kStatisticsPublishInterval);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::statisticsTimerFired(OSObject *, IOTimerEventSource *)
+{
+  _statisticsPublishPending = 0;
+  OSMemoryBarrier();
+
+  publishLatency();
+  publishEventCounters();
+  publishPolling();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::publishLatency()
+{
+  //
+  // Reflect the latency histograms in the registry, as a dictionary keyed by
+  // device and then by stage, each stage an array of bucket counts.  The
+  // request latency histograms are published the same way, keyed by
+  // priority class.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  static const char * deviceNames[2] = { "Keyboard", "Mouse" };
+  static const char * stageNames[kLatencyStages] =
+    { "InterruptToWorkLoop", "FirstByteToPacket", "PacketToDispatch" };
+  static const char * priorityNames[kRequestPriorities] =
+    { "Normal", "Interactive" };
+  static const char * requestStageNames[kRequestLatencyStages] =
+    { "SubmitToStart", "SubmitToCompletion" };
+
+  OSDictionary * latency = OSDictionary::withCapacity(2);
+
+  if (latency == 0)  return;
+
+  for (unsigned device = 0; device < 2; device++)
+  {
+    OSDictionary * stages = OSDictionary::withCapacity(kLatencyStages);
+    if (stages == 0)  break;
+
+    for (unsigned stage = 0; stage < kLatencyStages; stage++)
+    {
+      OSArray * buckets = createLatencyArray(_latencyHistogram[device][stage]);
+      if (buckets == 0)  break;
+
+      stages->setObject(stageNames[stage], buckets);
+      buckets->release();
+    }
+
+    latency->setObject(deviceNames[device], stages);
+    stages->release();
+  }
+
+  setProperty(kLatencyPropertyKey, latency);
+  latency->release();
+
+  latency = OSDictionary::withCapacity(kRequestPriorities);
+
+  if (latency == 0)  return;
+
+  for (unsigned priority = 0; priority < kRequestPriorities; priority++)
+  {
+    OSDictionary * stages = OSDictionary::withCapacity(kRequestLatencyStages);
+    if (stages == 0)  break;
+
+    for (unsigned stage = 0; stage < kRequestLatencyStages; stage++)
+    {
+      OSArray * buckets =
+        createLatencyArray(_requestLatencyHistogram[priority][stage]);
+      if (buckets == 0)  break;
+
+      stages->setObject(requestStageNames[stage], buckets);
+      buckets->release();
+    }
+
+    latency->setObject(priorityNames[priority], stages);
+    stages->release();
+  }
+
+  setProperty(kRequestLatencyPropertyKey, latency);
+  latency->release();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::publishEventCounters()
+{
+  //
+  // Reflect the error and recovery counters in the registry, as a dictionary
+  // keyed by device and then by event.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  static const char * deviceNames[2] = { "Keyboard", "Mouse" };
+  static const char * counterNames[kEventCounters] =
+    { "Timeouts", "SecondChanceCorrections", "CompareFailures",
+      "Resyncs", "OfflineDrops", "DeliveryOverruns", "Resends",
+      "Stalls", "Recoveries" };
+
+  OSDictionary * statistics = OSDictionary::withCapacity(2);
+
+  if (statistics == 0)  return;
+
+  for (unsigned device = 0; device < 2; device++)
+  {
+    OSDictionary * counters = OSDictionary::withCapacity(kEventCounters);
+    if (counters == 0)  break;
+
+    for (unsigned counter = 0; counter < kEventCounters; counter++)
+    {
+      OSNumber * count =
+        OSNumber::withNumber((UInt32) _eventCounters[device][counter], 32);
+      if (count == 0)  break;
+      counters->setObject(counterNames[counter], count);
+      count->release();
+    }
+
+    // Stall to recovered, on average and at most, in microseconds.
+
+    UInt32   recoveries = _eventCounters[device][kEC_Recovery];
+    UInt64   nanoseconds;
+    OSNumber * latency;
+
+    absolutetime_to_nanoseconds(recoveries ?
+                                _recoveryTotal[device] / recoveries : 0,
+                                &nanoseconds);
+    latency = OSNumber::withNumber((UInt32) (nanoseconds / 1000), 32);
+    if (latency)
+    {
+      counters->setObject("RecoveryLatencyAverage", latency);
+      latency->release();
+    }
+
+    absolutetime_to_nanoseconds(_recoveryMaximum[device], &nanoseconds);
+    latency = OSNumber::withNumber((UInt32) (nanoseconds / 1000), 32);
+    if (latency)
+    {
+      counters->setObject("RecoveryLatencyMaximum", latency);
+      latency->release();
+    }
+
+    statistics->setObject(deviceNames[device], counters);
+    counters->release();
+  }
+
+  setProperty(kStatisticsPropertyKey, statistics);
+  statistics->release();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::resetLatencyAction(OSObject * target,
+                                                void *, void *,
+                                                void *, void *)
+{
+  ApplePS2Controller * controller = (ApplePS2Controller *) target;
+
+  bzero(controller->_latencyHistogram, sizeof(controller->_latencyHistogram));
+  bzero(controller->_requestLatencyHistogram,
+        sizeof(controller->_requestLatencyHistogram));
+  controller->publishLatency();
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::setProperties(OSObject * properties)
+{
+  //
+  // Setting kLatencyResetKey (to any value) clears the latency histograms.
+  //
+
+  OSDictionary * dictionary = OSDynamicCast(OSDictionary, properties);
+
+  if (dictionary == 0)  return super::setProperties(properties);
+
+  if (dictionary->getObject(kLatencyResetKey))
+    return _workLoop->runAction(resetLatencyAction, this);
+
+  return super::setProperties(properties);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::newUserClient(task_t          owningTask,
+                                           void *          securityID,
+                                           UInt32          type,
+                                           OSDictionary *  properties,
+                                           IOUserClient ** handler)
+{
+#if FLIGHT_RECORDER_SUPPORT
+  //
+  // A kTraceUserClientType connection copies out the flight recorder; the
+  // user client refuses anyone but an administrator.
+  //
+
+  if (type == kTraceUserClientType)
+  {
+    ApplePS2TraceUserClient * client = new ApplePS2TraceUserClient;
+
+    if (client == 0)  return kIOReturnNoMemory;
+
+    if (!client->initWithTask(owningTask, securityID, type, properties))
+    {
+      client->release();
+      return kIOReturnNotPrivileged;
+    }
+
+    if (!client->attach(this))
+    {
+      client->release();
+      return kIOReturnError;
+    }
+
+    if (!client->start(this))
+    {
+      client->detach(this);
+      client->release();
+      return kIOReturnError;
+    }
+
+    *handler = client;
+    return kIOReturnSuccess;
+  }
+#endif
+
+  return super::newUserClient(owningTask, securityID, type, properties,
+                              handler);
+}
+
+#if FLIGHT_RECORDER_SUPPORT
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSData * ApplePS2Controller::copyTrace()
+{
+  //
+  // Return a capture of the flight recorder, which the caller releases.  The
+  // ring keeps recording while we copy it out: a record that was overwritten
+  // meanwhile restarts the capture after it, and one still being filled in
+  // ends it, so a capture is always a run of consecutive records.
+  //
+  // This method may be called from any thread.
+  //
+
+  PS2TraceHeader * header;
+  PS2TraceRecord * records;
+  PS2TraceRecord * record;
+  OSData *         trace;
+  UInt32           head = (UInt32) _traceHead;
+  UInt32           sequence;
+  UInt32           size = sizeof(PS2TraceHeader) +
+                          kTraceRingSize * sizeof(PS2TraceRecord);
+
+  header = (PS2TraceHeader *) IOMalloc(size);
+  if (header == 0)  return 0;
+  records = (PS2TraceRecord *) (header + 1);
+
+  header->magic         = kTraceMagic;
+  header->version       = kTraceVersion;
+  header->recordSize    = sizeof(PS2TraceRecord);
+  header->recordCount   = 0;
+  header->firstSequence = (head > kTraceRingSize) ? head-kTraceRingSize+1 : 1;
+  nanoseconds_to_absolutetime(1000000000ULL, &header->ticksPerSecond);
+
+  for (sequence = header->firstSequence; sequence <= head; sequence++)
+  {
+    PS2TraceRecord * slot = &_traceRing[(sequence - 1) & (kTraceRingSize-1)];
+
+    record           = &records[header->recordCount];
+    record->sequence = slot->sequence;
+    OSMemoryBarrier();
+    record->time     = slot->time;
+    record->flags    = slot->flags;
+    record->data     = slot->data;
+    record->reserved = 0;
+    OSMemoryBarrier();
+
+    if (record->sequence != sequence || slot->sequence != sequence)
+    {
+      if (record->sequence == 0 || record->sequence < sequence)  break;
+
+      // Overwritten by a newer record; start over after it.
+      header->firstSequence = sequence + 1;
+      header->recordCount   = 0;
+      continue;
+    }
+
+    header->recordCount++;
+  }
+
+  trace = OSData::withBytes(header, sizeof(PS2TraceHeader) +
+                            header->recordCount * sizeof(PS2TraceRecord));
+  IOFree(header, size);
+
+  return trace;
+}
+
+#endif //FLIGHT_RECORDER_SUPPORT
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::interruptLive(PS2DeviceType deviceType)
+{
+  //
+  // Tells whether a byte arriving on the given input stream will raise an
+  // interrupt that reaches interruptOccurred.  Never, once we are polling.
+  //
+
+  if (_polling)  return false;
+
+  if (deviceType == kDT_Mouse)
+    return _interruptInstalledMouse && (_commandByte & kCB_EnableMouseIRQ);
+  else
+    return _interruptInstalledKeyboard && (_commandByte & kCB_EnableKeyboardIRQ);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::armPollTimer()
+{
+  _pollWatchFull = false;
+  _pollLastTime  = mach_absolute_time();
+
+  if (_polling)
+    _pollTimer->setTimeoutUS(_pollInterval);
+  else if (_pollWatching)
+    _pollTimer->setTimeoutMS(kPollWatchInterval);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::startPolling()
+{
+  _polling      = true;
+  _pollWatching = false;
+  _pollInterval = kPollIntervalMin;
+  publishPolling();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::pollTimerFired(OSObject *, IOTimerEventSource *)
+{
+  //
+  // Until we poll, look for a byte left in the output buffer by an interrupt
+  // that never came.  Once we poll, hand any byte found to interruptOccurred
+  // as if its interrupt had fired, and adapt the interval to the traffic.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  UInt64        now = mach_absolute_time();
+  UInt8         status;
+  PS2DeviceType deviceType;
+
+  if (_hardwareOffline)  return;     // (rearmed on wake)
+  if (_polling == false && _pollWatching == false)  return;
+
+  status     = inPort(kCommandPort);
+  deviceType = (status & kMouseData) ? kDT_Mouse : kDT_Keyboard;
+
+  if (_polling == false)
+  {
+    if ((status & kOutputReady) && interruptLive(deviceType) && _pollWatchFull)
+    {
+      IOLog("%s: %s interrupt is not arriving, polling instead.\n",
+            getName(), (deviceType == kDT_Mouse) ? "Mouse" : "Keyboard");
+      startPolling();
+      armPollTimer();
+      return;
+    }
+
+    _pollWatchFull = (status & kOutputReady) && interruptLive(deviceType);
+    _pollTimer->setTimeoutMS(kPollWatchInterval);
+    return;
+  }
+
+  _pollCount++;
+
+  if (status & kOutputReady)
+  {
+    //
+    // The byte arrived some time since the previous poll; that gap bounds
+    // the wait polling cost it.
+    //
+
+    UInt64 gap = now - _pollLastTime;
+
+    _pollHits++;
+    _pollGapTotal += gap;
+    if (gap > _pollGapMaximum)  _pollGapMaximum = gap;
+
+    noteInterruptTime(deviceType, now);
+#if DEBUGGER_SUPPORT
+    // Keyboard bytes go through the primary handler's queue and escape
+    // check, and come back to us through the interrupt event source.
+    if (deviceType == kDT_Keyboard && _interruptSourceKeyboard)
+      interruptHandlerKeyboard(0, 0, 0, 0);
     else
+#endif
+    interruptOccurred((deviceType == kDT_Mouse) ? _interruptSourceMouse :
+                                                  _interruptSourceKeyboard, 0);
+
+    _pollInterval = kPollIntervalMin;
+    scheduleStatistics();
+  }
+  else if (_pollInterval < kPollIntervalMax)
+  {
+    _pollInterval *= 2;
+    if (_pollInterval > kPollIntervalMax)  _pollInterval = kPollIntervalMax;
+  }
+
+  _pollLastTime = now;
+  _pollTimer->setTimeoutUS(_pollInterval);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::publishPolling()
+{
+  //
+  // Reflect the polling state in the registry: whether we poll, the current
+  // interval, and the wait it costs a byte in microseconds, on average (half
+  // the gap before a poll that found one) and at most.
+  //
+
+  OSDictionary * polling = OSDictionary::withCapacity(6);
+  UInt64         nanoseconds;
+  UInt32         values[5];
+  static const char * valueNames[5] =
+    { "Interval", "Polls", "Hits", "LatencyAverage", "LatencyMaximum" };
+
+  if (polling == 0)  return;
+
+  values[0] = _polling ? _pollInterval : 0;
+  values[1] = _pollCount;
+  values[2] = _pollHits;
+  absolutetime_to_nanoseconds(_pollHits ? _pollGapTotal / _pollHits / 2 : 0,
+                              &nanoseconds);
+  values[3] = (UInt32) (nanoseconds / 1000);
+  absolutetime_to_nanoseconds(_pollGapMaximum, &nanoseconds);
+  values[4] = (UInt32) (nanoseconds / 1000);
+
+  polling->setObject("Active", _polling ? kOSBooleanTrue : kOSBooleanFalse);
+  for (unsigned index = 0; index < 5; index++)
+  {
+    OSNumber * value = OSNumber::withNumber(values[index], 32);
+    if (value == 0)  break;
+    polling->setObject(valueNames[index], value);
+    value->release();
+  }
+
+  setProperty(kPollingPropertyKey, polling);
+  polling->release();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::noteStall(unsigned channel, UInt64 since)
+{
+  //
+  // The port behind the given input channel stalled at the given time; have
+  // the watchdog recover it, unless we gave up on it already.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  if (_stallTime[channel] == 0)
+  {
+    _stallTime[channel] = since;
+    countEvent(channel ? kDT_Mouse : kDT_Keyboard, kEC_Stall);
+  }
+
+  if (_recoveryAttempts[channel] < kRecoveryAttempts && _watchdogTimer)
+  {
+    _watchdogArmed = true;
+    _watchdogTimer->setTimeoutMS(1);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::watchdogTimerFired(OSObject *, IOTimerEventSource *)
+{
+  //
+  // Take a device that has gone quiet partway through a packet as stalled,
+  // then recover whichever port has stalled.  Recovery waits for a parked
+  // request to finish, as it would otherwise cut into its command sequence.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  UInt64 now = mach_absolute_time();
+  UInt64 limit;
+  bool   rearm = false;
+
+  _watchdogArmed = false;
+
+  if (_hardwareOffline)  return;     // (stalls are forgotten on wake)
+
+  nanoseconds_to_absolutetime(kStallTimeout * 1000000ULL, &limit);
+
+  for (unsigned channel = 0; channel < kInputChannels; channel++)
+  {
+    PS2DeviceType deviceType = channel ? kDT_Mouse : kDT_Keyboard;
+
+    if (_stallTime[channel] || !framingContinues(channel))  continue;
+
+    if (now - _lastInputTime[channel] < limit)
+    {
+      rearm = true;
+      continue;
+    }
+
+    IOLog("%s: %s stopped partway through a packet, port stalled.\n",
+          getName(), (deviceType == kDT_Keyboard) ? "Keyboard" : "Mouse");
+    noteStall(channel, _lastInputTime[channel]);
+  }
+
+  for (unsigned channel = 0; channel < kInputChannels; channel++)
+  {
+    PS2DeviceType deviceType = channel ? kDT_Mouse : kDT_Keyboard;
+
+    if (_stallTime[channel] == 0 ||
+        _recoveryAttempts[channel] >= kRecoveryAttempts)  continue;
+
+    if (_requestContext.request)
+    {
+      rearm = true;
+      continue;
+    }
+
+    recoverPort(channel);
+  }
+
+  if (rearm)
+  {
+    _watchdogArmed = true;
+    _watchdogTimer->setTimeoutMS(kStallTimeout);
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::recoverPort(unsigned channel)
+{
+  //
+  // Recover the port behind one stalled input channel, leaving the others
+  // running.  Cycling the port's clock makes the device abandon whatever it
+  // was sending; what it left in the output buffer is dropped, while bytes
+  // from the other ports are passed on as usual.  A streaming mouse is then
+  // disabled and enabled again, so that its packets start over; that goes
+  // as a request of our own, which parks on its acknowledges like any other
+  // rather than hold the work loop, and reports back to recoveryDone.
+  //
+  // The aux clock is shared by every port of a multiplexing controller, so
+  // there the clock is left alone and only the stalled port is drained and
+  // restarted.
+  //
+  // This method should only be called from our single-threaded work loop,
+  // with no request under way.
+  //
+
+  bool          mouse      = (channel != 0);
+  UInt8         port       = mouse ? channel - 1 : 0;
+  bool          cycleClock = !(mouse && _muxActive);
+  PS2DeviceType deviceType = mouse ? kDT_Mouse : kDT_Keyboard;
+  UInt8         byte;
+  UInt64        time;
+  bool          recovered;
+
+  _outputAuxPort = port;                // (which aux bytes pollDataPort takes)
+
+  if (cycleClock)
+    writeCommandPort(mouse ? kCP_DisableMouseClock : kCP_DisableKeyboardClock);
+
+  for (unsigned count = 0; count < kReorderBufferSize * 2; count++)
+  {
+    if (!pollDataPort(deviceType, &byte, &time))  break;
+  }
+  _framing[channel].position = 0;
+
+  if (cycleClock)
+    writeCommandPort(mouse ? kCP_EnableMouseClock : kCP_EnableKeyboardClock);
+
+  recovered = waitInputBuffer(deviceType);  // (the controller took them)
+  _outputAuxPort = 0;
+
+  if (recovered && mouse && _mouseStreaming[port])
+  {
+    PS2Request * request = allocateRequest();
+
+    request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[0].inOrOut = kDP_SetDefaultsAndDisable;
+    request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[1].inOrOut = kDP_Enable;
+    request->commandsCount       = 2;
+    request->completionTarget    = this;
+    request->completionAction    = recoveryRequestDone;
+    request->completionParam     = (void *)(uintptr_t) channel;
+
+    _recoveryRequest = request;
+    startRequest(request, kDT_Mouse, port, mach_absolute_time(), true);
+    return;
+  }
+
+  recoveryDone(channel, recovered);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::recoveryRequestDone(void * target, void * param)
+{                                                      // PS2CompletionAction
+  ApplePS2Controller * me      = (ApplePS2Controller *) target;
+  unsigned             channel = (uintptr_t) param;
+  PS2Request *         request = me->_recoveryRequest;
+  bool                 recovered;
+
+  recovered = (request->commandsCount == 2);
+
+  me->_recoveryRequest = 0;
+  me->freeRequest(request);
+
+  if (recovered)
+    me->_framing[channel].position = 0;
+  else
+    me->_mouseStreaming[channel - 1] = true;  // (so that another attempt is made)
+
+  me->recoveryDone(channel, recovered);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::recoveryDone(unsigned channel, bool recovered)
+{
+  //
+  // Account for one attempt at recovering the port behind the given input
+  // channel.  A recovered mouse port's driver is told, so that it can set
+  // its device up again; the keyboard is only ever clocked, not reset, so
+  // its driver has nothing to do.  A failed attempt has the watchdog try
+  // again, until we give up on the port.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  PS2DeviceType deviceType = channel ? kDT_Mouse : kDT_Keyboard;
+
+  if (_stallTime[channel] == 0)  return;     // (forgotten on wake meanwhile)
+
+  if (recovered)
+  {
+    UInt64 latency = mach_absolute_time() - _stallTime[channel];
+
+    _recoveryTotal[deviceType] += latency;
+    if (latency > _recoveryMaximum[deviceType])
+      _recoveryMaximum[deviceType] = latency;
+    _stallTime[channel]        = 0;
+    _recoveryAttempts[channel] = 0;
+    countEvent(deviceType, kEC_Recovery);
+
+    if (channel)
+    {
+      OSBitOrAtomic(1 << channel, &_recoveryNotify);
+      thread_call_enter(_recoveryCall);
+    }
+  }
+  else if (++_recoveryAttempts[channel] < kRecoveryAttempts)
+  {
+    _watchdogArmed = true;
+    _watchdogTimer->setTimeoutMS(kStallTimeout);
+  }
+  else
+  {
+    IOLog("%s: Could not recover the %s port, giving up on it.\n",
+          getName(), (deviceType == kDT_Keyboard) ? "keyboard" : "mouse");
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::recoveryCallFired(thread_call_param_t param0,
+                                           thread_call_param_t)
+{
+  //
+  // Tell the driver of each aux port the watchdog recovered that its device
+  // was set back to its defaults, so that it can configure it again.  Runs
+  // outside both work loops, as dispatchDriverPowerControl must.
+  //
+
+  ApplePS2Controller * me       = (ApplePS2Controller *) param0;
+  UInt32               channels = OSBitAndAtomic(0, &me->_recoveryNotify);
+
+  for (unsigned channel = 1; channel < kInputChannels; channel++)
+  {
+    if ((channels & (1 << channel)) == 0)  continue;
+
+    me->_auxWorkLoop->runAction( powerControlAction, me,
+                                 (void *)(uintptr_t) kDT_Mouse,
+                                 (void *)(uintptr_t) kPS2C_ResetDevice,
+                                 (void *)(uintptr_t) (channel - 1) );
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::pollDataPort(PS2DeviceType deviceType,
+                                      UInt8 *       byte,
+                                      UInt64 *      time)
+{
+  //
+  // Returns the next byte on the requested input stream, and the time it
+  // arrived, if one is ready, without waiting.  Data that arrives for the other input stream in the
+  // meantime is delivered to the appropriate driver interrupt routine
+  // immediately (effectively, the request is "preempted" temporarily).
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  UInt8         readByte;
+  UInt64        readTime;
+  UInt32        readTag;
+  UInt8         status;
+  PS2DeviceType stream;
+
+  _auxPortError = false;
+
+  while (1)
+  {
+#if DEBUGGER_SUPPORT
+    int state;
+    lockController(&state);            // (lock out interrupt + access to queue)
+    if (deviceType == kDT_Keyboard && dequeueKeyboardData(byte, time))
+    {
+      unlockController(state);
+      return true;
+    }
+#endif //DEBUGGER_SUPPORT
+
+    if (!((status = inPort(kCommandPort)) & kOutputReady))
+    {
+#if DEBUGGER_SUPPORT
+      unlockController(state);  // (release interrupt lockout + access to queue)
+#endif //DEBUGGER_SUPPORT
+      return false;
+    }
+
+    //
+    // For older machines, it is necessary to wait a while after the controller
+    // has asserted the output buffer bit before reading the data port. No more
+    // data will be available if this wait is not performed.
+    //
+
+    portDelay(kDataDelay);
+
+    //
+    // Read in the data.  We return the data, however, only if it arrived on
+    // the requested input stream.
+    //
+
+    readByte = inPort(kDataPort);
+    readTag  = _dataPortReads - 1;
+    stream   = decodeStatus(status);
+    readTime = takeInterruptTime(stream, readTag);
+
+#if DEBUGGER_SUPPORT
+    unlockController(state);    // (release interrupt lockout + access to queue)
+#endif //DEBUGGER_SUPPORT
+
+    //
+    // An error code means nothing (working) is on that aux port; if it is
+    // the one we are reading from, there will be no answer.
+    //
+
+    if (muxError(status))
     {
-      if (deviceType == kDT_Keyboard)  return readByte;
+      if (deviceType == kDT_Mouse && _inputAuxPort == _outputAuxPort)
+      {
+        _auxPortError = true;
+        return false;
+      }
+      continue;
+    }
+
+    if ( _suppressTimeout ||            // startup mode w/o interrupts
+         (stream == deviceType &&
+          (stream == kDT_Keyboard || _inputAuxPort == _outputAuxPort)) )
+    {
+      *byte = readByte;
+      *time = readTime;
+      return true;
     }
 
     //
-    // The data we just received is for the other input stream, not the one
-    // that was requested, so dispatch other device's interrupt handler.
+    // The data we just received is for the other input stream (or another
+    // aux port), not the one that was requested, so dispatch that device's
+    // interrupt handler.
     //
 
-    dispatchDriverInterrupt((deviceType==kDT_Keyboard)?kDT_Mouse:kDT_Keyboard,
-                            readByte);
+    dispatchDriverInterrupt(stream, readByte, readTime);
   } // while (forever)
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
+bool ApplePS2Controller::waitDataPort(PS2DeviceType deviceType,
+                                      UInt8 *       byte,
+                                      UInt64 *      time,
+                                      UInt32        milliseconds)
+{
+  //
+  // Blocks until keyboard or mouse data is available from the controller
+  // and returns that data, as pollDataPort does.  There is a built-in
+  // timeout for this command of (timeoutCounter X kDataDelay) microseconds,
+  // approximately; false is returned if it expires.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  UInt32 timeoutCounter = milliseconds * 1000 / kDataDelay;
+
+  while (!pollDataPort(deviceType, byte, time))
+  {
+    if (_auxPortError || timeoutCounter-- == 0)  return false;
+    portDelay(kDataDelay);
+  }
 
-UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType,
-                                       UInt8         expectedByte)
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType)
 {
   //
   // Blocks until keyboard or mouse data is available from the controller
-  // and returns that data. Note, if mouse data is requested but keyboard
-  // data is what is available,  the data is delivered to the appropriate
-  // driver interrupt routine immediately (effectively, the request is
-  // "preempted" temporarily).
+  // and returns that data.  If we time out, something went awfully wrong;
+  // return a fake value.
+  //
+  // This method should only be called from our single-threaded work loop.
   //
-  // There is a built-in timeout for this command of (timeoutCounter X
-  // kDataDelay) microseconds, approximately. 
+
+  UInt8  readByte     = 0;
+  UInt64 readTime;
+  UInt64 startTime    = mach_absolute_time();
+  UInt32 milliseconds = responseTimeout(deviceType);
+
+  if (waitDataPort(deviceType, &readByte, &readTime, milliseconds))
+  {
+    if (!_suppressTimeout)  recordResponse(deviceType, startTime, readTime);
+  }
+  else if (!_suppressTimeout)
+  {
+    IOLog("%s: Timed out on %s input stream.\n", getName(),
+          (deviceType == kDT_Keyboard) ? "keyboard" : "mouse");
+    countEvent(deviceType, kEC_Timeout);
+    recordResponseTimeout(deviceType, milliseconds);
+  }
+
+  return readByte;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt32 ApplePS2Controller::responseTimeout(PS2DeviceType deviceType)
+{
+  //
+  // Returns how many milliseconds to wait for the answer to the byte last
+  // written, on the given input stream (for the mouse, from the aux port at
+  // hand).  Until there is a fair idea of how long the device takes, that is
+  // the full kRequestTimeout.
   //
   // This method should only be called from our single-threaded work loop.
   //
-  // This version of readDataPort does exactly the same as the original,
-  // except that if the value that should be read from the (appropriate)
-  // input stream is not what is expected, we make these assumptions:
+
+  unsigned           channel = inputChannel(deviceType, _outputAuxPort);
+  PS2ResponseTimer * timer   = &_responseTimers[channel][_responseKey];
+  UInt32             milliseconds;
+
+  if (_responseSilent[channel] >= kResponseSilentLimit)
+    return kResponseProbeTimeout;
+
+  if (timer->samples < kResponseSamplesMin)
+    return kRequestTimeout;
+
+  milliseconds = (timer->smoothed + 4 * timer->deviation + 999) / 1000;
+
+  if (milliseconds < kResponseTimeoutFloor)  milliseconds = kResponseTimeoutFloor;
+  if (milliseconds > kRequestTimeout)        milliseconds = kRequestTimeout;
+
+  return milliseconds;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::recordResponse(PS2DeviceType deviceType,
+                                        UInt64        startTime,
+                                        UInt64        time)
+{
+  //
+  // The device answered the byte last written, time - startTime after the
+  // read step began.  The estimate follows the answers the way TCP follows
+  // round trip times: gains of 1/8 for the mean and 1/4 for the deviation.
   //
-  // (a) the data byte we did get was  "asynchronous" data being sent by
-  //     the device, which has not figured out that it has to respond to
-  //     the command we just sent to it.
-  // (b) that the real  "expected" response will be the next byte in the
-  //     stream;   so what we do is put aside the first byte we read and
-  //     wait for the next byte; if it's the expected value, we dispatch
-  //     the first byte we read to the driver's interrupt handler,  then
-  //     return the expected byte. The caller will have never known that
-  //     asynchronous data arrived at a very bad time.
-  // (c) that the real "expected" response will arrive within (kDataDelay
-  //     X timeoutCounter) microseconds from the time the call is made.
-  //
-
-  UInt8  firstByte     = 0;
-  bool   firstByteHeld = false;
-  UInt8  readByte;
-  bool   requestedStream;
-  UInt8  status;
-  UInt32 timeoutCounter = 10000;    // (timeoutCounter * kDataDelay = 70 ms)
 
-  while (1)
+  unsigned           channel = inputChannel(deviceType, _outputAuxPort);
+  PS2ResponseTimer * timer   = &_responseTimers[channel][_responseKey];
+  UInt64             nanoseconds = 0;
+  SInt32             sample;
+  SInt32             error;
+
+  _responseSilent[channel] = 0;
+
+  if (time > startTime)
+    absolutetime_to_nanoseconds(time - startTime, &nanoseconds);
+
+  sample = (nanoseconds > kRequestTimeout * 1000000ULL) ?
+           kRequestTimeout * 1000 : (SInt32)(nanoseconds / 1000);
+
+  if (timer->samples == 0)
   {
-#if DEBUGGER_SUPPORT
-    int state;
-    lockController(&state);            // (lock out interrupt + access to queue)
-    if (deviceType == kDT_Keyboard && dequeueKeyboardData(&readByte))
+    timer->smoothed  = sample;
+    timer->deviation = sample / 2;
+  }
+  else
+  {
+    error = sample - (SInt32) timer->smoothed;
+    timer->smoothed  = (SInt32) timer->smoothed + error / 8;
+    if (error < 0)  error = -error;
+    timer->deviation = (SInt32) timer->deviation +
+                       (error - (SInt32) timer->deviation) / 4;
+  }
+
+  if (timer->samples < kResponseSamplesMin)  timer->samples++;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::recordResponseTimeout(PS2DeviceType deviceType,
+                                               UInt32        milliseconds)
+{
+  //
+  // No answer came within the given timeout.  If it was a calibrated one,
+  // the estimate was wrong; drop it so the next try gets the full timeout.
+  // After full timeouts, count towards taking the device as absent.
+  //
+
+  unsigned channel = inputChannel(deviceType, _outputAuxPort);
+
+  if (milliseconds < kRequestTimeout &&
+      _responseSilent[channel] < kResponseSilentLimit)
+  {
+    _responseTimers[channel][_responseKey].samples = 0;
+  }
+  else if (_responseSilent[channel] < kResponseSilentLimit)
+  {
+    _responseSilent[channel]++;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::waitInputBuffer(PS2DeviceType deviceType)
+{
+  //
+  // Block until room in the controller's input buffer is available, for a
+  // byte bound for the given port (for the mouse, the aux port at hand).  If
+  // none turns up within kInputBusyLimit, the port has stalled; false is
+  // returned and the byte should be dropped.  Once we have given up on
+  // recovering the port, we do not wait at all.
+  //
+  // This method should only be dispatched from our single-threaded work loop.
+  //
+
+  unsigned channel = inputChannel(deviceType, _outputAuxPort);
+  UInt32   waited  = 0;
+  UInt64   limit;
+
+  while (inPort(kCommandPort) & kInputBusy)
+  {
+    if (waited >= kInputBusyLimit ||
+        _recoveryAttempts[channel] >= kRecoveryAttempts)
     {
-      requestedStream = true;
-      goto skipForwardToY;
+      if (_stallTime[channel] == 0)
+      {
+        IOLog("%s: Controller input buffer stuck full, %s port stalled.\n",
+              getName(), (deviceType == kDT_Keyboard) ? "keyboard" : "mouse");
+      }
+      nanoseconds_to_absolutetime(waited * 1000ULL, &limit);
+      noteStall(channel, mach_absolute_time() - limit);
+      return false;
     }
-#endif //DEBUGGER_SUPPORT
+    portDelay(kDataDelay);
+    waited += kDataDelay;
+  }
+
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::writeDataPort(UInt8 byte)
+{
+  //
+  // Block until room in the controller's input buffer is available, then
+  // write the given byte to the Data Port.  Returns false if the byte was
+  // dropped, as the port stalled or the command port byte meant to route it
+  // was itself dropped; sent on its own, it would reach the wrong device.
+  //
+  // This method should only be dispatched from our single-threaded work loop.
+  //
+
+  if (_prefixDropped ||
+      !waitInputBuffer((_lastCommandPortByte == kCP_TransmitToMouse) ?
+                       kDT_Mouse : kDT_Keyboard))
+  {
+    _prefixDropped       = false;
+    _lastCommandPortByte = 0;
+    _responseParameter   = false;
+    return false;
+  }
+  outPort(kDataPort, byte);
+
+  // Keep track of whether the mouse is streaming; a reset or kDP_SetDefaults
+  // leaves it silent.
+
+  if (_lastCommandPortByte == kCP_TransmitToMouse)
+  {
+    if (byte == kDP_Enable)  _mouseStreaming[_outputAuxPort] = true;
+    else if (byte == kDP_SetDefaultsAndDisable || byte == kDP_SetDefaults ||
+             byte == kDP_Reset)  _mouseStreaming[_outputAuxPort] = false;
+  }
+
+  // Keep track of the command byte, whoever writes it.
+
+  // A byte for a device keys the timer its answer goes to, unless it is the
+  // parameter of the command before it, which opened the exchange.
+
+  if (_lastCommandPortByte == kCP_SetCommandByte)
+  {
+    _commandByte = byte;
+  }
+  else if (_responseParameter)
+  {
+    _responseParameter = false;
+  }
+  else
+  {
+    _responseKey       = byte;
+    _responseParameter = takesParameter(byte,
+                             _lastCommandPortByte == kCP_TransmitToMouse);
+  }
+  _lastCommandPortByte = 0;
+
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt8 ApplePS2Controller::readCommandByte()
+{
+  //
+  // Read the command byte back from the controller, and bring _commandByte
+  // in line with it.  Needed where the controller may have changed it behind
+  // our back: its self test, a mode switch, a sleep.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+  writeCommandPort(kCP_GetCommandByte);
+  _commandByte = readDataPort(kDT_Keyboard);
+
+  return _commandByte;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::writeCommandPort(UInt8 byte)
+{
+  //
+  // Block until room in the controller's input buffer is available, then
+  // write the given byte to the Command Port.
+  //
+  // In multiplexing mode kCP_TransmitToMouse goes out as the prefix for the
+  // aux port of the request at hand, _outputAuxPort.  It is still tracked as
+  // kCP_TransmitToMouse, so the data byte after it is handled as before.
+  //
+  // This method should only be dispatched from our single-threaded work loop.
+  //
 
-    //
-    // Wait for the controller's output buffer to become ready.
-    //
+  UInt8 portByte  = byte;
+  bool  mousePort = (byte == kCP_TransmitToMouse    ||
+                     byte == kCP_DisableMouseClock  ||
+                     byte == kCP_EnableMouseClock   ||
+                     byte == kCP_TestMousePort      ||
+                     byte == kCP_WriteMouseOutputBuffer ||
+                     (byte & ~(kMaxAuxPorts - 1)) == kCP_TransmitToMuxPortBase);
 
-    while (timeoutCounter && !((status = inb(kCommandPort)) & kOutputReady))
-    {
-      timeoutCounter--;
-      IODelay(kDataDelay);
-    }
+  if (byte == kCP_TransmitToMouse && _muxActive)
+    portByte = kCP_TransmitToMuxPortBase + _outputAuxPort;
 
-    //
-    // If we timed out, we return the first byte we read, unless THIS IS the
-    // first byte we are trying to read,  then something went awfully wrong
-    // and we return a fake value rather than lock up the controller longer.
-    //
+  if (!waitInputBuffer(mousePort ? kDT_Mouse : kDT_Keyboard))
+  {
+    // (the data byte meant to follow it must not go out on its own)
+    _prefixDropped       = true;
+    _lastCommandPortByte = byte;
+    return;
+  }
+  outPort(kCommandPort, portByte);
+  _prefixDropped = false;
 
-    if (timeoutCounter == 0)
-    {
-#if DEBUGGER_SUPPORT
-      unlockController(state);  // (release interrupt lockout + access to queue)
-#endif //DEBUGGER_SUPPORT
+  // Keep track of the command byte, as the clock commands change it too.
 
-      if (firstByteHeld)  return firstByte;
+  switch (byte)
+  {
+    case kCP_DisableKeyboardClock: _commandByte |=  kCB_DisableKeyboardClock; break;
+    case kCP_EnableKeyboardClock:  _commandByte &= ~kCB_DisableKeyboardClock; break;
+    case kCP_DisableMouseClock:    _commandByte |=  kCB_DisableMouseClock;    break;
+    case kCP_EnableMouseClock:     _commandByte &= ~kCB_DisableMouseClock;    break;
+  }
 
-      IOLog("%s: Timed out on %s input stream.\n", getName(),
-                          (deviceType == kDT_Keyboard) ? "keyboard" : "mouse");
-      return 0;
-    }
+  _lastCommandPortByte = byte;
+  if (byte != kCP_TransmitToMouse)
+  {
+    _responseKey       = kResponseTimerController;
+    _responseParameter = false;
+  }
+}
 
-    //
-    // For older machines, it is necessary to wait a while after the controller
-    // has asserted the output buffer bit before reading the data port. No more
-    // data will be available if this wait is not performed.
-    //
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-    IODelay(kDataDelay);
+bool ApplePS2Controller::takesParameter(UInt8 byte, bool mouse)
+{
+  //
+  // Returns true if the given device command is followed by a parameter byte.
+  //
 
-    //
-    // Read in the data.  We process the data, however, only if it arrived on
-    // the requested input stream.
-    //
+  if (mouse)
+    return (byte == kDP_SetMouseSampleRate || byte == kDP_SetMouseResolution);
 
-    readByte        = inb(kDataPort);
-    requestedStream = false;
+  return (byte == kDP_SetKeyboardLEDs      || byte == kDP_SetKeyboardTypematic ||
+          byte == kDP_GetSetKeyboardASCs);
+}
 
-    if ( (status & kMouseData) )
-    {
-      if (deviceType == kDT_Mouse)  requestedStream = true;
-    }
-    else
-    {
-      if (deviceType == kDT_Keyboard)  requestedStream = true;
-    }
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-#if DEBUGGER_SUPPORT
-skipForwardToY:
-    unlockController(state);    // (release interrupt lockout + access to queue)
-#endif //DEBUGGER_SUPPORT
+bool ApplePS2Controller::enableMux()
+{
+  //
+  // Switches the controller to active multiplexing mode, if it has one, and
+  // enables every aux port.  The switch is a knock sequence of aux loopback
+  // writes: a controller that multiplexes echoes the first two bytes and
+  // answers the third with its version, where one that does not simply
+  // echoes it (some answer 0xAC under legacy USB emulation, which is not a
+  // real version either).  The mouse IRQ is expected to be off.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
 
-    if (requestedStream)
-    {
-      if (readByte == expectedByte)
-      {
-        if (firstByteHeld == false)
-        {
-          //
-          // Normal case.  Return first byte received.
-          //
+  static const UInt8 knock[] = { 0xF0, 0x56, 0xA4 };
 
-          return readByte;
-        }
-        else
-        {
-          //
-          // Our assumption was correct.  The second byte matched.  Dispatch
-          // the first byte to the interrupt handler, and return the second.
-          //
+  UInt8  byte = 0;
+  UInt64 time;
 
-          dispatchDriverInterrupt(deviceType, firstByte);
-          return readByte;
-        }
-      }
-      else // (readByte does not match expectedByte)
-      {
-        if (firstByteHeld == false)
-        {
-          //
-          // The first byte was received, and does not match the byte we are
-          // expecting.  Put it aside for the moment.
-          //
+  for (unsigned index = 0; index < sizeof(knock); index++)
+  {
+    writeCommandPort(kCP_WriteMouseOutputBuffer);
+    writeDataPort(knock[index]);
+    if (!waitDataPort(kDT_Mouse, &byte, &time, kRequestTimeout))  return false;
+    if (index < sizeof(knock) - 1 && byte != knock[index])  return false;
+  }
+  if (byte == 0xA4 || byte == 0xAC)  return false;
 
-          firstByteHeld = true;
-          firstByte     = readByte;
-        }
-        else if (readByte != expectedByte)
-        {
-          //
-          // The second byte mismatched as well.  I have yet to see this case
-          // occur [Dan], however I do think it's plausible.  No error logged.
-          //
+  _muxActive  = true;
+  _muxVersion = byte;
 
-          dispatchDriverInterrupt(deviceType, readByte);
-          return firstByte;
-        }
-      }
-    }
-    else
-    {
-      //
-      // The data we just received is for the other input stream, not ours,
-      // so dispatch appropriate interrupt handler.
-      //
+  // Enable each port behind its own prefix, as Linux does.
 
-      dispatchDriverInterrupt((deviceType==kDT_Keyboard)?kDT_Mouse:kDT_Keyboard,
-                              readByte);
-    }
-  } // while (forever)
-}
+  for (unsigned port = 0; port < kMaxAuxPorts; port++)
+  {
+    writeCommandPort(kCP_TransmitToMuxPortBase + port);
+    writeCommandPort(kCP_EnableMouseClock);
+  }
 
-#endif
+  return true;
+}
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::writeDataPort(UInt8 byte)
+void ApplePS2Controller::probeAuxPorts()
 {
   //
-  // Block until room in the controller's input buffer is available, then
-  // write the given byte to the Data Port.
+  // Disable the device behind each aux port of a multiplexing controller,
+  // and note which ports have one: a port answers with an acknowledge, or
+  // with an error if there is nothing (working) behind it.  Only the ports
+  // that answered get a nub.
   //
-  // This method should only be dispatched from our single-threaded work loop.
+  // This method should only be called from our single-threaded work loop.
   //
 
-  while (inb(kCommandPort) & kInputBusy)  IODelay(kDataDelay);
-  outb(kDataPort, byte);
+  UInt8  byte;
+  UInt64 time;
+
+  for (_outputAuxPort = 0; _outputAuxPort < kMaxAuxPorts; _outputAuxPort++)
+  {
+    writeCommandPort(kCP_TransmitToMouse);
+    _auxPortPresent[_outputAuxPort] =
+                  writeDataPort(kDP_SetDefaultsAndDisable) &&
+                  waitDataPort(kDT_Mouse, &byte, &time, kFastInitAckTimeout);
+  }
+  _outputAuxPort = 0;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::writeCommandPort(UInt8 byte)
+void ApplePS2Controller::dropMuxPorts()
 {
   //
-  // Block until room in the controller's input buffer is available, then
-  // write the given byte to the Command Port.
+  // The controller would not go back to multiplexing mode on wake, so only
+  // the one legacy aux port is left, and its bytes come in as port 0's.
+  // Every other port is dropped: requests for it fail from now on (see
+  // runRequest), and its nub is terminated, taking its driver with it.
   //
-  // This method should only be dispatched from our single-threaded work loop.
+  // This method should only be called from our single-threaded work loop.
   //
 
-  while (inb(kCommandPort) & kInputBusy)  IODelay(kDataDelay);
-  outb(kCommandPort, byte);
+  for (unsigned port = 1; port < kMaxAuxPorts; port++)
+  {
+    if (!_auxPortPresent[port])  continue;
+
+    _auxPortPresent[port] = false;
+    _mouseStreaming[port] = false;
+    _framing[inputChannel(kDT_Mouse, port)].position = 0;
+
+    if (_mouseDevices[port])
+      _mouseDevices[port]->terminate();
+  }
 }
 
 // =============================================================================
@@ -1282,8 +4251,8 @@ bool ApplePS2Controller::doEscape(UInt8 scancode)
     {
       // Disable the mouse by forcing the clock line low.
 
-      while (inb(kCommandPort) & kInputBusy)  IODelay(kDataDelay);
-      outb(kCommandPort, kCP_DisableMouseClock);
+      while (inPort(kCommandPort) & kInputBusy)  portDelay(kDataDelay);
+      outPort(kCommandPort, kCP_DisableMouseClock);
 
       // Call the debugger function.
 
@@ -1291,8 +4260,8 @@ bool ApplePS2Controller::doEscape(UInt8 scancode)
 
       // Re-enable the mouse by making the clock line active.
 
-      while (inb(kCommandPort) & kInputBusy)  IODelay(kDataDelay);
-      outb(kCommandPort, kCP_EnableMouseClock);
+      while (inPort(kCommandPort) & kInputBusy)  portDelay(kDataDelay);
+      outPort(kCommandPort, kCP_EnableMouseClock);
 
       releaseModifiers = true;
     }
@@ -1340,13 +4309,14 @@ void ApplePS2Controller::enqueueKeyboardData(UInt8 key)
     queue_remove_first(&_keyboardQueueUnused,
                        element, KeyboardQueueElement *, chain);
 
-    // Store the new keyboard data element on the queue. 
-    element->data = key; 
+    // Store the new keyboard data element on the queue, noting its arrival.
+    element->data = key;
+    element->time = mach_absolute_time();
     queue_enter(&_keyboardQueue, element, KeyboardQueueElement *, chain); 
   }
 }
 
-bool ApplePS2Controller::dequeueKeyboardData(UInt8 * key)
+bool ApplePS2Controller::dequeueKeyboardData(UInt8 * key, UInt64 * time)
 {
   //
   // Dequeue keyboard data from our internal queues, if the queue is not
@@ -1360,7 +4330,8 @@ bool ApplePS2Controller::dequeueKeyboardData(UInt8 * key)
   if (!queue_empty(&_keyboardQueue))
   {
     queue_remove_first(&_keyboardQueue, element, KeyboardQueueElement *, chain);
-    *key = element->data;
+    *key  = element->data;
+    *time = element->time;
 
     // Place the unused keyboard data element onto the unused queue.
     queue_enter(&_keyboardQueueUnused, element, KeyboardQueueElement *, chain);
@@ -1416,12 +4387,15 @@ void ApplePS2Controller::setPowerStateCallout( thread_call_param_t param0,
                                                thread_call_param_t param1 )
 {
   ApplePS2Controller * me = (ApplePS2Controller *) param0;
+#ifdef __LP64__
+  UInt64       powerState = (UInt64) param1;
+#else
+  UInt32       powerState = (UInt32) param1;
+#endif
 
   if ( me && me->_workLoop )
   {
-    me->_workLoop->runAction( /* Action */ setPowerStateAction,
-                              /* target */ me,
-                              /*   arg0 */ param1 );
+    me->changePowerState( powerState );
   }
 
   me->release();  // drop the retain from setPowerState()
@@ -1447,9 +4421,14 @@ IOReturn ApplePS2Controller::setPowerStateAction( OSObject * target,
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
+void ApplePS2Controller::changePowerState( UInt32 powerState )
 {
-  UInt8 commandByte;
+  //
+  // Runs on the power change thread call, outside of any work loop.  The
+  // drivers are told about the change on their own work loops, and the
+  // controller changes state on ours, so that a driver can still issue
+  // synchronous requests from its power control action.
+  //
 
   if ( _currentPowerState != powerState )
   {
@@ -1462,31 +4441,14 @@ void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
         //
 
         // 1. Notify clients about the state change. Clients can issue
-        //    synchronous requests thanks to the recursive lock.
+        //    synchronous requests.
 
         dispatchDriverPowerControl( kPS2C_DisableDevice );
 
-        // 2. Freeze the request queue and drop all data received over
-        //    the PS/2 port.
-
-        _hardwareOffline = true;
+        // 2. Freeze the request queue, and 3. disable the PS/2 port.
 
-        // 3. Disable the PS/2 port.
-
-#if 0
-        // This will cause some machines to turn on the LCD after the
-        // ACPI display driver has turned it off. With a real display
-        // driver present, this block of code can be uncommented (?).
-
-        writeCommandPort( kCP_GetCommandByte );
-        commandByte = readDataPort( kDT_Keyboard );
-        commandByte |=  ( kCB_DisableKeyboardClock |
-                          kCB_DisableMouseClock );
-        commandByte &= ~( kCB_EnableKeyboardIRQ |
-                          kCB_EnableMouseIRQ );
-        writeCommandPort( kCP_SetCommandByte );
-        writeDataPort( commandByte );
-#endif
+        _workLoop->runAction( setPowerStateAction, this,
+                              (void *)(uintptr_t) powerState );
         break;
 
       case kPS2PowerStateDoze:
@@ -1503,23 +4465,20 @@ void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
         // Transition from Sleep state to Working state in 3 stages.
         //
 
-        // 1. Enable the PS/2 port.
-
-        writeCommandPort( kCP_GetCommandByte );
-        commandByte = readDataPort( kDT_Keyboard );
-        commandByte &= ~( kCB_DisableKeyboardClock |
-                          kCB_DisableMouseClock );
-        commandByte |=  ( kCB_EnableKeyboardIRQ |
-                          kCB_EnableMouseIRQ );
-        writeCommandPort( kCP_SetCommandByte );
-        writeDataPort( commandByte );
+        // 1. Enable the PS/2 port, and 2. unblock the request queue.
 
-        // 2. Unblock the request queue and wake up all driver threads
-        //    that were blocked by submitRequest().
+        _workLoop->runAction( setPowerStateAction, this,
+                              (void *)(uintptr_t) powerState );
 
-        _hardwareOffline = false;
+        // 3. Bring back the devices that left a resume snapshot, then
+        //    notify clients about the state change.
 
-        // 3. Notify clients about the state change.
+        _workLoop->runAction( setResumeRestoredAction, this,
+                              (void *)(uintptr_t) kDT_Keyboard,
+                              (void *)(uintptr_t) resumeDevice( kDT_Keyboard ) );
+        _workLoop->runAction( setResumeRestoredAction, this,
+                              (void *)(uintptr_t) kDT_Mouse,
+                              (void *)(uintptr_t) resumeDevice( kDT_Mouse ) );
 
         dispatchDriverPowerControl( kPS2C_EnableDevice );
 
@@ -1543,13 +4502,143 @@ void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
+{
+  //
+  // The controller's part of a power state change, see changePowerState.
+  //
+
+  UInt8 commandByte;
+
+  switch ( powerState )
+  {
+    case kPS2PowerStateSleep:
+
+      // Freeze the request queue and drop all data received over the
+      // PS/2 port.
+
+      _hardwareOffline = true;
+      resumeRequest();                // (fails a parked request right away)
+      _pollTimer->cancelTimeout();
+      _watchdogTimer->cancelTimeout();
+      _watchdogArmed = false;
+
+      // Disable the PS/2 port.
+
+#if 0
+      // This will cause some machines to turn on the LCD after the
+      // ACPI display driver has turned it off. With a real display
+      // driver present, this block of code can be uncommented (?).
+
+      writeCommandPort( kCP_GetCommandByte );
+      commandByte = readDataPort( kDT_Keyboard );
+      commandByte |=  ( kCB_DisableKeyboardClock |
+                        kCB_DisableMouseClock );
+      commandByte &= ~( kCB_EnableKeyboardIRQ |
+                        kCB_EnableMouseIRQ );
+      writeCommandPort( kCP_SetCommandByte );
+      writeDataPort( commandByte );
+#endif
+      break;
+
+    default:
+
+      // Enable the PS/2 port.  The controller may have left multiplexing
+      // mode while asleep; switch it back before the IRQs are on.
+
+      if ( _muxActive )
+      {
+        _muxActive = false;
+        if ( !enableMux() )
+        {
+          IOLog("%s: Could not restore active multiplexing, only the "
+                "first aux port is left.\n", getName());
+          dropMuxPorts();
+        }
+      }
+
+      commandByte = readCommandByte();
+      commandByte &= ~( kCB_DisableKeyboardClock |
+                        kCB_DisableMouseClock );
+      commandByte |=  ( kCB_EnableKeyboardIRQ |
+                        kCB_EnableMouseIRQ );
+      writeCommandPort( kCP_SetCommandByte );
+      writeDataPort( commandByte );
+
+      // Unblock the request queue and wake up all driver threads
+      // that were blocked by submitRequest().
+
+      // Whatever stalled before sleep was reset along with the devices.
+
+      bzero(_stallTime,        sizeof(_stallTime));
+      bzero(_recoveryAttempts, sizeof(_recoveryAttempts));
+      for (unsigned channel = 0; channel < kInputChannels; channel++)
+        _framing[channel].position = 0;
+
+      _hardwareOffline = false;
+      armPollTimer();
+      break;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2Controller::dispatchDriverPowerControl( UInt32 whatToDo )
 {
-  if (_powerControlInstalledMouse)
-    (*_powerControlActionMouse)(_powerControlTargetMouse, whatToDo);
+  //
+  // Each driver's power control action runs on the work loop its input is
+  // delivered on.  Must not be called from within either work loop.
+  //
+
+  for (unsigned port = 0; port < kMaxAuxPorts; port++)
+  {
+    if (_powerControlInstalledMouse[port])
+      _auxWorkLoop->runAction( powerControlAction, this,
+                               (void *)(uintptr_t) kDT_Mouse,
+                               (void *)(uintptr_t) whatToDo,
+                               (void *)(uintptr_t) port );
+  }
+
+  if (_powerControlInstalledKeyboard)
+    _workLoop->runAction( powerControlAction, this,
+                          (void *)(uintptr_t) kDT_Keyboard,
+                          (void *)(uintptr_t) whatToDo );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::powerControlAction( OSObject * target,
+                                                 void * arg0, void * arg1,
+                                                 void * arg2, void * arg3 )
+{
+  ApplePS2Controller * me         = (ApplePS2Controller *) target;
+  PS2DeviceType        deviceType = (PS2DeviceType)(uintptr_t) arg0;
+  UInt32               whatToDo   = (UInt32)(uintptr_t) arg1;
+  UInt8                auxPort    = (UInt8)(uintptr_t) arg2;
+
+  //
+  // A device whose configuration was replayed on wake only needs to be
+  // enabled by its driver.  Only aux port 0 has a snapshot.
+  //
+
+  if ( whatToDo == kPS2C_EnableDevice && auxPort == 0 &&
+       me->_resumeSnapshot[deviceType].restored )
+    whatToDo = kPS2C_ResumeDevice;
+
+  if ( deviceType == kDT_Mouse )
+  {
+    if (me->_powerControlInstalledMouse[auxPort])
+      (*me->_powerControlActionMouse[auxPort])(me->_powerControlTargetMouse[auxPort],
+                                               whatToDo);
+  }
+  else
+  {
+    if (me->_powerControlInstalledKeyboard)
+      (*me->_powerControlActionKeyboard)(me->_powerControlTargetKeyboard,
+                                         whatToDo);
+  }
 
-  if (_powerControlInstalledKeyboard)       
-    (*_powerControlActionKeyboard)(_powerControlTargetKeyboard, whatToDo);
+  return kIOReturnSuccess;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -1557,7 +4646,8 @@ void ApplePS2Controller::dispatchDriverPowerControl( UInt32 whatToDo )
 void ApplePS2Controller::installPowerControlAction(
                                           PS2DeviceType         deviceType,
                                           OSObject *            target, 
-                                          PS2PowerControlAction action )
+                                          PS2PowerControlAction action,
+                                          UInt8                 auxPort )
 {
   if ( deviceType == kDT_Keyboard && _powerControlInstalledKeyboard == false )
   {
@@ -1566,18 +4656,20 @@ void ApplePS2Controller::installPowerControlAction(
     _powerControlActionKeyboard = action;
     _powerControlInstalledKeyboard = true;
   }
-  else if ( deviceType == kDT_Mouse && _powerControlInstalledMouse == false )
+  else if ( deviceType == kDT_Mouse && auxPort < kMaxAuxPorts &&
+            _powerControlInstalledMouse[auxPort] == false )
   {
     target->retain();
-    _powerControlTargetMouse = target;
-    _powerControlActionMouse = action;
-    _powerControlInstalledMouse = true;
+    _powerControlTargetMouse[auxPort] = target;
+    _powerControlActionMouse[auxPort] = action;
+    _powerControlInstalledMouse[auxPort] = true;
   }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Controller::uninstallPowerControlAction( PS2DeviceType deviceType )
+void ApplePS2Controller::uninstallPowerControlAction( PS2DeviceType deviceType,
+                                                      UInt8         auxPort )
 {
   if ( deviceType == kDT_Keyboard && _powerControlInstalledKeyboard == true )
   {
@@ -1586,11 +4678,234 @@ void ApplePS2Controller::uninstallPowerControlAction( PS2DeviceType deviceType )
     _powerControlTargetKeyboard->release();
     _powerControlTargetKeyboard = 0;
   }
-  else if ( deviceType == kDT_Mouse && _powerControlInstalledMouse == true )
+  else if ( deviceType == kDT_Mouse && auxPort < kMaxAuxPorts &&
+            _powerControlInstalledMouse[auxPort] == true )
+  {
+    _powerControlInstalledMouse[auxPort] = false;
+    _powerControlActionMouse[auxPort] = NULL;
+    _powerControlTargetMouse[auxPort]->release();
+    _powerControlTargetMouse[auxPort] = 0;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::setResumeSnapshot( PS2DeviceType      deviceType,
+                                            const UInt8 *      identity,
+                                            UInt32             identityLength,
+                                            const PS2Request * restore,
+                                            UInt8              auxPort )
+{
+  PS2ResumeSnapshot snapshot;
+
+  // The replay on wake goes to aux port 0; the other ports reinitialize.
+
+  if ( auxPort != 0 )  return;
+
+  bzero( &snapshot, sizeof(snapshot) );
+
+  if ( restore )
+  {
+    if ( identityLength > kMaxIdentityBytes ||
+         restore->commandsCount > kMaxCommands )
+    {
+      IOLog("%s: resume snapshot too large, ignored\n", getName());
+      return;
+    }
+
+    snapshot.valid          = true;
+    snapshot.identityLength = identityLength;
+    snapshot.commandsCount  = restore->commandsCount;
+    bcopy( identity, snapshot.identity, identityLength );
+    bcopy( restore->commands, snapshot.commands,
+           restore->commandsCount * sizeof(PS2Command) );
+  }
+
+  //
+  // Swap it in on the work loop, so it never changes under a wake.
+  //
+
+  if ( _workLoop->inGate() )
+    setResumeSnapshotAction( this, (void *)(uintptr_t) deviceType,
+                             &snapshot, 0, 0 );
+  else
+    _workLoop->runAction( setResumeSnapshotAction, this,
+                          (void *)(uintptr_t) deviceType, &snapshot );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::setResumeSnapshotAction( OSObject * target,
+                                                      void * arg0, void * arg1,
+                                                      void * arg2, void * arg3 )
+{
+  ApplePS2Controller * me         = (ApplePS2Controller *) target;
+  PS2DeviceType        deviceType = (PS2DeviceType)(uintptr_t) arg0;
+
+  me->_resumeSnapshot[deviceType] = *(PS2ResumeSnapshot *) arg1;
+
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::copyResumeSnapshotAction( OSObject * target,
+                                                       void * arg0, void * arg1,
+                                                       void * arg2, void * arg3 )
+{
+  ApplePS2Controller * me         = (ApplePS2Controller *) target;
+  PS2DeviceType        deviceType = (PS2DeviceType)(uintptr_t) arg0;
+
+  *(PS2ResumeSnapshot *) arg1 = me->_resumeSnapshot[deviceType];
+
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::setResumeRestoredAction( OSObject * target,
+                                                      void * arg0, void * arg1,
+                                                      void * arg2, void * arg3 )
+{
+  ApplePS2Controller * me         = (ApplePS2Controller *) target;
+  PS2DeviceType        deviceType = (PS2DeviceType)(uintptr_t) arg0;
+
+  me->_resumeSnapshot[deviceType].restored = ( arg1 != 0 );
+
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::setPacketFraming( PS2DeviceType deviceType,
+                                           UInt8         packetLength,
+                                           UInt8         syncMask,
+                                           UInt8         syncValue,
+                                           UInt8         auxPort )
+{
+  unsigned channel;
+
+  if ( auxPort >= kMaxAuxPorts )  return;
+  channel = inputChannel( deviceType, auxPort );
+
+  if ( _workLoop->inGate() )
+    setPacketFramingAction( this, (void *)(uintptr_t) channel,
+                            (void *)(uintptr_t) packetLength,
+                            (void *)(uintptr_t) syncMask,
+                            (void *)(uintptr_t) syncValue );
+  else
+    _workLoop->runAction( setPacketFramingAction, this,
+                          (void *)(uintptr_t) channel,
+                          (void *)(uintptr_t) packetLength,
+                          (void *)(uintptr_t) syncMask,
+                          (void *)(uintptr_t) syncValue );
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOReturn ApplePS2Controller::setPacketFramingAction( OSObject * target,
+                                                     void * arg0, void * arg1,
+                                                     void * arg2, void * arg3 )
+{
+  ApplePS2Controller * me      = (ApplePS2Controller *) target;
+  PS2PacketFraming *   framing = &me->_framing[(uintptr_t) arg0];
+
+  //
+  // The driver sets its framing when its device is not streaming, so the
+  // next byte it gets starts a packet.
+  //
+
+  framing->length    = (UInt8)(uintptr_t) arg1;
+  framing->syncMask  = (UInt8)(uintptr_t) arg2;
+  framing->syncValue = (UInt8)(uintptr_t) arg3;
+  framing->position  = 0;
+
+  return kIOReturnSuccess;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::resumeDevice( PS2DeviceType deviceType )
+{
+  //
+  // Runs on the power change thread call after the port is back online.
+  // One kDP_GetId tells whether the device is still the one, in the same
+  // mode, that left the snapshot; if so, its stored commands are replayed
+  // and the driver is spared its full reset.  Anything unexpected leaves
+  // the device to the driver.  The snapshot is copied on the work loop,
+  // since its driver may replace it at any time.
+  //
+
+  PS2ResumeSnapshot   copy;
+  PS2ResumeSnapshot * snapshot = &copy;
+  PS2Request *        request;
+  unsigned            index = 0;
+  bool                matched;
+
+  _workLoop->runAction( copyResumeSnapshotAction, this,
+                        (void *)(uintptr_t) deviceType, &copy );
+
+  if ( !snapshot->valid )  return false;
+
+  request = allocateRequest();
+  if ( !request )  return false;
+
+  if ( deviceType == kDT_Mouse )
+  {
+    request->commands[index].command = kPS2C_WriteCommandPort;
+    request->commands[index].inOrOut = kCP_TransmitToMouse;
+    index++;
+  }
+  request->commands[index].command = kPS2C_WriteDataPort;
+  request->commands[index].inOrOut = kDP_GetId;
+  index++;
+  request->commands[index].command = kPS2C_ReadDataPortAndCompare;
+  request->commands[index].inOrOut = kSC_Acknowledge;
+  index++;
+  for ( unsigned i = 0; i < snapshot->identityLength; i++ )
+  {
+    request->commands[index].command = kPS2C_ReadDataPort;
+    request->commands[index].inOrOut = 0;
+    index++;
+  }
+  request->commandsCount = index;
+  submitRequestAndBlock( request, deviceType );
+
+  matched = ( request->commandsCount == index );
+  for ( unsigned i = 0; matched && i < snapshot->identityLength; i++ )
+  {
+    matched = ( request->commands[index - snapshot->identityLength + i].inOrOut
+                == snapshot->identity[i] );
+  }
+
+  if ( matched )
   {
-    _powerControlInstalledMouse = false;
-    _powerControlActionMouse = NULL;
-    _powerControlTargetMouse->release();
-    _powerControlTargetMouse = 0;
+    request->commandsCount = snapshot->commandsCount;
+    bcopy( snapshot->commands, request->commands,
+           snapshot->commandsCount * sizeof(PS2Command) );
+    submitRequestAndBlock( request, deviceType );
+
+    matched = ( request->commandsCount == snapshot->commandsCount );
   }
+
+  freeRequest( request );
+
+  return matched;
+}
+
+#if PORT_IO_BACKEND_SUPPORT
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::setPortBackend(const PS2PortBackend * backend)
+{
+  //
+  // Replace the port I/O backend; a null backend restores the hardware one.
+  // This must be done before start, or while the work loop is quiescent,
+  // since port accesses are not serialized against the swap.
+  //
+
+  _portBackend = backend ? *backend : hardwarePortBackend;
 }
+
+#endif //PORT_IO_BACKEND_SUPPORT
@@ -24,10 +24,11 @@
 #define _APPLEPS2CONTROLLER_H
 
 #include <IOKit/IOInterruptEventSource.h>
+#include <IOKit/IOLib.h>
 #include <IOKit/IOService.h>
+#include <IOKit/IOTimerEventSource.h>
 #include <IOKit/IOWorkLoop.h>
-//#include <IOKit/IOSyncer.h>
-#include "IOSyncer.h"
+#include <libkern/OSAtomic.h>
 #include "ApplePS2Device.h"
 
 class ApplePS2KeyboardDevice;
@@ -67,18 +68,18 @@ class ApplePS2MouseDevice;
 // the information passed in the kPS2C_ReadAndCompare primitive).  If we don't
 // receive this byte next on the input data stream, we put the byte we did get
 // aside for a moment, and give the keyboard (or mouse) a second chance to
-// respond correctly.
+// respond correctly.  A mouse may have most of a packet on its way, so we
+// keep putting bytes aside, up to kReorderBufferSize of them.
 //
-// If we receive the 0xFA acknowledgement byte on the second read, that we
-// assume that situation described above just happened.   We transparently
-// dispatch the first byte to the driver's interrupt handler, where it was
-// meant to go, and return the second correct byte to the read-and-compare
+// If we receive the 0xFA acknowledgement byte after all, then we assume that
+// situation described above just happened.   We transparently dispatch the
+// bytes put aside to the driver's interrupt handler, in order, where they
+// were meant to go, and return the correct byte to the read-and-compare
 // logic, where it was meant to go.  Everyone wins.
 //
-// The only situation this feature cannot help is where a kPS2C_ReadDataPort
-// primitive is issued in place of a kPS2C_ReadDataPortAndCompare primitive.
-// This is necessary in some requests because the driver does not know what
-// it is going to receive.   This can be illustrated in the mouse get info
+// That leaves the kPS2C_ReadDataPort primitive, issued in place of a
+// kPS2C_ReadDataPortAndCompare primitive because the driver does not know
+// what it is going to receive.  This can be illustrated in the mouse get info
 // command.
 //
 // 1. Write        Prepare to write to mouse.
@@ -88,14 +89,28 @@ class ApplePS2MouseDevice;
 // 5. Read         Get second information byte.   __-> these reads
 // 6. Rrad         Get third information byte.
 //
-// Controller cannot build any defenses against this.  It is suggested that the
-// driver writer disable the mouse first, then send any dangerous commands, and
-// re-enable the mouse when the command completes. 
+// Once the device has acknowledged the command, it has dropped its packet and
+// only answers, so steps 4 to 6 are safe.  What is left is a packet whose
+// start the driver already has.  A driver that describes its packets with
+// setPacketFraming lets the controller follow the packets it hands out; any
+// byte that can only be the rest of one goes to the driver, whatever step is
+// reading.  Such a driver has no need to disable its device around queries.
+// Other drivers can mark the request kRF_QuietWindow, and the controller
+// stops the mouse's stream for just that request.
 //
 // Note that the OUT_OF_ORDER_DATA_CORRECTION_FEATURE can be turned off at
-// compile time.    Please see the readDataPort:expecting: method for more
+// compile time.    Please see the resolveReadStep method for more
 // information about the assumptions necessary for this feature.
 //
+// A related note on how requests wait for their responses.  An asynchronous
+// request does not spin on the status port while the device thinks about
+// its answer.  When a read step finds no byte waiting, the request is parked
+// and the work loop goes back to other business; the interrupt that brings
+// the byte (or, with that interrupt disabled, a short polling timer) picks
+// the request up where it left off.  Only requests submitted synchronously
+// from within the work loop itself still spin, since their caller expects
+// them to be complete on return.
+//
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // Definitions
@@ -110,6 +125,25 @@ class ApplePS2MouseDevice;
 
 #define OUT_OF_ORDER_DATA_CORRECTION_FEATURE 1
 
+// Most stream bytes a read step puts aside while it waits for its answer;
+// more than the longest packet of any supported device.
+
+#define kReorderBufferSize      8
+
+// Route every controller access to the data and command ports through a
+// pluggable backend (PS2PortBackend) rather than the raw inb/outb inlines.
+// This lets the controller run against ApplePS2PortSimulator; the host test
+// build under tests/ turns it on.
+
+#ifndef PORT_IO_BACKEND_SUPPORT
+#define PORT_IO_BACKEND_SUPPORT 0
+#endif
+
+// Record every access to the data and command ports in a ring (the "flight
+// recorder"), which an administrator can copy out after the fact.
+
+#define FLIGHT_RECORDER_SUPPORT 1
+
 // PS/2 device types.
 
 typedef enum { kDT_Keyboard, kDT_Mouse } PS2DeviceType;
@@ -121,9 +155,155 @@ typedef enum { kDT_Keyboard, kDT_Mouse } PS2DeviceType;
 #define kIPL_Keyboard           6
 #define kIPL_Mouse              3
 
+// Bytes held per device for a batch interrupt action before delivery.
+
+#define kInterruptBatchSize     16
+
+// Every data port read is counted.  The primary interrupt handlers stamp the
+// arrival time with the low bits of that count, so the work loop only takes
+// a stamp that was noted for the very byte it has just read.
+
+#define kInterruptTagMask       0xFFULL
+
+// Input latency histograms, per device and PS2LatencyStage.  Bucket n counts
+// samples of [2^(n-1), 2^n) microseconds, bucket 0 those under a microsecond
+// and the last bucket everything longer.  They are cleared by setting
+// kLatencyResetKey on the controller.
+
+#define kLatencyBuckets         16
+#define kLatencyPropertyKey     "InputLatency"
+#define kLatencyResetKey        "ResetInputLatency"
+
+// Request latency histograms, per PS2RequestPriority, from submission to the
+// start of the request and to its completion.  Same buckets as above, and
+// cleared along with them.
+
+#define kRequestLatencyPropertyKey "RequestLatency"
+
+enum
+{
+  kRL_Started,                          // submitted to started
+  kRL_Completed                         // submitted to completed
+};
+
+#define kRequestLatencyStages   2
+
+// Bytes in flight from the port work loop to the mouse driver's work loop.
+
+#define kAuxInputSize           256     // must be a power of two
+
+// Error and recovery counters, per device and PS2EventCounter.
+
+#define kStatisticsPropertyKey  "Statistics"
+
+// Both of the above are republished at most once per interval, and only if
+// something was counted.
+
+#define kStatisticsPublishInterval 1000  // (ms)
+
+// Fast initialization, enabled by setting kFastInitKey in the personality.
+// When firmware has clearly set the controller up, start skips the controller
+// and port self tests and gives the devices short timeouts.  How long each
+// phase of initialization took is published in microseconds either way.
+
+#define kFastInitKey            "FastInit"
+#define kFastInitTimeout        5       // msec for the controller to answer
+#define kFastInitAckTimeout     20      // msec for a device to acknowledge
+#define kBootTimePropertyKey    "BootTime"
+
+// Polling, for machines whose keyboard and mouse interrupts never arrive.
+// Until the first interrupt is serviced, the poll timer looks at the status
+// register every kPollWatchInterval; a byte that sits in the output buffer,
+// with its interrupt enabled, across two looks switches the controller over
+// to polling for good.  Once an interrupt has been serviced the watch stops,
+// and it starts again only when a parked request finds its byte waiting
+// without an interrupt.  Setting kPollingModeKey in the personality polls
+// from the start.  While polling, the interval drops to kPollIntervalMin as soon
+// as a byte turns up and doubles with every empty poll, up to
+// kPollIntervalMax.  The interval and the wait it costs are published.
+
+#define kPollingModeKey         "PollingMode"
+#define kPollingPropertyKey     "Polling"
+#define kPollWatchInterval      250     // msec between looks, not polling
+#define kPollIntervalMin        1000    // usec, while bytes are flowing
+#define kPollIntervalMax        16000   // usec, when idle
+
+// Stall watchdog.  A device that stops partway through a packet for
+// kStallTimeout, or a controller input buffer that stays full for
+// kInputBusyLimit while a byte waits to go to a device, stalls that port.
+// Each aux port of a multiplexing controller stalls on its own.  The
+// watchdog recovers only the stalled port, up to kRecoveryAttempts times
+// before giving up on it until the next wake, and then calls the power
+// control action of a mouse port's driver with kPS2C_ResetDevice (the
+// keyboard's clock is only cycled, which leaves its setup alone).  A
+// streaming mouse is restarted by a request of the controller's own, which
+// parks on its acknowledges like any other.  The time from the start of
+// each stall to the end of its recovery is published with the counters.
+
+#define kStallTimeout           50      // msec without the rest of a packet
+#define kInputBusyLimit         20000   // usec for the input buffer to drain
+#define kRecoveryAttempts       3
+
+// Active multiplexing, enabled by setting kMuxModeKey in the personality.  A
+// multiplexing controller has up to kMaxAuxPorts aux devices behind the one
+// aux stream, say a touchpad and a pointing stick: the status register tells
+// which port each aux byte came from, and a byte goes to port n after
+// kCP_TransmitToMuxPortBase + n rather than kCP_TransmitToMouse.  Each port
+// that answers when probed at start gets a mouse nub of its own, with its
+// number in kAuxPortKey, and its own driver, packet framing, request
+// routing, response timers and stall state.  A port with nothing behind it
+// answers with an error, which fails a read waiting on that port at once.
+// Should the controller not go back to multiplexing on wake, the ports past
+// the first are dropped and their nubs terminated.  Counters, histograms
+// and resume snapshots are kept per input stream, as before; the snapshot
+// only for aux port 0.
+
+#define kMuxModeKey             "MuxMode"
+#define kMuxVersionPropertyKey  "MuxVersion"
+#define kAuxPortKey             "AuxPort"
+#define kMaxAuxPorts            4       // must be a power of two
+
+// Packets are followed per input channel: the keyboard stream, then each
+// aux port.
+
+#define kInputChannels          (1 + kMaxAuxPorts)
+
+enum
+{
+  kBP_Flush,                            // clocks off, stale data discarded
+  kBP_SelfTest,                         // command byte read, self tests
+  kBP_Devices,                          // devices set to defaults, disabled
+  kBP_Drain                             // input streams cleared
+};
+
+#define kBootPhases             4
+
 // Port timings.
 
 #define kDataDelay              7       // usec to delay before data is valid
+#define kRequestTimeout         70      // msec to wait for a response byte
+#define kRequestPollInterval    1000    // usec between polls of parked request
+#define kRequestResendLimit     3       // retransmissions of one byte
+#define kRequestResendBackoff   500     // usec before the first retransmission,
+                                        // doubled for each one after it
+
+// Response timeouts.  How long each device takes to answer is learned per
+// command last written to it (a parameter byte is answered under the command
+// it belongs to, kResponseTimerController is for the controller's own
+// replies), and a read step waits about the smoothed response time plus four
+// deviations, never less than kResponseTimeoutFloor nor more than
+// kRequestTimeout.  The floor leaves room for a device busy with a packet or
+// a scan, which a handful of quick answers says nothing about.  A device
+// that lets kResponseSilentLimit full timeouts go by in a row is taken as
+// absent and only probed for kResponseProbeTimeout, until it sends a byte
+// again.
+
+#define kResponseTimeoutFloor   20      // msec, shortest calibrated timeout
+#define kResponseSamplesMin     8       // responses seen before calibrating
+#define kResponseSilentLimit    2
+#define kResponseProbeTimeout   5       // msec per read step while absent
+#define kResponseTimerController 256
+#define kResponseTimerSlots     257
 
 // Ports used to control the PS/2 keyboard/mouse and read data from it.
 
@@ -139,6 +319,81 @@ typedef enum { kDT_Keyboard, kDT_Mouse } PS2DeviceType;
 #define kKeyboardInhibited      0x10    // 0 if keyboard inhibited
 #define kMouseData              0x20    // mouse data available
 
+// The same, in active multiplexing mode, for aux data.
+
+#define kMuxError               0x04    // byte is an error code for the port
+#define kMuxPortShift           6       // aux port the byte came from
+
+#if PORT_IO_BACKEND_SUPPORT
+// Port I/O backend.  The read and write actions stand in for inb and outb on
+// kDataPort/kCommandPort; the delay action stands in for IODelay, so that a
+// simulated backend can advance its own clock instead of spinning the CPU.
+
+typedef UInt8 (*PS2PortReadAction)(void * target, UInt16 port);
+typedef void  (*PS2PortWriteAction)(void * target, UInt16 port, UInt8 byte);
+typedef void  (*PS2PortDelayAction)(void * target, UInt32 microseconds);
+
+struct PS2PortBackend
+{
+  void *             target;
+  PS2PortReadAction  readAction;
+  PS2PortWriteAction writeAction;
+  PS2PortDelayAction delayAction;
+};
+typedef struct PS2PortBackend PS2PortBackend;
+#endif //PORT_IO_BACKEND_SUPPORT
+
+#if FLIGHT_RECORDER_SUPPORT
+// Flight recorder.  Every inb/outb on kDataPort/kCommandPort takes the next
+// slot of a fixed ring, claimed with one atomic increment, so the interrupt
+// handlers and the work loop can record side by side without a lock.  A slot
+// holds sequence 0 while it is being filled in, which lets a capture taken
+// while recording goes on skip records it would otherwise tear.  Status
+// reads are recorded only when the status changes, so that polling loops do
+// not wash the interesting history out of the ring.  Bytes read off the
+// keyboard stream are keystrokes, so only that one arrived, and when, is
+// recorded (kTF_Redacted); they never make it into the ring.
+//
+// copyTrace returns a capture as an OSData: one PS2TraceHeader, followed by
+// recordCount PS2TraceRecords, oldest first, all in host byte order.  User
+// space gets one by opening a kTraceUserClientType connection to the
+// controller, which only administrators may, and calling kTraceMethodCopy
+// with an output structure large enough for a full ring.
+
+#define kTraceRingSize          1024    // records, power of two
+#define kTraceMagic             0x50533254  // 'PS2T'
+#define kTraceVersion           2
+#define kTraceUserClientType    0x50533254  // 'PS2T'
+#define kTraceMethodCopy        0
+
+#define kTF_Write               0x01    // outb, otherwise inb
+#define kTF_CommandPort         0x02    // kCommandPort, otherwise kDataPort
+#define kTF_Mouse               0x04    // data port byte from/to the mouse
+#define kTF_Redacted            0x08    // keyboard byte read, data left out
+
+struct PS2TraceRecord
+{
+  UInt64          time;                 // mach_absolute_time
+  volatile UInt32 sequence;             // position in the trace, plus one
+  UInt8           flags;                // kTF_*
+  UInt8           data;
+  UInt16          reserved;
+};
+typedef struct PS2TraceRecord PS2TraceRecord;
+
+struct PS2TraceHeader
+{
+  UInt32 magic;                         // kTraceMagic
+  UInt16 version;                       // kTraceVersion
+  UInt16 recordSize;                    // sizeof(PS2TraceRecord)
+  UInt32 recordCount;
+  UInt32 firstSequence;                 // of the oldest record; earlier ones
+                                        // were overwritten
+  UInt64 ticksPerSecond;                // of the record times
+};
+typedef struct PS2TraceHeader PS2TraceHeader;
+#endif //FLIGHT_RECORDER_SUPPORT
+
 #if DEBUGGER_SUPPORT
 // Definitions for our internal keyboard queue (holds keys processed by the
 // interrupt-time mini-monitor-key-sequence detection code).
@@ -150,9 +405,146 @@ struct KeyboardQueueElement
 {
   queue_chain_t chain;
   UInt8         data;
+  UInt64        time;                   // arrival, mach_absolute_time
 };
 #endif //DEBUGGER_SUPPORT
 
+// Asynchronous request ring.  Clients on any thread fill slots; only the work
+// loop drains them.  A slot's sequence number tells whose turn it is: it is
+// equal to the ring position when the slot is free for that position, and
+// one past it once the request pointer has been published.
+
+#define kRequestRingSize 64              // must be a power of two
+
+typedef struct PS2RequestSlot PS2RequestSlot;
+struct PS2RequestSlot
+{
+  volatile UInt32 sequence;
+  PS2Request *    request;
+  PS2DeviceType   deviceType;           // submitting device
+  UInt8           auxPort;              // ... its aux port, if the mouse
+  UInt64          submitTime;           // mach_absolute_time
+};
+
+// Requests that find the ring full go on an overflow list instead, under a
+// simple lock, in entries from IOMalloc, so that submitting never fails.
+// While the list is not empty, every request goes on it, so that a thread's
+// requests stay in order; the work loop takes from it once the ring is empty.
+
+typedef struct PS2OverflowRequest PS2OverflowRequest;
+struct PS2OverflowRequest
+{
+  PS2OverflowRequest * next;
+  PS2RequestSlot       slot;            // (sequence unused)
+};
+
+// Request scheduler.  The work loop moves requests off the ring into a FIFO
+// per priority class and device, and always starts the most urgent request,
+// alternating between devices within a class.  A class that has been passed
+// over kRequestStarvationLimit times in a row goes next, whatever is waiting.
+// There are as many queue entries as ring slots; while they are all in use,
+// requests simply wait in the ring.
+
+#define kRequestStarvationLimit 4
+
+typedef struct PS2QueuedRequest PS2QueuedRequest;
+struct PS2QueuedRequest
+{
+  PS2QueuedRequest * next;
+  PS2Request *       request;
+  UInt8              auxPort;
+  UInt64             submitTime;
+};
+
+// Preallocated request pool.  allocateRequest hands these out before it
+// falls back to IOMalloc.  The free list is a stack of pool indices; its head
+// packs a generation count above the top index (plus one, zero is empty) so
+// a compare-and-swap cannot be fooled by an entry that left and came back.
+
+#define kRequestPoolSize        32       // at most 0xFFFF
+
+#define kRequestPoolIndexMask   0x0000FFFF
+#define kRequestPoolGeneration  0x00010000
+
+// Execution state of a request, kept across parking.
+
+typedef struct PS2RequestContext PS2RequestContext;
+struct PS2RequestContext
+{
+  PS2Request *  request;
+  unsigned      deviceType;             // PS2DeviceType that submitted it
+  UInt8         auxPort;                // ... its aux port, if the mouse
+  PS2Request *  segment;                // segment holding current command
+  unsigned      index;                  // current command within segment
+  PS2DeviceType deviceMode;             // input stream the reads come from
+  bool          transmitToMouse;
+  bool          stepStarted;            // current read step under way
+  bool          stepDone;               // current read step has its result
+  bool          failed;
+  bool          parked;                 // waiting for a byte
+  bool          streamQuiet;            // device acknowledged last write
+  unsigned      heldCount;              // bytes put aside, second chance
+  bool          passedThrough;          // step let packet bytes through
+  UInt8         held[kReorderBufferSize];
+  UInt64        heldTime[kReorderBufferSize];
+  UInt64        deadline;               // for the current read step
+  UInt64        submitTime;
+  unsigned      priority;               // PS2RequestPriority
+  bool          resendValid;            // resendByte may be sent again
+  bool          resendToMouse;
+  bool          resendPending;          // retransmission due at resendTime
+  UInt8         resendByte;             // last byte written to the device
+  unsigned      resendCount;
+  UInt64        resendTime;
+  bool          cancelled;              // see cancelRequests
+  bool          expired;                // request's time limit ran out
+  UInt64        requestDeadline;        // zero if no time limit
+  bool          quietResume;            // resumeSegment still to run
+  bool          quietFailed;            // request failed at failSegment
+  PS2Request *  failSegment;
+  unsigned      failIndex;
+  UInt64        stepStartTime;          // for the response time
+  UInt32        stepTimeout;            // msec, see responseTimeout
+  PS2Request    suspendSegment;         // see kRF_QuietWindow
+  PS2Request    resumeSegment;
+};
+
+// What a driver left with setResumeSnapshot: the device's ID bytes and the
+// commands that bring its configuration back after sleep.
+
+typedef struct PS2ResumeSnapshot PS2ResumeSnapshot;
+struct PS2ResumeSnapshot
+{
+  bool          valid;
+  bool          restored;               // replayed on the last wake
+  UInt8         identityLength;
+  UInt8         identity[kMaxIdentityBytes];
+  UInt8         commandsCount;
+  PS2Command    commands[kMaxCommands];
+};
+
+// A device's stream packets, as described with setPacketFraming, and how
+// far into one the bytes handed to the driver are.
+
+typedef struct PS2PacketFraming PS2PacketFraming;
+struct PS2PacketFraming
+{
+  UInt8         length;                 // zero if unknown
+  UInt8         syncMask;
+  UInt8         syncValue;              // first byte & syncMask
+  UInt8         position;
+};
+
+// Response time estimate for one kind of read step, in microseconds.
+
+typedef struct PS2ResponseTimer PS2ResponseTimer;
+struct PS2ResponseTimer
+{
+  UInt32        smoothed;
+  UInt32        deviation;
+  UInt32        samples;
+};
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 // ApplePS2Controller Class Declaration
 //
@@ -165,6 +557,8 @@ public:                                // interrupt-time variables and functions
   IOInterruptEventSource * _interruptSourceKeyboard;
   IOInterruptEventSource * _interruptSourceMouse;
   IOInterruptEventSource * _interruptSourceQueue;
+  volatile UInt64          _interruptTime[2];     // last IRQ, per PS2DeviceType
+  volatile UInt32          _dataPortReads;        // tags the above
 
 #if DEBUGGER_SUPPORT
   bool                     _debuggingEnabled;
@@ -173,30 +567,133 @@ public:                                // interrupt-time variables and functions
   void unlockController(int state);
 
   bool doEscape(UInt8 key);
-  bool dequeueKeyboardData(UInt8 * key);
+  bool dequeueKeyboardData(UInt8 * key, UInt64 * time);
   void enqueueKeyboardData(UInt8 key);
 #endif //DEBUGGER_SUPPORT
 
+  inline UInt8 inPort(UInt16 port);
+  inline void  outPort(UInt16 port, UInt8 byte);
+  inline void  portDelay(UInt32 microseconds);
+  inline void  noteInterruptTime(PS2DeviceType deviceType, UInt64 time);
+
 private:
   IOWorkLoop *             _workLoop;
-  queue_head_t             _requestQueue;
-  IOSimpleLock *           _requestQueueLock;
+  PS2RequestSlot           _requestRing[kRequestRingSize];
+  volatile UInt32          _requestRingHead;      // next position to fill
+  UInt32                   _requestRingTail;      // next position to drain
+  IOSimpleLock *           _requestOverflowLock;
+  PS2OverflowRequest *     _requestOverflowHead;
+  PS2OverflowRequest *     _requestOverflowTail;
+  volatile UInt32          _requestOverflowCount; // on the list right now
+  UInt32                   _requestOverflowTotal; // ever, for the registry
+
+  IOWorkLoop *             _auxWorkLoop;          // mouse driver runs here
+  IOInterruptEventSource * _auxInputSource;
+  UInt8                    _auxInput[kAuxInputSize];
+  UInt64                   _auxInputTime[kAuxInputSize];
+  UInt8                    _auxInputFrom[kAuxInputSize]; // aux port
+  volatile UInt32          _auxInputHead;         // filled by the port loop
+  volatile UInt32          _auxInputTail;         // drained by the aux loop
+  bool                     _auxInputSignal;       // wake aux loop at flush
+
+  PS2QueuedRequest         _requestEntries[kRequestRingSize];
+  PS2QueuedRequest *       _requestEntriesFree;
+  PS2QueuedRequest *       _requestQueueHead[kRequestPriorities][2];
+  PS2QueuedRequest *       _requestQueueTail[kRequestPriorities][2];
+  UInt32                   _requestPassedOver[kRequestPriorities];
+  unsigned                 _requestLastDevice[kRequestPriorities];
+  UInt32                   _requestLatencyHistogram[kRequestPriorities][kRequestLatencyStages][kLatencyBuckets];
+
+  PS2Request *             _requestPool;          // preallocated requests
+  UInt16                   _requestPoolNext[kRequestPoolSize];
+  volatile UInt32          _requestPoolHead;      // generation | index + 1
+  volatile SInt32          _requestPoolInUse;
+  SInt32                   _requestPoolHighWater;
+  volatile SInt32          _requestPoolExhausted; // times IOMalloc was used
+  PS2RequestContext        _requestContext;       // (parked) async request
+  IOTimerEventSource *     _requestTimer;
+  IOLock *                 _requestWaitLock;      // for submitRequestAndBlock
+
+  UInt8                    _commandByte;          // shadow of command byte
+  UInt8                    _lastCommandPortByte;
+  bool                     _prefixDropped;        // ... was never written
+  bool                     _mouseStreaming[kMaxAuxPorts]; // kDP_Enable last sent
+  bool                     _muxActive;            // active multiplexing mode
+  bool                     _auxPortPresent[kMaxAuxPorts]; // answered the probe
+  bool                     _auxPortError;         // error from _outputAuxPort
+  UInt8                    _muxVersion;
+  UInt8                    _inputAuxPort;         // aux byte being handled
+  UInt8                    _outputAuxPort;        // where kCP_TransmitToMouse goes
+  UInt32                   _responseKey;          // response timer slot
+  bool                     _responseParameter;    // next byte is a parameter
+  UInt32                   _responseSilent[kInputChannels]; // timeouts in a row
+  PS2ResponseTimer         _responseTimers[kInputChannels][kResponseTimerSlots];
+
+#if PORT_IO_BACKEND_SUPPORT
+  PS2PortBackend           _portBackend;
+#endif
+
+#if FLIGHT_RECORDER_SUPPORT
+  PS2TraceRecord           _traceRing[kTraceRingSize];
+  volatile SInt32          _traceHead;            // records ever taken
+  UInt8                    _traceLastStatus;      // last status recorded
+  bool                     _traceToMouse;         // kCP_TransmitToMouse sent
+
+  inline void traceRecord(UInt8 flags, UInt8 data);
+#endif
 
   OSObject *               _interruptTargetKeyboard;
-  OSObject *               _interruptTargetMouse;
+  OSObject *               _interruptTargetMouse[kMaxAuxPorts];
   PS2InterruptAction       _interruptActionKeyboard;
-  PS2InterruptAction       _interruptActionMouse;
+  PS2InterruptAction       _interruptActionMouse[kMaxAuxPorts];
+  PS2InterruptBatchAction  _interruptBatchActionKeyboard;
+  PS2InterruptBatchAction  _interruptBatchActionMouse[kMaxAuxPorts];
   bool                     _interruptInstalledKeyboard;
-  bool                     _interruptInstalledMouse;
+  bool                     _interruptInstalledMouse; // IRQ, for any aux port
+  bool                     _auxPortInstalled[kMaxAuxPorts];
+
+  UInt8                    _interruptBatch[2][kInterruptBatchSize];
+  UInt64                   _interruptBatchTime[2][kInterruptBatchSize];
+  UInt32                   _interruptBatchCount[2]; // per PS2DeviceType
+  bool                     _interruptBatching;    // draining input stream
+
+  UInt32                   _latencyHistogram[2][kLatencyStages][kLatencyBuckets];
+  volatile SInt32          _eventCounters[2][kEventCounters];
+  IOTimerEventSource *     _statisticsTimer;
+  volatile UInt32          _statisticsPublishPending;
+
+  IOTimerEventSource *     _pollTimer;
+  bool                     _polling;              // no interrupts, polled
+  UInt32                   _pollInterval;         // usec, while polling
+  bool                     _pollWatching;         // no interrupt seen yet
+  bool                     _pollWatchFull;        // output buffer full then
+  UInt64                   _pollLastTime;
+  UInt32                   _pollCount;
+  UInt32                   _pollHits;             // polls that found a byte
+  UInt64                   _pollGapTotal;         // since previous poll, hits
+  UInt64                   _pollGapMaximum;
+
+  IOTimerEventSource *     _watchdogTimer;
+  bool                     _watchdogArmed;
+  UInt64                   _lastInputTime[kInputChannels];
+  UInt64                   _stallTime[kInputChannels]; // stall began, or zero
+  UInt32                   _recoveryAttempts[kInputChannels]; // this stall
+  UInt64                   _recoveryTotal[2];     // stall to recovered
+  UInt64                   _recoveryMaximum[2];
+  PS2Request *             _recoveryRequest;      // restarting a stream
+  thread_call_t            _recoveryCall;         // tells drivers, see below
+  volatile UInt32          _recoveryNotify;       // input channels recovered
 
   OSObject *               _powerControlTargetKeyboard;
-  OSObject *               _powerControlTargetMouse;
+  OSObject *               _powerControlTargetMouse[kMaxAuxPorts];
   PS2PowerControlAction    _powerControlActionKeyboard;
-  PS2PowerControlAction    _powerControlActionMouse;
+  PS2PowerControlAction    _powerControlActionMouse[kMaxAuxPorts];
   bool                     _powerControlInstalledKeyboard;
-  bool                     _powerControlInstalledMouse;
+  bool                     _powerControlInstalledMouse[kMaxAuxPorts];
+  PS2ResumeSnapshot        _resumeSnapshot[2];    // per PS2DeviceType
+  PS2PacketFraming         _framing[kInputChannels];
 
-  ApplePS2MouseDevice *    _mouseDevice;          // mouse nub
+  ApplePS2MouseDevice *    _mouseDevices[kMaxAuxPorts]; // mouse nubs
   ApplePS2KeyboardDevice * _keyboardDevice;       // keyboard nub
 
 #if DEBUGGER_SUPPORT
@@ -219,19 +716,112 @@ private:
   bool   				   _newIRQLayout;
 #endif
 
-  virtual void  dispatchDriverInterrupt(PS2DeviceType deviceType, UInt8 data);
+  virtual void  dispatchDriverInterrupt(PS2DeviceType deviceType,
+                                        UInt8         data,
+                                        UInt64        time);
+  virtual void  batchDriverInterrupt(PS2DeviceType deviceType,
+                                     UInt8         data,
+                                     UInt64        time);
+  virtual void  flushDriverInterrupts();
+  virtual void  queueAuxInput(UInt8 data, UInt64 time);
+  virtual void  auxInputOccurred(IOInterruptEventSource *, int);
+  virtual void  routeInputByte(PS2DeviceType deviceType,
+                               UInt8         data,
+                               UInt64        time);
+  virtual UInt64 takeInterruptTime(PS2DeviceType deviceType, UInt32 tag);
+  virtual void  scheduleStatistics();
+  virtual void  statisticsTimerFired(OSObject *, IOTimerEventSource *);
+  virtual void  recordRequestLatency(PS2RequestContext * context,
+                                     unsigned            stage,
+                                     UInt64              endTime);
+  virtual void  publishLatency();
+  virtual void  publishEventCounters();
+  virtual void  armPollTimer();
+  virtual void  pollTimerFired(OSObject *, IOTimerEventSource *);
+  virtual void  startPolling();
+  virtual void  publishPolling();
+  virtual void  noteStall(unsigned channel, UInt64 since);
+  virtual void  watchdogTimerFired(OSObject *, IOTimerEventSource *);
+  virtual void  recoverPort(unsigned channel);
+  virtual void  recoveryDone(unsigned channel, bool recovered);
+  virtual bool  waitInputBuffer(PS2DeviceType deviceType);
+  static  void  recoveryRequestDone(void * target, void * param);
+  static  void  recoveryCallFired(thread_call_param_t param0,
+                                  thread_call_param_t param1);
+
+  static IOReturn resetLatencyAction(OSObject * target,
+                                     void * arg0, void * arg1,
+                                     void * arg2, void * arg3);
+  virtual bool  interruptLive(PS2DeviceType deviceType);
   virtual void  interruptOccurred(IOInterruptEventSource *, int);
-  virtual void  processRequest(PS2Request * request);
   virtual void  processRequestQueue(IOInterruptEventSource *, int);
+  virtual void  drainRequestQueue(bool mayPark);
+  virtual void  flushRequestQueue();
+  virtual bool  enqueueRequest(PS2Request *  request,
+                               PS2DeviceType deviceType,
+                               UInt8         auxPort);
+  virtual void  overflowRequest(PS2Request *  request,
+                                PS2DeviceType deviceType,
+                                UInt8         auxPort);
+  virtual void  pullRequestRing();
+  virtual PS2Request * dequeueRequest(UInt64 *        submitTime,
+                                      PS2DeviceType * deviceType,
+                                      UInt8 *         auxPort);
+  virtual void  publishRequestPoolStatistics();
   static  void  submitRequestAndBlockCompletion(void *, void * param);
 
+  static IOReturn cancelRequestsAction(OSObject * target,
+                                       void * arg0, void * arg1,
+                                       void * arg2, void * arg3);
+
+  virtual void  startRequest(PS2Request *  request,
+                             PS2DeviceType deviceType,
+                             UInt8         auxPort,
+                             UInt64        submitTime,
+                             bool          mayPark);
+  virtual bool  requestTargetsMouse(PS2Request * request);
+  virtual bool  closeQuietWindow(PS2RequestContext * context);
+  virtual bool  runRequest(PS2RequestContext * context, bool mayPark);
+  virtual void  resolveReadStep(PS2RequestContext * context,
+                                UInt8               byte,
+                                UInt64              time);
+  virtual void  timeoutReadStep(PS2RequestContext * context);
+  virtual void  errorReadStep(PS2RequestContext * context);
+  virtual void  muxErrorOccurred();
+  virtual void  releaseHeldBytes(PS2RequestContext * context);
+  virtual void  trackFraming(unsigned channel, UInt8 data);
+  virtual bool  framingContinues(unsigned channel);
+  virtual void  retransmitByte(PS2RequestContext * context, bool mayPark);
+  virtual void  parkRequest(PS2RequestContext * context);
+  virtual void  resumeRequest();
+  virtual void  finishRequest(PS2RequestContext * context);
+  virtual void  requestTimerFired(OSObject *, IOTimerEventSource *);
+
+  virtual bool  pollDataPort(PS2DeviceType deviceType,
+                             UInt8 *       byte,
+                             UInt64 *      time);
+  virtual bool  waitDataPort(PS2DeviceType deviceType,
+                             UInt8 *       byte,
+                             UInt64 *      time,
+                             UInt32        milliseconds);
   virtual UInt8 readDataPort(PS2DeviceType deviceType);
+  virtual UInt32 responseTimeout(PS2DeviceType deviceType);
+  virtual void  recordResponse(PS2DeviceType deviceType,
+                               UInt64        startTime,
+                               UInt64        time);
+  virtual void  recordResponseTimeout(PS2DeviceType deviceType,
+                                      UInt32        milliseconds);
   virtual void  writeCommandPort(UInt8 byte);
-  virtual void  writeDataPort(UInt8 byte);
+  virtual bool  writeDataPort(UInt8 byte);
+  virtual bool  takesParameter(UInt8 byte, bool mouse);
+  virtual UInt8 readCommandByte();
+  virtual bool  enableMux();
+  virtual void  probeAuxPorts();
+  virtual void  dropMuxPorts();
 
-#if OUT_OF_ORDER_DATA_CORRECTION_FEATURE
-  virtual UInt8 readDataPort(PS2DeviceType deviceType, UInt8 expectedByte);
-#endif
+  inline PS2DeviceType decodeStatus(UInt8 status);
+  inline bool          muxError(UInt8 status);
+  inline unsigned      inputChannel(PS2DeviceType deviceType, UInt8 auxPort);
 
   static void setPowerStateCallout(thread_call_param_t param0,
                                    thread_call_param_t param1);
@@ -241,9 +831,34 @@ private:
                                       void * arg2, void * arg3);
 
   virtual void setPowerStateGated(UInt32 newPowerState);
+  virtual void changePowerState(UInt32 newPowerState);
 
   virtual void dispatchDriverPowerControl(UInt32 whatToDo);
 
+  static IOReturn powerControlAction(OSObject * target,
+                                     void * arg0, void * arg1,
+                                     void * arg2, void * arg3);
+
+  static IOReturn setResumeSnapshotAction(OSObject * target,
+                                          void * arg0, void * arg1,
+                                          void * arg2, void * arg3);
+
+  static IOReturn copyResumeSnapshotAction(OSObject * target,
+                                           void * arg0, void * arg1,
+                                           void * arg2, void * arg3);
+
+  static IOReturn setResumeRestoredAction(OSObject * target,
+                                          void * arg0, void * arg1,
+                                          void * arg2, void * arg3);
+
+  virtual bool resumeDevice(PS2DeviceType deviceType);
+
+  static IOReturn setPacketFramingAction(OSObject * target,
+                                         void * arg0, void * arg1,
+                                         void * arg2, void * arg3);
+
+  virtual void initializeHardware(bool fast);
+
   virtual void free(void);
 
 public:
@@ -252,25 +867,191 @@ public:
   virtual void stop(IOService * provider);
 
   virtual IOWorkLoop * getWorkLoop() const;
-  virtual IOSyncer * CreateIOSyncer(bool twoRetains);
   virtual void installInterruptAction(PS2DeviceType      deviceType,
                                       OSObject *         target,
-                                      PS2InterruptAction action);
-  virtual void uninstallInterruptAction(PS2DeviceType deviceType);
+                                      PS2InterruptAction action,
+                                      UInt8              auxPort = 0);
+  virtual void installInterruptBatchAction(PS2DeviceType           deviceType,
+                                           OSObject *              target,
+                                           PS2InterruptBatchAction action,
+                                           UInt8                   auxPort = 0);
+  virtual void uninstallInterruptAction(PS2DeviceType deviceType,
+                                        UInt8         auxPort = 0);
+  virtual void recordLatency(PS2DeviceType   deviceType,
+                             PS2LatencyStage stage,
+                             UInt64          startTime,
+                             UInt64          endTime);
+  virtual void countEvent(PS2DeviceType deviceType, PS2EventCounter counter);
+  virtual IOReturn setProperties(OSObject * properties);
+  virtual IOReturn newUserClient(task_t         owningTask,
+                                 void *         securityID,
+                                 UInt32         type,
+                                 OSDictionary * properties,
+                                 IOUserClient ** handler);
+#if FLIGHT_RECORDER_SUPPORT
+  virtual OSData * copyTrace();
+#endif
 
   virtual PS2Request * allocateRequest();
   virtual void         freeRequest(PS2Request * request);
-  virtual bool         submitRequest(PS2Request * request);
-  virtual void         submitRequestAndBlock(PS2Request * request);
+  virtual bool         submitRequest(PS2Request *  request,
+                                     PS2DeviceType deviceType,
+                                     UInt8         auxPort = 0);
+  virtual void         submitRequestAndBlock(PS2Request *  request,
+                                             PS2DeviceType deviceType,
+                                             UInt8         auxPort = 0);
+
+  virtual void         cancelRequests(PS2DeviceType deviceType,
+                                      UInt8         auxPort = 0);
+
+  virtual void setCommandByte(UInt8 setBits, UInt8 clearBits);
 
   virtual IOReturn setPowerState(unsigned long powerStateOrdinal,
                                  IOService *   policyMaker);
 
   virtual void installPowerControlAction(PS2DeviceType         deviceType,
                                          OSObject *            target, 
-                                         PS2PowerControlAction action);
+                                         PS2PowerControlAction action,
+                                         UInt8                 auxPort = 0);
+
+  virtual void uninstallPowerControlAction(PS2DeviceType deviceType,
+                                           UInt8         auxPort = 0);
+
+  virtual void setResumeSnapshot(PS2DeviceType      deviceType,
+                                 const UInt8 *      identity,
+                                 UInt32             identityLength,
+                                 const PS2Request * restore,
+                                 UInt8              auxPort = 0);
 
-  virtual void uninstallPowerControlAction(PS2DeviceType deviceType);
+  virtual void setPacketFraming(PS2DeviceType deviceType,
+                                UInt8         packetLength,
+                                UInt8         syncMask,
+                                UInt8         syncValue,
+                                UInt8         auxPort = 0);
+
+#if PORT_IO_BACKEND_SUPPORT
+  virtual void setPortBackend(const PS2PortBackend * backend);
+#endif
 };
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Port access.  Without PORT_IO_BACKEND_SUPPORT these compile down to the
+// bare inb/outb/IODelay calls they replace.
+//
+
+#if FLIGHT_RECORDER_SUPPORT
+inline void ApplePS2Controller::traceRecord(UInt8 flags, UInt8 data)
+{
+  UInt32           sequence = (UInt32) OSIncrementAtomic(&_traceHead) + 1;
+  PS2TraceRecord * record   = &_traceRing[(sequence - 1) & (kTraceRingSize-1)];
+
+  record->sequence = 0;                 // (invalid while being filled in)
+  OSMemoryBarrier();
+  record->time  = mach_absolute_time();
+  record->flags = flags;
+  record->data  = data;
+  OSMemoryBarrier();
+  record->sequence = sequence;
+}
+#endif //FLIGHT_RECORDER_SUPPORT
+
+inline UInt8 ApplePS2Controller::inPort(UInt16 port)
+{
+  UInt8 byte;
+
+  // (counted ahead of the read, so that an interrupt raised by the next byte
+  //  is already tagged past this one)
+  if (port == kDataPort)  OSIncrementAtomic(&_dataPortReads);
+
+#if PORT_IO_BACKEND_SUPPORT
+  byte = (*_portBackend.readAction)(_portBackend.target, port);
+#else
+  byte = inb(port);
+#endif
+
+#if FLIGHT_RECORDER_SUPPORT
+  if (port == kDataPort)
+  {
+    if (_traceLastStatus & kMouseData)
+      traceRecord(kTF_Mouse, byte);
+    else
+      traceRecord(kTF_Redacted, 0);
+  }
+  else if (byte != _traceLastStatus)
+  {
+    _traceLastStatus = byte;
+    traceRecord(kTF_CommandPort, byte);
+  }
+#endif
+
+  return byte;
+}
+
+inline void ApplePS2Controller::outPort(UInt16 port, UInt8 byte)
+{
+#if PORT_IO_BACKEND_SUPPORT
+  (*_portBackend.writeAction)(_portBackend.target, port, byte);
+#else
+  outb(port, byte);
+#endif
+
+#if FLIGHT_RECORDER_SUPPORT
+  if (port == kDataPort)
+  {
+    traceRecord(kTF_Write | (_traceToMouse ? kTF_Mouse : 0), byte);
+    _traceToMouse = false;
+  }
+  else
+  {
+    traceRecord(kTF_Write | kTF_CommandPort, byte);
+    _traceToMouse = (byte == kCP_TransmitToMouse ||
+                     (byte & ~(kMaxAuxPorts - 1)) == kCP_TransmitToMuxPortBase);
+  }
+#endif
+}
+
+inline void ApplePS2Controller::noteInterruptTime(PS2DeviceType deviceType,
+                                                  UInt64        time)
+{
+  // (one store, so the work loop never sees a time with a stale tag)
+  _interruptTime[deviceType] = (time & ~kInterruptTagMask) |
+                               (_dataPortReads & kInterruptTagMask);
+}
+
+inline PS2DeviceType ApplePS2Controller::decodeStatus(UInt8 status)
+{
+  //
+  // Returns the input stream the byte about to be read off the data port
+  // came in on, given the status read just before, and notes its aux port.
+  //
+
+  if (!(status & kMouseData))  return kDT_Keyboard;
+
+  _inputAuxPort = _muxActive ? (status >> kMuxPortShift) & (kMaxAuxPorts - 1)
+                             : 0;
+  return kDT_Mouse;
+}
+
+inline bool ApplePS2Controller::muxError(UInt8 status)
+{
+  // An aux port with nothing (working) behind it answers with an error code.
+  return _muxActive && (status & (kMouseData | kMuxError)) ==
+                                 (kMouseData | kMuxError);
+}
+
+inline unsigned ApplePS2Controller::inputChannel(PS2DeviceType deviceType,
+                                                 UInt8         auxPort)
+{
+  return (deviceType == kDT_Mouse) ? 1 + auxPort : 0;
+}
+
+inline void ApplePS2Controller::portDelay(UInt32 microseconds)
+{
+#if PORT_IO_BACKEND_SUPPORT
+  (*_portBackend.delayAction)(_portBackend.target, microseconds);
+#else
+  IODelay(microseconds);
+#endif
+}
+
 #endif /* _APPLEPS2CONTROLLER_H */
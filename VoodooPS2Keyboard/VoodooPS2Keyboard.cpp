@@ -56,6 +56,7 @@ bool ApplePS2Keyboard::init(OSDictionary * properties)
 
   _device                    = 0;
   _extendCount               = 0;
+  _packetStartTime           = 0;
   _interruptHandlerInstalled = false;
   _ledState                  = 0;
 
@@ -192,6 +193,12 @@ void ApplePS2Keyboard::stop(IOService * provider)
 
   assert(_device == provider);
 
+  //
+  // Drop whatever requests are still outstanding; the keyboard may be gone.
+  //
+
+  _device->cancelRequests();
+
   //
   // Disable the keyboard itself, so that it may stop reporting key events.
   //
@@ -202,7 +209,7 @@ void ApplePS2Keyboard::stop(IOService * provider)
   // Disable the keyboard clock and the keyboard IRQ line.
   //
 
-  setCommandByte(kCB_DisableKeyboardClock, kCB_EnableKeyboardIRQ);
+  _device->setCommandByte(kCB_DisableKeyboardClock, kCB_EnableKeyboardIRQ);
 
   //
   // Uninstall the interrupt handler.
@@ -243,7 +250,22 @@ void ApplePS2Keyboard::interruptOccurred(UInt8 scanCode)   // PS2InterruptAction
   else if (scanCode == kSC_Resend)
     IOLog("%s: Unexpected resend request from PS/2 controller.\n", getName());
   else
-    dispatchKeyboardEventWithScancode(scanCode);
+  {
+    //
+    // Report how long the scan code sequence took to come in, and how long
+    // the key event took to dispatch, to the controller's histograms.
+    //
+
+    UInt64 now = mach_absolute_time();
+
+    if (_extendCount == 0)  _packetStartTime = now;
+
+    if (dispatchKeyboardEventWithScancode(scanCode))
+    {
+      _device->recordLatency(kLS_Packet, _packetStartTime, now);
+      _device->recordLatency(kLS_Dispatch, now, mach_absolute_time());
+    }
+  }
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -564,6 +586,7 @@ void ApplePS2Keyboard::setLEDs(UInt8 ledState)
   request->commands[3].command = kPS2C_ReadDataPortAndCompare;
   request->commands[3].inOrOut = kSC_Acknowledge;
   request->commandsCount = 4;
+  request->priority = kRP_Interactive;     // (caps lock feedback goes first)
   _device->submitRequestAndBlock(request);
   _device->freeRequest(request);
 }
@@ -595,61 +618,6 @@ void ApplePS2Keyboard::setKeyboardEnable(bool enable)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Keyboard::setCommandByte(UInt8 setBits, UInt8 clearBits)
-{
-  //
-  // Sets the bits setBits and clears the bits clearBits "atomically" in the
-  // controller's Command Byte.   Since the controller does not provide such
-  // a read-modify-write primitive, we resort to a test-and-set try loop.
-  //
-  // Do NOT issue this request from the interrupt/completion context.
-  //
-
-  UInt8        commandByte;
-  UInt8        commandByteNew;
-  PS2Request * request = _device->allocateRequest();
-
-  do
-  {
-    // (read command byte)
-    request->commands[0].command = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut = kCP_GetCommandByte;
-    request->commands[1].command = kPS2C_ReadDataPort;
-    request->commands[1].inOrOut = 0;
-    request->commandsCount = 2;
-    _device->submitRequestAndBlock(request);
-
-    //
-    // Modify the command byte as requested by caller.
-    //
-
-    commandByte    = request->commands[1].inOrOut;
-    commandByteNew = (commandByte | setBits) & (~clearBits);
-
-    // ("test-and-set" command byte)
-    request->commands[0].command = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut = kCP_GetCommandByte;
-    request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-    request->commands[1].inOrOut = commandByte;
-    request->commands[2].command = kPS2C_WriteCommandPort;
-    request->commands[2].inOrOut = kCP_SetCommandByte;
-    request->commands[3].command = kPS2C_WriteDataPort;
-    request->commands[3].inOrOut = commandByteNew;
-    request->commandsCount = 4;
-    _device->submitRequestAndBlock(request);
-
-    //
-    // Repeat this loop if last command failed, that is, if the old command byte
-    // was modified since we first read it.
-    //
-
-  } while (request->commandsCount != 4);
-
-  _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 const unsigned char * ApplePS2Keyboard::defaultKeymapOfLength(UInt32 * length)
 {
 	//
@@ -783,7 +751,7 @@ void ApplePS2Keyboard::setDevicePowerState( UInt32 whatToDo )
 
       setKeyboardEnable( false );
 
-	  setCommandByte(kCB_DisableKeyboardClock, kCB_EnableKeyboardIRQ);
+	  _device->setCommandByte(kCB_DisableKeyboardClock, kCB_EnableKeyboardIRQ);
 
       if ( _interruptHandlerInstalled )
 		  _device->uninstallInterruptAction();
@@ -840,8 +808,8 @@ void ApplePS2Keyboard::initKeyboard()
   // and the keyboard Kscan -> scan code translation mode.
   //
 
-  setCommandByte(kCB_EnableKeyboardIRQ | kCB_TranslateMode,
-                 kCB_DisableKeyboardClock);
+  _device->setCommandByte(kCB_EnableKeyboardIRQ | kCB_TranslateMode,
+                          kCB_DisableKeyboardClock);
 
   //
   // Finally, we enable the keyboard itself, so that it may start reporting
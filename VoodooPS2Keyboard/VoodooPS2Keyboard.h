@@ -62,6 +62,7 @@ private:
     ApplePS2KeyboardDevice * _device;
     UInt32                   _keyBitVector[KBV_NUNITS];
     UInt8                    _extendCount;
+    UInt64                   _packetStartTime;
     UInt8                    _interruptHandlerInstalled:1;
     UInt8                    _powerControlHandlerInstalled:1;
     UInt8                    _ledState;
@@ -74,7 +75,6 @@ private:
     bool logScan; //enable/disable log scan codes
 
     virtual bool dispatchKeyboardEventWithScancode(UInt8 scanCode);
-    virtual void setCommandByte(UInt8 setBits, UInt8 clearBits);
     virtual void setLEDs(UInt8 ledState);
     virtual void setKeyboardEnable(bool enable);
     virtual void initKeyboard();
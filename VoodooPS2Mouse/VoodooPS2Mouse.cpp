@@ -54,6 +54,7 @@ bool ApplePS2Mouse::init(OSDictionary * properties)
   _device                    = 0;
   _interruptHandlerInstalled = false;
   _packetByteCount           = 0;
+  _packetStartTime           = 0;
   _packetLength              = kPacketLengthStandard;
   defres					 = (150) << 16; // (default is 150 dpi; 6 counts/mm)
   forceres					 = false;
@@ -61,6 +62,7 @@ bool ApplePS2Mouse::init(OSDictionary * properties)
   _type                      = kMouseTypeStandard;
   _buttonCount               = 3;
   _mouseInfoBytes            = (UInt32)-1;
+  _sampleRate                = 0;
 
   if (num=OSDynamicCast (OSNumber, properties->getObject ("DefaultResolution")))
 	defres = num->unsigned32BitValue();
@@ -176,6 +178,12 @@ void ApplePS2Mouse::stop(IOService * provider)
 
   assert(_device == provider);
 
+  //
+  // Drop whatever requests are still outstanding; the mouse may be gone.
+  //
+
+  _device->cancelRequests();
+
   //
   // Disable the mouse itself, so that it may stop reporting mouse events.
   //
@@ -186,7 +194,7 @@ void ApplePS2Mouse::stop(IOService * provider)
   // Disable the mouse clock and the mouse IRQ line.
   //
 
-  setCommandByte(kCB_DisableMouseClock, kCB_EnableMouseIRQ);
+  _device->setCommandByte(kCB_DisableMouseClock, kCB_EnableMouseIRQ);
 
   //
   // Uninstall the interrupt handler.
@@ -202,6 +210,9 @@ void ApplePS2Mouse::stop(IOService * provider)
   if ( _powerControlHandlerInstalled ) _device->uninstallPowerControlAction();
   _powerControlHandlerInstalled = false;
 
+  _device->setResumeSnapshot(0, 0, 0);
+  _device->setPacketFraming(0, 0, 0);
+
   //
   // Release the pointer to the provider object.
   //
@@ -287,11 +298,30 @@ void ApplePS2Mouse::resetMouse()
 
   _packetByteCount = 0;
 
+  //
+  // Tell the controller how our packets look, so that motion can go on
+  // while requests are under way.  Bit 3 of the first byte is the only
+  // sync bit a standard mouse has, and the controller frames exactly as
+  // interruptOccurred does.  The overflow bits are no help: mice set them
+  // on fast motion, and a packet that has them is a packet all the same.
+  // Hence a motion byte with bit 3 set, arriving where a packet should
+  // start, is taken for one; only our own resynchronization (the reset in
+  // interruptOccurred) gets us back in step, and the controller with us.
+  //
+
+  _device->setPacketFraming(_packetLength, 0x08, 0x08);
+
+  //
+  // Leave the controller what it takes to skip all of the above on wake.
+  //
+
+  setResumeSnapshot();
+
   //
   // Enable the mouse clock (should already be so) and the mouse IRQ line.
   //
 
-  setCommandByte(kCB_EnableMouseIRQ, kCB_DisableMouseClock);
+  _device->setCommandByte(kCB_EnableMouseIRQ, kCB_DisableMouseClock);
 
   //
   // Finally, we enable the mouse itself, so that it may start reporting
@@ -303,8 +333,51 @@ void ApplePS2Mouse::resetMouse()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2Mouse::setResumeSnapshot()
+{
+  //
+  // The mouse ID tells whether the mouse kept its Intellimouse mode through
+  // sleep; if so, resolution and sampling rate are all there is to restore.
+  // The rate is the one programmed last, after the Intellimouse knock.
+  // Without its information bytes the mouse is left to a full reset.
+  //
+
+  PS2Request * request  = _device->allocateRequest();
+  UInt8        identity = _type;
+
+  if (!request)  return;
+
+  if (_mouseInfoBytes == (UInt32)-1)
+  {
+    _device->setResumeSnapshot(0, 0, 0);
+  }
+  else
+  {
+    request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[0].inOrOut = kDP_SetMouseResolution;
+    request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[1].inOrOut = (_mouseInfoBytes >> 8) & 0xFF;
+    request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[2].inOrOut = kDP_SetMouseSampleRate;
+    request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[3].inOrOut = _sampleRate;
+    request->commandsCount = 4;
+    _device->setResumeSnapshot(&identity, 1, request);
+  }
+
+  _device->freeRequest(request);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2Mouse::scheduleMouseReset()
 {
+  //
+  // Packet synchronization was lost; let the controller's statistics know.
+  //
+
+  _device->countEvent(kEC_Resync);
+
   //
   // Request the mouse to stop. A 0xF5 command is issued.
   //
@@ -349,13 +422,20 @@ void ApplePS2Mouse::interruptOccurred(UInt8 data)      // PS2InterruptAction
   //
   // Add this byte to the packet buffer.  If the packet is complete, that is,
   // we have the three (or four) bytes, dispatch this packet for processing.
+  // How long that took is reported to the controller's histograms.
   //
 
+  if (_packetByteCount == 0)  _packetStartTime = mach_absolute_time();
+
   _packetBuffer[_packetByteCount++] = data;
 
   if (_packetByteCount == _packetLength)
   {
+    UInt64 now = mach_absolute_time();
+
+    _device->recordLatency(kLS_Packet, _packetStartTime, now);
     dispatchRelativePointerEventWithPacket(_packetBuffer, _packetLength);
+    _device->recordLatency(kLS_Dispatch, now, mach_absolute_time());
     _packetByteCount = 0;
     _mouseResetCount = 0;
   }
@@ -527,6 +607,8 @@ void ApplePS2Mouse::setMouseSampleRate(UInt8 sampleRate)
 
   PS2Request * request = _device->allocateRequest();
 
+  _sampleRate = sampleRate;
+
   // (set mouse sample rate command)
   request->commands[0].command = kPS2C_WriteCommandPort;
   request->commands[0].inOrOut = kCP_TransmitToMouse;
@@ -691,6 +773,7 @@ UInt32 ApplePS2Mouse::getMouseInformation()
   request->commands[5].command = kPS2C_ReadDataPort;
   request->commands[5].inOrOut = 0;
   request->commandsCount = 6;
+  request->flags         = kRF_QuietWindow;   // (unframed answer)
   _device->submitRequestAndBlock(request);
 
   if (request->commandsCount == 6) // success?
@@ -731,6 +814,7 @@ UInt8 ApplePS2Mouse::getMouseID()
   request->commands[3].command = kPS2C_ReadDataPort;
   request->commands[3].inOrOut = 0;
   request->commandsCount = 4;
+  request->flags         = kRF_QuietWindow;   // (unframed answer)
   _device->submitRequestAndBlock(request);
 
   if (request->commandsCount == 4) // success?
@@ -743,61 +827,6 @@ UInt8 ApplePS2Mouse::getMouseID()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2Mouse::setCommandByte(UInt8 setBits, UInt8 clearBits)
-{
-  //
-  // Sets the bits setBits and clears the bits clearBits "atomically" in the
-  // controller's Command Byte.   Since the controller does not provide such
-  // a read-modify-write primitive, we resort to a test-and-set try loop.
-  //
-  // Do NOT issue this request from the interrupt/completion context.
-  //
-
-  UInt8        commandByte;
-  UInt8        commandByteNew;
-  PS2Request * request = _device->allocateRequest();
-
-  do
-  {
-    // (read command byte)
-    request->commands[0].command = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut = kCP_GetCommandByte;
-    request->commands[1].command = kPS2C_ReadDataPort;
-    request->commands[1].inOrOut = 0;
-    request->commandsCount = 2;
-    _device->submitRequestAndBlock(request);
-
-    //
-    // Modify the command byte as requested by caller.
-    //
-
-    commandByte    = request->commands[1].inOrOut;
-    commandByteNew = (commandByte | setBits) & (~clearBits);
-
-    // ("test-and-set" command byte)
-    request->commands[0].command = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut = kCP_GetCommandByte;
-    request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-    request->commands[1].inOrOut = commandByte;
-    request->commands[2].command = kPS2C_WriteCommandPort;
-    request->commands[2].inOrOut = kCP_SetCommandByte;
-    request->commands[3].command = kPS2C_WriteDataPort;
-    request->commands[3].inOrOut = commandByteNew;
-    request->commandsCount = 4;
-    _device->submitRequestAndBlock(request);
-
-    //
-    // Repeat this loop if last command failed, that is, if the old command byte
-    // was modified since we first read it.
-    //
-
-  } while (request->commandsCount != 4);  
-
-  _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 void ApplePS2Mouse::setDevicePowerState( UInt32 whatToDo )
 {
     switch ( whatToDo )
@@ -809,9 +838,18 @@ void ApplePS2Mouse::setDevicePowerState( UInt32 whatToDo )
             break;
 
         case kPS2C_EnableDevice:
+        case kPS2C_ResetDevice:
             
             // Enable mouse and restore state.
             resetMouse();
             break;
+
+        case kPS2C_ResumeDevice:
+
+            // State was restored by the controller; just enable the mouse.
+            _packetByteCount = 0;
+            _device->setCommandByte(kCB_EnableMouseIRQ, kCB_DisableMouseClock);
+            setMouseEnable( true );
+            break;
     }
 }
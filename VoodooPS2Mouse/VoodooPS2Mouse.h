@@ -55,11 +55,13 @@ private:
   unsigned              _powerControlHandlerInstalled:1;
   UInt8                 _packetBuffer[kPacketLengthMax];
   UInt32                _packetByteCount;
+  UInt64                _packetStartTime;
   UInt32                _packetLength;
   IOFixed               _resolution;                // (dots per inch)
   PS2MouseId            _type;
   IOItemCount           _buttonCount;
   UInt32                _mouseInfoBytes;
+  UInt8                 _sampleRate;                // (last programmed)
   UInt32                _mouseResetCount;
   IOFixed				defres;
   bool					forceres;
@@ -69,13 +71,13 @@ private:
                                                         UInt32  packetSize);
   virtual UInt8  getMouseID();
   virtual UInt32 getMouseInformation();
-  virtual void   setCommandByte(UInt8 setBits, UInt8 clearBits);
   virtual PS2MouseId setIntellimouseMode();
   virtual void   setMouseEnable(bool enable);
   virtual void   setMouseSampleRate(UInt8 sampleRate);
   virtual void   setMouseResolution(UInt8 resolution);
   virtual void   scheduleMouseReset();
   virtual void   resetMouse();
+  virtual void   setResumeSnapshot();
   virtual void   setDevicePowerState(UInt32 whatToDo);
 
 protected:
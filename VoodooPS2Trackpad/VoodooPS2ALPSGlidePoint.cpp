@@ -77,6 +77,8 @@ bool ApplePS2ALPSGlidePoint::init( OSDictionary * properties )
     _device                    = 0;
     _interruptHandlerInstalled = false;
     _packetByteCount           = 0;
+    _packetTime                = 0;
+    _packetStartTime           = 0;
     _resolution                = (100) << 16; // (100 dpi, 4 counts/mm) On init should be on default
     _touchPadModeByte          = kTapEnabled;
     _scrolling                 = SCROLL_NONE;
@@ -321,9 +323,8 @@ bool ApplePS2ALPSGlidePoint::start( IOService * provider )
 	//	DEBUG_LOG("E7: { 0x%02x, 0x%02x, 0x%02x } E6: { 0x%02x, 0x%02x, 0x%02x }",
 	//			  E7.byte0, E7.byte1, E7.byte2, E6.byte0, E6.byte1, E6.byte2);
 	//	setMisc(0x84);
-		setECMode(true);  
-		AlpsECWrite(0x0008, 0x82);
-		setECMode(false);
+		static const UInt16 ecWrites[][2] = { { 0x0008, 0x82 } };
+		setECRegisters(ecWrites, sizeof(ecWrites) / sizeof(ecWrites[0]));
 	/*	setMisc(0x82);
 	
 		AlpsECWrite(0x0004, 0x06);
@@ -354,6 +355,12 @@ bool ApplePS2ALPSGlidePoint::start( IOService * provider )
 		setAbsoluteMode();	
 	}
 
+    //
+    // Leave the controller what it takes to skip the power-on wait on wake.
+    //
+
+    setResumeSnapshot();
+
     //
     // Must add this property to let our superclass know that it should handle
     // trackpad acceleration settings from user space.  Without this, tracking
@@ -366,15 +373,15 @@ bool ApplePS2ALPSGlidePoint::start( IOService * provider )
     // Install our driver's interrupt handler, for asynchronous data delivery.
     //
 
-    _device->installInterruptAction(this,
-        OSMemberFunctionCast(PS2InterruptAction,this,&ApplePS2ALPSGlidePoint::interruptOccurred));
+    _device->installInterruptBatchAction(this,
+        OSMemberFunctionCast(PS2InterruptBatchAction,this,&ApplePS2ALPSGlidePoint::interruptOccurred));
     _interruptHandlerInstalled = true;
 
     //
     // Enable the mouse clock (should already be so) and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+    _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 
     //
     // Finally, we enable the trackpad itself, so that it may start reporting
@@ -406,6 +413,12 @@ void ApplePS2ALPSGlidePoint::stop( IOService * provider )
 	DEBUG_LOG("touchpad stopped\n");
     assert(_device == provider);
 
+    //
+    // Drop whatever requests are still outstanding; the pad may be gone.
+    //
+
+    _device->cancelRequests();
+
     //
     // Disable the mouse itself, so that it may stop reporting mouse events.
     //
@@ -416,7 +429,7 @@ void ApplePS2ALPSGlidePoint::stop( IOService * provider )
     // Disable the mouse clock and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
+    _device->setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
 
     //
     // Uninstall the interrupt handler.
@@ -432,6 +445,8 @@ void ApplePS2ALPSGlidePoint::stop( IOService * provider )
     if ( _powerControlHandlerInstalled ) _device->uninstallPowerControlAction();
     _powerControlHandlerInstalled = false;
 
+    _device->setResumeSnapshot( 0, 0, 0 );
+
 	super::stop(provider);
 }
 
@@ -454,65 +469,62 @@ void ApplePS2ALPSGlidePoint::free()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2ALPSGlidePoint::interruptOccurred( UInt8 data )
+void ApplePS2ALPSGlidePoint::interruptOccurred( const UInt8 * data, const UInt64 * times, UInt32 count )
 {
     //
     // This will be invoked automatically from our device when asynchronous
     // events need to be delivered. Process the trackpad data. Do NOT issue
     // any BLOCKING commands to our device in this context.
     //
-    // Ignore all bytes until we see the start of a packet, otherwise the
-    // packets may get out of sequence and things will get very confusing.
-    //
-	//debug any input	
-    if (_packetByteCount == 0 &&  !(data & 0x08))
-    {
-//		DEBUG_LOG("!%02x ", data);
-        return;
-    }
-    if (_packetByteCount == 0 && (data == kSC_Acknowledge))
+
+    UInt64 now = mach_absolute_time();
+
+    while (count)
     {
-        return;
-    }
-//	DEBUG_LOG("!%02x ", data);
-    _packetBuffer[_packetByteCount++] = data;
-    /*
-	if((_packetBuffer[0] & 0xc8) == 0x08) {
-		if(_packetByteCount == 3) {
-        dispatchRelativePointerEventWithPacket(_packetBuffer, 3);
-        _packetByteCount = 0;
-			return;
-		}
-		return;
+        //
+        // Ignore all bytes until we see the start of a packet, otherwise the
+        // packets may get out of sequence and things will get very confusing.
+        //
+        if (_packetByteCount == 0 && (!(*data & 0x08) || (*data == kSC_Acknowledge)))
+        {
+//		    DEBUG_LOG("!%02x ", *data);
+            data++;
+            times++;
+            count--;
+            continue;
+        }
+
+        //
+        // Add as much of the data as fits to the packet buffer, and dispatch
+        // the packet once it is complete.  The packet is timed by the arrival
+        // of its first byte.
+        //
+
+        UInt32 length = 6 - _packetByteCount;
+        if (length > count)  length = count;
+
+        if (_packetByteCount == 0)
+        {
+            _packetTime      = *times;
+            _packetStartTime = now;
+        }
+
+        bcopy(data, &_packetBuffer[_packetByteCount], length);
+        _packetByteCount += length;
+        data             += length;
+        times            += length;
+        count            -= length;
+
+        if (_packetByteCount == 6) // Absolute mode
+        {
+            UInt64 complete = mach_absolute_time();
+
+            _device->recordLatency(kLS_Packet, _packetStartTime, complete);
+            dispatchAbsolutePointerEventWithPacket(_packetBuffer,6);
+            _device->recordLatency(kLS_Dispatch, complete, mach_absolute_time());
+            _packetByteCount = 0;
+        }
     }
-	if((_packetBuffer[0] & 0xf8) != 0xf8) {
-		DEBUG_LOG("Bad data: %d bytes\n",(int)_packetByteCount);
-		_packetByteCount = 0;
-		return; //bad data.
-	}
-	if(_packetByteCount >= 2 && _packetByteCount <=6 && _packetBuffer[_packetByteCount-1] == 0x80)
-	{
-		DEBUG_LOG("Bad data2: %d bytes\n",(int)_packetByteCount);
-		_packetByteCount = 0;
-		return; //bad data
-	}*/
-	//THeKiNG
-/*	if(_packetByteCount == 3) // Normal PS/2 mouse mode
-	{
-		dispatchRelativePointerEventWithPacket(_packetBuffer,3);
-		_packetByteCount = 0;
-		return;
-	}*/
-	
-	if(_packetByteCount == 6) // Absolute mode
-	{
-//		DEBUG_LOG("\n");
-		dispatchAbsolutePointerEventWithPacket(_packetBuffer,6);
-		_packetByteCount = 0;
-		
-		return;
-	}
-	return;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -582,11 +594,7 @@ void ApplePS2ALPSGlidePoint::dispatchAbsolutePointerEventWithPacket(
 			  (unsigned int)packet[3], (unsigned int)packet[4], (unsigned int)packet[5]);
 	//IOSleep(20);
 
-#if APPLESDK
-	clock_get_uptime(&now);
-#else 
-	clock_get_uptime((uint64_t*)&now);
-#endif
+	*(uint64_t*)&now = _packetTime;
     
     left  |= (packet[3]) & 1;
     right |= (packet[3] >> 1) & 1;
@@ -1103,6 +1111,26 @@ void ApplePS2ALPSGlidePoint::setMisc( UInt16 val )
 }	
 
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2ALPSGlidePoint::setSampleRateAndResolutionCommands(PS2Request * request, int * index,
+                                                                uint8_t rate, uint8_t res )
+{
+	// No need to disable data reporting first: nothing is read back but
+	// acknowledges, which the controller keeps apart from packets.
+	request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+	request->commands[(*index)++].inOrOut = kDP_SetMouseSampleRate; 				// 0xF3
+	request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+	request->commands[(*index)++].inOrOut = rate;								// 100
+	request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+	request->commands[(*index)++].inOrOut = kDP_SetMouseResolution; 				// 0xE8
+	request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+	request->commands[(*index)++].inOrOut = res;   								// 0x02 = 4 counts per mm
+	// (the status knock in getStatus leaves reporting off)
+	request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+	request->commands[(*index)++].inOrOut = kDP_Enable; 							// 0xF4, Enable Data Reporting
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 void ApplePS2ALPSGlidePoint::setSampleRateAndResolution(uint8_t rate, uint8_t res )
@@ -1114,19 +1142,9 @@ void ApplePS2ALPSGlidePoint::setSampleRateAndResolution(uint8_t rate, uint8_t re
     PS2Request * request = _device->allocateRequest();
     if ( !request ) return;
 	DEBUG_LOG("setSampleRateAndResolution %d %d", (int)rate, (int)res);
-	request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut = kDP_SetDefaultsAndDisable; 			// 0xF5, Disable data reporting 
-	request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
-	request->commands[1].inOrOut = kDP_SetMouseSampleRate; 				// 0xF3
-	request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
-	request->commands[2].inOrOut = rate;								// 100
-	request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
-	request->commands[3].inOrOut = kDP_SetMouseResolution; 				// 0xE8
-	request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
-	request->commands[4].inOrOut = res;   								// 0x02 = 4 counts per mm
-	request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
-	request->commands[5].inOrOut = kDP_Enable; 							// 0xF4, Enable Data Reporting
-	request->commandsCount = 6;
+	int index = 0;
+	setSampleRateAndResolutionCommands(request, &index, rate, res);
+	request->commandsCount = index;
 	_device->submitRequestAndBlock(request);
 
     _device->freeRequest(request);
@@ -1169,63 +1187,6 @@ void ApplePS2ALPSGlidePoint::setSampleRateAndResolution(uint8_t rate, uint8_t re
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2ALPSGlidePoint::setCommandByte( UInt8 setBits, UInt8 clearBits )
-{
-    //
-    // Sets the bits setBits and clears the bits clearBits "atomically" in the
-    // controller's Command Byte.   Since the controller does not provide such
-    // a read-modify-write primitive, we resort to a test-and-set try loop.
-    //
-    // Do NOT issue this request from the interrupt/completion context.
-    //
-
-    UInt8        commandByte;
-    UInt8        commandByteNew;
-    PS2Request * request = _device->allocateRequest();
-	DEBUG_LOG("setCommandByte\n");
-    if ( !request ) return;
-
-    do
-    {
-        // (read command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPort;
-        request->commands[1].inOrOut = 0;
-        request->commandsCount = 2;
-        _device->submitRequestAndBlock(request);
-
-        //
-        // Modify the command byte as requested by caller.
-        //
-
-        commandByte    = request->commands[1].inOrOut;
-        commandByteNew = (commandByte | setBits) & (~clearBits);
-
-        // ("test-and-set" command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-        request->commands[1].inOrOut = commandByte;
-        request->commands[2].command = kPS2C_WriteCommandPort;
-        request->commands[2].inOrOut = kCP_SetCommandByte;
-        request->commands[3].command = kPS2C_WriteDataPort;
-        request->commands[3].inOrOut = commandByteNew;
-        request->commandsCount = 4;
-        _device->submitRequestAndBlock(request);
-
-        //
-        // Repeat this loop if last command failed, that is, if the
-        // old command byte was modified since we first read it.
-        //
-
-    } while (request->commandsCount != 4);  
-
-    _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 IOReturn ApplePS2ALPSGlidePoint::setParamProperties( OSDictionary * dict )
 {
     OSNumber * clicking = OSDynamicCast( OSNumber, dict->getObject("Clicking") );
@@ -1337,21 +1298,33 @@ void ApplePS2ALPSGlidePoint::setDevicePowerState( UInt32 whatToDo )
 			_touchPadModeByte = 0;
             setTouchPadEnable( false );
             break;
-		case 2:  //Slice :)
-			DEBUG_LOG("Touchpad waking up with state 2\n");
+		case kPS2C_ResumeDevice:
+			DEBUG_LOG("Touchpad waking up with kPS2C_ResumeDevice\n");
+
+			//
+			// The controller found the pad on wake and set it up again;
+			// as it answered, it is through its self-test already.
+			//
+
+            setTapEnable( _touchPadModeByte );
+            _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+			setTouchPadEnable( true );
+			break;
+
+        case kPS2C_ResetDevice:         // (recovered port, no power cycle)
         case kPS2C_EnableDevice:
 			DEBUG_LOG("Touchpad waking up with kPS2C_EnableDevice\n");
 		
 			//_touchPadModeByte = 1;
             setTapEnable( _touchPadModeByte );
-			IOSleep(1000);
+			if ( whatToDo != kPS2C_ResetDevice )  IOSleep(1000);
 
             //
             // Enable the mouse clock (should already be so) and the
             // mouse IRQ line.
             //
 
-            setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+            _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 		//	setTapEnable( _touchPadModeByte );
 			DEBUG_LOG(" Waking up Touchpad setting setTapEnable to %d\n",_touchPadModeByte);
 
@@ -1382,6 +1355,32 @@ void ApplePS2ALPSGlidePoint::setDevicePowerState( UInt32 whatToDo )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2ALPSGlidePoint::setResumeSnapshot()
+{
+    //
+    // Sampling rate and resolution, and absolute mode, are what start sets
+    // up for good; tapping is a toggle that has to read the status first,
+    // so that stays with the driver.  A GlidePoint answers kDP_GetId as a
+    // standard mouse, in either mode.
+    //
+
+    PS2Request * request  = _device->allocateRequest();
+    UInt8        identity = 0x00;
+    int          index    = 0;
+
+    if ( !request ) return;
+
+    setSampleRateAndResolutionCommands(request, &index, 100, 2);
+    if (_absolute)
+        setAbsoluteModeCommands(request, &index);
+    request->commandsCount = index;
+    _device->setResumeSnapshot(&identity, 1, request);
+
+    _device->freeRequest(request);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 bool ApplePS2ALPSGlidePoint::setECMode(bool enable)
 {
     UInt8   Byte1, Byte2, Byte3;
@@ -1389,6 +1388,34 @@ bool ApplePS2ALPSGlidePoint::setECMode(bool enable)
 
     if (!request) return false;
 
+    AlpsECModeCommands(request, enable);
+    _device->submitRequestAndBlock(request);
+
+	if (enable) {
+		// Result is "EC Report"
+		Byte1 = request->commands[5].inOrOut;
+		Byte2 = request->commands[6].inOrOut;
+		Byte3 = request->commands[7].inOrOut;
+		DEBUG_LOG("ApplePS2ALPSGlidePoint EC Report: { 0x%02x, 0x%02x, 0x%02x }\n",
+				  Byte1, Byte2, Byte3);
+		
+		if (!isECReport(Byte1, Byte2, Byte3)) // No luck so far :(
+		{
+			DEBUG_LOG("ApplePS2ALPSGlidePoint Failed to enter EC Mode!\n");
+			_device->freeRequest(request);
+			return false;
+		}
+	}
+
+    _device->freeRequest(request);
+
+	return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2ALPSGlidePoint::AlpsECModeCommands(PS2Request * request, bool enable)
+{
     // Set EC mode
     request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
     request->commands[0].inOrOut = kDP_SetMouseStreamMode;              // 0xEA
@@ -1408,32 +1435,16 @@ bool ApplePS2ALPSGlidePoint::setECMode(bool enable)
 		request->commands[7].command = kPS2C_ReadDataPort;
 		request->commands[7].inOrOut = 0;
 		request->commandsCount = 8;
-		_device->submitRequestAndBlock(request);
-		
-		// Result is "EC Report"
-		Byte1 = request->commands[5].inOrOut;
-		Byte2 = request->commands[6].inOrOut;
-		Byte3 = request->commands[7].inOrOut;
-		DEBUG_LOG("ApplePS2ALPSGlidePoint EC Report: { 0x%02x, 0x%02x, 0x%02x }\n",
-				  Byte1, Byte2, Byte3);
-		
-		if (Byte1 != 0x88 || Byte2 != 0x07 || (Byte3 != 0x9b && Byte3 != 0x9d)) // No luck so far :(
-		{
-			DEBUG_LOG("ApplePS2ALPSGlidePoint Failed to enter EC Mode!\n");
-			_device->freeRequest(request);
-			return false;
-		}
-		
-	
 	} else {
 		request->commandsCount = 1;
-		_device->submitRequestAndBlock(request);
-
 	}
+}
 
-    _device->freeRequest(request);
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-	return true;
+bool ApplePS2ALPSGlidePoint::isECReport(UInt8 byte1, UInt8 byte2, UInt8 byte3)
+{
+	return (byte1 == 0x88 && byte2 == 0x07 && (byte3 == 0x9b || byte3 == 0x9d));
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -1461,6 +1472,25 @@ int ApplePS2ALPSGlidePoint::AlpsECWrite(uint16_t addr, uint8_t value)
     
     if ( !request ) return 0;
 
+    int indRead = AlpsECWriteCommands(request, addr, value);
+
+    _device->submitRequestAndBlock(request);
+    
+    AddrH = request->commands[indRead++].inOrOut;
+    AddrL = request->commands[indRead++].inOrOut;
+    Val = request->commands[indRead].inOrOut;
+
+    DEBUG_LOG(" EC response: { addr_high: 0x%04x, addr_low: 0x%04x, value: 0x%02x }\n",
+        AddrH, AddrL, Val);
+
+    _device->freeRequest(request);
+    return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int ApplePS2ALPSGlidePoint::AlpsECWriteCommands(PS2Request * request, uint16_t addr, uint8_t value)
+{
     // Select new address: EC addr3 addr2 addr1 addr0
     request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;  //4
     request->commands[0].inOrOut =  kDP_MouseResetWrap; //sync.. EC
@@ -1490,17 +1520,71 @@ int ApplePS2ALPSGlidePoint::AlpsECWrite(uint16_t addr, uint8_t value)
     }
     
     request->commandsCount = index;
+    return indRead;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2ALPSGlidePoint::setECRegisters(const UInt16 (*writes)[2], int count)
+{
+    //
+    // Enter EC mode, write the given { address, value } pairs and leave EC
+    // mode again as one request.  Every step is a segment of its own, chained
+    // with nextSegment, so the controller runs them back to back instead of
+    // this thread waiting out a round trip per register.  As before, the
+    // writes and the exit go out whatever the EC report says.
+    //
+
+    PS2Request * request = _device->allocateRequest();
+    PS2Request * segment = request;
+    bool         success = true;
+
+    if ( !request ) return false;
+
+    AlpsECModeCommands(request, true);
+
+    for (int write = 0; write <= count && segment; write++)
+    {
+        PS2Request * next = _device->allocateRequest();
+
+        if ( next )
+        {
+            if (write < count)
+                AlpsECWriteCommands(next, writes[write][0], writes[write][1]);
+            else
+                AlpsECModeCommands(next, false);
+        }
+        segment->nextSegment = next;
+        segment = next;
+    }
+
+    if ( !segment )
+    {
+        _device->freeRequest(request);
+        return false;
+    }
+
     _device->submitRequestAndBlock(request);
-    
-    AddrH = request->commands[indRead++].inOrOut;
-    AddrL = request->commands[indRead++].inOrOut;
-    Val = request->commands[indRead].inOrOut;
 
-    DEBUG_LOG(" EC response: { addr_high: 0x%04x, addr_low: 0x%04x, value: 0x%02x }\n",
-        AddrH, AddrL, Val);
+    DEBUG_LOG("ApplePS2ALPSGlidePoint EC Report: { 0x%02x, 0x%02x, 0x%02x }\n",
+              request->commands[5].inOrOut, request->commands[6].inOrOut,
+              request->commands[7].inOrOut);
+
+    if (request->commandsCount != 8 ||
+        !isECReport(request->commands[5].inOrOut, request->commands[6].inOrOut,
+                    request->commands[7].inOrOut))
+    {
+        DEBUG_LOG("ApplePS2ALPSGlidePoint Failed to enter EC Mode!\n");
+        success = false;
+    }
+
+    // A failed step ends the request, and leaves the segments after it with
+    // a commandsCount of zero; so the exit segment tells whether it all ran.
+
+    success &= (segment->commandsCount == 1);
 
     _device->freeRequest(request);
-    return 0;
+    return success;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -1548,6 +1632,17 @@ void ApplePS2ALPSGlidePoint::getModel(ALPSStatus_t *E6,ALPSStatus_t *E7)
 
 	if ( !request )
         return;
+
+    // The E7 report is chained to the E6 report, so both are fetched in a
+    // single request.
+    PS2Request * requestE7 = _device->allocateRequest();
+    if ( !requestE7 )
+    {
+        _device->freeRequest(request);
+        return;
+    }
+    request->nextSegment = requestE7;
+
     DEBUG_LOG("getModel\n");
     // "E6 report"
     request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
@@ -1571,45 +1666,39 @@ void ApplePS2ALPSGlidePoint::getModel(ALPSStatus_t *E6,ALPSStatus_t *E7)
     request->commands[8].command = kPS2C_ReadDataPort;
     request->commands[8].inOrOut = 0;
 	request->commandsCount = 9;
+
+    // Now fetch "E7 report"
+    requestE7->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[0].inOrOut  = kDP_SetMouseResolution;
+	requestE7->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
+	requestE7->commands[1].inOrOut = 0;
+	
+    // 3X set mouse scaling 2 to 1
+    requestE7->commands[2].command  = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[2].inOrOut  = kDP_SetMouseScaling2To1;
+    requestE7->commands[3].command  = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[3].inOrOut  = kDP_SetMouseScaling2To1;
+    requestE7->commands[4].command  = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[4].inOrOut  = kDP_SetMouseScaling2To1;
+    requestE7->commands[5].command  = kPS2C_SendMouseCommandAndCompareAck;
+    requestE7->commands[5].inOrOut  = kDP_GetMouseInformation;
+    requestE7->commands[6].command  = kPS2C_ReadDataPort;
+    requestE7->commands[6].inOrOut  = 0;
+    requestE7->commands[7].command = kPS2C_ReadDataPort;
+    requestE7->commands[7].inOrOut = 0;
+    requestE7->commands[8].command = kPS2C_ReadDataPort;
+    requestE7->commands[8].inOrOut = 0;
+	requestE7->commandsCount = 9;
     _device->submitRequestAndBlock(request);
 	
     // result is "E6 report"
 	E6->byte0 = request->commands[6].inOrOut;
 	E6->byte1 = request->commands[7].inOrOut;
 	E6->byte2 = request->commands[8].inOrOut;
-    _device->freeRequest(request);
-	
-    request = _device->allocateRequest();
-    if (!request)
-        return;
 
-    // Now fetch "E7 report"
-    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut  = kDP_SetMouseResolution;
-	request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
-	request->commands[1].inOrOut = 0;
-	
-    // 3X set mouse scaling 2 to 1
-    request->commands[2].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut  = kDP_SetMouseScaling2To1;
-    request->commands[3].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut  = kDP_SetMouseScaling2To1;
-    request->commands[4].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[4].inOrOut  = kDP_SetMouseScaling2To1;
-    request->commands[5].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[5].inOrOut  = kDP_GetMouseInformation;
-    request->commands[6].command  = kPS2C_ReadDataPort;
-    request->commands[6].inOrOut  = 0;
-    request->commands[7].command = kPS2C_ReadDataPort;
-    request->commands[7].inOrOut = 0;
-    request->commands[8].command = kPS2C_ReadDataPort;
-    request->commands[8].inOrOut = 0;
-	request->commandsCount = 9;
-    _device->submitRequestAndBlock(request);
-
-	E7->byte0 = request->commands[6].inOrOut;
-	E7->byte1 = request->commands[7].inOrOut;
-	E7->byte2 = request->commands[8].inOrOut;
+	E7->byte0 = requestE7->commands[6].inOrOut;
+	E7->byte1 = requestE7->commands[7].inOrOut;
+	E7->byte2 = requestE7->commands[8].inOrOut;
 
 	_device->freeRequest(request);
 	
@@ -1620,29 +1709,37 @@ void ApplePS2ALPSGlidePoint::getModel(ALPSStatus_t *E6,ALPSStatus_t *E7)
 void ApplePS2ALPSGlidePoint::setAbsoluteMode()
 {
     PS2Request * request = _device->allocateRequest();
+    int          index   = 0;
 
     if ( !request )
         return;
 	DEBUG_LOG("setAbsoluteMode\n");
+	setAbsoluteModeCommands(request, &index);
+    request->commandsCount = index;
+    _device->submitRequestAndBlock(request);
+	_device->freeRequest(request);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2ALPSGlidePoint::setAbsoluteModeCommands(PS2Request * request, int * index)
+{
     // (read command byte)
-	request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut = kDP_SetDefaultsAndDisable;			//F5
-    request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[1].inOrOut = kDP_SetDefaultsAndDisable;			//F5
-    request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut = kDP_SetDefaultsAndDisable;			//F5
-    request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut = kDP_SetDefaultsAndDisable;			//F5
-	request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
-	request->commands[4].inOrOut = kDP_Enable;							//F4
+	request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[(*index)++].inOrOut = kDP_SetDefaultsAndDisable;		//F5
+    request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[(*index)++].inOrOut = kDP_SetDefaultsAndDisable;		//F5
+    request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[(*index)++].inOrOut = kDP_SetDefaultsAndDisable;		//F5
+    request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[(*index)++].inOrOut = kDP_SetDefaultsAndDisable;		//F5
+	request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+	request->commands[(*index)++].inOrOut = kDP_Enable;						//F4
 	
 	// Switch mouse to poll (remote) mode so motion data will not get in our way
 	
-	request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
-	request->commands[5].inOrOut = kDP_SetMousePoll; 					//F0
-    request->commandsCount = 6;
-    _device->submitRequestAndBlock(request);
-	_device->freeRequest(request);
+	request->commands[*index].command = kPS2C_SendMouseCommandAndCompareAck;
+	request->commands[(*index)++].inOrOut = kDP_SetMousePoll; 				//F0
 }
 
 // =============================================================================
\ No newline at end of file
@@ -51,6 +51,8 @@ private:
     UInt32                _powerControlHandlerInstalled:1;
     UInt8                 _packetBuffer[6];
     UInt32                _packetByteCount;
+    UInt64                _packetTime;            // first byte's arrival
+    UInt64                _packetStartTime;       // first byte's delivery
     IOFixed               _resolution;
     UInt16                _touchPadVersion;
     UInt8                 _touchPadModeByte;
@@ -109,17 +111,24 @@ protected:
 	virtual void   dispatchAbsolutePointerEventWithPacket(UInt8 *packet,UInt32 packetSize);
 	virtual void   getModel(ALPSStatus_t *e6,ALPSStatus_t *e7);
 	virtual void   setAbsoluteMode();
+	virtual void   setAbsoluteModeCommands(PS2Request * request, int * index);
+	virtual void   setResumeSnapshot();
 	virtual bool   setECMode(bool enable);
+	virtual bool   setECRegisters(const UInt16 (*writes)[2], int count);
+	virtual bool   isECReport(UInt8 byte1, UInt8 byte2, UInt8 byte3);
 	virtual void	setMisc( UInt16 val );
 	
+	virtual void	AlpsECModeCommands(PS2Request * request, bool enable);
 	virtual void	AlpsECNibble(PS2Request * request, int * index, uint8_t nibble);
+	virtual int		AlpsECWriteCommands(PS2Request * request, uint16_t addr, uint8_t value);
 	virtual int		AlpsECWrite(uint16_t addr, uint8_t value);
 	
 	virtual void   getStatus(ALPSStatus_t *status);
 	virtual int    insideScrollArea(int x,int y);
 
-    virtual void   setCommandByte( UInt8 setBits, UInt8 clearBits );
 	virtual void   setSampleRateAndResolution(uint8_t rate, uint8_t res );
+	virtual void   setSampleRateAndResolutionCommands(PS2Request * request, int * index,
+	                                                  uint8_t rate, uint8_t res );
 
 	virtual void   setTapEnable( bool enable );
     virtual void   setTouchPadEnable( bool enable );
@@ -129,7 +138,7 @@ protected:
                                         bool  enableStreamMode = false );
 #endif
 	virtual void   free();
-	virtual void   interruptOccurred( UInt8 data );
+	virtual void   interruptOccurred( const UInt8 * data, const UInt64 * times, UInt32 count );
     virtual void   setDevicePowerState(UInt32 whatToDo);
 
 protected:
@@ -60,6 +60,7 @@ bool ApplePS2SentelicFSP::init( OSDictionary * properties )
     _device                    = 0;
     _interruptHandlerInstalled = false;
     _packetByteCount           = 0;
+    _packetStartTime           = 0;
     _resolution                = (100) << 16; // (100 dpi, 4 counts/mm)
     _touchPadModeByte          = kModeByteValueGesturesDisabled;
 	
@@ -86,21 +87,20 @@ bool ApplePS2SentelicFSP::init( OSDictionary * properties )
 #define FSP_BIT_ONPAD_ENABLE    0x01
 #define FSP_BIT_FIX_VSCR        0x08
 
-int fsp_ps2_command(ApplePS2MouseDevice * device, PS2Request * request, int cmd)
+void fsp_ps2_command(PS2Request * request, int cmd)
 {
-    request->commands[0].command  = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut  = kCP_TransmitToMouse;
-    request->commands[1].command  = kPS2C_WriteDataPort;
-    request->commands[1].inOrOut  = cmd;
-    request->commands[2].command  = kPS2C_ReadDataPort;
-    request->commands[2].inOrOut  = 0;
-
-    request->commandsCount = 3;
-    device->submitRequestAndBlock(request);
+    // Append cmd to the request; the response byte is read but not checked.
+
+    int index = request->commandsCount;
 
-    //IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_ps2_command(cmd = %0x) => %0x\n", cmd, request->commands[2].inOrOut);
+    request->commands[index+0].command  = kPS2C_WriteCommandPort;
+    request->commands[index+0].inOrOut  = kCP_TransmitToMouse;
+    request->commands[index+1].command  = kPS2C_WriteDataPort;
+    request->commands[index+1].inOrOut  = cmd;
+    request->commands[index+2].command  = kPS2C_ReadDataPort;
+    request->commands[index+2].inOrOut  = 0;
 
-    return (request->commandsCount == 3) ? request->commands[2].inOrOut : -1;
+    request->commandsCount = index + 3;
 }
 
 int fsp_reg_read(ApplePS2MouseDevice * device, PS2Request * request, int reg)
@@ -117,28 +117,41 @@ int fsp_reg_read(ApplePS2MouseDevice * device, PS2Request * request, int reg)
         register_select = 0x68;
     }
 
-    fsp_ps2_command(device, request, 0xf3);
-    fsp_ps2_command(device, request, 0x66);
-    fsp_ps2_command(device, request, 0x88);
-    fsp_ps2_command(device, request, 0xf3);
-    fsp_ps2_command(device, request, register_select);
-    fsp_ps2_command(device, request, register_value);
-
-    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut  = kDP_GetMouseInformation;
-    request->commands[1].command  = kPS2C_ReadDataPort;
-    request->commands[1].inOrOut  = 0;
-    request->commands[2].command  = kPS2C_ReadDataPort;
-    request->commands[2].inOrOut  = 0;
-    request->commands[3].command  = kPS2C_ReadDataPort;
-    request->commands[3].inOrOut  = 0;
-
-    request->commandsCount = 4;
+    // The register select sequence fills the request; the read itself goes
+    // into a chained segment, so the whole thing is one trip to the
+    // controller.
+
+    PS2Request * readSegment = device->allocateRequest();
+    if (!readSegment)
+        return -1;
+
+    request->commandsCount = 0;
+    fsp_ps2_command(request, 0xf3);
+    fsp_ps2_command(request, 0x66);
+    fsp_ps2_command(request, 0x88);
+    fsp_ps2_command(request, 0xf3);
+    fsp_ps2_command(request, register_select);
+    fsp_ps2_command(request, register_value);
+
+    readSegment->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
+    readSegment->commands[0].inOrOut  = kDP_GetMouseInformation;
+    readSegment->commands[1].command  = kPS2C_ReadDataPort;
+    readSegment->commands[1].inOrOut  = 0;
+    readSegment->commands[2].command  = kPS2C_ReadDataPort;
+    readSegment->commands[2].inOrOut  = 0;
+    readSegment->commands[3].command  = kPS2C_ReadDataPort;
+    readSegment->commands[3].inOrOut  = 0;
+    readSegment->commandsCount = 4;
+
+    request->nextSegment = readSegment;
     device->submitRequestAndBlock(request);
+    request->nextSegment = 0;
 
-    //IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_reg_read(reg = %0x) => %0x\n", reg, request->commands[3].inOrOut);
+    //IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_reg_read(reg = %0x) => %0x\n", reg, readSegment->commands[3].inOrOut);
 
-    return (request->commandsCount == 4) ? request->commands[3].inOrOut : -1;
+    int value = (readSegment->commandsCount == 4) ? readSegment->commands[3].inOrOut : -1;
+    device->freeRequest(readSegment);
+    return value;
 }
 
 void fsp_reg_write(ApplePS2MouseDevice * device, PS2Request * request, int reg, int val)
@@ -155,9 +168,10 @@ void fsp_reg_write(ApplePS2MouseDevice * device, PS2Request * request, int reg,
         register_select = 0x74;
     }
 
-    fsp_ps2_command(device, request, 0xf3);
-    fsp_ps2_command(device, request, register_select);
-    fsp_ps2_command(device, request, register_value);
+    request->commandsCount = 0;
+    fsp_ps2_command(request, 0xf3);
+    fsp_ps2_command(request, register_select);
+    fsp_ps2_command(request, register_value);
 
     register_select = 0x33;
     register_value = val;
@@ -171,9 +185,11 @@ void fsp_reg_write(ApplePS2MouseDevice * device, PS2Request * request, int reg,
         register_select = 0x47;
     }
 
-    fsp_ps2_command(device, request, 0xf3);
-    fsp_ps2_command(device, request, register_select);
-    fsp_ps2_command(device, request, register_value);
+    fsp_ps2_command(request, 0xf3);
+    fsp_ps2_command(request, register_select);
+    fsp_ps2_command(request, register_value);
+
+    device->submitRequestAndBlock(request);
 
     //IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_reg_write(reg = %0x, val = %0x)\n", reg, val);
 }
@@ -330,7 +346,7 @@ bool ApplePS2SentelicFSP::start( IOService * provider )
     // Enable the mouse clock (should already be so) and the mouse IRQ line.
     //
 	
-    setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+    _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 	
     //
     // Finally, we enable the trackpad itself, so that it may start reporting
@@ -361,6 +377,12 @@ void ApplePS2SentelicFSP::stop( IOService * provider )
 	
     assert(_device == provider);
 	
+    //
+    // Drop whatever requests are still outstanding; the pad may be gone.
+    //
+
+    _device->cancelRequests();
+
     //
     // Disable the mouse itself, so that it may stop reporting mouse events.
     //
@@ -371,7 +393,7 @@ void ApplePS2SentelicFSP::stop( IOService * provider )
     // Disable the mouse clock and the mouse IRQ line.
     //
 	
-    setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
+    _device->setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
 	
     //
     // Uninstall the interrupt handler.
@@ -426,14 +448,21 @@ void ApplePS2SentelicFSP::interruptOccurred( UInt8 data )
 	
     //
     // Add this byte to the packet buffer. If the packet is complete, that is,
-    // we have the three bytes, dispatch this packet for processing.
+    // we have the three bytes, dispatch this packet for processing.  How long
+    // that took is reported to the controller's histograms.
     //
 	
+    if (_packetByteCount == 0)  _packetStartTime = mach_absolute_time();
+
     _packetBuffer[_packetByteCount++] = data;
     
     if (_packetByteCount == _packetSize)
     {
+        UInt64 now = mach_absolute_time();
+
+        _device->recordLatency(kLS_Packet, _packetStartTime, now);
         dispatchRelativePointerEventWithPacket(_packetBuffer, _packetSize);
+        _device->recordLatency(kLS_Dispatch, now, mach_absolute_time());
         _packetByteCount = 0;
     }
 }
@@ -573,63 +602,6 @@ UInt32 ApplePS2SentelicFSP::getTouchPadData( UInt8 dataSelector )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2SentelicFSP::setCommandByte( UInt8 setBits, UInt8 clearBits )
-{
-    //
-    // Sets the bits setBits and clears the bits clearBits "atomically" in the
-    // controller's Command Byte.   Since the controller does not provide such
-    // a read-modify-write primitive, we resort to a test-and-set try loop.
-    //
-    // Do NOT issue this request from the interrupt/completion context.
-    //
-	
-    UInt8        commandByte;
-    UInt8        commandByteNew;
-    PS2Request * request = _device->allocateRequest();
-	
-    if ( !request ) return;
-	
-    do
-    {
-        // (read command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPort;
-        request->commands[1].inOrOut = 0;
-        request->commandsCount = 2;
-        _device->submitRequestAndBlock(request);
-		
-        //
-        // Modify the command byte as requested by caller.
-        //
-		
-        commandByte    = request->commands[1].inOrOut;
-        commandByteNew = (commandByte | setBits) & (~clearBits);
-		
-        // ("test-and-set" command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-        request->commands[1].inOrOut = commandByte;
-        request->commands[2].command = kPS2C_WriteCommandPort;
-        request->commands[2].inOrOut = kCP_SetCommandByte;
-        request->commands[3].command = kPS2C_WriteDataPort;
-        request->commands[3].inOrOut = commandByteNew;
-        request->commandsCount = 4;
-        _device->submitRequestAndBlock(request);
-		
-        //
-        // Repeat this loop if last command failed, that is, if the
-        // old command byte was modified since we first read it.
-        //
-		
-    } while (request->commandsCount != 4);  
-	
-    _device->freeRequest(request);
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 IOReturn ApplePS2SentelicFSP::setParamProperties( OSDictionary * dict )
 {
     OSNumber * clicking = OSDynamicCast( OSNumber, dict->getObject("Clicking") );
@@ -672,20 +644,22 @@ void ApplePS2SentelicFSP::setDevicePowerState( UInt32 whatToDo )
 			
         case kPS2C_EnableDevice:
 		case 2:
+        case kPS2C_ResetDevice:
 			
             //
             // Must not issue any commands before the device has
-            // completed its power-on self-test and calibration.
+            // completed its power-on self-test and calibration.  A
+            // recovered port was not power cycled.
             //
 			
-            IOSleep(1000);
+            if ( whatToDo != kPS2C_ResetDevice )  IOSleep(1000);
 			
             //
             // Enable the mouse clock (should already be so) and the
             // mouse IRQ line.
             //
 			
-            setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+            _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 			
             //
             // Clear packet buffer pointer to avoid issues caused by
@@ -40,13 +40,13 @@ class ApplePS2SentelicFSP : public IOHIPointing
 		UInt32                _powerControlHandlerInstalled:1;
 		UInt8                 _packetBuffer[4];
 		UInt32                _packetByteCount;
+		UInt64                _packetStartTime;
 		UInt8                 _packetSize;
 		IOFixed               _resolution;
 		UInt16                _touchPadVersion;
 		UInt8                 _touchPadModeByte;
 		
 		virtual void   dispatchRelativePointerEventWithPacket( UInt8 * packet, UInt32  packetSize ); 
-		virtual void   setCommandByte( UInt8 setBits, UInt8 clearBits );
 		
 		virtual void   setTouchPadEnable( bool enable );
 		virtual UInt32 getTouchPadData( UInt8 dataSelector );
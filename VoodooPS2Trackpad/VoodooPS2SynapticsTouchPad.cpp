@@ -57,6 +57,8 @@ bool ApplePS2SynapticsTouchPad::init( OSDictionary * properties )
     _device                    = 0;
     _interruptHandlerInstalled = false;
     _packetByteCount           = 0;
+    _packetTime                = 0;
+    _packetStartTime           = 0;
     _resolution                = (2400) << 16; // 2400 dpi default was (100 dpi, 4 counts/mm)
     _touchPadModeByte          = 0x80; //default: absolute, low-rate, no w-mode
 	z_finger=30;
@@ -261,6 +263,12 @@ bool ApplePS2SynapticsTouchPad::start( IOService * provider )
 
     setTouchPadModeByte(_touchPadModeByte);
 
+    //
+    // Leave the controller what it takes to skip the power-on wait on wake.
+    //
+
+    setResumeSnapshot();
+
     //
     // Advertise the current state of the tapping feature.
     //
@@ -280,15 +288,22 @@ bool ApplePS2SynapticsTouchPad::start( IOService * provider )
     // Install our driver's interrupt handler, for asynchronous data delivery.
     //
 
-    _device->installInterruptAction(this,
-        OSMemberFunctionCast(PS2InterruptAction,this,&ApplePS2SynapticsTouchPad::interruptOccurred));
+    _device->installInterruptBatchAction(this,
+        OSMemberFunctionCast(PS2InterruptBatchAction,this,&ApplePS2SynapticsTouchPad::interruptOccurred));
     _interruptHandlerInstalled = true;
 
     //
     // Enable the mouse clock (should already be so) and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+    _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+
+    //
+    // Tell the controller how our packets look, so that it can keep them
+    // apart from command responses.
+    //
+
+    _device->setPacketFraming( 6, 0xc0, 0x80 );
 
     //
     // Finally, we enable the trackpad itself, so that it may start reporting
@@ -320,6 +335,12 @@ void ApplePS2SynapticsTouchPad::stop( IOService * provider )
 
     assert(_device == provider);
 
+    //
+    // Drop whatever requests are still outstanding; the pad may be gone.
+    //
+
+    _device->cancelRequests();
+
     //
     // Disable the mouse itself, so that it may stop reporting mouse events.
     //
@@ -330,7 +351,7 @@ void ApplePS2SynapticsTouchPad::stop( IOService * provider )
     // Disable the mouse clock and the mouse IRQ line.
     //
 
-    setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
+    _device->setCommandByte( kCB_DisableMouseClock, kCB_EnableMouseIRQ );
 
     //
     // Uninstall the interrupt handler.
@@ -346,6 +367,9 @@ void ApplePS2SynapticsTouchPad::stop( IOService * provider )
     if ( _powerControlHandlerInstalled ) _device->uninstallPowerControlAction();
     _powerControlHandlerInstalled = false;
 
+    _device->setResumeSnapshot( 0, 0, 0 );
+    _device->setPacketFraming( 0, 0, 0 );
+
 	super::stop(provider);
 }
 
@@ -368,32 +392,61 @@ void ApplePS2SynapticsTouchPad::free()
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2SynapticsTouchPad::interruptOccurred( UInt8 data )
+void ApplePS2SynapticsTouchPad::interruptOccurred( const UInt8 * data, const UInt64 * times, UInt32 count )
 {
     //
     // This will be invoked automatically from our device when asynchronous
     // events need to be delivered. Process the trackpad data. Do NOT issue
     // any BLOCKING commands to our device in this context.
     //
-    // Ignore all bytes until we see the start of a packet, otherwise the
-    // packets may get out of sequence and things will get very confusing.
-    //
-    if (_packetByteCount == 0 && ((data == kSC_Acknowledge) || ((data & 0xc0)!=0x80)))
-    {
-        return;
-    }
 
-    //
-    // Add this byte to the packet buffer. If the packet is complete, that is,
-    // we have the three bytes, dispatch this packet for processing.
-    //
+    UInt64 now = mach_absolute_time();
 
-    _packetBuffer[_packetByteCount++] = data;
-    
-    if (_packetByteCount == 6)
+    while (count)
     {
-        dispatchRelativePointerEventWithPacket(_packetBuffer, 6);
-        _packetByteCount = 0;
+        //
+        // Ignore all bytes until we see the start of a packet, otherwise the
+        // packets may get out of sequence and things will get very confusing.
+        //
+        if (_packetByteCount == 0 && ((*data == kSC_Acknowledge) || ((*data & 0xc0)!=0x80)))
+        {
+            data++;
+            times++;
+            count--;
+            continue;
+        }
+
+        //
+        // Add as much of the data as fits to the packet buffer. If the packet
+        // is complete, that is, we have the six bytes, dispatch this packet
+        // for processing.  The packet is timed by the arrival of its first
+        // byte, not by when we get around to processing it.
+        //
+
+        UInt32 length = 6 - _packetByteCount;
+        if (length > count)  length = count;
+
+        if (_packetByteCount == 0)
+        {
+            _packetTime      = *times;
+            _packetStartTime = now;
+        }
+
+        bcopy(data, &_packetBuffer[_packetByteCount], length);
+        _packetByteCount += length;
+        data             += length;
+        times            += length;
+        count            -= length;
+
+        if (_packetByteCount == 6)
+        {
+            UInt64 complete = mach_absolute_time();
+
+            _device->recordLatency(kLS_Packet, _packetStartTime, complete);
+            dispatchRelativePointerEventWithPacket(_packetBuffer, 6);
+            _device->recordLatency(kLS_Dispatch, complete, mach_absolute_time());
+            _packetByteCount = 0;
+        }
     }
 }
 
@@ -418,11 +471,7 @@ void ApplePS2SynapticsTouchPad::
 	AbsoluteTime now;
 	int x,y,z,w;
 
-#if APPLESDK
-	clock_get_uptime(&now);
-#else 
-	clock_get_uptime((uint64_t*)&now);
-#endif
+	*(uint64_t*)&now = _packetTime;
     if ( (packet[0] & 0x1)) buttons |= 0x1;  // left button   (bit 0 in packet)
     if ( (packet[0] & 0x2) ) buttons |= 0x2;  // right button  (bit 1 in packet)
     
@@ -624,49 +673,48 @@ UInt32 ApplePS2SynapticsTouchPad::getTouchPadData( UInt8 dataSelector )
 
     if ( !request ) return returnValue;
 
-    // Disable stream mode before the command sequence.
-    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut  = kDP_SetDefaultsAndDisable;
-
     // 4 set resolution commands, each encode 2 data bits.
+    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[0].inOrOut  = kDP_SetMouseResolution;
     request->commands[1].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[1].inOrOut  = kDP_SetMouseResolution;
-    request->commands[2].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut  = (dataSelector >> 6) & 0x3;
+    request->commands[1].inOrOut  = (dataSelector >> 6) & 0x3;
 
+    request->commands[2].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[2].inOrOut  = kDP_SetMouseResolution;
     request->commands[3].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut  = kDP_SetMouseResolution;
-    request->commands[4].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[4].inOrOut  = (dataSelector >> 4) & 0x3;
+    request->commands[3].inOrOut  = (dataSelector >> 4) & 0x3;
 
+    request->commands[4].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[4].inOrOut  = kDP_SetMouseResolution;
     request->commands[5].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[5].inOrOut  = kDP_SetMouseResolution;
-    request->commands[6].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[6].inOrOut  = (dataSelector >> 2) & 0x3;
+    request->commands[5].inOrOut  = (dataSelector >> 2) & 0x3;
 
+    request->commands[6].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[6].inOrOut  = kDP_SetMouseResolution;
     request->commands[7].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[7].inOrOut  = kDP_SetMouseResolution;
-    request->commands[8].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[8].inOrOut  = (dataSelector >> 0) & 0x3;
+    request->commands[7].inOrOut  = (dataSelector >> 0) & 0x3;
 
     // Read response bytes.
-    request->commands[9].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[9].inOrOut  = kDP_GetMouseInformation;
+    request->commands[8].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[8].inOrOut  = kDP_GetMouseInformation;
+    request->commands[9].command  = kPS2C_ReadDataPort;
+    request->commands[9].inOrOut  = 0;
     request->commands[10].command = kPS2C_ReadDataPort;
     request->commands[10].inOrOut = 0;
     request->commands[11].command = kPS2C_ReadDataPort;
     request->commands[11].inOrOut = 0;
-    request->commands[12].command = kPS2C_ReadDataPort;
-    request->commands[12].inOrOut = 0;
 
-    request->commandsCount = 13;
+    // The answer is not framed; have the controller hold the pad's stream
+    // for just this request.
+    request->commandsCount = 12;
+    request->flags         = kRF_QuietWindow;
     _device->submitRequestAndBlock(request);
 
-    if (request->commandsCount == 13) // success?
+    if (request->commandsCount == 12) // success?
     {
-        returnValue = ((UInt32)request->commands[10].inOrOut << 16) |
-                      ((UInt32)request->commands[11].inOrOut <<  8) |
-                      ((UInt32)request->commands[12].inOrOut);
+        returnValue = ((UInt32)request->commands[9].inOrOut  << 16) |
+                      ((UInt32)request->commands[10].inOrOut <<  8) |
+                      ((UInt32)request->commands[11].inOrOut);
     }
 
     _device->freeRequest(request);
@@ -684,106 +732,79 @@ bool ApplePS2SynapticsTouchPad::setTouchPadModeByte( UInt8 modeByteValue,
 
     if ( !request ) return false;
 
-    // Disable stream mode before the command sequence.
-    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut  = kDP_SetDefaultsAndDisable;
+    // The pad may go on streaming: its packets are framed, and nothing is
+    // read back but acknowledges.
+
+    setTouchPadModeByteCommands(request, modeByteValue);
+
+    request->commands[10].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[10].inOrOut  = enableStreamMode ?
+                                     kDP_Enable :
+                                     kDP_SetMouseScaling1To1; /* Nop */
+
+    request->commandsCount = 11;
+    _device->submitRequestAndBlock(request);
+
+    success = (request->commandsCount == 11);
+
+    _device->freeRequest(request);
+    
+    return success;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2SynapticsTouchPad::setTouchPadModeByteCommands( PS2Request * request,
+                                                             UInt8        modeByteValue )
+{
     // 4 set resolution commands, each encode 2 data bits.
+    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[0].inOrOut  = kDP_SetMouseResolution;
     request->commands[1].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[1].inOrOut  = kDP_SetMouseResolution;
-    request->commands[2].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut  = (modeByteValue >> 6) & 0x3;
+    request->commands[1].inOrOut  = (modeByteValue >> 6) & 0x3;
 
+    request->commands[2].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[2].inOrOut  = kDP_SetMouseResolution;
     request->commands[3].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut  = kDP_SetMouseResolution;
-    request->commands[4].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[4].inOrOut  = (modeByteValue >> 4) & 0x3;
+    request->commands[3].inOrOut  = (modeByteValue >> 4) & 0x3;
 
+    request->commands[4].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[4].inOrOut  = kDP_SetMouseResolution;
     request->commands[5].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[5].inOrOut  = kDP_SetMouseResolution;
-    request->commands[6].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[6].inOrOut  = (modeByteValue >> 2) & 0x3;
+    request->commands[5].inOrOut  = (modeByteValue >> 2) & 0x3;
 
+    request->commands[6].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[6].inOrOut  = kDP_SetMouseResolution;
     request->commands[7].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[7].inOrOut  = kDP_SetMouseResolution;
-    request->commands[8].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[8].inOrOut  = (modeByteValue >> 0) & 0x3;
+    request->commands[7].inOrOut  = (modeByteValue >> 0) & 0x3;
 
     // Set sample rate 20 to set mode byte 2. Older pads have 4 mode
     // bytes (0,1,2,3), but only mode byte 2 remain in modern pads.
+    request->commands[8].command  = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[8].inOrOut  = kDP_SetMouseSampleRate;
     request->commands[9].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[9].inOrOut  = kDP_SetMouseSampleRate;
-    request->commands[10].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[10].inOrOut = 20;
-
-    request->commands[11].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[11].inOrOut  = enableStreamMode ?
-                                     kDP_Enable :
-                                     kDP_SetMouseScaling1To1; /* Nop */
+    request->commands[9].inOrOut  = 20;
 
-    request->commandsCount = 12;
-    _device->submitRequestAndBlock(request);
-
-    success = (request->commandsCount == 12);
-
-    _device->freeRequest(request);
-    
-    return success;
+    request->commandsCount = 10;
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-void ApplePS2SynapticsTouchPad::setCommandByte( UInt8 setBits, UInt8 clearBits )
+void ApplePS2SynapticsTouchPad::setResumeSnapshot()
 {
     //
-    // Sets the bits setBits and clears the bits clearBits "atomically" in the
-    // controller's Command Byte.   Since the controller does not provide such
-    // a read-modify-write primitive, we resort to a test-and-set try loop.
-    //
-    // Do NOT issue this request from the interrupt/completion context.
+    // The mode byte is all the configuration the pad keeps, so it is all the
+    // controller needs to put back on wake.  A Synaptics pad answers
+    // kDP_GetId as a standard mouse, whatever its mode.
     //
 
-    UInt8        commandByte;
-    UInt8        commandByteNew;
-    PS2Request * request = _device->allocateRequest();
+    PS2Request * request  = _device->allocateRequest();
+    UInt8        identity = 0x00;
 
     if ( !request ) return;
 
-    do
-    {
-        // (read command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPort;
-        request->commands[1].inOrOut = 0;
-        request->commandsCount = 2;
-        _device->submitRequestAndBlock(request);
-
-        //
-        // Modify the command byte as requested by caller.
-        //
-
-        commandByte    = request->commands[1].inOrOut;
-        commandByteNew = (commandByte | setBits) & (~clearBits);
-
-        // ("test-and-set" command byte)
-        request->commands[0].command = kPS2C_WriteCommandPort;
-        request->commands[0].inOrOut = kCP_GetCommandByte;
-        request->commands[1].command = kPS2C_ReadDataPortAndCompare;
-        request->commands[1].inOrOut = commandByte;
-        request->commands[2].command = kPS2C_WriteCommandPort;
-        request->commands[2].inOrOut = kCP_SetCommandByte;
-        request->commands[3].command = kPS2C_WriteDataPort;
-        request->commands[3].inOrOut = commandByteNew;
-        request->commandsCount = 4;
-        _device->submitRequestAndBlock(request);
-
-        //
-        // Repeat this loop if last command failed, that is, if the
-        // old command byte was modified since we first read it.
-        //
-
-    } while (request->commandsCount != 4);  
+    setTouchPadModeByteCommands(request, _touchPadModeByte);
+    _device->setResumeSnapshot(&identity, 1, request);
 
     _device->freeRequest(request);
 }
@@ -857,7 +878,10 @@ IOReturn ApplePS2SynapticsTouchPad::setParamProperties( OSDictionary * config )
 		_touchPadModeByte &=~(1<<0);
 	
 	if (_touchPadModeByte!=oldmode && inited)
+	{
 		setTouchPadModeByte (_touchPadModeByte);
+		setResumeSnapshot ();
+	}
 	_packetByteCount=0;
 	touchmode = MODE_NOTOUCH;
 	
@@ -902,15 +926,28 @@ void ApplePS2SynapticsTouchPad::setDevicePowerState( UInt32 whatToDo )
             setTouchPadEnable( false );
             break;
 
+        case kPS2C_ResumeDevice:
+
+            //
+            // The controller found the pad on wake and put its mode byte
+            // back; as it answered, it is through its self-test already.
+            //
+
+            _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+            _packetByteCount = 0;
+            setTouchPadEnable( true );
+            break;
+
         case kPS2C_EnableDevice:
-		case 2:
+        case kPS2C_ResetDevice:
 
             //
             // Must not issue any commands before the device has
-            // completed its power-on self-test and calibration.
+            // completed its power-on self-test and calibration.  A
+            // recovered port was not power cycled.
             //
 
-            IOSleep(1000);
+            if ( whatToDo != kPS2C_ResetDevice )  IOSleep(1000);
 
             setTouchPadModeByte( _touchPadModeByte );
 
@@ -919,7 +956,7 @@ void ApplePS2SynapticsTouchPad::setDevicePowerState( UInt32 whatToDo )
             // mouse IRQ line.
             //
 
-            setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
+            _device->setCommandByte( kCB_EnableMouseIRQ, kCB_DisableMouseClock );
 
             //
             // Clear packet buffer pointer to avoid issues caused by
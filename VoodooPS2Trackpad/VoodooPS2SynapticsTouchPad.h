@@ -40,6 +40,8 @@ private:
     UInt32                _powerControlHandlerInstalled:1;
     UInt8                 _packetBuffer[50];
     UInt32                _packetByteCount;
+    UInt64                _packetTime;            // first byte's arrival
+    UInt64                _packetStartTime;       // first byte's delivery
     IOFixed               _resolution;
     UInt16                _touchPadVersion;
     UInt8                 _touchPadModeByte;
@@ -75,15 +77,16 @@ private:
 	virtual void   dispatchRelativePointerEventWithPacket( UInt8 * packet,
                                                            UInt32  packetSize );
 
-    virtual void   setCommandByte( UInt8 setBits, UInt8 clearBits );
-
     virtual void   setTouchPadEnable( bool enable );
     virtual UInt32 getTouchPadData( UInt8 dataSelector );
     virtual bool   setTouchPadModeByte( UInt8 modeByteValue,
                                         bool  enableStreamMode = false );
+    virtual void   setTouchPadModeByteCommands( PS2Request * request,
+                                                UInt8        modeByteValue );
+    virtual void   setResumeSnapshot();
 
 	virtual void   free();
-	virtual void   interruptOccurred( UInt8 data );
+	virtual void   interruptOccurred( const UInt8 * data, const UInt64 * times, UInt32 count );
     virtual void   setDevicePowerState(UInt32 whatToDo);
 
 protected:
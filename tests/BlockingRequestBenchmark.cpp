@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Round trip of a blocking request from outside the work loop: the
+// controller's submitRequestAndBlock, which waits on a flag on the caller's
+// stack, against the way it used to work, with an IOSyncer allocated for
+// every request (kept here as it was: an OSObject with a simple lock of its
+// own, retained twice, signalled from the completion routine).
+//
+// Both go through the real controller and the simulated i8042.  The device
+// time a request takes is the same either way; what differs is the host
+// time spent around it, so that is what is reported: for an empty request,
+// which is nothing but that overhead, and for kDP_GetId, which is what the
+// init and wake paths send.
+//
+
+#include <time.h>
+#include "PS2TestBench.h"
+
+#define kRoundTrips     20000
+
+static UInt64 wallNanoseconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (UInt64) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// =============================================================================
+// IOSyncer, as submitRequestAndBlock used it
+//
+
+class HostSyncer : public OSObject
+{
+  OSDeclareDefaultStructors(HostSyncer);
+
+public:
+  IOSimpleLock * guardLock;
+  volatile bool  threadMustStop;
+
+  static HostSyncer * create()
+  {
+    HostSyncer * me = new HostSyncer;
+
+    me->guardLock      = IOSimpleLockAlloc();
+    me->threadMustStop = false;
+    me->retain();                       // (twoRetains)
+    return me;
+  }
+
+  virtual void free()
+  {
+    IOSimpleLockFree(guardLock);
+    OSObject::free();
+  }
+
+  static bool stopped(void * context)
+  {
+    return ((HostSyncer *) context)->threadMustStop;
+  }
+
+  void wait()
+  {
+    IOSimpleLockLock(guardLock);
+    bool mustStop = threadMustStop;
+    IOSimpleLockUnlock(guardLock);
+
+    if (!mustStop)  hostRunUntil(stopped, this, ~0ULL);
+    release();
+  }
+
+  void signal()
+  {
+    IOSimpleLockLock(guardLock);
+    threadMustStop = true;
+    IOSimpleLockUnlock(guardLock);
+    release();
+  }
+
+  static void completion(void *, void * param)
+  {
+    ((HostSyncer *) param)->signal();
+  }
+};
+
+static void submitWithSyncer(ApplePS2KeyboardDevice * keyboard,
+                             PS2Request *             request)
+{
+  HostSyncer * syncer = HostSyncer::create();
+
+  request->completionTarget = keyboard;
+  request->completionAction = HostSyncer::completion;
+  request->completionParam  = syncer;
+
+  keyboard->submitRequest(request);
+  syncer->wait();
+}
+
+// =============================================================================
+// Benchmark
+//
+
+static void fillRequest(PS2Request * request, bool getId)
+{
+  bzero(request, sizeof(PS2Request));
+  if (!getId)  return;
+
+  request->commands[0].command = kPS2C_WriteDataPort;
+  request->commands[0].inOrOut = kDP_GetId;
+  request->commands[1].command = kPS2C_ReadDataPortAndCompare;
+  request->commands[1].inOrOut = kSC_Acknowledge;
+  request->commands[2].command = kPS2C_ReadDataPort;
+  request->commands[3].command = kPS2C_ReadDataPort;
+  request->commandsCount = 4;
+}
+
+static void run(PS2TestBench * bench, bool getId)
+{
+  //
+  // The two take turns, so that neither gets a warmer cache.
+  //
+
+  PS2Request * request = bench->keyboard->allocateRequest();
+  UInt64       wall[2]     = { 0, 0 };
+  UInt64       device[2]   = { 0, 0 };
+  unsigned     failures[2] = { 0, 0 };
+
+  for (unsigned index = 0; index < 2 * kRoundTrips; index++)
+  {
+    int    syncer      = index & 1;
+    UInt64 start       = wallNanoseconds();
+    UInt64 deviceStart = mach_absolute_time();
+
+    fillRequest(request, getId);
+
+    if (syncer)
+      submitWithSyncer(bench->keyboard, request);
+    else
+      bench->keyboard->submitRequestAndBlock(request);
+
+    wall[syncer]   += wallNanoseconds() - start;
+    device[syncer] += mach_absolute_time() - deviceStart;
+
+    if (getId && (request->commandsCount != 4 ||
+                  request->commands[2].inOrOut != 0xAB ||
+                  request->commands[3].inOrOut != 0x83))
+      failures[syncer]++;
+  }
+
+  bench->keyboard->freeRequest(request);
+
+  check(failures[0] == 0 && failures[1] == 0,
+        "%s: %u and %u round trips failed",
+        getId ? "kDP_GetId" : "empty", failures[0], failures[1]);
+
+  printf("%-10s  IOSyncer   %7.0f ns host  %7.0f us device\n",
+         getId ? "kDP_GetId" : "empty",
+         (double) wall[1] / kRoundTrips, device[1] / 1e3 / kRoundTrips);
+  printf("%-10s  stack flag %7.0f ns host  %7.0f us device\n",
+         "", (double) wall[0] / kRoundTrips, device[0] / 1e3 / kRoundTrips);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main()
+{
+  PS2TestBenchOptions options = { true, false, false, false };
+  PS2TestBench        bench;
+
+  if (!check(bench.start(&options) && bench.keyboard,
+             "controller did not start"))
+    return testResult();
+
+  //
+  // With no driver to take it, the acknowledge the keyboard still owes for
+  // the controller's kDP_SetDefaultsAndDisable sits in the output buffer
+  // once its clock is on; a throwaway request takes it out of the way.
+  //
+
+  PS2Request * request = bench.keyboard->allocateRequest();
+
+  bench.keyboard->setCommandByte(kCB_EnableKeyboardIRQ, kCB_DisableKeyboardClock);
+  request->commands[0].command = kPS2C_ReadDataPort;
+  request->commandsCount = 1;
+  bench.keyboard->submitRequestAndBlock(request);
+  bench.keyboard->freeRequest(request);
+
+  run(&bench, false);
+  run(&bench, true);
+
+  bench.stop();
+  return testResult();
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Ends requests to a mouse that has stopped answering, the two ways a
+// driver can: with a time limit, which should complete the request as
+// kRF_Expired once it runs out rather than when the read step gives up,
+// and with cancelRequests, which should have completed the request (quiet
+// window and all, the mouse not acknowledging the restart of its stream
+// either) by the time it returns.
+//
+
+#include "PS2TestBench.h"
+#include "VoodooPS2Keyboard.h"
+#include "VoodooPS2Mouse.h"
+
+#define kSettleNanoseconds      (100ULL * 1000000ULL)
+#define kParkNanoseconds        (5ULL * 1000000ULL)
+#define kTimeLimit              10      // ms
+#define kTimeLimitSlack         (5ULL * 1000000ULL)
+
+static bool completed;
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void requestCompleted(void *, void *)
+{
+  completed = true;
+}
+
+static bool requestDone(void *)
+{
+  return completed;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static PS2Request * submitCommand(PS2TestBench * bench,
+                                  UInt8          flags,
+                                  UInt16         timeLimit)
+{
+  //
+  // A harmless command the mouse would acknowledge, were it listening: set
+  // 1:1 scaling.
+  //
+
+  PS2Request * request = bench->mouse[0]->allocateRequest();
+
+  request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+  request->commands[0].inOrOut = kDP_SetMouseScaling1To1;
+  request->commandsCount    = 1;
+  request->flags            = flags;
+  request->timeLimit        = timeLimit;
+  request->completionTarget = bench->mouse[0];
+  request->completionAction = requestCompleted;
+  request->completionParam  = 0;
+
+  completed = false;
+  bench->mouse[0]->submitRequest(request);
+  return request;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main()
+{
+  PS2TestBenchOptions options = { false, false, false, false };
+  PS2TestBench        bench;
+  PS2Request *        request;
+
+  if (!check(bench.start(&options), "controller did not start"))
+    return testResult();
+  if (!check(bench.keyboard && bench.mouse[0], "nubs missing"))
+    return testResult();
+
+  IOService * keyboard = startDriver(new ApplePS2Keyboard, bench.keyboard);
+  IOService * mouse    = startDriver(new ApplePS2Mouse, bench.mouse[0]);
+
+  if (!check(keyboard && mouse, "drivers did not start"))
+    return testResult();
+
+  hostRun(kSettleNanoseconds);
+
+  //
+  // Time limit: the mouse ignores the command, and the request ends when
+  // its limit does.
+  //
+
+  UInt64 start = bench.simulator.now();
+  UInt64 expiredTime;
+
+  bench.simulator.setRefusals(kDT_Mouse, 0, 1);
+  request = submitCommand(&bench, 0, kTimeLimit);
+  hostRunUntil(requestDone, 0, ~0ULL);
+  expiredTime = bench.simulator.now() - start;
+
+  check(request->flags & kRF_Expired, "request past its limit not expired");
+  check(request->commandsCount == 0,
+        "expired request stopped at step %u, expected 0", request->commandsCount);
+  check(expiredTime < kTimeLimit * 1000000ULL + kTimeLimitSlack,
+        "expired request took %llu ms for a %u ms limit",
+        expiredTime / 1000000, kTimeLimit);
+
+  bench.mouse[0]->freeRequest(request);
+
+  //
+  // Cancel: the mouse takes the stop of its stream, then ignores the
+  // command and the restart, and the request is parked on the command when
+  // it is cancelled.
+  //
+
+  bench.simulator.setRefusals(kDT_Mouse, 0, 2, 1);
+  request = submitCommand(&bench, kRF_QuietWindow, 0);
+  hostRun(kParkNanoseconds);
+
+  check(!completed, "request completed before it was cancelled");
+
+  start = bench.simulator.now();
+  bench.mouse[0]->cancelRequests();
+
+  UInt64 cancelTime = bench.simulator.now() - start;
+
+  check(completed, "request not completed when cancelRequests returned");
+  check(request->flags & kRF_Cancelled, "cancelled request not marked so");
+
+  if (!completed)  hostRunUntil(requestDone, 0, ~0ULL);
+  bench.mouse[0]->freeRequest(request);
+
+  printf("cancel      expired in %llu us, cancelled in %llu us\n",
+         expiredTime / 1000, cancelTime / 1000);
+
+  stopDriver(mouse, bench.mouse[0]);
+  stopDriver(keyboard, bench.keyboard);
+  bench.stop();
+  return testResult();
+}
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Drives the input latency histograms from a simulated byte stream: mouse
+// packets and typing go through the controller and the real keyboard and
+// mouse drivers, and the published histograms must account for every byte,
+// packet and HID event, with the samples where the simulated timing puts
+// them.  Then the histograms are reset.
+//
+
+#include "PS2TestBench.h"
+#include "VoodooPS2Keyboard.h"
+#include "VoodooPS2Mouse.h"
+
+#define kRunNanoseconds         (2ULL * 1000000000ULL)
+#define kStepNanoseconds        (20ULL * 1000000ULL)
+#define kMousePacketInterval    (10ULL * 1000000ULL)   // 100 Hz
+#define kDeviceByteNanoseconds  1100000                 // 11 bits at 10 kHz
+
+static const char * deviceNames[2] = { "Keyboard", "Mouse" };
+static const char * stageNames[kLatencyStages] =
+  { "InterruptToWorkLoop", "FirstByteToPacket", "PacketToDispatch" };
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static OSArray * copyHistogram(ApplePS2Controller * controller,
+                               unsigned             device,
+                               unsigned             stage)
+{
+  OSDictionary * latency;
+  OSDictionary * stages;
+  OSArray *      buckets;
+
+  latency = OSDynamicCast(OSDictionary,
+                          controller->getProperty(kLatencyPropertyKey));
+  if (latency == 0)  return 0;
+
+  stages = OSDynamicCast(OSDictionary, latency->getObject(deviceNames[device]));
+  if (stages == 0)  return 0;
+
+  buckets = OSDynamicCast(OSArray, stages->getObject(stageNames[stage]));
+  if (buckets == 0 || buckets->getCount() != kLatencyBuckets)  return 0;
+
+  buckets->retain();
+  return buckets;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt32 countSamples(OSArray * buckets, unsigned first, unsigned last)
+{
+  UInt32 samples = 0;
+
+  for (unsigned bucket = first; bucket <= last; bucket++)
+  {
+    OSNumber * count = OSDynamicCast(OSNumber, buckets->getObject(bucket));
+    if (count)  samples += count->unsigned32BitValue();
+  }
+
+  return samples;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static unsigned bucketOf(UInt64 nanoseconds)
+{
+  unsigned bucket = 0;
+
+  for (UInt64 microseconds = nanoseconds / 1000;
+       microseconds && bucket < kLatencyBuckets - 1;
+       microseconds >>= 1)
+    bucket++;
+
+  return bucket;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void checkStage(ApplePS2Controller * controller,
+                       unsigned             device,
+                       unsigned             stage,
+                       UInt32               samples,
+                       unsigned             firstBucket,
+                       unsigned             lastBucket)
+{
+  //
+  // The stage must hold exactly the given number of samples, all of them in
+  // the given range of buckets.
+  //
+
+  OSArray * buckets = copyHistogram(controller, device, stage);
+
+  if (!check(buckets != 0, "%s %s: histogram not published",
+             deviceNames[device], stageNames[stage]))
+    return;
+
+  UInt32 total   = countSamples(buckets, 0, kLatencyBuckets - 1);
+  UInt32 inRange = countSamples(buckets, firstBucket, lastBucket);
+
+  check(total == samples, "%s %s: %u samples, expected %u",
+        deviceNames[device], stageNames[stage], total, samples);
+  check(inRange == total, "%s %s: %u of %u samples outside buckets %u-%u",
+        deviceNames[device], stageNames[stage], total - inRange, total,
+        firstBucket, lastBucket);
+
+  buckets->release();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main()
+{
+  static const UInt8  mousePacket[3] = { 0x08, 0x01, 0xFF };
+  PS2TestBenchOptions options = { false, false, false, false };
+  PS2TestBench        bench;
+  PS2SimulatorStatistics statistics;
+
+  bench.simulator.setTiming(500, 2000, kDeviceByteNanoseconds,
+                            kDeviceByteNanoseconds);
+
+  if (!check(bench.start(&options), "controller did not start"))
+    return testResult();
+  if (!check(bench.keyboard && bench.mouse[0], "nubs missing"))
+    return testResult();
+
+  IOService * keyboard = startDriver(new ApplePS2Keyboard, bench.keyboard);
+  IOService * mouse    = startDriver(new ApplePS2Mouse, bench.mouse[0]);
+
+  if (!check(keyboard && mouse, "drivers did not start"))
+    return testResult();
+
+  //
+  // Start from empty histograms, once whatever the drivers' start stirred up
+  // has settled.
+  //
+
+  OSDictionary * reset = OSDictionary::withCapacity(1);
+  reset->setObject(kLatencyResetKey, kOSBooleanTrue);
+
+  hostRun(kStepNanoseconds);
+  bench.controller->setProperties(reset);
+  bench.simulator.resetStatistics();
+  hostClearHIDEvents();
+
+  //
+  // Stream mouse packets, and type a key (make, then break) every step.
+  //
+
+  UInt32 keyEvents = 0;
+
+  bench.simulator.setStreamPacket(kDT_Mouse, mousePacket, sizeof(mousePacket),
+                                  kMousePacketInterval);
+
+  for (UInt64 step = 0; step * kStepNanoseconds < kRunNanoseconds; step++)
+  {
+    UInt8 scancode = 0x1E | ((step % 2) ? kSC_UpBit : 0);
+    bench.simulator.injectData(kDT_Keyboard, &scancode, 1);
+    keyEvents++;
+    hostRun(kStepNanoseconds);
+  }
+
+  bench.simulator.setStreamPacket(kDT_Mouse, 0, 0, 0);
+
+  // (long enough for the statistics timer to publish what came in last)
+  hostRun(2 * kStatisticsPublishInterval * 1000000ULL);
+
+  bench.simulator.getStatistics(&statistics);
+
+  UInt32 pointerEvents = 0;
+  UInt32 keyboardEvents = 0;
+
+  for (UInt32 index = 0; index < hostHIDEventCount(); index++)
+  {
+    const HostHIDEvent * event = hostHIDEvent(index);
+
+    if (event->type == kHostRelativePointer)  pointerEvents++;
+    else if (event->type == kHostKeyboard)    keyboardEvents++;
+  }
+
+  UInt32 packets = (UInt32) (statistics.bytesDelivered[kDT_Mouse] /
+                             sizeof(mousePacket));
+
+  check(statistics.bytesDelivered[kDT_Keyboard] == keyEvents,
+        "%llu keyboard bytes read, %u typed",
+        statistics.bytesDelivered[kDT_Keyboard], keyEvents);
+  check(keyboardEvents == keyEvents, "%u key events dispatched, %u typed",
+        keyboardEvents, keyEvents);
+  check(packets >= kRunNanoseconds / kMousePacketInterval - 1 &&
+        pointerEvents == packets,
+        "%u pointer events dispatched, %u packets read", pointerEvents, packets);
+
+  //
+  // Every byte read is a sample for the interrupt stage, and the work loop
+  // is there to read it within a few port accesses.  Every packet is a
+  // sample for the other two stages; a keyboard packet is a single byte and
+  // is complete as soon as it arrives, and a mouse packet takes two more
+  // bytes' time on the wire after its first.  Dispatch is immediate on the
+  // simulated clock, which only moves on port accesses.
+  //
+
+  UInt64 mousePacketTime = (sizeof(mousePacket) - 1) * kDeviceByteNanoseconds;
+
+  checkStage(bench.controller, kDT_Keyboard, kLS_Interrupt,
+             (UInt32) statistics.bytesDelivered[kDT_Keyboard], 0, bucketOf(100000));
+  checkStage(bench.controller, kDT_Mouse, kLS_Interrupt,
+             (UInt32) statistics.bytesDelivered[kDT_Mouse], 0, bucketOf(100000));
+  checkStage(bench.controller, kDT_Keyboard, kLS_Packet, keyEvents, 0, 0);
+  checkStage(bench.controller, kDT_Mouse, kLS_Packet, packets,
+             bucketOf(mousePacketTime), bucketOf(mousePacketTime + 100000));
+  checkStage(bench.controller, kDT_Keyboard, kLS_Dispatch, keyEvents, 0, 0);
+  checkStage(bench.controller, kDT_Mouse, kLS_Dispatch, packets, 0, 0);
+
+  //
+  // A reset empties every histogram at once.
+  //
+
+  bench.controller->setProperties(reset);
+  reset->release();
+
+  for (unsigned device = kDT_Keyboard; device <= kDT_Mouse; device++)
+    for (unsigned stage = 0; stage < kLatencyStages; stage++)
+      checkStage(bench.controller, device, stage, 0, 0, kLatencyBuckets - 1);
+
+  printf("latency     %u key events, %u mouse packets through the histograms\n",
+         keyEvents, packets);
+
+  stopDriver(mouse, bench.mouse[0]);
+  stopDriver(keyboard, bench.keyboard);
+  bench.stop();
+
+  return testResult();
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Plays a flight recorder capture back through the controller and the real
+// drivers, as fast as the host can go:
+//
+//   PS2Replay <IOClass> <capture> [<events>]
+//
+// The controller comes up on the simulated i8042 with the keyboard driver
+// and the given pointing driver (ApplePS2Mouse, ApplePS2SynapticsTouchPad,
+// ApplePS2ALPSGlidePoint, ApplePS2ALPSMultiTouch or ApplePS2SentelicFSP),
+// the simulated mouse answering the driver's probe as the pad would.  Once
+// the drivers are up, the capture's mouse bytes are played back in its
+// timing, and the pointer events the driver dispatches, which go nowhere
+// but into the HID sinks of the kernel shim, are printed one per line.
+// With <events>, they are compared with it instead, and any difference, or
+// any write the controller made that is not in the capture, fails the run.
+//
+// Keyboard bytes are redacted in captures, so there are no key events to
+// replay.
+//
+
+#include <time.h>
+#include "PS2TestBench.h"
+
+#define kSettleNanoseconds      (100ULL * 1000000ULL)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void * readFile(const char * path, UInt32 * length)
+{
+  FILE * file   = fopen(path, "rb");
+  void * buffer = 0;
+  long   size;
+
+  if (file == 0)  return 0;
+
+  if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 &&
+      fseek(file, 0, SEEK_SET) == 0 && (buffer = malloc(size)) != 0 &&
+      fread(buffer, size, 1, file) != 1)
+  {
+    free(buffer);
+    buffer = 0;
+  }
+
+  fclose(file);
+  if (buffer)  *length = (UInt32) size;
+  return buffer;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt64 traceNanoseconds(const PS2TraceHeader * header)
+{
+  const PS2TraceRecord * records = (const PS2TraceRecord *) (header + 1);
+
+  if (header->recordCount == 0)  return 0;
+
+  UInt64 ticks = records[header->recordCount - 1].time - records[0].time;
+
+  return (ticks / header->ticksPerSecond) * 1000000000ULL +
+         (ticks % header->ticksPerSecond) * 1000000000ULL / header->ticksPerSecond;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt64 wallNanoseconds()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (UInt64) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static bool replayDone(void * context)
+{
+  return ((ApplePS2PortSimulator *) context)->replayDone();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt32 compareEvents(FILE * expected)
+{
+  //
+  // Compare the pointer events dispatched with the expected ones, line by
+  // line, and report the first difference.  Returns the number of events
+  // that differ, are missing or are extra.
+  //
+
+  UInt32 differences = 0;
+  UInt32 index       = 0;
+  UInt32 line        = 0;
+  char   want[128];
+  char   got[128];
+
+  for (;;)
+  {
+    bool haveWant = fgets(want, sizeof(want), expected) != 0;
+    bool haveGot  = false;
+
+    if (haveWant)  want[strcspn(want, "\n")] = 0;
+
+    while (index < hostHIDEventCount())
+    {
+      const HostHIDEvent * event = hostHIDEvent(index++);
+
+      if (event->type == kHostKeyboard)  continue;
+
+      formatHIDEvent(event, got, sizeof(got));
+      haveGot = true;
+      break;
+    }
+
+    if (!haveWant && !haveGot)  break;
+    line++;
+
+    if (haveWant && haveGot && strcmp(want, got) == 0)  continue;
+
+    if (differences++ == 0)
+      fprintf(stderr, "event %u: expected \"%s\", replayed \"%s\"\n", line,
+              haveWant ? want : "(none)", haveGot ? got : "(none)");
+  }
+
+  return differences;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main(int argc, char ** argv)
+{
+  PS2TestBenchOptions    options = { false, false, false, false };
+  PS2TestBench           bench;
+  PS2SimulatorStatistics statistics;
+  const PS2TraceHeader * trace;
+  UInt32                 length;
+
+  if (argc != 3 && argc != 4)
+  {
+    fprintf(stderr, "usage: %s <IOClass> <capture> [<events>]\n", argv[0]);
+    return 2;
+  }
+
+  const char * className = argv[1];
+
+  trace = (const PS2TraceHeader *) readFile(argv[2], &length);
+  if (trace == 0)
+  {
+    fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[2]);
+    return 2;
+  }
+
+  FILE * expected = 0;
+
+  if (argc == 4 && (expected = fopen(argv[3], "r")) == 0)
+  {
+    fprintf(stderr, "%s: cannot read %s\n", argv[0], argv[3]);
+    return 2;
+  }
+
+  //
+  // Bring the stack up to where the capture begins.
+  //
+
+  if (!check(bench.start(&options), "controller did not start"))
+    return testResult();
+  if (!check(bench.keyboard && bench.mouse[0], "nubs missing"))
+    return testResult();
+
+  IOService * keyboard = startDriver(OSDynamicCast(IOService,
+                           OSMetaClass::allocClassWithName("ApplePS2Keyboard")),
+                           bench.keyboard);
+  IOService * pointing = startPointingDriver(&bench, className);
+
+  if (!check(keyboard && pointing, "%s did not start", className))
+    return testResult();
+
+  hostRun(kSettleNanoseconds);
+  hostClearHIDEvents();
+  bench.simulator.resetStatistics();
+
+  if (!check(bench.simulator.loadTrace(trace, length),
+             "%s is not a capture", argv[2]))
+    return testResult();
+
+  //
+  // Play it.
+  //
+
+  UInt64 traceTime = traceNanoseconds(trace);
+  UInt64 started   = wallNanoseconds();
+
+  bool done = hostRunUntil(replayDone, &bench.simulator,
+                           bench.simulator.now() + traceTime + kSettleNanoseconds);
+  hostRun(kSettleNanoseconds);
+
+  UInt64 elapsed = wallNanoseconds() - started;
+
+  bench.simulator.getStatistics(&statistics);
+
+  check(done, "capture did not play to the end");
+  check(statistics.replayMismatches == 0,
+        "%llu writes differ from the capture", statistics.replayMismatches);
+
+  UInt32 events = 0;
+
+  for (UInt32 index = 0; index < hostHIDEventCount(); index++)
+    if (hostHIDEvent(index)->type != kHostKeyboard)  events++;
+
+  if (expected)
+  {
+    UInt32 differences = compareEvents(expected);
+
+    check(differences == 0, "%u of the replayed events differ", differences);
+    fclose(expected);
+  }
+  else
+  {
+    for (UInt32 index = 0; index < hostHIDEventCount(); index++)
+    {
+      const HostHIDEvent * event = hostHIDEvent(index);
+      char                 line[128];
+
+      if (event->type == kHostKeyboard)  continue;
+
+      formatHIDEvent(event, line, sizeof(line));
+      printf("%s\n", line);
+    }
+  }
+
+  fprintf(stderr, "replay      %s: %llu bytes, %u events, "
+                  "%llu.%03llu s of input in %llu.%03llu ms\n",
+          className, statistics.replayBytes, events,
+          traceTime / 1000000000ULL, traceTime / 1000000ULL % 1000,
+          elapsed / 1000000ULL, elapsed / 1000ULL % 1000);
+
+  stopDriver(pointing, bench.mouse[0]);
+  stopDriver(keyboard, bench.keyboard);
+  bench.stop();
+
+  free((void *) trace);
+  return testResult();
+}
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Records a session for PS2Replay to play back:
+//
+//   ReplaySession <IOClass> <capture> <events>
+//
+// The keyboard driver and the given pointing driver are brought up on the
+// simulated pad, and a finger moves across it, lifts and taps.  The flight
+// recorder capture of the session, from once the drivers were up, goes to
+// <capture>, and the pointer events the driver dispatched, one per line, to
+// <events>.  Replaying the capture must give back exactly those events.
+//
+
+#include "PS2TestBench.h"
+
+#define kSettleNanoseconds      (100ULL * 1000000ULL)
+#define kPacketInterval         (10ULL * 1000000ULL)   // 100 Hz
+#define kPackets                32
+#define kLiftPacket             20                     // finger up
+#define kTapPacket              24                     // tap, two packets long
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt32 makePacket(const char * className, UInt32 index, UInt8 * packet)
+{
+  //
+  // The index'th packet of the session, in the given driver's format.
+  // Returns its length.
+  //
+
+  bool  touching = (index < kLiftPacket) ||
+                   (index == kTapPacket || index == kTapPacket + 1);
+  bool  button   = (index >= kLiftPacket - 4 && index < kLiftPacket);
+  SInt8 dx       = touching ? 3 : 0;
+  SInt8 dy       = touching ? -2 : 0;
+
+  if (strcmp(className, "ApplePS2SynapticsTouchPad") == 0)
+  {
+    // Absolute, W = 4 (one finger)
+    int x = 2000 + 40 * index;
+    int y = 3000 + 20 * index;
+    int z = touching ? 60 : 0;
+
+    packet[0] = 0x90 | (button ? 0x01 : 0);
+    packet[1] = ((y >> 4) & 0xF0) | ((x >> 8) & 0x0F);
+    packet[2] = z;
+    packet[3] = 0xC0 | ((x >> 8) & 0x10) | ((y >> 7) & 0x20);
+    packet[4] = x & 0xFF;
+    packet[5] = y & 0xFF;
+    return 6;
+  }
+
+  if (strcmp(className, "ApplePS2ALPSGlidePoint") == 0)
+  {
+    // Absolute, with the finger and gesture (tap) bits
+    int x = 400 + 8 * index;
+    int y = 300 + 4 * index;
+    int z = touching ? 40 : 0;
+
+    packet[0] = 0x88;
+    packet[1] = x & 0x7F;
+    packet[2] = ((x >> 4) & 0x78) | (touching ? 0x02 : 0) |
+                                    ((index == kTapPacket) ? 0x01 : 0);
+    packet[3] = 0x08 | ((y >> 3) & 0x70) | (button ? 0x01 : 0);
+    packet[4] = y & 0x7F;
+    packet[5] = z;
+    return 6;
+  }
+
+  //
+  // Relative, with a wheel byte where the driver asks for IntelliMouse mode.
+  //
+
+  packet[0] = 0x08 | (button ? 0x01 : 0) | ((dx < 0) ? 0x10 : 0) |
+                                           ((dy < 0) ? 0x20 : 0);
+  packet[1] = (UInt8) dx;
+  packet[2] = (UInt8) dy;
+
+  if (strcmp(className, "ApplePS2ALPSMultiTouch") == 0 ||
+      strcmp(className, "ApplePS2SentelicFSP") == 0)
+  {
+    packet[3] = (index == kTapPacket) ? 0x01 : 0x00;
+    return 4;
+  }
+
+  return 3;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt32 lastSequence(ApplePS2Controller * controller)
+{
+  OSData * trace = controller->copyTrace();
+  UInt32   sequence;
+
+  if (trace == 0)  return 0;
+
+  const PS2TraceHeader * header = (const PS2TraceHeader *) trace->getBytesNoCopy();
+  sequence = header->firstSequence + header->recordCount - 1;
+
+  trace->release();
+  return sequence;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main(int argc, char ** argv)
+{
+  PS2TestBenchOptions options = { false, false, false, false };
+  PS2TestBench        bench;
+
+  if (argc != 4)
+  {
+    fprintf(stderr, "usage: %s <IOClass> <capture> <events>\n", argv[0]);
+    return 2;
+  }
+
+  const char * className = argv[1];
+
+  if (!check(bench.start(&options), "controller did not start"))
+    return testResult();
+  if (!check(bench.keyboard && bench.mouse[0], "nubs missing"))
+    return testResult();
+
+  IOService * keyboard = startDriver(OSDynamicCast(IOService,
+                           OSMetaClass::allocClassWithName("ApplePS2Keyboard")),
+                           bench.keyboard);
+  IOService * pointing = startPointingDriver(&bench, className);
+
+  if (!check(keyboard && pointing, "%s did not start", className))
+    return testResult();
+
+  hostRun(kSettleNanoseconds);
+
+  UInt32 mark = lastSequence(bench.controller);
+  hostClearHIDEvents();
+
+  //
+  // The session.
+  //
+
+  for (UInt32 index = 0; index < kPackets; index++)
+  {
+    UInt8  packet[kSimulatorPacketSize];
+    UInt32 length = makePacket(className, index, packet);
+
+    bench.simulator.injectData(kDT_Mouse, packet, length);
+    hostRun(kPacketInterval);
+  }
+
+  hostRun(kSettleNanoseconds);
+
+  //
+  // Its capture, from the first record after the drivers were up, which must
+  // all still be in the ring.
+  //
+
+  OSData * trace = bench.controller->copyTrace();
+
+  if (!check(trace != 0, "no capture"))
+    return testResult();
+
+  PS2TraceHeader * header  = (PS2TraceHeader *) trace->getBytesNoCopy();
+  PS2TraceRecord * records = (PS2TraceRecord *) (header + 1);
+  UInt32           skip    = mark + 1 - header->firstSequence;
+
+  if (!check(header->firstSequence <= mark + 1 && skip <= header->recordCount,
+             "session did not fit in the flight recorder"))
+    return testResult();
+
+  header->firstSequence += skip;
+  header->recordCount   -= skip;
+  bcopy(&records[skip], &records[0], header->recordCount * sizeof(PS2TraceRecord));
+
+  FILE * file = fopen(argv[2], "wb");
+
+  check(file && fwrite(header, sizeof(PS2TraceHeader) +
+                       header->recordCount * sizeof(PS2TraceRecord), 1, file) == 1,
+        "could not write %s", argv[2]);
+  if (file)  fclose(file);
+  trace->release();
+
+  //
+  // And what the driver made of it.
+  //
+
+  UInt32 events = 0;
+
+  file = fopen(argv[3], "w");
+  check(file != 0, "could not write %s", argv[3]);
+
+  for (UInt32 index = 0; file && index < hostHIDEventCount(); index++)
+  {
+    const HostHIDEvent * event = hostHIDEvent(index);
+    char                 line[128];
+
+    if (event->type == kHostKeyboard)  continue;
+
+    formatHIDEvent(event, line, sizeof(line));
+    fprintf(file, "%s\n", line);
+    events++;
+  }
+  if (file)  fclose(file);
+
+  check(events >= kPackets / 2, "%s dispatched only %u events", className, events);
+
+  printf("session     %s: %u pointer events\n", className, events);
+
+  stopDriver(pointing, bench.mouse[0]);
+  stopDriver(keyboard, bench.keyboard);
+  bench.stop();
+  return testResult();
+}
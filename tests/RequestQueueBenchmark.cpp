@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Cost per request of getting asynchronous requests from the drivers to the
+// work loop: the controller's request ring, against the locked queue it
+// replaced (an IOSimpleLock around a queue_head_t, kept here as it was).
+//
+// o  Uncontended: one thread submits a burst, then the work loop drains it.
+//    For the ring, the drain is the controller's own work loop run, which
+//    also starts and finishes each (empty) request, so it is an upper bound
+//    on the queue's share; for the locked queue, it is the dequeue alone.
+//
+// o  Contended: several host threads submit while the main thread drains,
+//    which is where the lock used to cost.
+//
+// Along the way it checks that a burst bigger than the ring is neither lost
+// nor reordered: the excess waits on the overflow list.
+//
+
+#include <pthread.h>
+#include <time.h>
+#include <kern/queue.h>
+#include "PS2TestBench.h"
+
+#define kBurst                  48      // fits the ring
+#define kOverflowBurst          (3 * kRequestRingSize)
+#define kRounds                 2000
+#define kContendedRequests      200000
+#define kMaxProducers           4
+
+static UInt64 wallNanoseconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (UInt64) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// =============================================================================
+// The locked queue, as it was before the ring
+//
+
+struct LockedRequest
+{
+  PS2Request    request;
+  queue_chain_t chain;
+};
+
+class LockedRequestQueue
+{
+public:
+  IOSimpleLock *           lock;
+  queue_head_t             queue;
+  IOInterruptEventSource * signal;
+
+  LockedRequestQueue()
+  {
+    lock   = IOSimpleLockAlloc();
+    signal = IOInterruptEventSource::interruptEventSource(0, 0);
+    queue_init(&queue);
+  }
+
+  ~LockedRequestQueue()
+  {
+    signal->release();
+    IOSimpleLockFree(lock);
+  }
+
+  void submit(LockedRequest * request)
+  {
+    IOSimpleLockLock(lock);
+    queue_enter(&queue, request, LockedRequest *, chain);
+    IOSimpleLockUnlock(lock);
+
+    signal->interruptOccurred(0, 0, 0);
+  }
+
+  LockedRequest * dequeue()
+  {
+    LockedRequest * request = 0;
+
+    IOSimpleLockLock(lock);
+    if (!queue_empty(&queue))
+      queue_remove_first(&queue, request, LockedRequest *, chain);
+    IOSimpleLockUnlock(lock);
+
+    return request;
+  }
+};
+
+// =============================================================================
+// Completion bookkeeping
+//
+// Each request carries its index as the completion parameter, so that the
+// completion can free it and tell whether requests came through in order.
+//
+
+struct Completions
+{
+  ApplePS2KeyboardDevice * keyboard;
+  PS2Request **            requests;
+  UInt64                   count;
+  UInt64                   next;        // index expected next
+  bool                     ordered;
+};
+
+static void requestCompleted(void * target, void * param)
+{
+  Completions * completions = (Completions *) target;
+  UInt64        index       = (uintptr_t) param;
+
+  if (index != completions->next)  completions->ordered = false;
+  completions->next = index + 1;
+  completions->count++;
+
+  completions->keyboard->freeRequest(completions->requests[index]);
+  completions->requests[index] = 0;
+}
+
+static void prepareRequests(Completions * completions, UInt64 count)
+{
+  completions->count   = 0;
+  completions->next    = 0;
+  completions->ordered = true;
+
+  for (UInt64 index = 0; index < count; index++)
+  {
+    PS2Request * request = completions->keyboard->allocateRequest();
+
+    request->commandsCount    = 0;
+    request->completionTarget = completions;
+    request->completionAction = requestCompleted;
+    request->completionParam  = (void *) (uintptr_t) index;
+    completions->requests[index] = request;
+  }
+}
+
+// =============================================================================
+// Contended submission
+//
+
+struct Producer
+{
+  pthread_t                thread;
+  ApplePS2KeyboardDevice * keyboard;    // the ring, through the nub
+  LockedRequestQueue *     locked;      // or the locked queue
+  PS2Request **            requests;
+  LockedRequest *          lockedRequests;
+  UInt64                   first;
+  UInt64                   count;
+  volatile bool *          go;
+  UInt64                   nanoseconds; // spent submitting
+};
+
+static void * produce(void * argument)
+{
+  Producer * producer = (Producer *) argument;
+
+  while (!*producer->go)  ;
+
+  UInt64 start = wallNanoseconds();
+
+  for (UInt64 index = producer->first;
+       index < producer->first + producer->count; index++)
+  {
+    if (producer->keyboard)
+      producer->keyboard->submitRequest(producer->requests[index]);
+    else
+      producer->locked->submit(&producer->lockedRequests[index]);
+  }
+
+  producer->nanoseconds = wallNanoseconds() - start;
+  return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void runContended(PS2TestBench * bench, Completions * completions,
+                         LockedRequest * lockedRequests, unsigned producers)
+{
+  Producer      producer[kMaxProducers];
+  volatile bool go;
+  UInt64        total = kContendedRequests;
+  UInt64        submitTotal[2] = { 0, 0 };
+  UInt64        elapsed[2];
+
+  for (int ring = 1; ring >= 0; ring--)
+  {
+    LockedRequestQueue locked;
+    UInt64             drained = 0;
+
+    if (ring)  prepareRequests(completions, total);
+    go = false;
+
+    for (unsigned index = 0; index < producers; index++)
+    {
+      producer[index].keyboard       = ring ? bench->keyboard : 0;
+      producer[index].locked         = &locked;
+      producer[index].requests       = completions->requests;
+      producer[index].lockedRequests = lockedRequests;
+      producer[index].first          = total / producers * index;
+      producer[index].count          = total / producers;
+      producer[index].go             = &go;
+      pthread_create(&producer[index].thread, 0, produce, &producer[index]);
+    }
+
+    UInt64 start = wallNanoseconds();
+    go = true;
+
+    if (ring)
+    {
+      while (completions->count < total / producers * producers)  hostRun(0);
+      drained = completions->count;
+    }
+    else
+    {
+      while (drained < total / producers * producers)
+        if (locked.dequeue())  drained++;
+    }
+
+    elapsed[ring] = wallNanoseconds() - start;
+
+    for (unsigned index = 0; index < producers; index++)
+    {
+      pthread_join(producer[index].thread, 0);
+      submitTotal[ring] += producer[index].nanoseconds;
+    }
+
+    check(drained == total / producers * producers,
+          "%u producers: %llu of %llu requests drained",
+          producers, drained, total / producers * producers);
+  }
+
+  total = total / producers * producers;
+  printf("contended, %u producer%s   locked queue  submit %6.1f ns  "
+         "%5.2f M requests/s\n", producers, producers == 1 ? " " : "s",
+         (double) submitTotal[0] / total, total * 1e3 / elapsed[0]);
+  printf("                           request ring  submit %6.1f ns  "
+         "%5.2f M requests/s\n",
+         (double) submitTotal[1] / total, total * 1e3 / elapsed[1]);
+}
+
+// =============================================================================
+// Benchmark
+//
+
+int main()
+{
+  PS2TestBenchOptions options = { true, false, false, false };
+  PS2TestBench        bench;
+  Completions         completions;
+
+  if (!check(bench.start(&options) && bench.keyboard,
+             "controller did not start"))
+    return testResult();
+
+  completions.keyboard = bench.keyboard;
+  completions.requests = new PS2Request * [kContendedRequests];
+
+  //
+  // A burst bigger than the ring: nothing lost, nothing reordered.
+  //
+
+  prepareRequests(&completions, kOverflowBurst);
+  for (UInt64 index = 0; index < kOverflowBurst; index++)
+    check(bench.keyboard->submitRequest(completions.requests[index]),
+          "request %llu refused", index);
+  hostRun(0);
+
+  OSNumber * overflows = OSDynamicCast(OSNumber,
+                         bench.controller->getProperty("RequestRingOverflows"));
+
+  check(completions.count == kOverflowBurst,
+        "%llu of %u requests completed", completions.count, kOverflowBurst);
+  check(completions.ordered, "requests completed out of order");
+  check(overflows && overflows->unsigned32BitValue() > 0,
+        "overflow list not used");
+
+  //
+  // Uncontended: submit a burst that fits, then drain it.
+  //
+
+  LockedRequest *    lockedRequests = new LockedRequest[kContendedRequests];
+  LockedRequestQueue locked;
+  UInt64             submitTime[2] = { 0, 0 };
+  UInt64             drainTime[2]  = { 0, 0 };
+
+  for (unsigned round = 0; round < kRounds; round++)
+  {
+    UInt64 start;
+    UInt64 drained = 0;
+
+    prepareRequests(&completions, kBurst);
+
+    start = wallNanoseconds();
+    for (UInt64 index = 0; index < kBurst; index++)
+      bench.keyboard->submitRequest(completions.requests[index]);
+    submitTime[1] += wallNanoseconds() - start;
+
+    start = wallNanoseconds();
+    hostRun(0);
+    drainTime[1] += wallNanoseconds() - start;
+
+    start = wallNanoseconds();
+    for (UInt64 index = 0; index < kBurst; index++)
+      locked.submit(&lockedRequests[index]);
+    submitTime[0] += wallNanoseconds() - start;
+
+    start = wallNanoseconds();
+    while (locked.dequeue())  drained++;
+    drainTime[0] += wallNanoseconds() - start;
+
+    check(completions.count == kBurst && drained == kBurst,
+          "round %u: %llu and %llu of %u requests drained",
+          round, completions.count, drained, kBurst);
+  }
+
+  UInt64 requests = (UInt64) kRounds * kBurst;
+
+  printf("uncontended, per request   locked queue  submit %6.1f ns  "
+         "dequeue %6.1f ns\n",
+         (double) submitTime[0] / requests, (double) drainTime[0] / requests);
+  printf("                           request ring  submit %6.1f ns  "
+         "dequeue and run %6.1f ns\n",
+         (double) submitTime[1] / requests, (double) drainTime[1] / requests);
+
+  //
+  // Contended.
+  //
+
+  for (unsigned producers = 1; producers <= kMaxProducers; producers *= 2)
+    runContended(&bench, &completions, lockedRequests, producers);
+
+  delete [] lockedRequests;
+  delete [] completions.requests;
+  bench.stop();
+  return testResult();
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Has the mouse answer a command with kSC_Resend, first once, which the
+// controller should get past by sending the byte again, and then more often
+// than it is willing to, which should fail the command straight away.  In
+// neither case may the refusal reach the mouse driver as stream data, where
+// it would throw the driver's packets out of step and leave the watchdog
+// waiting on a packet that never was.
+//
+
+#include "PS2TestBench.h"
+#include "VoodooPS2Keyboard.h"
+#include "VoodooPS2Mouse.h"
+
+#define kSettleNanoseconds      (100ULL * 1000000ULL)
+#define kWatchdogNanoseconds    (1000ULL * 1000000ULL)
+#define kFailureNanoseconds     (50ULL * 1000000ULL)
+#define kPublishNanoseconds     ((kStatisticsPublishInterval + 100) * 1000000ULL)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt32 mouseCounter(ApplePS2Controller * controller, const char * name)
+{
+  OSDictionary * statistics;
+  OSDictionary * counters;
+  OSNumber *     count;
+
+  statistics = OSDynamicCast(OSDictionary,
+                             controller->getProperty(kStatisticsPropertyKey));
+  if (statistics == 0)  return 0;
+
+  counters = OSDynamicCast(OSDictionary, statistics->getObject("Mouse"));
+  if (counters == 0)  return 0;
+
+  count = OSDynamicCast(OSNumber, counters->getObject(name));
+  return count ? count->unsigned32BitValue() : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt32 pointerEvents()
+{
+  UInt32 events = 0;
+
+  for (UInt32 index = 0; index < hostHIDEventCount(); index++)
+    if (hostHIDEvent(index)->type == kHostRelativePointer)  events++;
+
+  return events;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static bool sendCommand(PS2TestBench * bench, UInt64 * nanoseconds)
+{
+  //
+  // A harmless command the mouse acknowledges: set 1:1 scaling.
+  //
+
+  PS2Request * request = bench->mouse[0]->allocateRequest();
+  UInt64       start   = bench->simulator.now();
+  bool         success;
+
+  request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+  request->commands[0].inOrOut = kDP_SetMouseScaling1To1;
+  request->commandsCount = 1;
+  bench->mouse[0]->submitRequestAndBlock(request);
+
+  success      = (request->commandsCount == 1);
+  *nanoseconds = bench->simulator.now() - start;
+
+  bench->mouse[0]->freeRequest(request);
+  return success;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main()
+{
+  static const UInt8  mousePacket[3] = { 0x08, 0x01, 0xFF };
+  PS2TestBenchOptions options = { false, false, false, false };
+  PS2TestBench        bench;
+  UInt64              onceTime;
+  UInt64              refusedTime;
+
+  if (!check(bench.start(&options), "controller did not start"))
+    return testResult();
+  if (!check(bench.keyboard && bench.mouse[0], "nubs missing"))
+    return testResult();
+
+  IOService * keyboard = startDriver(new ApplePS2Keyboard, bench.keyboard);
+  IOService * mouse    = startDriver(new ApplePS2Mouse, bench.mouse[0]);
+
+  if (!check(keyboard && mouse, "drivers did not start"))
+    return testResult();
+
+  hostRun(kSettleNanoseconds);
+
+  //
+  // Refused once: the byte goes again, and the command gets through.
+  //
+
+  bench.simulator.setRefusals(kDT_Mouse, kSC_Resend, 1);
+
+  check(sendCommand(&bench, &onceTime), "command refused once failed");
+  hostRun(kPublishNanoseconds);
+  check(mouseCounter(bench.controller, "Resends") == 1,
+        "%u resends counted, expected 1",
+        mouseCounter(bench.controller, "Resends"));
+
+  //
+  // Refused every time: the command fails as soon as the retries run out,
+  // without waiting out a read step.
+  //
+
+  UInt32 failures = mouseCounter(bench.controller, "CompareFailures");
+
+  bench.simulator.setRefusals(kDT_Mouse, kSC_Resend, kRequestResendLimit + 1);
+
+  check(!sendCommand(&bench, &refusedTime), "command refused throughout passed");
+  hostRun(kPublishNanoseconds);
+
+  check(refusedTime < kFailureNanoseconds,
+        "refused command took %llu ms to fail", refusedTime / 1000000);
+  check(mouseCounter(bench.controller, "CompareFailures") == failures + 1,
+        "%u compare failures counted, expected %u",
+        mouseCounter(bench.controller, "CompareFailures"), failures + 1);
+
+  //
+  // No refusal reached the driver: there is no packet under way for the
+  // watchdog to give up on, and the next packet is taken as one.
+  //
+
+  hostClearHIDEvents();
+  hostRun(kWatchdogNanoseconds + kPublishNanoseconds);
+
+  check(mouseCounter(bench.controller, "Stalls") == 0,
+        "%u stalls after the refusals, expected none",
+        mouseCounter(bench.controller, "Stalls"));
+
+  bench.simulator.injectData(kDT_Mouse, mousePacket, sizeof(mousePacket));
+  hostRun(kSettleNanoseconds);
+
+  check(pointerEvents() == 1, "%u pointer events after the refusals, expected 1",
+        pointerEvents());
+
+  printf("resend      refused once: %llu us, refused throughout: failed "
+         "in %llu us\n", onceTime / 1000, refusedTime / 1000);
+
+  stopDriver(mouse, bench.mouse[0]);
+  stopDriver(keyboard, bench.keyboard);
+  bench.stop();
+  return testResult();
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Stops the mouse partway through a packet, and checks that the watchdog
+// takes the port as stalled, recovers it, and has the mouse driver set the
+// mouse up again, after which its packets come through as before.
+//
+
+#include "PS2TestBench.h"
+#include "VoodooPS2Keyboard.h"
+#include "VoodooPS2Mouse.h"
+
+#define kSettleNanoseconds      (100ULL * 1000000ULL)
+#define kRecoveryNanoseconds    (1000ULL * 1000000ULL)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt32 mouseCounter(ApplePS2Controller * controller, const char * name)
+{
+  OSDictionary * statistics;
+  OSDictionary * counters;
+  OSNumber *     count;
+
+  statistics = OSDynamicCast(OSDictionary,
+                             controller->getProperty(kStatisticsPropertyKey));
+  if (statistics == 0)  return 0;
+
+  counters = OSDynamicCast(OSDictionary, statistics->getObject("Mouse"));
+  if (counters == 0)  return 0;
+
+  count = OSDynamicCast(OSNumber, counters->getObject(name));
+  return count ? count->unsigned32BitValue() : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static UInt32 pointerEvents()
+{
+  UInt32 events = 0;
+
+  for (UInt32 index = 0; index < hostHIDEventCount(); index++)
+    if (hostHIDEvent(index)->type == kHostRelativePointer)  events++;
+
+  return events;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main()
+{
+  static const UInt8  mousePacket[3] = { 0x08, 0x01, 0xFF };
+  PS2TestBenchOptions options = { false, false, false, false };
+  PS2TestBench        bench;
+  PS2SimulatorStatistics before;
+  PS2SimulatorStatistics after;
+
+  if (!check(bench.start(&options), "controller did not start"))
+    return testResult();
+  if (!check(bench.keyboard && bench.mouse[0], "nubs missing"))
+    return testResult();
+
+  IOService * keyboard = startDriver(new ApplePS2Keyboard, bench.keyboard);
+  IOService * mouse    = startDriver(new ApplePS2Mouse, bench.mouse[0]);
+
+  if (!check(keyboard && mouse, "drivers did not start"))
+    return testResult();
+
+  hostRun(kSettleNanoseconds);
+  bench.simulator.getStatistics(&before);
+
+  //
+  // The first byte of a packet, and nothing after it.
+  //
+
+  bench.simulator.injectData(kDT_Mouse, mousePacket, 1);
+  hostRun(kRecoveryNanoseconds);
+
+  bench.simulator.getStatistics(&after);
+
+  UInt32 stalls     = mouseCounter(bench.controller, "Stalls");
+  UInt32 recoveries = mouseCounter(bench.controller, "Recoveries");
+
+  check(stalls == 1, "%u mouse stalls counted, expected 1", stalls);
+  check(recoveries == 1, "%u mouse recoveries counted, expected 1", recoveries);
+
+  //
+  // Cycling the clock and restarting the stream takes six writes; the
+  // driver setting the mouse up again, told of the recovery, takes more.
+  //
+
+  UInt64 writes = after.portWrites - before.portWrites;
+
+  check(writes > 6, "only %llu writes, the driver was not told", writes);
+
+  //
+  // And the mouse is back.
+  //
+
+  hostClearHIDEvents();
+  bench.simulator.injectData(kDT_Mouse, mousePacket, sizeof(mousePacket));
+  hostRun(kSettleNanoseconds);
+
+  check(pointerEvents() == 1, "%u pointer events after recovery, expected 1",
+        pointerEvents());
+
+  printf("stall       %u stall, %u recovery, %llu writes to bring it back\n",
+         stalls, recoveries, writes);
+
+  stopDriver(mouse, bench.mouse[0]);
+  stopDriver(keyboard, bench.keyboard);
+  bench.stop();
+  return testResult();
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Runs the controller against the simulated i8042 under keyboard and mouse
+// load, with keyboard LED requests in between, and checks that every byte
+// the devices sent reaches the drivers, in time, and that the requests get
+// through.  Once with interrupts, once in polling mode.  Reports how fast
+// the host got through it.  Polling mode is run with the interrupts lost
+// altogether, as on the machines that need it.
+//
+
+#include <sys/time.h>
+#include "PS2TestBench.h"
+
+#define kRunNanoseconds         (5ULL * 1000000000ULL)
+#define kStepNanoseconds        (10ULL * 1000000ULL)
+#define kMousePacketInterval    (10ULL * 1000000ULL)   // 100 Hz
+#define kLEDRequestSteps        10                      // every 100 ms
+#define kMaxReadLatency         (3ULL * 1000000ULL)     // ready to read
+#define kMaxPollReadLatency     (30ULL * 1000000ULL)
+
+// =============================================================================
+// PS2ByteSink Class
+//
+// Stands in for a driver: takes the bytes from a nub and keeps count.
+//
+
+class PS2ByteSink : public OSObject
+{
+  OSDeclareDefaultStructors(PS2ByteSink);
+
+public:
+  UInt64 bytes;
+  UInt64 latencyTotal;                  // arrival to delivery, nanoseconds
+  UInt64 latencyMaximum;
+  UInt8  last;
+
+  static void received(void *         target,
+                       const UInt8 *  data,
+                       const UInt64 * times,
+                       UInt32         count);
+};
+
+void PS2ByteSink::received(void *         target,
+                           const UInt8 *  data,
+                           const UInt64 * times,
+                           UInt32         count)
+{
+  PS2ByteSink * sink = (PS2ByteSink *) target;
+  UInt64        now  = mach_absolute_time();
+
+  for (UInt32 index = 0; index < count; index++)
+  {
+    UInt64 latency = now - times[index];
+
+    sink->bytes++;
+    sink->latencyTotal += latency;
+    if (latency > sink->latencyMaximum)  sink->latencyMaximum = latency;
+    sink->last = data[index];
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static bool setKeyboardLEDs(ApplePS2KeyboardDevice * keyboard, UInt8 leds)
+{
+  PS2Request * request = keyboard->allocateRequest();
+
+  request->commands[0].command = kPS2C_WriteDataPort;
+  request->commands[0].inOrOut = kDP_SetKeyboardLEDs;
+  request->commands[1].command = kPS2C_ReadDataPortAndCompare;
+  request->commands[1].inOrOut = kSC_Acknowledge;
+  request->commands[2].command = kPS2C_WriteDataPort;
+  request->commands[2].inOrOut = leds;
+  request->commands[3].command = kPS2C_ReadDataPortAndCompare;
+  request->commands[3].inOrOut = kSC_Acknowledge;
+  request->commandsCount = 4;
+  keyboard->submitRequestAndBlock(request);
+
+  bool success = (request->commandsCount == 4);
+  keyboard->freeRequest(request);
+  return success;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static bool enableMouse(ApplePS2MouseDevice * mouse)
+{
+  PS2Request * request = mouse->allocateRequest();
+
+  request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+  request->commands[0].inOrOut = kDP_Enable;
+  request->commandsCount = 1;
+  mouse->submitRequestAndBlock(request);
+
+  bool success = (request->commandsCount == 1);
+  mouse->freeRequest(request);
+  return success;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static double wallSeconds()
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void runLoad(bool pollingMode)
+{
+  static const UInt8  mousePacket[3] = { 0x08, 0x01, 0xFF };
+  const char *        mode = pollingMode ? "polling" : "interrupts";
+  PS2TestBenchOptions options = { false, pollingMode, false, pollingMode };
+  PS2TestBench        bench;
+  PS2SimulatorStatistics statistics;
+
+  bench.simulator.setTiming(500, 2000, 1100000, 1100000);
+
+  if (!check(bench.start(&options), "%s: controller did not start", mode))
+    return;
+  if (!check(bench.keyboard && bench.mouse[0], "%s: nubs missing", mode))
+    return;
+
+  PS2ByteSink * keyboardSink = new PS2ByteSink;
+  PS2ByteSink * mouseSink    = new PS2ByteSink;
+
+  bench.keyboard->installInterruptBatchAction(keyboardSink,
+                                              PS2ByteSink::received);
+  bench.mouse[0]->installInterruptBatchAction(mouseSink,
+                                              PS2ByteSink::received);
+  bench.keyboard->setCommandByte(kCB_EnableKeyboardIRQ, kCB_DisableKeyboardClock);
+  bench.mouse[0]->setCommandByte(kCB_EnableMouseIRQ, kCB_DisableMouseClock);
+  check(enableMouse(bench.mouse[0]), "%s: mouse enable failed", mode);
+
+  // (whatever the devices still had to say from start is not load)
+  hostRun(kStepNanoseconds);
+  keyboardSink->bytes = mouseSink->bytes = 0;
+  bench.simulator.resetStatistics();
+  bench.simulator.setStreamPacket(kDT_Mouse, mousePacket, sizeof(mousePacket),
+                                  kMousePacketInterval);
+
+  //
+  // Type a key every other step, and set the LEDs every so often.
+  //
+
+  UInt64 typed        = 0;
+  UInt32 ledRequests  = 0;
+  UInt32 ledFailures  = 0;
+  double wallStart    = wallSeconds();
+
+  for (UInt64 step = 0; step * kStepNanoseconds < kRunNanoseconds; step++)
+  {
+    if (step % 2 == 0)
+    {
+      UInt8 scancode = 0x1E | ((step % 4) ? kSC_UpBit : 0);
+      bench.simulator.injectData(kDT_Keyboard, &scancode, 1);
+      typed++;
+    }
+    if (step % kLEDRequestSteps == kLEDRequestSteps / 2)
+    {
+      ledRequests++;
+      if (!setKeyboardLEDs(bench.keyboard, (UInt8) (step / kLEDRequestSteps) & 7))
+        ledFailures++;
+    }
+    hostRun(kStepNanoseconds);
+  }
+
+  bench.simulator.setStreamPacket(kDT_Mouse, 0, 0, 0);
+  hostRun(100 * 1000000ULL);
+
+  double wallTime = wallSeconds() - wallStart;
+  bench.simulator.getStatistics(&statistics);
+
+  //
+  // Every byte read off the keyboard port was typed, or an acknowledge for
+  // an LED request; every byte read off the aux port was streamed.
+  //
+
+  check(statistics.bytesDropped[kDT_Keyboard] == 0 &&
+        statistics.bytesDropped[kDT_Mouse] == 0,
+        "%s: device queue overflowed", mode);
+  check(ledFailures == 0, "%s: %u of %u LED requests failed",
+        mode, ledFailures, ledRequests);
+  check(keyboardSink->bytes == typed,
+        "%s: keyboard driver got %llu of %llu bytes",
+        mode, keyboardSink->bytes, typed);
+  check(statistics.bytesDelivered[kDT_Keyboard] == typed + 2 * ledRequests,
+        "%s: %llu keyboard bytes read, expected %llu", mode,
+        statistics.bytesDelivered[kDT_Keyboard], typed + 2 * ledRequests);
+  check(mouseSink->bytes == statistics.bytesDelivered[kDT_Mouse] &&
+        mouseSink->bytes % sizeof(mousePacket) == 0 &&
+        mouseSink->bytes >= sizeof(mousePacket) * (kRunNanoseconds /
+                                                   kMousePacketInterval - 1),
+        "%s: mouse driver got %llu bytes, %llu read", mode,
+        mouseSink->bytes, statistics.bytesDelivered[kDT_Mouse]);
+
+  UInt64 maxReadLatency = pollingMode ? kMaxPollReadLatency : kMaxReadLatency;
+
+  for (int deviceType = kDT_Keyboard; deviceType <= kDT_Mouse; deviceType++)
+    check(statistics.latencyMaximum[deviceType] <= maxReadLatency,
+          "%s: %s byte waited %llu ns to be read", mode,
+          deviceType == kDT_Mouse ? "mouse" : "keyboard",
+          statistics.latencyMaximum[deviceType]);
+
+  UInt64 bytes = statistics.bytesDelivered[kDT_Keyboard] +
+                 statistics.bytesDelivered[kDT_Mouse];
+
+  printf("%-10s  %6llu bytes  read latency avg %5llu us max %5llu us  "
+         "driver latency max %5llu us  host %.0f bytes/s (%.1fx real time)\n",
+         mode, bytes,
+         (statistics.latencyTotal[0] + statistics.latencyTotal[1]) /
+         (bytes ? bytes : 1) / 1000,
+         (statistics.latencyMaximum[0] > statistics.latencyMaximum[1] ?
+          statistics.latencyMaximum[0] : statistics.latencyMaximum[1]) / 1000,
+         (keyboardSink->latencyMaximum > mouseSink->latencyMaximum ?
+          keyboardSink->latencyMaximum : mouseSink->latencyMaximum) / 1000,
+         bytes / wallTime, (kRunNanoseconds / 1e9) / wallTime);
+
+  bench.keyboard->uninstallInterruptAction();
+  bench.mouse[0]->uninstallInterruptAction();
+  keyboardSink->release();
+  mouseSink->release();
+  bench.stop();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main()
+{
+  runLoad(false);
+  runLoad(true);
+  return testResult();
+}
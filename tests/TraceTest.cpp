@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Types and moves the mouse under the flight recorder, and checks what a
+// capture gives away: every mouse byte, but of the keyboard only that a
+// byte arrived, and only to an administrator, through the user client.
+// Nothing is left behind in the registry.
+//
+
+#include "PS2TestBench.h"
+#include "VoodooPS2Keyboard.h"
+#include "VoodooPS2Mouse.h"
+
+#define kStepNanoseconds        (20ULL * 1000000ULL)
+#define kSteps                  50
+#define kMousePacketInterval    (10ULL * 1000000ULL)   // 100 Hz
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static IOUserClient * openTraceClient(ApplePS2Controller * controller,
+                                      IOReturn *           result)
+{
+  IOUserClient * client = 0;
+
+  *result = controller->newUserClient(current_task(), 0, kTraceUserClientType,
+                                      0, &client);
+  return (*result == kIOReturnSuccess) ? client : 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void closeTraceClient(IOUserClient * client)
+{
+  client->clientClose();
+  client->release();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main()
+{
+  static const UInt8  mousePacket[3] = { 0x08, 0x01, 0xFF };
+  PS2TestBenchOptions options = { false, false, false, false };
+  PS2TestBench        bench;
+
+  if (!check(bench.start(&options), "controller did not start"))
+    return testResult();
+  if (!check(bench.keyboard && bench.mouse[0], "nubs missing"))
+    return testResult();
+
+  IOService * keyboard = startDriver(new ApplePS2Keyboard, bench.keyboard);
+  IOService * mouse    = startDriver(new ApplePS2Mouse, bench.mouse[0]);
+
+  if (!check(keyboard && mouse, "drivers did not start"))
+    return testResult();
+
+  //
+  // Some typing and some mouse motion for the recorder.
+  //
+
+  bench.simulator.setStreamPacket(kDT_Mouse, mousePacket, sizeof(mousePacket),
+                                  kMousePacketInterval);
+
+  for (int step = 0; step < kSteps; step++)
+  {
+    UInt8 scancode = 0x2D | ((step % 2) ? kSC_UpBit : 0);
+    bench.simulator.injectData(kDT_Keyboard, &scancode, 1);
+    hostRun(kStepNanoseconds);
+  }
+
+  bench.simulator.setStreamPacket(kDT_Mouse, 0, 0, 0);
+  hostRun(kStepNanoseconds);
+
+  //
+  // A capture has the mouse bytes and the keyboard bytes' arrival, but not
+  // a single keyboard byte's value.
+  //
+
+  OSData * trace = bench.controller->copyTrace();
+
+  if (!check(trace != 0, "no capture"))
+    return testResult();
+
+  const PS2TraceHeader * header  = (const PS2TraceHeader *) trace->getBytesNoCopy();
+  const PS2TraceRecord * records = (const PS2TraceRecord *) (header + 1);
+  UInt32                 mouseBytes    = 0;
+  UInt32                 keyboardBytes = 0;
+  UInt32                 leaks         = 0;
+
+  check(header->magic == kTraceMagic && header->version == kTraceVersion &&
+        trace->getLength() == sizeof(PS2TraceHeader) +
+                              header->recordCount * sizeof(PS2TraceRecord),
+        "capture is malformed");
+
+  for (UInt32 index = 0; index < header->recordCount; index++)
+  {
+    const PS2TraceRecord * record = &records[index];
+
+    if (record->flags & (kTF_Write | kTF_CommandPort))  continue;
+
+    if (record->flags & kTF_Mouse)
+      mouseBytes++;
+    else if ((record->flags & kTF_Redacted) && record->data == 0)
+      keyboardBytes++;
+    else
+      leaks++;
+  }
+
+  check(leaks == 0, "%u keyboard bytes in the capture", leaks);
+  check(keyboardBytes >= kSteps, "%u keyboard bytes noted, %u typed",
+        keyboardBytes, kSteps);
+  check(mouseBytes >= sizeof(mousePacket) * (kSteps * kStepNanoseconds /
+                                             kMousePacketInterval - 1),
+        "only %u mouse bytes in the capture", mouseBytes);
+
+  //
+  // User space gets the same, but only as an administrator.
+  //
+
+  IOReturn       result;
+  IOUserClient * client;
+
+  hostSetClientPrivileged(false);
+  client = openTraceClient(bench.controller, &result);
+  check(client == 0 && result == kIOReturnNotPrivileged,
+        "trace user client opened without privilege (%08x)", result);
+  if (client)  closeTraceClient(client);
+
+  hostSetClientPrivileged(true);
+  client = openTraceClient(bench.controller, &result);
+
+  if (check(client != 0, "trace user client refused (%08x)", result))
+  {
+    UInt32                    size   = trace->getLength() + 4096;
+    UInt8 *                   buffer = (UInt8 *) malloc(size);
+    IOExternalMethodArguments arguments;
+
+    bzero(&arguments, sizeof(arguments));
+    arguments.structureOutputDescriptor =
+                                  IOMemoryDescriptor::withAddress(buffer, 64);
+
+    result = client->externalMethod(kTraceMethodCopy, &arguments);
+    check(result == kIOReturnNoSpace,
+          "capture copied into a short buffer (%08x)", result);
+    arguments.structureOutputDescriptor->release();
+
+    arguments.structureOutputDescriptor =
+                                  IOMemoryDescriptor::withAddress(buffer, size);
+
+    result = client->externalMethod(kTraceMethodCopy, &arguments);
+    if (check(result == kIOReturnSuccess, "capture copy failed (%08x)", result))
+    {
+      const PS2TraceHeader * copied = (const PS2TraceHeader *) buffer;
+
+      check(arguments.structureOutputDescriptorSize ==
+            sizeof(PS2TraceHeader) + copied->recordCount * sizeof(PS2TraceRecord) &&
+            copied->magic == kTraceMagic &&
+            copied->recordCount >= header->recordCount,
+            "user client capture is malformed");
+    }
+    arguments.structureOutputDescriptor->release();
+
+    result = client->externalMethod(kTraceMethodCopy + 1, &arguments);
+    check(result == kIOReturnBadArgument, "unknown method accepted");
+
+    free(buffer);
+    closeTraceClient(client);
+  }
+
+  hostSetClientPrivileged(false);
+  trace->release();
+
+  //
+  // And none of it is published.
+  //
+
+  OSDictionary * properties = bench.controller->getPropertyTable();
+
+  for (unsigned index = 0; properties && index < properties->getCount(); index++)
+  {
+    OSData * data = OSDynamicCast(OSData, properties->getObjectAt(index));
+    check(data == 0 || data->getLength() < sizeof(PS2TraceHeader) ||
+          ((const PS2TraceHeader *) data->getBytesNoCopy())->magic != kTraceMagic,
+          "capture published in the registry");
+  }
+
+  printf("trace       %u mouse bytes kept, %u keyboard bytes redacted\n",
+         mouseBytes, keyboardBytes);
+
+  stopDriver(mouse, bench.mouse[0]);
+  stopDriver(keyboard, bench.keyboard);
+  bench.stop();
+  return testResult();
+}
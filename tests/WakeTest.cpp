@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// Puts the controller to sleep and wakes it with the given pointing driver
+// running:
+//
+//   WakeTest <IOClass>
+//
+// The device is still there and still the same on wake, so the controller
+// should bring it back from the driver's resume snapshot, and the driver,
+// told so with kPS2C_ResumeDevice, should not wait out the power-on
+// self-test a device that was reset would need.
+//
+
+#include "PS2TestBench.h"
+
+#define kPowerStateSleep        0
+#define kPowerStateNormal       2
+
+#define kSettleNanoseconds      (100ULL * 1000000ULL)
+#define kPowerOnNanoseconds     (1000ULL * 1000000ULL)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+int main(int argc, char ** argv)
+{
+  PS2TestBenchOptions options = { false, false, false, false };
+  PS2TestBench        bench;
+
+  if (argc != 2)
+  {
+    fprintf(stderr, "usage: %s <IOClass>\n", argv[0]);
+    return 2;
+  }
+
+  const char * className = argv[1];
+
+  if (!check(bench.start(&options), "controller did not start"))
+    return testResult();
+  if (!check(bench.mouse[0], "mouse nub missing"))
+    return testResult();
+
+  IOService * pointing = startPointingDriver(&bench, className);
+
+  if (!check(pointing, "%s did not start", className))
+    return testResult();
+
+  hostRun(kSettleNanoseconds);
+
+  bench.controller->setPowerState(kPowerStateSleep, 0);
+  hostRun(kSettleNanoseconds);
+
+  //
+  // The wake runs on a thread call, which the bench runs to the end,
+  // however long the driver sleeps in it.
+  //
+
+  UInt64 start = bench.simulator.now();
+
+  bench.controller->setPowerState(kPowerStateNormal, 0);
+  hostRun(kSettleNanoseconds);
+
+  UInt64 wakeTime = bench.simulator.now() - start;
+
+  check(wakeTime < kPowerOnNanoseconds,
+        "wake took %llu ms, the power-on wait was not skipped",
+        wakeTime / 1000000);
+
+  printf("wake        %-26s %6llu ms\n", className, wakeTime / 1000000);
+
+  stopDriver(pointing, bench.mouse[0]);
+  bench.stop();
+  return testResult();
+}
@@ -0,0 +1,370 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "PS2TestBench.h"
+
+static int gFailures = 0;
+
+// =============================================================================
+// PS2TestBench Class Implementation
+//
+
+PS2TestBench::PS2TestBench()
+{
+  provider    = 0;
+  controller  = 0;
+  keyboard    = 0;
+  for (unsigned port = 0; port < kMaxAuxPorts; port++)  mouse[port] = 0;
+  _interruptsLost = false;
+  _hook           = 0;
+  _hookContext    = 0;
+
+  hostReset();
+  simulator.init();
+}
+
+PS2TestBench::~PS2TestBench()
+{
+  stop();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool PS2TestBench::start(const PS2TestBenchOptions * options)
+{
+  HostClock      clock = { this, clockNow, clockAdvance, clockNextEvent };
+  PS2PortBackend backend;
+  OSDictionary * properties;
+
+  _interruptsLost = options->interruptsLost;
+
+  hostSetClock(&clock);
+  hostSetRegisterServiceHook(registerService, this);
+  simulator.setInterruptAction(this, raiseInterrupt);
+  simulator.getBackend(&backend);
+
+  provider = new IOService;
+  provider->init();
+
+  properties = OSDictionary::withCapacity(4);
+  properties->setObject(kFastInitKey,
+                        options->fastInit ? kOSBooleanTrue : kOSBooleanFalse);
+  properties->setObject(kPollingModeKey,
+                        options->pollingMode ? kOSBooleanTrue : kOSBooleanFalse);
+  properties->setObject(kMuxModeKey,
+                        options->muxMode ? kOSBooleanTrue : kOSBooleanFalse);
+
+  controller = new ApplePS2Controller;
+
+  bool started = controller->init(properties) && controller->attach(provider);
+  properties->release();
+
+  if (started)
+  {
+    controller->setPortBackend(&backend);
+    started = controller->start(provider);
+  }
+
+  if (!started)
+  {
+    controller->detach(provider);
+    controller->release();
+    controller = 0;
+    return false;
+  }
+
+  // Let the nubs' drivers, if any, finish whatever start kicked off.
+  hostRun(0);
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2TestBench::stop()
+{
+  if (controller)
+  {
+    controller->stop(provider);
+    controller->detach(provider);
+    controller->release();
+    controller = 0;
+  }
+  if (provider)
+  {
+    provider->release();
+    provider = 0;
+  }
+
+  keyboard = 0;
+  for (unsigned port = 0; port < kMaxAuxPorts; port++)  mouse[port] = 0;
+
+  hostSetRegisterServiceHook(0, 0);
+  hostSetClock(0);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2TestBench::setRegisterServiceHook(
+                          void (*hook)(IOService * service, void * context),
+                          void * context)
+{
+  _hook        = hook;
+  _hookContext = context;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2TestBench::registerService(IOService * service, void * context)
+{
+  PS2TestBench *        bench = (PS2TestBench *) context;
+  ApplePS2MouseDevice * nub   = OSDynamicCast(ApplePS2MouseDevice, service);
+
+  if (OSDynamicCast(ApplePS2KeyboardDevice, service))
+  {
+    bench->keyboard = (ApplePS2KeyboardDevice *) service;
+  }
+  else if (nub)
+  {
+    OSNumber * port = OSDynamicCast(OSNumber, nub->getProperty(kAuxPortKey));
+
+    if (port && port->unsigned32BitValue() < kMaxAuxPorts)
+      bench->mouse[port->unsigned32BitValue()] = nub;
+  }
+
+  if (bench->_hook)  (*bench->_hook)(service, bench->_hookContext);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void PS2TestBench::raiseInterrupt(void * target, PS2DeviceType deviceType)
+{
+  PS2TestBench * bench = (PS2TestBench *) target;
+
+  if (bench->_interruptsLost)  return;
+
+  hostRaiseInterrupt(bench->provider,
+                     (deviceType == kDT_Mouse) ? kIRQ_Mouse : kIRQ_Keyboard);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt64 PS2TestBench::clockNow(void * target)
+{
+  return ((PS2TestBench *) target)->simulator.now();
+}
+
+void PS2TestBench::clockAdvance(void * target, UInt64 nanoseconds)
+{
+  ((PS2TestBench *) target)->simulator.advance(nanoseconds);
+}
+
+UInt64 PS2TestBench::clockNextEvent(void * target)
+{
+  return ((PS2TestBench *) target)->simulator.nextEventTime();
+}
+
+// =============================================================================
+// Drivers
+//
+
+IOService * startDriver(IOService * driver, IOService * nub,
+                        OSDictionary * properties)
+{
+  SInt32 score   = 0;
+  bool   started;
+
+  if (properties)
+    properties->retain();
+  else
+    properties = OSDictionary::withCapacity(1);
+
+  started = driver->init(properties) && driver->attach(nub);
+  properties->release();
+
+  if (started && driver->probe(nub, &score) && driver->start(nub))
+    return driver;
+
+  if (started)  driver->detach(nub);
+  driver->release();
+  return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void stopDriver(IOService * driver, IOService * nub)
+{
+  if (driver == 0)  return;
+
+  driver->stop(nub);
+  driver->detach(nub);
+  driver->release();
+}
+
+// =============================================================================
+// Pointing Drivers
+//
+
+//
+// What each pad answers to the identification sequences its driver sends,
+// beyond what the plain mouse model says.  Only as much of each protocol as
+// the drivers' probe and start need is here.
+//
+
+static const PS2SimulatorReply synapticsReplies[] =
+{
+  // Identify TouchPad (special command 0x00): v7.8
+  { 9, { 0xE8, 0x00, 0xE8, 0x00, 0xE8, 0x00, 0xE8, 0x00, 0xE9 },
+    3, { 0x08, 0x47, 0x07 } },
+};
+
+static const PS2SimulatorReply glidePointReplies[] =
+{
+  { 6, { 0xE8, 0x00, 0xE6, 0xE6, 0xE6, 0xE9 }, 3, { 0x00, 0x00, 0x64 } },
+  { 6, { 0xE8, 0x00, 0xE7, 0xE7, 0xE7, 0xE9 }, 3, { 0x63, 0x02, 0x50 } },
+
+  // (a nibble in command mode, which has no report)
+  { 5, { 0xE7, 0xE7, 0xE7, 0xF5, 0xE9 }, 0, { 0 } },
+};
+
+static const PS2SimulatorReply multiTouchReplies[] =
+{
+  { 6, { 0xE8, 0x00, 0xE6, 0xE6, 0xE6, 0xE9 }, 3, { 0x00, 0x00, 0x64 } },
+  { 6, { 0xE8, 0x00, 0xE7, 0xE7, 0xE7, 0xE9 }, 3, { 0x73, 0x02, 0x64 } },
+  { 5, { 0xE7, 0xE7, 0xE7, 0xF5, 0xE9 }, 0, { 0 } },
+
+  // IntelliMouse knock
+  { 7, { 0xF3, 0xC8, 0xF3, 0x64, 0xF3, 0x50, 0xF2 }, 1, { 0x03 } },
+};
+
+static const PS2SimulatorReply sentelicReplies[] =
+{
+  // Register reads: device ID, version, revision
+  { 7, { 0xF3, 0x66, 0x88, 0xF3, 0x66, 0x00, 0xE9 }, 3, { 0x00, 0x00, 0x01 } },
+  { 7, { 0xF3, 0x66, 0x88, 0xF3, 0x66, 0x01, 0xE9 }, 3, { 0x00, 0x00, 0xD0 } },
+  { 7, { 0xF3, 0x66, 0x88, 0xF3, 0x66, 0x04, 0xE9 }, 3, { 0x00, 0x00, 0x02 } },
+
+  // IntelliMouse knock, answered with four byte packets
+  { 7, { 0xF3, 0xC8, 0xF3, 0xC8, 0xF3, 0x50, 0xF2 }, 1, { 0x04 } },
+};
+
+struct PS2PointingPersonality
+{
+  const char *              className;
+  const PS2SimulatorReply * replies;
+  UInt32                    replyCount;
+};
+
+#define REPLIES(table)  table, sizeof(table) / sizeof(table[0])
+
+static const PS2PointingPersonality pointingPersonalities[] =
+{
+  { "ApplePS2Mouse",             0, 0                         },
+  { "ApplePS2SynapticsTouchPad", REPLIES(synapticsReplies)   },
+  { "ApplePS2ALPSGlidePoint",    REPLIES(glidePointReplies)  },
+  { "ApplePS2ALPSMultiTouch",    REPLIES(multiTouchReplies)  },
+  { "ApplePS2SentelicFSP",       REPLIES(sentelicReplies)    },
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOService * startPointingDriver(PS2TestBench * bench, const char * className)
+{
+  const PS2PointingPersonality * personality = 0;
+  OSObject *                     object;
+  IOService *                    driver;
+
+  for (unsigned index = 0;
+       index < sizeof(pointingPersonalities) / sizeof(pointingPersonalities[0]);
+       index++)
+  {
+    if (strcmp(pointingPersonalities[index].className, className) == 0)
+      personality = &pointingPersonalities[index];
+  }
+
+  if (personality == 0 || bench->mouse[0] == 0)  return 0;
+
+  object = OSMetaClass::allocClassWithName(className);
+  driver = OSDynamicCast(IOService, object);
+  if (driver == 0)
+  {
+    if (object)  object->release();
+    return 0;
+  }
+
+  bench->simulator.setReplies(kDT_Mouse, personality->replies,
+                              personality->replyCount);
+  return startDriver(driver, bench->mouse[0]);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void formatHIDEvent(const HostHIDEvent * event, char * line, size_t size)
+{
+  switch (event->type)
+  {
+    case kHostRelativePointer:
+      snprintf(line, size, "relative %d %d buttons %x",
+               (int) event->a, (int) event->b, (unsigned) event->buttons);
+      break;
+
+    case kHostAbsolutePointer:
+      snprintf(line, size, "absolute %d %d pressure %d buttons %x",
+               (int) event->a, (int) event->b, (int) event->c,
+               (unsigned) event->buttons);
+      break;
+
+    case kHostScrollWheel:
+      snprintf(line, size, "scroll %d %d %d",
+               (int) event->a, (int) event->b, (int) event->c);
+      break;
+
+    case kHostKeyboard:
+      snprintf(line, size, "key %d %s", (int) event->a, event->b ? "down" : "up");
+      break;
+  }
+}
+
+// =============================================================================
+// Test Bookkeeping
+//
+
+bool check(bool condition, const char * format, ...)
+{
+  if (!condition)
+  {
+    va_list arguments;
+
+    va_start(arguments, format);
+    fprintf(stderr, "FAILED: ");
+    vfprintf(stderr, format, arguments);
+    fprintf(stderr, "\n");
+    va_end(arguments);
+    gFailures++;
+  }
+  return condition;
+}
+
+int testResult()
+{
+  if (gFailures)  fprintf(stderr, "%d check(s) failed\n", gFailures);
+  return gFailures ? 1 : 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _PS2TESTBENCH_H
+#define _PS2TESTBENCH_H
+
+#include "ApplePS2PortSimulator.h"
+#include "ApplePS2KeyboardDevice.h"
+#include "ApplePS2MouseDevice.h"
+
+//
+// The controller running against ApplePS2PortSimulator under the host kernel
+// shim, with the system clock slaved to the simulator's.  start brings the
+// controller up the way IOKit would, through init, attach and start on a
+// plain provider, and catches the nubs it registers; what drives them is up
+// to the test.
+//
+
+struct PS2TestBenchOptions
+{
+  bool fastInit;                        // kFastInitKey
+  bool pollingMode;                     // kPollingModeKey
+  bool muxMode;                         // kMuxModeKey
+  bool interruptsLost;                  // IRQs never reach the controller
+};
+typedef struct PS2TestBenchOptions PS2TestBenchOptions;
+
+class PS2TestBench
+{
+public:
+  ApplePS2PortSimulator    simulator;
+  IOService *              provider;
+  ApplePS2Controller *     controller;
+  ApplePS2KeyboardDevice * keyboard;
+  ApplePS2MouseDevice *    mouse[kMaxAuxPorts];
+
+  PS2TestBench();
+  ~PS2TestBench();
+
+  // Set the simulator up (timing, load) before start; stop tears it all down.
+  bool start(const PS2TestBenchOptions * options);
+  void stop();
+
+  // Called for each service that registers other than the nubs, which is
+  // where a test attaches drivers of its own.
+  void setRegisterServiceHook(void (*hook)(IOService * service, void * context),
+                              void * context);
+
+private:
+  bool   _interruptsLost;
+  void * _hookContext;
+  void (*_hook)(IOService * service, void * context);
+
+  static void   registerService(IOService * service, void * context);
+  static void   raiseInterrupt(void * target, PS2DeviceType deviceType);
+  static UInt64 clockNow(void * target);
+  static void   clockAdvance(void * target, UInt64 nanoseconds);
+  static UInt64 clockNextEvent(void * target);
+};
+
+//
+// A driver matched to a nub the way IOKit would: init (with the given
+// personality properties, if any), attach, probe and start.  startDriver
+// returns the driver, or releases it and returns 0 if it did not start.
+//
+
+IOService * startDriver(IOService *    driver,
+                        IOService *    nub,
+                        OSDictionary * properties = 0);
+void        stopDriver(IOService * driver, IOService * nub);
+
+//
+// A pointing driver by its IOClass: the simulated mouse is given the replies
+// of the pad the driver is written for, and the driver is then matched to
+// the first mouse nub.  Returns 0 for a class the bench does not know, or if
+// the driver did not start.
+//
+
+IOService * startPointingDriver(PS2TestBench * bench, const char * className);
+
+//
+// A HID event as one line of text, without its times, which is how the
+// replay tool prints and compares them.
+//
+
+void formatHIDEvent(const HostHIDEvent * event, char * line, size_t size);
+
+//
+// Test bookkeeping: check prints the failure and counts it, and the test's
+// main returns testResult.
+//
+
+bool check(bool condition, const char * format, ...);
+int  testResult();
+
+#endif /* _PS2TESTBENCH_H */
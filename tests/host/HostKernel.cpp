@@ -0,0 +1,1474 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include "HostKernel.h"
+
+#include <cxxabi.h>
+#include <map>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+// =============================================================================
+// Scheduler State
+//
+
+// Logical threads.  Each work loop is a thread of its own, as is every thread
+// call while it runs; whoever calls into the stack from outside is thread 0.
+
+#define kHostInterruptThread    (-1)
+
+static int gCurrentThread = 0;
+static int gNextThread    = 1;
+
+static UInt64 gDefaultTime = 0;
+static UInt64 defaultClockNow(void *)             { return gDefaultTime; }
+static void   defaultClockAdvance(void *, UInt64 ns) { gDefaultTime += ns; }
+static UInt64 defaultClockNextEvent(void *)       { return ~0ULL; }
+
+static const HostClock gDefaultClock =
+  { 0, defaultClockNow, defaultClockAdvance, defaultClockNextEvent };
+static HostClock gClock = gDefaultClock;
+
+static IOWorkLoop * gWorkLoops = 0;
+
+struct HostThreadCall
+{
+  thread_call_func_t  func;
+  thread_call_param_t param0;
+  thread_call_param_t param1;
+  bool                pending;
+};
+
+static std::vector<HostThreadCall *> gThreadCalls;      // pending, in order
+
+struct HostWaiter
+{
+  void * event;
+  bool   woken;
+};
+
+static std::vector<HostWaiter *> gWaiters;
+
+struct HostPendingInterrupt
+{
+  IOService * provider;
+  int         source;
+};
+
+static std::vector<HostPendingInterrupt> gPendingInterrupts;
+static int                               gInterruptMask = 0;
+static bool                              gInInterrupt   = false;
+
+static std::map<std::string, int>        gBootArgs;
+static bool                              gLogging = false;
+static bool                              gClientPrivileged = false;
+static std::vector<std::string>          gLog;
+static std::vector<HostHIDEvent>         gHIDEvents;
+
+static void (*gRegisterServiceHook)(IOService *, void *) = 0;
+static void *  gRegisterServiceContext = 0;
+
+void hostDeliverInterrupts();
+
+// =============================================================================
+// libkern Containers
+//
+
+void * OSObject::operator new(size_t size)
+{
+  void * memory = calloc(1, size);
+  if (!memory)  abort();
+  return memory;
+}
+
+void OSObject::operator delete(void * memory)
+{
+  ::free(memory);
+}
+
+void OSObject::free()
+{
+  delete this;
+}
+
+void OSObject::retain() const
+{
+  _retainCount++;
+}
+
+void OSObject::release() const
+{
+  if (--_retainCount == 0)  const_cast<OSObject *>(this)->free();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static OSMetaClass * gMetaClasses = 0;     // (zero before any constructor runs)
+
+OSMetaClass::OSMetaClass(const char * className, OSObject * (*alloc)())
+{
+  _className   = className;
+  _alloc       = alloc;
+  _next        = gMetaClasses;
+  gMetaClasses = this;
+}
+
+OSObject * OSMetaClass::allocClassWithName(const char * name)
+{
+  for (OSMetaClass * metaClass = gMetaClasses; metaClass; metaClass = metaClass->_next)
+    if (strcmp(metaClass->_className, name) == 0)  return (*metaClass->_alloc)();
+  return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSString * OSString::withCString(const char * string)
+{
+  OSString * me = new OSString;
+  me->_string = strdup(string);
+  return me;
+}
+
+bool OSString::isEqualTo(const char * string) const
+{
+  return strcmp(_string, string) == 0;
+}
+
+bool OSString::isEqualTo(const OSString * string) const
+{
+  return string && strcmp(_string, string->_string) == 0;
+}
+
+void OSString::free()
+{
+  ::free(_string);
+  OSObject::free();
+}
+
+const OSSymbol * OSSymbol::withCString(const char * string)
+{
+  OSSymbol * me = new OSSymbol;
+  me->_string = strdup(string);
+  return me;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSNumber * OSNumber::withNumber(unsigned long long value, unsigned bits)
+{
+  OSNumber * me = new OSNumber;
+  me->_bits = bits;
+  me->setValue(value);
+  return me;
+}
+
+void OSNumber::setValue(unsigned long long value)
+{
+  _value = (_bits >= 64) ? value : value & ((1ULL << _bits) - 1);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSBoolean * const kOSBooleanTrue  = new OSBoolean(true);
+OSBoolean * const kOSBooleanFalse = new OSBoolean(false);
+
+OSBoolean * OSBoolean::withBoolean(bool value)
+{
+  return value ? kOSBooleanTrue : kOSBooleanFalse;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSData * OSData::withCapacity(unsigned capacity)
+{
+  OSData * me = new OSData;
+  me->_capacity = capacity ? capacity : 16;
+  me->_bytes    = (UInt8 *) malloc(me->_capacity);
+  return me;
+}
+
+OSData * OSData::withBytes(const void * bytes, unsigned length)
+{
+  OSData * me = withCapacity(length);
+  me->appendBytes(bytes, length);
+  return me;
+}
+
+bool OSData::appendBytes(const void * bytes, unsigned length)
+{
+  if (_length + length > _capacity)
+  {
+    while (_length + length > _capacity)  _capacity *= 2;
+    _bytes = (UInt8 *) realloc(_bytes, _capacity);
+  }
+  if (bytes)  memcpy(_bytes + _length, bytes, length);
+  else        memset(_bytes + _length, 0, length);
+  _length += length;
+  return true;
+}
+
+bool OSData::isEqualTo(const void * bytes, unsigned length) const
+{
+  return length == _length && memcmp(bytes, _bytes, length) == 0;
+}
+
+void OSData::free()
+{
+  ::free(_bytes);
+  OSObject::free();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSArray * OSArray::withCapacity(unsigned capacity)
+{
+  OSArray * me = new OSArray;
+  me->_capacity = capacity ? capacity : 4;
+  me->_objects  = (OSObject **) calloc(me->_capacity, sizeof(OSObject *));
+  return me;
+}
+
+bool OSArray::setObject(const OSObject * object)
+{
+  if (!object)  return false;
+  if (_count == _capacity)
+  {
+    _capacity *= 2;
+    _objects = (OSObject **) realloc(_objects, _capacity * sizeof(OSObject *));
+  }
+  object->retain();
+  _objects[_count++] = const_cast<OSObject *>(object);
+  return true;
+}
+
+OSObject * OSArray::getObject(unsigned index) const
+{
+  return (index < _count) ? _objects[index] : 0;
+}
+
+void OSArray::free()
+{
+  for (unsigned index = 0; index < _count; index++)
+    _objects[index]->release();
+  ::free(_objects);
+  OSObject::free();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSDictionary * OSDictionary::withCapacity(unsigned capacity)
+{
+  OSDictionary * me = new OSDictionary;
+  me->_capacity = capacity ? capacity : 4;
+  me->_keys     = (const OSSymbol **) calloc(me->_capacity, sizeof(OSSymbol *));
+  me->_objects  = (OSObject **) calloc(me->_capacity, sizeof(OSObject *));
+  return me;
+}
+
+OSObject * OSDictionary::getObject(const char * key) const
+{
+  for (unsigned index = 0; index < _count; index++)
+    if (_keys[index]->isEqualTo(key))  return _objects[index];
+  return 0;
+}
+
+OSObject * OSDictionary::getObject(const OSString * key) const
+{
+  return key ? getObject(key->getCStringNoCopy()) : 0;
+}
+
+bool OSDictionary::setObject(const char * key, const OSObject * object)
+{
+  if (!key || !object)  return false;
+
+  object->retain();
+  for (unsigned index = 0; index < _count; index++)
+  {
+    if (_keys[index]->isEqualTo(key))
+    {
+      _objects[index]->release();
+      _objects[index] = const_cast<OSObject *>(object);
+      return true;
+    }
+  }
+
+  if (_count == _capacity)
+  {
+    _capacity *= 2;
+    _keys    = (const OSSymbol **) realloc(_keys, _capacity * sizeof(OSSymbol *));
+    _objects = (OSObject **) realloc(_objects, _capacity * sizeof(OSObject *));
+  }
+  _keys[_count]    = OSSymbol::withCString(key);
+  _objects[_count] = const_cast<OSObject *>(object);
+  _count++;
+  return true;
+}
+
+bool OSDictionary::setObject(const OSString * key, const OSObject * object)
+{
+  return key && setObject(key->getCStringNoCopy(), object);
+}
+
+void OSDictionary::removeObject(const char * key)
+{
+  for (unsigned index = 0; index < _count; index++)
+  {
+    if (_keys[index]->isEqualTo(key))
+    {
+      _keys[index]->release();
+      _objects[index]->release();
+      _count--;
+      memmove(&_keys[index], &_keys[index + 1],
+              (_count - index) * sizeof(OSSymbol *));
+      memmove(&_objects[index], &_objects[index + 1],
+              (_count - index) * sizeof(OSObject *));
+      return;
+    }
+  }
+}
+
+const OSSymbol * OSDictionary::getKey(unsigned index) const
+{
+  return (index < _count) ? _keys[index] : 0;
+}
+
+OSObject * OSDictionary::getObjectAt(unsigned index) const
+{
+  // Iterating a dictionary yields its keys, as in libkern.
+  return (index < _count) ? const_cast<OSSymbol *>(_keys[index]) : 0;
+}
+
+void OSDictionary::free()
+{
+  for (unsigned index = 0; index < _count; index++)
+  {
+    _keys[index]->release();
+    _objects[index]->release();
+  }
+  ::free(_keys);
+  ::free(_objects);
+  OSObject::free();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+OSCollectionIterator * OSCollectionIterator::withCollection(
+                                               const OSCollection * collection)
+{
+  if (!collection)  return 0;
+
+  OSCollectionIterator * me = new OSCollectionIterator;
+  collection->retain();
+  me->_collection = collection;
+  return me;
+}
+
+OSObject * OSCollectionIterator::getNextObject()
+{
+  return (_index < _collection->getCount()) ?
+         _collection->getObjectAt(_index++) : 0;
+}
+
+void OSCollectionIterator::free()
+{
+  _collection->release();
+  OSIterator::free();
+}
+
+// =============================================================================
+// IOLib
+//
+
+void IOLog(const char * format, ...)
+{
+  char    line[512];
+  va_list arguments;
+
+  va_start(arguments, format);
+  vsnprintf(line, sizeof(line), format, arguments);
+  va_end(arguments);
+
+  gLog.push_back(line);
+  if (gLogging)  fputs(line, stderr);
+}
+
+void * IOMalloc(size_t size)
+{
+  return malloc(size);
+}
+
+void IOFree(void * address, size_t size)
+{
+  ::free(address);
+}
+
+void Debugger(const char * reason)
+{
+  fprintf(stderr, "Debugger: %s\n", reason);
+  abort();
+}
+
+void IODelay(unsigned microseconds)
+{
+  // A busy wait; interrupts still come in, nothing else gets to run.
+  (*gClock.advance)(gClock.target, (UInt64) microseconds * 1000);
+}
+
+void IOSleep(unsigned milliseconds)
+{
+  hostRun((UInt64) milliseconds * 1000000);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct IOLock
+{
+  bool held;
+};
+
+// Simple locks spin for real, so that a benchmark may hammer a lock-protected
+// path from several host threads; taking one twice on the same thread is a
+// deadlock, and reported as such.
+
+struct IOSimpleLock
+{
+  volatile bool held;
+  volatile long owner;                  // host thread holding it, or zero
+};
+
+static long hostThreadId()
+{
+  static volatile long nextId = 0;
+  static __thread long id     = 0;
+
+  if (id == 0)  id = __atomic_add_fetch(&nextId, 1, __ATOMIC_SEQ_CST);
+  return id;
+}
+
+IOLock * IOLockAlloc()
+{
+  return (IOLock *) calloc(1, sizeof(IOLock));
+}
+
+void IOLockFree(IOLock * lock)
+{
+  ::free(lock);
+}
+
+void IOLockLock(IOLock * lock)
+{
+  if (lock->held)
+  {
+    fprintf(stderr, "host: IOLock taken twice\n");
+    abort();
+  }
+  lock->held = true;
+}
+
+void IOLockUnlock(IOLock * lock)
+{
+  lock->held = false;
+}
+
+static bool waiterWoken(void * context)
+{
+  return ((HostWaiter *) context)->woken;
+}
+
+int IOLockSleep(IOLock * lock, void * event, int interruptible)
+{
+  //
+  // Let the rest of the system run until somebody wakes us.  If nothing is
+  // left that could, we would sleep forever.
+  //
+
+  HostWaiter waiter = { event, false };
+
+  gWaiters.push_back(&waiter);
+  lock->held = false;
+
+  if (!hostRunUntil(waiterWoken, &waiter, ~0ULL))
+  {
+    fprintf(stderr, "host: IOLockSleep would never wake\n");
+    abort();
+  }
+
+  lock->held = true;
+  for (size_t index = 0; index < gWaiters.size(); index++)
+    if (gWaiters[index] == &waiter)  gWaiters.erase(gWaiters.begin() + index);
+
+  return THREAD_AWAKENED;
+}
+
+void IOLockWakeup(IOLock * lock, void * event, bool oneThread)
+{
+  for (size_t index = 0; index < gWaiters.size(); index++)
+  {
+    if (gWaiters[index]->event == event && !gWaiters[index]->woken)
+    {
+      gWaiters[index]->woken = true;
+      if (oneThread)  break;
+    }
+  }
+}
+
+IOSimpleLock * IOSimpleLockAlloc()
+{
+  return (IOSimpleLock *) calloc(1, sizeof(IOSimpleLock));
+}
+
+void IOSimpleLockFree(IOSimpleLock * lock)
+{
+  ::free(lock);
+}
+
+void IOSimpleLockLock(IOSimpleLock * lock)
+{
+  if (lock->owner == hostThreadId())
+  {
+    fprintf(stderr, "host: simple lock taken twice\n");
+    abort();
+  }
+  while (__atomic_exchange_n(&lock->held, true, __ATOMIC_ACQUIRE))
+    while (lock->held)  ;
+  lock->owner = hostThreadId();
+}
+
+void IOSimpleLockUnlock(IOSimpleLock * lock)
+{
+  lock->owner = 0;
+  __atomic_store_n(&lock->held, false, __ATOMIC_RELEASE);
+}
+
+IOInterruptState IOSimpleLockLockDisableInterrupt(IOSimpleLock * lock)
+{
+  gInterruptMask++;
+  IOSimpleLockLock(lock);
+  return 0;
+}
+
+void IOSimpleLockUnlockEnableInterrupt(IOSimpleLock * lock,
+                                       IOInterruptState state)
+{
+  IOSimpleLockUnlock(lock);
+  if (--gInterruptMask == 0)  hostDeliverInterrupts();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt64 mach_absolute_time()
+{
+  return (*gClock.now)(gClock.target);
+}
+
+void clock_get_uptime(UInt64 * result)
+{
+  *result = mach_absolute_time();
+}
+
+void clock_interval_to_deadline(UInt32 interval, UInt32 scale, UInt64 * result)
+{
+  *result = mach_absolute_time() + (UInt64) interval * scale;
+}
+
+void clock_interval_to_absolutetime_interval(UInt32 interval, UInt32 scale,
+                                             UInt64 * result)
+{
+  *result = (UInt64) interval * scale;
+}
+
+void absolutetime_to_nanoseconds(UInt64 absoluteTime, UInt64 * result)
+{
+  *result = absoluteTime;
+}
+
+void nanoseconds_to_absolutetime(UInt64 nanoseconds, UInt64 * result)
+{
+  *result = nanoseconds;
+}
+
+void clock_get_system_microtime(UInt32 * seconds, UInt32 * microseconds)
+{
+  UInt64 now = mach_absolute_time();
+
+  *seconds      = (UInt32) (now / 1000000000);
+  *microseconds = (UInt32) (now % 1000000000 / 1000);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool PE_parse_boot_argn(const char * name, void * value, int size)
+{
+  std::map<std::string, int>::iterator entry = gBootArgs.find(name);
+
+  if (entry == gBootArgs.end())  return false;
+  memcpy(value, &entry->second, (size < (int) sizeof(int)) ? size : sizeof(int));
+  return true;
+}
+
+bool PE_parse_boot_arg(const char * name, void * value)
+{
+  return PE_parse_boot_argn(name, value, sizeof(int));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+thread_call_t thread_call_allocate(thread_call_func_t  func,
+                                   thread_call_param_t param0)
+{
+  HostThreadCall * call = (HostThreadCall *) calloc(1, sizeof(HostThreadCall));
+  call->func   = func;
+  call->param0 = param0;
+  return call;
+}
+
+boolean_t thread_call_enter1(thread_call_t call, thread_call_param_t param1)
+{
+  call->param1 = param1;
+  if (call->pending)  return TRUE;
+  call->pending = true;
+  gThreadCalls.push_back(call);
+  return FALSE;
+}
+
+boolean_t thread_call_enter(thread_call_t call)
+{
+  return thread_call_enter1(call, call->param1);
+}
+
+boolean_t thread_call_cancel(thread_call_t call)
+{
+  for (size_t index = 0; index < gThreadCalls.size(); index++)
+  {
+    if (gThreadCalls[index] == call)
+    {
+      gThreadCalls.erase(gThreadCalls.begin() + index);
+      call->pending = false;
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+boolean_t thread_call_free(thread_call_t call)
+{
+  thread_call_cancel(call);
+  ::free(call);
+  return TRUE;
+}
+
+// =============================================================================
+// IORegistryEntry, IOService
+//
+
+bool IORegistryEntry::init(OSDictionary * properties)
+{
+  if (properties)
+  {
+    properties->retain();
+    _properties = properties;
+  }
+  else
+  {
+    _properties = OSDictionary::withCapacity(8);
+  }
+  return true;
+}
+
+void IORegistryEntry::free()
+{
+  if (_properties)  _properties->release();
+  OSObject::free();
+}
+
+bool IORegistryEntry::setProperty(const char * key, OSObject * value)
+{
+  return _properties->setObject(key, value);
+}
+
+bool IORegistryEntry::setProperty(const OSString * key, OSObject * value)
+{
+  return _properties->setObject(key, value);
+}
+
+bool IORegistryEntry::setProperty(const char * key, const char * value)
+{
+  OSString * string = OSString::withCString(value);
+  bool       result = setProperty(key, string);
+  string->release();
+  return result;
+}
+
+bool IORegistryEntry::setProperty(const char * key, bool value)
+{
+  return setProperty(key, value ? kOSBooleanTrue : kOSBooleanFalse);
+}
+
+bool IORegistryEntry::setProperty(const char * key, unsigned long long value,
+                                  unsigned bits)
+{
+  OSNumber * number = OSNumber::withNumber(value, bits);
+  bool       result = setProperty(key, number);
+  number->release();
+  return result;
+}
+
+bool IORegistryEntry::setProperty(const char * key, void * bytes,
+                                  unsigned length)
+{
+  OSData * data   = OSData::withBytes(bytes, length);
+  bool     result = setProperty(key, data);
+  data->release();
+  return result;
+}
+
+OSObject * IORegistryEntry::getProperty(const char * key) const
+{
+  return _properties ? _properties->getObject(key) : 0;
+}
+
+void IORegistryEntry::removeProperty(const char * key)
+{
+  _properties->removeObject(key);
+}
+
+IOReturn IORegistryEntry::setProperties(OSObject * properties)
+{
+  return kIOReturnUnsupported;
+}
+
+const char * IORegistryEntry::getName() const
+{
+  if (_name[0] == 0)
+  {
+    int    status;
+    char * name = abi::__cxa_demangle(typeid(*this).name(), 0, 0, &status);
+
+    snprintf(const_cast<char *>(_name), sizeof(_name), "%s",
+             (status == 0 && name) ? name : "IORegistryEntry");
+    ::free(name);
+  }
+  return _name;
+}
+
+void IORegistryEntry::setName(const char * name)
+{
+  snprintf(_name, sizeof(_name), "%s", name);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool IOService::init(OSDictionary * properties)
+{
+  return IORegistryEntry::init(properties);
+}
+
+void IOService::free()
+{
+  IORegistryEntry::free();
+}
+
+IOService * IOService::probe(IOService * provider, SInt32 * score)
+{
+  return this;
+}
+
+bool IOService::start(IOService * provider)
+{
+  return true;
+}
+
+void IOService::stop(IOService * provider)
+{
+}
+
+bool IOService::attach(IOService * provider)
+{
+  provider->retain();
+  _provider = provider;
+  return true;
+}
+
+void IOService::detach(IOService * provider)
+{
+  if (_provider == provider)
+  {
+    _provider = 0;
+    provider->release();
+  }
+}
+
+void IOService::registerService(IOOptionBits options)
+{
+  if (gRegisterServiceHook)  (*gRegisterServiceHook)(this, gRegisterServiceContext);
+}
+
+bool IOService::terminate(IOOptionBits options)
+{
+  IOService * provider = _provider;
+
+  if (provider)
+  {
+    stop(provider);
+    detach(provider);
+  }
+  return true;
+}
+
+IOWorkLoop * IOService::getWorkLoop() const
+{
+  return _provider ? _provider->getWorkLoop() : 0;
+}
+
+IOReturn IOService::message(UInt32 type, IOService * provider, void * argument)
+{
+  return kIOReturnUnsupported;
+}
+
+IOReturn IOService::newUserClient(task_t owningTask, void * securityID,
+                                  UInt32 type, OSDictionary * properties,
+                                  IOUserClient ** handler)
+{
+  return kIOReturnUnsupported;
+}
+
+IOReturn IOService::registerInterrupt(int source, OSObject * target,
+                                      IOInterruptAction handler, void * refCon)
+{
+  if (source < 0 || source >= kHostInterrupts)  return kIOReturnBadArgument;
+
+  _interrupts[source].target  = target;
+  _interrupts[source].handler = handler;
+  _interrupts[source].refCon  = refCon;
+  _interrupts[source].enabled = false;
+  return kIOReturnSuccess;
+}
+
+IOReturn IOService::unregisterInterrupt(int source)
+{
+  if (source < 0 || source >= kHostInterrupts)  return kIOReturnBadArgument;
+
+  bzero(&_interrupts[source], sizeof(_interrupts[source]));
+  return kIOReturnSuccess;
+}
+
+IOReturn IOService::enableInterrupt(int source)
+{
+  if (source < 0 || source >= kHostInterrupts)  return kIOReturnBadArgument;
+
+  _interrupts[source].enabled = true;
+  return kIOReturnSuccess;
+}
+
+IOReturn IOService::disableInterrupt(int source)
+{
+  if (source < 0 || source >= kHostInterrupts)  return kIOReturnBadArgument;
+
+  _interrupts[source].enabled = false;
+  return kIOReturnSuccess;
+}
+
+IOReturn IOService::getInterruptType(int source, int * interruptType)
+{
+  *interruptType = 0;                   // edge
+  return kIOReturnSuccess;
+}
+
+IOReturn IOService::registerPowerDriver(IOService *      controllingDriver,
+                                        IOPMPowerState * powerStates,
+                                        unsigned long    numberOfStates)
+{
+  return kIOReturnSuccess;
+}
+
+IOReturn IOService::setPowerState(unsigned long powerStateOrdinal,
+                                  IOService *   whatDevice)
+{
+  return kIOPMAckImplied;
+}
+
+void IOService::raiseInterrupt(int source)
+{
+  if (source < 0 || source >= kHostInterrupts)  return;
+  if (_interrupts[source].pending)  return;
+
+  HostPendingInterrupt pending = { this, source };
+
+  _interrupts[source].pending = true;
+  gPendingInterrupts.push_back(pending);
+  hostDeliverInterrupts();
+}
+
+void hostRaiseInterrupt(IOService * provider, int source)
+{
+  provider->raiseInterrupt(source);
+}
+
+void hostDeliverInterrupts()
+{
+  //
+  // Run the primary handlers of the lines raised, unless interrupts are off
+  // or we already are in a handler, in which case this is called again once
+  // that is over.
+  //
+
+  if (gInterruptMask || gInInterrupt)  return;
+
+  gInInterrupt = true;
+
+  while (!gPendingInterrupts.empty())
+  {
+    HostPendingInterrupt     pending   = gPendingInterrupts.front();
+    IOService::Interrupt &   interrupt = pending.provider->_interrupts[pending.source];
+    int                      thread    = gCurrentThread;
+
+    gPendingInterrupts.erase(gPendingInterrupts.begin());
+    interrupt.pending = false;
+
+    if (!interrupt.enabled || !interrupt.handler)  continue;
+
+    gCurrentThread = kHostInterruptThread;
+    (*interrupt.handler)(interrupt.target, interrupt.refCon, pending.provider,
+                         pending.source);
+    gCurrentThread = thread;
+  }
+
+  gInInterrupt = false;
+}
+
+// =============================================================================
+// User Clients
+//
+
+task_t current_task()
+{
+  return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOMemoryDescriptor * IOMemoryDescriptor::withAddress(void *      address,
+                                                     IOByteCount length)
+{
+  IOMemoryDescriptor * me = new IOMemoryDescriptor;
+
+  me->init();
+  me->_address = (UInt8 *) address;
+  me->_length  = length;
+  return me;
+}
+
+IOByteCount IOMemoryDescriptor::writeBytes(IOByteCount  offset,
+                                           const void * bytes,
+                                           IOByteCount  length)
+{
+  if (offset >= _length)  return 0;
+  if (length > _length - offset)  length = _length - offset;
+
+  memcpy(_address + offset, bytes, length);
+  return length;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool IOUserClient::initWithTask(task_t owningTask, void * securityID,
+                                UInt32 type, OSDictionary * properties)
+{
+  return IOService::init(properties);
+}
+
+IOReturn IOUserClient::clientClose()
+{
+  return kIOReturnUnsupported;
+}
+
+IOReturn IOUserClient::externalMethod(UInt32                      selector,
+                                      IOExternalMethodArguments * arguments,
+                                      IOExternalMethodDispatch *  dispatch,
+                                      OSObject *                  target,
+                                      void *                      reference)
+{
+  return kIOReturnUnsupported;
+}
+
+IOReturn IOUserClient::clientHasPrivilege(void *       securityToken,
+                                          const char * privilegeName)
+{
+  return gClientPrivileged ? kIOReturnSuccess : kIOReturnNotPrivileged;
+}
+
+// =============================================================================
+// Work Loops and Event Sources
+//
+
+bool IOEventSource::init(OSObject * owner, Action action)
+{
+  _owner   = owner;
+  _action  = action;
+  _enabled = true;
+  return OSObject::init();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOInterruptEventSource * IOInterruptEventSource::interruptEventSource(
+                                                        OSObject *  owner,
+                                                        Action      action,
+                                                        IOService * provider,
+                                                        int         intIndex)
+{
+  IOInterruptEventSource * me = new IOInterruptEventSource;
+  me->init(owner, (IOEventSource::Action) action);
+  return me;
+}
+
+void IOInterruptEventSource::interruptOccurred(void *, IOService *, int)
+{
+  __atomic_fetch_add(&_producerCount, 1, __ATOMIC_SEQ_CST);
+}
+
+bool IOInterruptEventSource::checkForWork()
+{
+  UInt32 producerCount = _producerCount;
+
+  if (!_enabled || producerCount == _consumerCount)  return false;
+
+  int count = (int) (producerCount - _consumerCount);
+  _consumerCount = producerCount;
+  (*(Action) _action)(_owner, this, count);
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+IOTimerEventSource * IOTimerEventSource::timerEventSource(OSObject * owner,
+                                                         Action     action)
+{
+  IOTimerEventSource * me = new IOTimerEventSource;
+  me->init(owner, (IOEventSource::Action) action);
+  me->_deadline = ~0ULL;
+  return me;
+}
+
+IOReturn IOTimerEventSource::setTimeoutUS(UInt32 microseconds)
+{
+  return setTimeout(microseconds, kMicrosecondScale);
+}
+
+IOReturn IOTimerEventSource::setTimeoutMS(UInt32 milliseconds)
+{
+  return setTimeout(milliseconds, kMillisecondScale);
+}
+
+IOReturn IOTimerEventSource::setTimeout(UInt32 interval, UInt32 scaleFactor)
+{
+  UInt64 deadline;
+
+  clock_interval_to_deadline(interval, scaleFactor, &deadline);
+  return wakeAtTime(deadline);
+}
+
+IOReturn IOTimerEventSource::wakeAtTime(UInt64 deadline)
+{
+  _deadline = deadline;
+  return kIOReturnSuccess;
+}
+
+void IOTimerEventSource::cancelTimeout()
+{
+  _deadline = ~0ULL;
+}
+
+bool IOTimerEventSource::checkForWork()
+{
+  if (!_enabled || _deadline > mach_absolute_time())  return false;
+
+  _deadline = ~0ULL;
+  if (_action)  (*(Action) _action)(_owner, this);
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static std::map<const IOWorkLoop *, int> gWorkLoopThreads;
+
+IOWorkLoop * IOWorkLoop::workLoop()
+{
+  IOWorkLoop * me = new IOWorkLoop;
+
+  gWorkLoopThreads[me] = gNextThread++;
+
+  // (kept in creation order, which is the order they get their turn in)
+  IOWorkLoop ** link = &gWorkLoops;
+  while (*link)  link = &(*link)->_nextLoop;
+  *link = me;
+
+  return me;
+}
+
+void IOWorkLoop::free()
+{
+  for (IOWorkLoop ** link = &gWorkLoops; *link; link = &(*link)->_nextLoop)
+  {
+    if (*link == this)
+    {
+      *link = _nextLoop;
+      break;
+    }
+  }
+  gWorkLoopThreads.erase(this);
+
+  while (_sources)  removeEventSource(_sources);
+  OSObject::free();
+}
+
+IOWorkLoop * IOWorkLoop::firstWorkLoop()
+{
+  return gWorkLoops;
+}
+
+IOReturn IOWorkLoop::addEventSource(IOEventSource * source)
+{
+  if (source->_workLoop)  return kIOReturnBusy;
+
+  source->retain();
+  source->_workLoop = this;
+  source->_next     = 0;
+
+  IOEventSource ** link = &_sources;
+  while (*link)  link = &(*link)->_next;
+  *link = source;
+
+  return kIOReturnSuccess;
+}
+
+IOReturn IOWorkLoop::removeEventSource(IOEventSource * source)
+{
+  for (IOEventSource ** link = &_sources; *link; link = &(*link)->_next)
+  {
+    if (*link == source)
+    {
+      *link = source->_next;
+      source->_workLoop = 0;
+      source->_next     = 0;
+      source->release();
+      return kIOReturnSuccess;
+    }
+  }
+  return kIOReturnBadArgument;
+}
+
+IOReturn IOWorkLoop::runAction(Action action, OSObject * target, void * arg0,
+                               void * arg1, void * arg2, void * arg3)
+{
+  IOReturn result;
+
+  closeGate();
+  result = (*action)(target, arg0, arg1, arg2, arg3);
+  openGate();
+
+  return result;
+}
+
+void IOWorkLoop::closeGate()
+{
+  //
+  // The gate is recursive for its holder.  Anyone else would block until it
+  // is opened; here the holder is somewhere down our own stack, waiting for
+  // us, so there is nothing for it but to go in as well.
+  //
+
+  if (_gateDepth++ == 0)  _gateThread = gCurrentThread;
+}
+
+void IOWorkLoop::openGate()
+{
+  if (--_gateDepth == 0)  _gateThread = 0;
+}
+
+bool IOWorkLoop::inGate() const
+{
+  return _gateDepth != 0 && _gateThread == gCurrentThread;
+}
+
+bool IOWorkLoop::runEventSources()
+{
+  //
+  // Give the first event source with work to do its turn, as our thread.
+  //
+
+  if (_gateDepth)  return false;
+
+  int  thread = gCurrentThread;
+  bool worked = false;
+
+  retain();
+  gCurrentThread = gWorkLoopThreads[this];
+  closeGate();
+
+  for (IOEventSource * source = _sources; source && !worked; source = source->_next)
+    worked = source->checkForWork();
+
+  openGate();
+  gCurrentThread = thread;
+  release();
+
+  return worked;
+}
+
+UInt64 IOWorkLoop::nextDeadline() const
+{
+  UInt64 deadline = ~0ULL;
+
+  for (IOEventSource * source = _sources; source; source = source->_next)
+    if (source->nextDeadline() < deadline)  deadline = source->nextDeadline();
+
+  return deadline;
+}
+
+// =============================================================================
+// HID Event Sinks
+//
+
+static void recordHIDEvent(HostHIDEventType type, UInt64 time, SInt32 a,
+                           SInt32 b, SInt32 c, UInt32 buttons)
+{
+  HostHIDEvent event;
+
+  event.time         = time;
+  event.dispatchTime = mach_absolute_time();
+  event.type         = type;
+  event.a            = a;
+  event.b            = b;
+  event.c            = c;
+  event.buttons      = buttons;
+  gHIDEvents.push_back(event);
+}
+
+IOReturn IOHIDevice::setParamProperties(OSDictionary * dict)
+{
+  return kIOReturnSuccess;
+}
+
+IOReturn IOHIDevice::setProperties(OSObject * properties)
+{
+  OSDictionary * dict = OSDynamicCast(OSDictionary, properties);
+  return dict ? setParamProperties(dict) : kIOReturnBadArgument;
+}
+
+bool IOHIPointing::init(OSDictionary * properties)
+{
+  return IOHIDevice::init(properties);
+}
+
+void IOHIPointing::dispatchRelativePointerEvent(int dx, int dy,
+                                                UInt32 buttonState,
+                                                AbsoluteTime ts)
+{
+  recordHIDEvent(kHostRelativePointer, ts, dx, dy, 0, buttonState);
+}
+
+void IOHIPointing::dispatchAbsolutePointerEvent(Point * newLoc, Bounds * bounds,
+                                                UInt32 buttonState,
+                                                bool proximity, int pressure,
+                                                int pressureMin,
+                                                int pressureMax,
+                                                int stylusAngle,
+                                                AbsoluteTime ts)
+{
+  recordHIDEvent(kHostAbsolutePointer, ts, newLoc->x, newLoc->y, pressure,
+                 buttonState);
+}
+
+void IOHIPointing::dispatchScrollWheelEvent(short deltaAxis1, short deltaAxis2,
+                                            short deltaAxis3, AbsoluteTime ts)
+{
+  recordHIDEvent(kHostScrollWheel, ts, deltaAxis1, deltaAxis2, deltaAxis3, 0);
+}
+
+bool IOHIKeyboard::init(OSDictionary * properties)
+{
+  return IOHIDevice::init(properties);
+}
+
+void IOHIKeyboard::setAlphaLock(bool val)
+{
+  _alphaLock = val;
+  setAlphaLockFeedback(val);
+}
+
+void IOHIKeyboard::setNumLock(bool val)
+{
+  _numLock = val;
+  setNumLockFeedback(val);
+}
+
+void IOHIKeyboard::dispatchKeyboardEvent(unsigned int keyCode, bool goingDown,
+                                         AbsoluteTime time)
+{
+  recordHIDEvent(kHostKeyboard, time, keyCode, goingDown, 0, 0);
+}
+
+// =============================================================================
+// Host Control
+//
+
+void hostSetClock(const HostClock * clock)
+{
+  gClock = clock ? *clock : gDefaultClock;
+}
+
+void hostReset()
+{
+  gDefaultTime = 0;
+  gLog.clear();
+  gHIDEvents.clear();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static bool runOne()
+{
+  //
+  // Run one piece of work that is due: a work loop event source, or else a
+  // thread call.  Interrupts are taken as they are raised.
+  //
+
+  hostDeliverInterrupts();
+
+  for (IOWorkLoop * loop = gWorkLoops; loop; loop = loop->nextWorkLoop())
+    if (loop->runEventSources())  return true;
+
+  if (!gThreadCalls.empty())
+  {
+    HostThreadCall * call   = gThreadCalls.front();
+    int              thread = gCurrentThread;
+
+    gThreadCalls.erase(gThreadCalls.begin());
+    call->pending  = false;
+    gCurrentThread = gNextThread++;
+    (*call->func)(call->param0, call->param1);
+    gCurrentThread = thread;
+    return true;
+  }
+
+  return false;
+}
+
+static UInt64 nextDeadline()
+{
+  //
+  // The soonest anything is scheduled to happen.  Timers on a work loop whose
+  // gate is held cannot fire until it is opened, so do not count.
+  //
+
+  UInt64 deadline = (*gClock.nextEvent)(gClock.target);
+
+  for (IOWorkLoop * loop = gWorkLoops; loop; loop = loop->nextWorkLoop())
+    if (!loop->gateHeld() && loop->nextDeadline() < deadline)
+      deadline = loop->nextDeadline();
+
+  return deadline;
+}
+
+bool hostRunUntil(bool (*predicate)(void * context), void * context,
+                  UInt64 deadline)
+{
+  for (;;)
+  {
+    if (predicate && (*predicate)(context))  return true;
+    if (runOne())  continue;
+
+    UInt64 now  = mach_absolute_time();
+    UInt64 next = nextDeadline();
+
+    if (now >= deadline)  return predicate == 0;
+
+    // Nothing to do; let time pass until something is.
+
+    if (next <= now)   next = now + 1;
+    if (next > deadline)  next = deadline;
+    if (next == ~0ULL)  return false;           // idle for good
+
+    (*gClock.advance)(gClock.target, next - now);
+  }
+}
+
+void hostRunUntil(UInt64 deadline)
+{
+  hostRunUntil(0, 0, deadline);
+}
+
+void hostRun(UInt64 nanoseconds)
+{
+  hostRunUntil(0, 0, mach_absolute_time() + nanoseconds);
+}
+
+void hostSetRegisterServiceHook(void (*hook)(IOService *, void *),
+                                void * context)
+{
+  gRegisterServiceHook    = hook;
+  gRegisterServiceContext = context;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void hostSetBootArg(const char * name, int value)
+{
+  gBootArgs[name] = value;
+}
+
+void hostSetClientPrivileged(bool privileged)
+{
+  gClientPrivileged = privileged;
+}
+
+void hostSetLogging(bool enabled)
+{
+  gLogging = enabled;
+}
+
+UInt32 hostLogCount(const char * substring)
+{
+  UInt32 count = 0;
+
+  for (size_t index = 0; index < gLog.size(); index++)
+    if (strstr(gLog[index].c_str(), substring))  count++;
+
+  return count;
+}
+
+UInt32 hostHIDEventCount()
+{
+  return (UInt32) gHIDEvents.size();
+}
+
+const HostHIDEvent * hostHIDEvent(UInt32 index)
+{
+  return (index < gHIDEvents.size()) ? &gHIDEvents[index] : 0;
+}
+
+void hostClearHIDEvents()
+{
+  gHIDEvents.clear();
+}
@@ -0,0 +1,862 @@
+/*
+ * Copyright (c) 2002 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.2 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _HOSTKERNEL_H
+#define _HOSTKERNEL_H
+
+//
+// Just enough of libkern and IOKit for the controller and the drivers to
+// build and run as an ordinary host process, which is what the tests under
+// tests/ do.  The headers under host/include stand in for the kernel ones
+// and all come here.
+//
+// Everything runs on the one host thread.  Work loops, timers and thread
+// calls are scheduled by hostRun (and by anything that would sleep in the
+// kernel: IOLockSleep, IOSleep), which hands each work loop's event sources
+// their turn whenever that loop's gate is free, much as the work loop
+// threads would.  Time is virtual: mach_absolute_time is a nanosecond count
+// that advances only when someone waits, so a run is deterministic and as
+// fast as the host can go.  A harness can slave that clock to a device
+// model (see HostClock), such as ApplePS2PortSimulator.
+//
+// Interrupt lines are hooked by registerInterrupt on a provider, as usual,
+// and raised with hostRaiseInterrupt.  The handler runs at once unless
+// interrupts are disabled (IOSimpleLockLockDisableInterrupt) or a handler is
+// already running, in which case it runs as soon as that is over.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Basic types
+//
+
+typedef uint8_t   UInt8;
+typedef uint16_t  UInt16;
+typedef uint32_t  UInt32;
+typedef uint64_t  UInt64;
+typedef int8_t    SInt8;
+typedef int16_t   SInt16;
+typedef int32_t   SInt32;
+typedef int64_t   SInt64;
+typedef UInt8     Boolean;
+
+typedef int       IOReturn;
+typedef UInt32    IOOptionBits;
+typedef SInt32    IOFixed;
+typedef UInt32    IOItemCount;
+typedef UInt64    IOByteCount;
+typedef UInt64    AbsoluteTime;
+typedef UInt64    IOPhysicalAddress;
+typedef unsigned  natural_t;
+typedef int       kern_return_t;
+typedef int       boolean_t;
+
+#ifndef TRUE
+#define TRUE  1
+#define FALSE 0
+#endif
+
+#define __BEGIN_DECLS extern "C" {
+#define __END_DECLS   }
+
+#define kIOReturnSuccess        0
+#define kIOReturnError          ((IOReturn) 0xe00002bc)
+#define kIOReturnNoMemory       ((IOReturn) 0xe00002bd)
+#define kIOReturnNoResources    ((IOReturn) 0xe00002be)
+#define kIOReturnBadArgument    ((IOReturn) 0xe00002c2)
+#define kIOReturnNotPrivileged  ((IOReturn) 0xe00002c1)
+#define kIOReturnUnsupported    ((IOReturn) 0xe00002c7)
+#define kIOReturnNoSpace        ((IOReturn) 0xe00002db)
+#define kIOReturnBusy           ((IOReturn) 0xe00002d5)
+#define kIOReturnTimeout        ((IOReturn) 0xe00002d6)
+#define kIOReturnNotReady       ((IOReturn) 0xe00002d8)
+#define kIOReturnAborted        ((IOReturn) 0xe00002eb)
+
+#define kNanosecondScale        1
+#define kMicrosecondScale       1000
+#define kMillisecondScale       1000000
+#define kSecondScale            1000000000
+
+#define THREAD_UNINT            0
+#define THREAD_INTERRUPTIBLE    1
+#define THREAD_AWAKENED         0
+#define THREAD_TIMED_OUT        1
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// libkern containers
+//
+
+class OSObject;
+
+class OSMetaClassBase
+{
+public:
+  virtual ~OSMetaClassBase() {}
+};
+
+class OSObject : public OSMetaClassBase
+{
+public:
+  OSObject() : _retainCount(1) {}
+
+  // Kernel objects come zero filled, and the drivers rely on it.
+  static void * operator new(size_t size);
+  static void   operator delete(void * memory);
+
+  virtual bool init() { return true; }
+  virtual void free();
+  virtual void retain() const;
+  virtual void release() const;
+  int          getRetainCount() const { return _retainCount; }
+
+protected:
+  virtual ~OSObject() {}
+
+private:
+  mutable int _retainCount;
+};
+
+// Every class defined with OSDefineMetaClassAndStructors registers itself by
+// name, so that a harness can create a driver from its IOClass the way IOKit
+// matching does.
+
+class OSMetaClass
+{
+public:
+  OSMetaClass(const char * className, OSObject * (*alloc)());
+  static OSObject * allocClassWithName(const char * name);
+
+private:
+  const char *  _className;
+  OSObject *  (*_alloc)();
+  OSMetaClass * _next;
+};
+
+class OSString : public OSObject
+{
+public:
+  static OSString * withCString(const char * string);
+  const char *      getCStringNoCopy() const { return _string; }
+  unsigned          getLength() const { return (unsigned) strlen(_string); }
+  bool              isEqualTo(const char * string) const;
+  bool              isEqualTo(const OSString * string) const;
+  virtual void      free();
+
+protected:
+  char * _string;
+};
+
+class OSSymbol : public OSString
+{
+public:
+  static const OSSymbol * withCString(const char * string);
+};
+
+class OSNumber : public OSObject
+{
+public:
+  static OSNumber * withNumber(unsigned long long value, unsigned bits);
+  UInt8             unsigned8BitValue()  const { return (UInt8)  _value; }
+  UInt16            unsigned16BitValue() const { return (UInt16) _value; }
+  UInt32            unsigned32BitValue() const { return (UInt32) _value; }
+  UInt64            unsigned64BitValue() const { return _value; }
+  unsigned          numberOfBits() const { return _bits; }
+  void              setValue(unsigned long long value);
+  void              addValue(SInt64 value) { setValue(_value + value); }
+
+private:
+  UInt64   _value;
+  unsigned _bits;
+};
+
+class OSBoolean : public OSObject
+{
+public:
+  static OSBoolean * withBoolean(bool value);
+  bool               getValue() const { return _value; }
+  bool               isTrue() const { return _value; }
+  bool               isFalse() const { return !_value; }
+  virtual void       retain() const {}
+  virtual void       release() const {}
+
+  OSBoolean(bool value) : _value(value) {}
+
+private:
+  bool _value;
+};
+
+extern OSBoolean * const kOSBooleanTrue;
+extern OSBoolean * const kOSBooleanFalse;
+
+class OSData : public OSObject
+{
+public:
+  static OSData * withBytes(const void * bytes, unsigned length);
+  static OSData * withCapacity(unsigned capacity);
+  const void *    getBytesNoCopy() const { return _bytes; }
+  unsigned        getLength() const { return _length; }
+  bool            appendBytes(const void * bytes, unsigned length);
+  bool            isEqualTo(const void * bytes, unsigned length) const;
+  virtual void    free();
+
+private:
+  UInt8 *  _bytes;
+  unsigned _length;
+  unsigned _capacity;
+};
+
+class OSCollection : public OSObject
+{
+public:
+  virtual unsigned   getCount() const = 0;
+  virtual OSObject * getObjectAt(unsigned index) const = 0;
+};
+
+class OSArray : public OSCollection
+{
+public:
+  static OSArray *   withCapacity(unsigned capacity);
+  bool               setObject(const OSObject * object);
+  OSObject *         getObject(unsigned index) const;
+  virtual unsigned   getCount() const { return _count; }
+  virtual OSObject * getObjectAt(unsigned index) const { return getObject(index); }
+  virtual void       free();
+
+private:
+  OSObject ** _objects;
+  unsigned    _count;
+  unsigned    _capacity;
+};
+
+class OSDictionary : public OSCollection
+{
+public:
+  static OSDictionary * withCapacity(unsigned capacity);
+  OSObject *            getObject(const char * key) const;
+  OSObject *            getObject(const OSString * key) const;
+  bool                  setObject(const char * key, const OSObject * object);
+  bool                  setObject(const OSString * key, const OSObject * object);
+  void                  removeObject(const char * key);
+  const OSSymbol *      getKey(unsigned index) const;
+  virtual unsigned      getCount() const { return _count; }
+  virtual OSObject *    getObjectAt(unsigned index) const;
+  virtual void          free();
+
+private:
+  const OSSymbol ** _keys;
+  OSObject **       _objects;
+  unsigned          _count;
+  unsigned          _capacity;
+};
+
+class OSIterator : public OSObject
+{
+public:
+  virtual OSObject * getNextObject() = 0;
+  virtual void       reset() = 0;
+};
+
+class OSCollectionIterator : public OSIterator
+{
+public:
+  static OSCollectionIterator * withCollection(const OSCollection * collection);
+  virtual OSObject *            getNextObject();
+  virtual void                  reset() { _index = 0; }
+  virtual void                  free();
+
+private:
+  const OSCollection * _collection;
+  unsigned             _index;
+};
+
+template <class T> inline T * OSDynamicCastHelper(const OSMetaClassBase * object)
+{
+  return dynamic_cast<T *>(const_cast<OSMetaClassBase *>(object));
+}
+
+#define OSDynamicCast(type, object) OSDynamicCastHelper<type>(object)
+#define OSTypeAlloc(type)           (new type)
+
+// As with the kernel's GCC build, a bound pointer to member function turns
+// into a plain function taking the object first (-Wno-pmf-conversions).
+#define OSMemberFunctionCast(cptrtype, self, func) \
+        ((cptrtype) ((self)->*(func)))
+
+#define OSDeclareDefaultStructors(className)                              \
+  public:                                                                 \
+    className() {}                                                        \
+  protected:                                                              \
+    virtual ~className() {}                                               \
+  private:
+#define OSDeclareAbstractStructors(className) OSDeclareDefaultStructors(className)
+#define OSDefineMetaClassAndStructors(className, superName)            \
+  static OSObject * className##Alloc() { return new className; }          \
+  static OSMetaClass className##MetaClass(#className, className##Alloc);
+#define OSDefineMetaClassAndAbstractStructors(className, superName)
+#define OSMetaClassDeclareReservedUnused(className, index)
+#define OSMetaClassDefineReservedUnused(className, index)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Atomics
+//
+
+template <class T> inline SInt32 OSAddAtomic(SInt32 amount, volatile T * address)
+{ return (SInt32) __atomic_fetch_add(address, (T) amount, __ATOMIC_SEQ_CST); }
+
+template <class T> inline SInt32 OSIncrementAtomic(volatile T * address)
+{ return OSAddAtomic(1, address); }
+
+template <class T> inline SInt32 OSDecrementAtomic(volatile T * address)
+{ return OSAddAtomic(-1, address); }
+
+template <class T> inline SInt64 OSAddAtomic64(SInt64 amount, volatile T * address)
+{ return (SInt64) __atomic_fetch_add(address, (T) amount, __ATOMIC_SEQ_CST); }
+
+template <class T> inline SInt64 OSIncrementAtomic64(volatile T * address)
+{ return OSAddAtomic64(1, address); }
+
+template <class T> inline UInt32 OSBitOrAtomic(UInt32 mask, volatile T * address)
+{ return (UInt32) __atomic_fetch_or(address, (T) mask, __ATOMIC_SEQ_CST); }
+
+template <class T> inline UInt32 OSBitAndAtomic(UInt32 mask, volatile T * address)
+{ return (UInt32) __atomic_fetch_and(address, (T) mask, __ATOMIC_SEQ_CST); }
+
+template <class T> inline Boolean OSCompareAndSwap(UInt32 oldValue, UInt32 newValue,
+                                                   volatile T * address)
+{
+  T expected = (T) oldValue;
+  return __atomic_compare_exchange_n(address, &expected, (T) newValue, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+template <class T> inline Boolean OSCompareAndSwap64(UInt64 oldValue, UInt64 newValue,
+                                                     volatile T * address)
+{
+  T expected = (T) oldValue;
+  return __atomic_compare_exchange_n(address, &expected, (T) newValue, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+inline Boolean OSCompareAndSwapPtr(void * oldValue, void * newValue,
+                                   void * volatile * address)
+{
+  return __atomic_compare_exchange_n(address, &oldValue, newValue, false,
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+inline void OSMemoryBarrier() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// IOLib
+//
+
+void   IOLog(const char * format, ...) __attribute__((format(printf, 1, 2)));
+void * IOMalloc(size_t size);
+void   IOFree(void * address, size_t size);
+void   IODelay(unsigned microseconds);
+void   IOSleep(unsigned milliseconds);
+void   Debugger(const char * reason);
+
+struct IOLock;
+struct IOSimpleLock;
+typedef int IOInterruptState;
+
+IOLock *         IOLockAlloc();
+void             IOLockFree(IOLock * lock);
+void             IOLockLock(IOLock * lock);
+void             IOLockUnlock(IOLock * lock);
+int              IOLockSleep(IOLock * lock, void * event, int interruptible);
+void             IOLockWakeup(IOLock * lock, void * event, bool oneThread);
+
+IOSimpleLock *   IOSimpleLockAlloc();
+void             IOSimpleLockFree(IOSimpleLock * lock);
+void             IOSimpleLockLock(IOSimpleLock * lock);
+void             IOSimpleLockUnlock(IOSimpleLock * lock);
+IOInterruptState IOSimpleLockLockDisableInterrupt(IOSimpleLock * lock);
+void             IOSimpleLockUnlockEnableInterrupt(IOSimpleLock * lock,
+                                                   IOInterruptState state);
+
+UInt64 mach_absolute_time();
+void   clock_get_uptime(UInt64 * result);
+void   clock_interval_to_deadline(UInt32 interval, UInt32 scale, UInt64 * result);
+void   clock_interval_to_absolutetime_interval(UInt32 interval, UInt32 scale,
+                                               UInt64 * result);
+void   absolutetime_to_nanoseconds(UInt64 absoluteTime, UInt64 * result);
+void   nanoseconds_to_absolutetime(UInt64 nanoseconds, UInt64 * result);
+void   clock_get_system_microtime(UInt32 * seconds, UInt32 * microseconds);
+
+bool   PE_parse_boot_argn(const char * name, void * value, int size);
+bool   PE_parse_boot_arg(const char * name, void * value);
+
+typedef struct HostThreadCall * thread_call_t;
+typedef void *                  thread_call_param_t;
+typedef void (*thread_call_func_t)(thread_call_param_t param0,
+                                   thread_call_param_t param1);
+
+thread_call_t thread_call_allocate(thread_call_func_t func,
+                                   thread_call_param_t param0);
+boolean_t     thread_call_enter(thread_call_t call);
+boolean_t     thread_call_enter1(thread_call_t call, thread_call_param_t param1);
+boolean_t     thread_call_cancel(thread_call_t call);
+boolean_t     thread_call_free(thread_call_t call);
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// IOService and friends
+//
+
+class IOService;
+class IOWorkLoop;
+class IOPMrootDomain;
+class IOUserClient;
+
+typedef struct HostTask * task_t;
+
+typedef void (*IOInterruptAction)(OSObject * target, void * refCon,
+                                  IOService * nub, int source);
+
+struct IOPMPowerState
+{
+  unsigned long version;
+  unsigned long capabilityFlags;
+  unsigned long outputPowerCharacter;
+  unsigned long inputPowerRequirement;
+  unsigned long staticPower;
+  unsigned long unbudgetedPower;
+  unsigned long powerToAttain;
+  unsigned long timeToAttain;
+  unsigned long settleUpTime;
+  unsigned long timeToLower;
+  unsigned long settleDownTime;
+  unsigned long powerDomainBudget;
+};
+
+#define kIOPMDeviceUsable       0x00008000
+#define kIOPMDoze               0x00000400
+#define kIOPMPowerOn            0x00000002
+#define IOPMPowerOn             kIOPMPowerOn
+#define kIOPMAckImplied         0
+#define IOPMAckImplied          kIOPMAckImplied
+#define kIOPMSleepNow           (1 << 0)
+
+#define kIOClientPrivilegeAdministrator "root"
+
+class IORegistryEntry : public OSObject
+{
+public:
+  virtual bool       init(OSDictionary * properties = 0);
+  virtual void       free();
+
+  bool               setProperty(const char * key, OSObject * value);
+  bool               setProperty(const OSString * key, OSObject * value);
+  bool               setProperty(const char * key, const char * value);
+  bool               setProperty(const char * key, bool value);
+  bool               setProperty(const char * key, unsigned long long value,
+                                 unsigned bits);
+  bool               setProperty(const char * key, void * bytes, unsigned length);
+  OSObject *         getProperty(const char * key) const;
+  void               removeProperty(const char * key);
+  OSDictionary *     getPropertyTable() const { return _properties; }
+  virtual IOReturn   setProperties(OSObject * properties);
+
+  virtual const char * getName() const;
+  void               setName(const char * name);
+
+private:
+  OSDictionary * _properties;
+  char           _name[64];
+};
+
+class IOService : public IORegistryEntry
+{
+public:
+  virtual bool        init(OSDictionary * properties = 0);
+  virtual void        free();
+  virtual IOService * probe(IOService * provider, SInt32 * score);
+  virtual bool        start(IOService * provider);
+  virtual void        stop(IOService * provider);
+  virtual bool        attach(IOService * provider);
+  virtual void        detach(IOService * provider);
+  virtual void        registerService(IOOptionBits options = 0);
+  virtual bool        terminate(IOOptionBits options = 0);
+  IOService *         getProvider() const { return _provider; }
+  virtual IOWorkLoop * getWorkLoop() const;
+  virtual IOReturn    message(UInt32 type, IOService * provider,
+                              void * argument = 0);
+
+  virtual IOReturn    registerInterrupt(int source, OSObject * target,
+                                        IOInterruptAction handler,
+                                        void * refCon = 0);
+  virtual IOReturn    unregisterInterrupt(int source);
+  virtual IOReturn    enableInterrupt(int source);
+  virtual IOReturn    disableInterrupt(int source);
+  virtual IOReturn    getInterruptType(int source, int * interruptType);
+
+  void                PMinit() {}
+  void                PMstop() {}
+  IOReturn            registerPowerDriver(IOService * controllingDriver,
+                                          IOPMPowerState * powerStates,
+                                          unsigned long numberOfStates);
+  void                joinPMtree(IOService * driver) {}
+  IOReturn            acknowledgeSetPowerState() { return kIOReturnSuccess; }
+  virtual IOReturn    setPowerState(unsigned long powerStateOrdinal,
+                                    IOService * whatDevice);
+  IOPMrootDomain *    getPMRootDomain() const { return 0; }
+  static IOService *  getPlatform() { return 0; }
+  virtual IOReturn    newUserClient(task_t owningTask, void * securityID,
+                                    UInt32 type, OSDictionary * properties,
+                                    IOUserClient ** handler);
+
+  // Host additions: raise one of the lines hooked with registerInterrupt.
+  void                raiseInterrupt(int source);
+
+private:
+  enum { kHostInterrupts = 16 };
+
+  struct Interrupt
+  {
+    OSObject *        target;
+    IOInterruptAction handler;
+    void *            refCon;
+    bool              enabled;
+    bool              pending;
+  };
+
+  IOService * _provider;
+  Interrupt   _interrupts[kHostInterrupts];
+
+  friend void hostDeliverInterrupts();
+};
+
+class IOPMrootDomain : public IOService
+{
+public:
+  void receivePowerNotification(UInt32 message) {}
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// User clients
+//
+
+task_t current_task();
+
+class IOMemoryDescriptor : public OSObject
+{
+public:
+  static IOMemoryDescriptor * withAddress(void * address, IOByteCount length);
+  IOByteCount getLength() const { return _length; }
+  IOByteCount writeBytes(IOByteCount offset, const void * bytes,
+                         IOByteCount length);
+
+private:
+  UInt8 *     _address;
+  IOByteCount _length;
+};
+
+struct IOExternalMethodArguments
+{
+  const void *         structureInput;
+  UInt32               structureInputSize;
+  void *               structureOutput;
+  UInt32               structureOutputSize;
+  IOMemoryDescriptor * structureOutputDescriptor;
+  UInt32               structureOutputDescriptorSize;
+};
+
+struct IOExternalMethodDispatch;
+
+class IOUserClient : public IOService
+{
+public:
+  virtual bool     initWithTask(task_t owningTask, void * securityID,
+                                UInt32 type, OSDictionary * properties);
+  virtual IOReturn clientClose();
+  virtual IOReturn externalMethod(UInt32 selector,
+                                  IOExternalMethodArguments * arguments,
+                                  IOExternalMethodDispatch * dispatch = 0,
+                                  OSObject * target = 0,
+                                  void * reference = 0);
+
+  // Answers as set with hostSetClientPrivileged.
+  static IOReturn  clientHasPrivilege(void * securityToken,
+                                      const char * privilegeName);
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Work loops and event sources
+//
+
+class IOEventSource : public OSObject
+{
+public:
+  typedef void (*Action)(OSObject * owner, ...);
+
+  virtual bool init(OSObject * owner, Action action = 0);
+  virtual void enable()  { _enabled = true; }
+  virtual void disable() { _enabled = false; }
+  bool         isEnabled() const { return _enabled; }
+  IOWorkLoop * getWorkLoop() const { return _workLoop; }
+
+protected:
+  OSObject *      _owner;
+  Action          _action;
+  IOWorkLoop *    _workLoop;
+  IOEventSource * _next;
+  bool            _enabled;
+
+  // Do any work that is due; returns true if there was some.
+  virtual bool checkForWork() = 0;
+  virtual UInt64 nextDeadline() const { return ~0ULL; }
+
+  friend class IOWorkLoop;
+};
+
+class IOInterruptEventSource : public IOEventSource
+{
+public:
+  typedef void (*Action)(OSObject * owner, IOInterruptEventSource * sender,
+                         int count);
+
+  static IOInterruptEventSource * interruptEventSource(OSObject * owner,
+                                                       Action action,
+                                                       IOService * provider = 0,
+                                                       int intIndex = 0);
+  virtual void interruptOccurred(void * refCon, IOService * nub, int source);
+
+protected:
+  volatile UInt32 _producerCount;
+  UInt32          _consumerCount;
+
+  virtual bool checkForWork();
+};
+
+typedef IOInterruptEventSource::Action IOInterruptEventAction;
+
+class IOTimerEventSource : public IOEventSource
+{
+public:
+  typedef void (*Action)(OSObject * owner, IOTimerEventSource * sender);
+
+  static IOTimerEventSource * timerEventSource(OSObject * owner,
+                                               Action action = 0);
+  IOReturn setTimeoutUS(UInt32 microseconds);
+  IOReturn setTimeoutMS(UInt32 milliseconds);
+  IOReturn setTimeout(UInt32 interval, UInt32 scaleFactor = kNanosecondScale);
+  IOReturn wakeAtTime(UInt64 deadline);
+  void     cancelTimeout();
+
+protected:
+  UInt64 _deadline;                       // ~0 while idle
+
+  virtual bool   checkForWork();
+  virtual UInt64 nextDeadline() const { return _enabled ? _deadline : ~0ULL; }
+};
+
+class IOWorkLoop : public OSObject
+{
+public:
+  typedef IOReturn (*Action)(OSObject * target, void * arg0, void * arg1,
+                             void * arg2, void * arg3);
+
+  static IOWorkLoop * workLoop();
+  virtual void        free();
+
+  IOReturn addEventSource(IOEventSource * source);
+  IOReturn removeEventSource(IOEventSource * source);
+  IOReturn runAction(Action action, OSObject * target, void * arg0 = 0,
+                     void * arg1 = 0, void * arg2 = 0, void * arg3 = 0);
+  void     closeGate();
+  void     openGate();
+  bool     inGate() const;
+
+  // Host additions, for the scheduler.
+  bool     runEventSources();
+  UInt64   nextDeadline() const;
+  bool     gateHeld() const { return _gateDepth != 0; }
+
+  static IOWorkLoop * firstWorkLoop();
+  IOWorkLoop *        nextWorkLoop() const { return _nextLoop; }
+
+private:
+  IOEventSource * _sources;
+  int             _gateDepth;
+  int             _gateThread;
+  IOWorkLoop *    _nextLoop;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// HID event sinks
+//
+
+struct Point  { SInt16 x, y; };
+struct Bounds { SInt16 minx, maxx, miny, maxy; };
+
+#define NX_EVS_DEVICE_TYPE_KEYBOARD      1
+#define NX_EVS_DEVICE_TYPE_MOUSE         2
+#define NX_EVS_DEVICE_TYPE_TABLET        3
+#define NX_EVS_DEVICE_INTERFACE_ADB      1
+#define NX_EVS_DEVICE_INTERFACE_ACE      2
+#define NX_EVS_DEVICE_INTERFACE_BUS_ACE  3
+
+#define kIOHIDPointerAccelerationTypeKey     "HIDPointerAccelerationType"
+#define kIOHIDMouseAccelerationType          "HIDMouseAcceleration"
+#define kIOHIDTrackpadAccelerationType       "HIDTrackpadAcceleration"
+#define kIOHIDPointerResolutionKey           "HIDPointerResolution"
+#define kIOHIDScrollResolutionKey            "HIDScrollResolution"
+#define kIOHIDScrollAccelerationTypeKey      "HIDScrollAccelerationType"
+#define kIOHIDTrackpadScrollAccelerationKey  "HIDTrackpadScrollAcceleration"
+#define kIOHIDKeyboardCapsLockDoesLockKey    "HIDKeyboardCapsLockDoesLock"
+
+#define NX_KEYTYPE_SOUND_UP     0
+#define NX_KEYTYPE_SOUND_DOWN   1
+#define NX_KEYTYPE_HELP         5
+#define NX_POWER_KEY            6
+#define NX_KEYTYPE_MUTE         7
+#define NX_UP_ARROW_KEY         8
+#define NX_DOWN_ARROW_KEY       9
+#define NX_KEYTYPE_NUM_LOCK     10
+
+// What the drivers hand the HID system, in the order they do.
+
+enum HostHIDEventType
+{
+  kHostRelativePointer,                 // a = dx, b = dy
+  kHostAbsolutePointer,                 // a = x, b = y, c = pressure
+  kHostScrollWheel,                     // a, b, c = axis 1, 2, 3
+  kHostKeyboard                         // a = key code, b = going down
+};
+
+struct HostHIDEvent
+{
+  UInt64           time;                // time stamp passed in
+  UInt64           dispatchTime;        // mach_absolute_time at the call
+  HostHIDEventType type;
+  SInt32           a, b, c;
+  UInt32           buttons;
+};
+
+class IOHIDevice : public IOService
+{
+public:
+  virtual UInt32   deviceType()  { return 0; }
+  virtual UInt32   interfaceID() { return 0; }
+  virtual IOReturn setParamProperties(OSDictionary * dict);
+  virtual IOReturn setProperties(OSObject * properties);
+};
+
+class IOHIPointing : public IOHIDevice
+{
+public:
+  virtual bool init(OSDictionary * properties = 0);
+
+protected:
+  virtual IOItemCount buttonCount() { return 1; }
+  virtual IOFixed     resolution()  { return 100 << 16; }
+
+  void dispatchRelativePointerEvent(int dx, int dy, UInt32 buttonState,
+                                    AbsoluteTime ts);
+  void dispatchAbsolutePointerEvent(Point * newLoc, Bounds * bounds,
+                                    UInt32 buttonState, bool proximity,
+                                    int pressure, int pressureMin,
+                                    int pressureMax, int stylusAngle,
+                                    AbsoluteTime ts);
+  void dispatchScrollWheelEvent(short deltaAxis1, short deltaAxis2,
+                                short deltaAxis3, AbsoluteTime ts);
+};
+
+class IOHIKeyboard : public IOHIDevice
+{
+public:
+  virtual bool init(OSDictionary * properties = 0);
+  bool         alphaLock() const { return _alphaLock; }
+  bool         numLock() const   { return _numLock; }
+  void         setAlphaLock(bool val);
+  void         setNumLock(bool val);
+
+protected:
+  virtual const unsigned char * defaultKeymapOfLength(UInt32 * length) = 0;
+  virtual void   setAlphaLockFeedback(bool locked) {}
+  virtual void   setNumLockFeedback(bool locked) {}
+  virtual UInt32 maxKeyCodes() { return 0; }
+  virtual bool   doesKeyLock(int key) { return false; }
+  virtual unsigned getLEDStatus() { return 0; }
+
+  void dispatchKeyboardEvent(unsigned int keyCode, bool goingDown,
+                             AbsoluteTime time);
+
+private:
+  bool _alphaLock;
+  bool _numLock;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Host control
+//
+
+// The virtual clock.  By default it is a plain counter; a harness can hand
+// it to a device model, whose own clock then is the system's, and which
+// names the next moment something will happen on its side.
+
+struct HostClock
+{
+  void * target;
+  UInt64 (*now)(void * target);
+  void   (*advance)(void * target, UInt64 nanoseconds);
+  UInt64 (*nextEvent)(void * target);   // absolute; ~0 if nothing pending
+};
+
+void   hostSetClock(const HostClock * clock);   // 0 for the default
+void   hostReset();                             // clock to zero, events out
+
+// Let everything that is due run, letting time pass until the deadline.
+void   hostRun(UInt64 nanoseconds);
+void   hostRunUntil(UInt64 deadline);
+
+// Run until the predicate holds, or the deadline passes (returns false).
+bool   hostRunUntil(bool (*predicate)(void * context), void * context,
+                    UInt64 deadline);
+
+// Called for every nub (or driver) that registers itself, which is where a
+// harness plays the part of IOKit matching.
+void   hostSetRegisterServiceHook(void (*hook)(IOService * service,
+                                               void *      context),
+                                  void * context);
+
+void   hostSetBootArg(const char * name, int value);
+void   hostSetClientPrivileged(bool privileged);   // user clients' tasks
+void   hostSetLogging(bool enabled);
+UInt32 hostLogCount(const char * substring);    // IOLog lines containing it
+
+void   hostRaiseInterrupt(IOService * provider, int source);
+
+// HID events dispatched by the drivers, oldest first.
+UInt32               hostHIDEventCount();
+const HostHIDEvent * hostHIDEvent(UInt32 index);
+void                 hostClearHIDEvents();
+
+#endif /* _HOSTKERNEL_H */
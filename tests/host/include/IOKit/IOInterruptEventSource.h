@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOInterruptEventSource.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOINTERRUPTEVENTSOURCE_H
+#define _HOST_IOKIT_IOINTERRUPTEVENTSOURCE_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOINTERRUPTEVENTSOURCE_H */
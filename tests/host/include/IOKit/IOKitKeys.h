@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOKitKeys.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOKITKEYS_H
+#define _HOST_IOKIT_IOKITKEYS_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOKITKEYS_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOLib.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOLIB_H
+#define _HOST_IOKIT_IOLIB_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOLIB_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOLocks.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOLOCKS_H
+#define _HOST_IOKIT_IOLOCKS_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOLOCKS_H */
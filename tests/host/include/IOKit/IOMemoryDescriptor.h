@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOMemoryDescriptor.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOMEMORYDESCRIPTOR_H
+#define _HOST_IOKIT_IOMEMORYDESCRIPTOR_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOMEMORYDESCRIPTOR_H */
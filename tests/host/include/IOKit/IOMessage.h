@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOMessage.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOMESSAGE_H
+#define _HOST_IOKIT_IOMESSAGE_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOMESSAGE_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOPlatformExpert.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOPLATFORMEXPERT_H
+#define _HOST_IOKIT_IOPLATFORMEXPERT_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOPLATFORMEXPERT_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOService.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOSERVICE_H
+#define _HOST_IOKIT_IOSERVICE_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOSERVICE_H */
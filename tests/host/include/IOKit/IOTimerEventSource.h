@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOTimerEventSource.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOTIMEREVENTSOURCE_H
+#define _HOST_IOKIT_IOTIMEREVENTSOURCE_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOTIMEREVENTSOURCE_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOTypes.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOTYPES_H
+#define _HOST_IOKIT_IOTYPES_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOTYPES_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOUserClient.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOUSERCLIENT_H
+#define _HOST_IOKIT_IOUSERCLIENT_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOUSERCLIENT_H */
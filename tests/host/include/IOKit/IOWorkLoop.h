@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/IOWorkLoop.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_IOWORKLOOP_H
+#define _HOST_IOKIT_IOWORKLOOP_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_IOWORKLOOP_H */
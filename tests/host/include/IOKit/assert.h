@@ -0,0 +1,13 @@
+// Host stand-in for <IOKit/assert.h>; see HostKernel.h.  As in a release
+// kernel, assertions compile away.
+
+#ifndef _HOST_IOKIT_ASSERT_H
+#define _HOST_IOKIT_ASSERT_H
+
+#include <HostKernel.h>
+
+#ifndef assert
+#define assert(ex) ((void) 0)
+#endif
+
+#endif /* _HOST_IOKIT_ASSERT_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/hidsystem/IOHIDParameter.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_HIDSYSTEM_IOHIDPARAMETER_H
+#define _HOST_IOKIT_HIDSYSTEM_IOHIDPARAMETER_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_HIDSYSTEM_IOHIDPARAMETER_H */
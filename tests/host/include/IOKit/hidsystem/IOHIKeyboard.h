@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/hidsystem/IOHIKeyboard.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_HIDSYSTEM_IOHIKEYBOARD_H
+#define _HOST_IOKIT_HIDSYSTEM_IOHIKEYBOARD_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_HIDSYSTEM_IOHIKEYBOARD_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/hidsystem/IOHIPointing.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_HIDSYSTEM_IOHIPOINTING_H
+#define _HOST_IOKIT_HIDSYSTEM_IOHIPOINTING_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_HIDSYSTEM_IOHIPOINTING_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/pwr_mgt/IOPM.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_PWR_MGT_IOPM_H
+#define _HOST_IOKIT_PWR_MGT_IOPM_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_PWR_MGT_IOPM_H */
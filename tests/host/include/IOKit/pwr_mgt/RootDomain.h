@@ -0,0 +1,8 @@
+// Host stand-in for <IOKit/pwr_mgt/RootDomain.h>; see HostKernel.h.
+
+#ifndef _HOST_IOKIT_PWR_MGT_ROOTDOMAIN_H
+#define _HOST_IOKIT_PWR_MGT_ROOTDOMAIN_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_IOKIT_PWR_MGT_ROOTDOMAIN_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <kern/clock.h>; see HostKernel.h.
+
+#ifndef _HOST_KERN_CLOCK_H
+#define _HOST_KERN_CLOCK_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_KERN_CLOCK_H */
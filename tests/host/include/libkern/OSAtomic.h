@@ -0,0 +1,8 @@
+// Host stand-in for <libkern/OSAtomic.h>; see HostKernel.h.
+
+#ifndef _HOST_LIBKERN_OSATOMIC_H
+#define _HOST_LIBKERN_OSATOMIC_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_LIBKERN_OSATOMIC_H */
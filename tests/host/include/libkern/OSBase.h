@@ -0,0 +1,8 @@
+// Host stand-in for <libkern/OSBase.h>; see HostKernel.h.
+
+#ifndef _HOST_LIBKERN_OSBASE_H
+#define _HOST_LIBKERN_OSBASE_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_LIBKERN_OSBASE_H */
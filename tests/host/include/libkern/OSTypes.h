@@ -0,0 +1,8 @@
+// Host stand-in for <libkern/OSTypes.h>; see HostKernel.h.
+
+#ifndef _HOST_LIBKERN_OSTYPES_H
+#define _HOST_LIBKERN_OSTYPES_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_LIBKERN_OSTYPES_H */
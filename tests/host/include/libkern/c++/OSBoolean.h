@@ -0,0 +1,8 @@
+// Host stand-in for <libkern/c++/OSBoolean.h>; see HostKernel.h.
+
+#ifndef _HOST_LIBKERN_C___OSBOOLEAN_H
+#define _HOST_LIBKERN_C___OSBOOLEAN_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_LIBKERN_C___OSBOOLEAN_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <libkern/c++/OSObject.h>; see HostKernel.h.
+
+#ifndef _HOST_LIBKERN_C___OSOBJECT_H
+#define _HOST_LIBKERN_C___OSOBJECT_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_LIBKERN_C___OSOBJECT_H */
@@ -0,0 +1,8 @@
+// Host stand-in for <machine/machine_routines.h>; see HostKernel.h.
+
+#ifndef _HOST_MACHINE_MACHINE_ROUTINES_H
+#define _HOST_MACHINE_MACHINE_ROUTINES_H
+
+#include <HostKernel.h>
+
+#endif /* _HOST_MACHINE_MACHINE_ROUTINES_H */
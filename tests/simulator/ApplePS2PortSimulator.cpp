@@ -0,0 +1,888 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <IOKit/IOLib.h>
+#include "ApplePS2PortSimulator.h"
+
+#if PORT_IO_BACKEND_SUPPORT
+
+// Default timings, in nanoseconds.
+
+#define kSimAccessTime          1000        // one ISA I/O cycle
+#define kSimInputTime           20000       // controller digesting a write
+#define kSimDeviceByteTime      1100000     // 11 bits at 10 kHz
+
+// Command byte left behind by a typical firmware.
+
+#define kSimFirmwareCommandByte (kCB_EnableKeyboardIRQ | kCB_EnableMouseIRQ | \
+                                 kCB_SystemFlag | kCB_TranslateMode)
+
+// =============================================================================
+// ApplePS2PortSimulator Class Implementation
+//
+
+void ApplePS2PortSimulator::init()
+{
+  bzero(this, sizeof(*this));
+
+  _accessNanoseconds = kSimAccessTime;
+  _inputNanoseconds  = kSimInputTime;
+  _commandByte       = kSimFirmwareCommandByte;
+  _outputSource      = kDT_Keyboard;
+
+  _devices[kDT_Keyboard].byteNanoseconds = kSimDeviceByteTime;
+  _devices[kDT_Keyboard].enabled         = true;
+  _devices[kDT_Mouse].byteNanoseconds    = kSimDeviceByteTime;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::setTiming(UInt32 accessNanoseconds,
+                                      UInt32 inputNanoseconds,
+                                      UInt32 keyboardByteNanoseconds,
+                                      UInt32 mouseByteNanoseconds)
+{
+  _accessNanoseconds = accessNanoseconds;
+  _inputNanoseconds  = inputNanoseconds;
+  _devices[kDT_Keyboard].byteNanoseconds = keyboardByteNanoseconds;
+  _devices[kDT_Mouse].byteNanoseconds    = mouseByteNanoseconds;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::getBackend(PS2PortBackend * backend)
+{
+  backend->target      = this;
+  backend->readAction  = readAction;
+  backend->writeAction = writeAction;
+  backend->delayAction = delayAction;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::setInterruptAction(void * target,
+                                               PS2SimulatorInterruptAction action)
+{
+  _interruptTarget = target;
+  _interruptAction = action;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2PortSimulator::injectData(PS2DeviceType deviceType,
+                                       const UInt8 * bytes,
+                                       UInt32        count)
+{
+  //
+  // Queue asynchronous stream data from the given device, as if the user had
+  // just typed or moved.  Returns false if the device queue overflowed.
+  //
+
+  bool success = true;
+
+  for (UInt32 index = 0; index < count; index++)
+    success &= deviceQueue(deviceType, bytes[index], _now);
+
+  latchOutput();
+  return success;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::setStreamPacket(PS2DeviceType deviceType,
+                                            const UInt8 * packet,
+                                            UInt32        packetSize,
+                                            UInt64        intervalNanoseconds)
+{
+  //
+  // Have the device send the given packet every intervalNanoseconds for as
+  // long as it is enabled and its clock is running.  A zero interval stops
+  // the stream.  The packet is also what the mouse answers kDP_MousePoll with.
+  //
+
+  Device & device = _devices[deviceType];
+
+  if (packetSize > kSimulatorPacketSize)  packetSize = kSimulatorPacketSize;
+
+  bcopy(packet, device.packet, packetSize);
+  device.packetSize     = packetSize;
+  device.packetInterval = intervalNanoseconds;
+  device.nextPacketTime = _now + intervalNanoseconds;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::setReplies(PS2DeviceType             deviceType,
+                                       const PS2SimulatorReply * replies,
+                                       UInt32                    replyCount)
+{
+  //
+  // Give the device the replies of a particular model.  The table is used in
+  // place, and must stay around for as long as the simulator does.
+  //
+
+  _devices[deviceType].replies    = replies;
+  _devices[deviceType].replyCount = replyCount;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::setRefusals(PS2DeviceType deviceType,
+                                        UInt8         answer,
+                                        UInt32        count,
+                                        UInt32        after)
+{
+  //
+  // Have the device refuse count bytes sent to it, once it has taken the
+  // next after bytes as usual: each is answered with the given byte, or with
+  // nothing at all if it is zero, and does not otherwise reach the device.
+  //
+
+  _devices[deviceType].refusalAnswer = answer;
+  _devices[deviceType].refusalCount  = count;
+  _devices[deviceType].refusalAfter  = after;
+}
+
+#if FLIGHT_RECORDER_SUPPORT
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2PortSimulator::loadTrace(const void * trace, UInt32 length)
+{
+  //
+  // Start playing back a flight recorder capture.  The capture is used in
+  // place, and must stay around until replayDone.  Load it once the stack
+  // is in the state the capture began in, typically with the drivers up.
+  // Returns false if this is not a capture we understand.
+  //
+
+  const PS2TraceHeader * header = (const PS2TraceHeader *) trace;
+
+  if ( length < sizeof(PS2TraceHeader)                  ||
+       header->magic      != kTraceMagic                ||
+       header->version    != kTraceVersion              ||
+       header->recordSize != sizeof(PS2TraceRecord)     ||
+       header->ticksPerSecond == 0                      ||
+       length < sizeof(PS2TraceHeader) +
+                (UInt64) header->recordCount * sizeof(PS2TraceRecord) )
+    return false;
+
+  _replayRecords        = (const PS2TraceRecord *) (header + 1);
+  _replayCount          = header->recordCount;
+  _replayNext           = 0;
+  _replayWriteCursor    = 0;
+  _replayTicksPerSecond = header->ticksPerSecond;
+  _replayFirstTime      = _replayCount ? _replayRecords[0].time : 0;
+  _replayBase           = _now;
+  _replaySkipReply      = false;
+
+  replayFeed();
+  latchOutput();
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::replayFeed()
+{
+  //
+  // Queue the trace's device bytes that have fallen due, stopping at a write
+  // the controller has not made yet, or when a device queue is full.
+  //
+
+  while (_replayNext < _replayCount)
+  {
+    const PS2TraceRecord * record = &_replayRecords[_replayNext];
+    UInt64                 time   = replayTime(record);
+
+    if (record->flags & kTF_Write)
+    {
+      //
+      // Once the controller has made the write, carry on from it with the
+      // trace's spacing.  A command the controller answers itself means the
+      // next byte read in the trace is that answer, which we do not replay.
+      //
+
+      if (_replayNext >= _replayWriteCursor)  return;
+      if (_now > time)  _replayBase += _now - time;
+
+      _replaySkipReply = (record->flags & kTF_CommandPort) &&
+                         (record->data == kCP_GetCommandByte  ||
+                          record->data == kCP_TestController  ||
+                          record->data == kCP_TestKeyboardPort ||
+                          record->data == kCP_TestMousePort);
+    }
+    else if (record->flags & kTF_CommandPort)
+    {
+      // (status reads carry nothing to play back)
+    }
+    else if (_replaySkipReply)
+    {
+      _replaySkipReply = false;
+    }
+    else if (record->flags & kTF_Redacted)
+    {
+      // (keyboard bytes are left out of captures; the keyboard model answers)
+    }
+    else
+    {
+      PS2DeviceType deviceType = (record->flags & kTF_Mouse) ? kDT_Mouse :
+                                                               kDT_Keyboard;
+
+      if (time > _now)  return;
+      if (_devices[deviceType].count == kSimulatorQueueSize)  return;
+
+      deviceQueue(deviceType, record->data, time);
+      _statistics.replayBytes++;
+    }
+
+    _replayNext++;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::replayWrite(UInt16 port, UInt8 byte)
+{
+  //
+  // Match a write made by the controller against the next write in the
+  // trace.  Writes past the end of the trace are not checked.
+  //
+
+  UInt8 flags = kTF_Write | ((port == kCommandPort) ? kTF_CommandPort : 0);
+
+  while (_replayWriteCursor < _replayCount &&
+         !(_replayRecords[_replayWriteCursor].flags & kTF_Write))
+    _replayWriteCursor++;
+
+  if (_replayWriteCursor == _replayCount)  return;
+
+  const PS2TraceRecord * record = &_replayRecords[_replayWriteCursor++];
+
+  if ((record->flags & ~kTF_Mouse) != flags || record->data != byte)
+    _statistics.replayMismatches++;
+
+  replayFeed();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt64 ApplePS2PortSimulator::replayTime(const PS2TraceRecord * record) const
+{
+  //
+  // Our time for a trace record, in nanoseconds.  Records taken at interrupt
+  // level may be a hair out of order; they are clamped to the start.
+  //
+
+  UInt64 ticks = (record->time > _replayFirstTime) ?
+                 record->time - _replayFirstTime : 0;
+
+  return _replayBase +
+         (ticks / _replayTicksPerSecond) * 1000000000ULL +
+         (ticks % _replayTicksPerSecond) * 1000000000ULL / _replayTicksPerSecond;
+}
+
+#endif //FLIGHT_RECORDER_SUPPORT
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::advance(UInt64 nanoseconds)
+{
+  //
+  // Let time pass without any port access, eg. while the work loop sleeps.
+  //
+
+  tick(nanoseconds);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt64 ApplePS2PortSimulator::nextEventTime() const
+{
+  //
+  // The soonest a byte can be latched into the output buffer, or a streamed
+  // packet fall due; ~0 if nothing is on its way.  While the output buffer
+  // is full nothing more happens until the controller reads it.
+  //
+
+  UInt64 next = ~0ULL;
+
+  if (_outputFull)  return next;
+
+  if (_controllerCount && _controllerQueue[0].readyTime < next)
+    next = _controllerQueue[0].readyTime;
+
+  for (int deviceType = kDT_Keyboard; deviceType <= kDT_Mouse; deviceType++)
+  {
+    const Device & device = _devices[deviceType];
+
+    if (!clockEnabled((PS2DeviceType) deviceType))  continue;
+
+    if (device.count && device.queue[device.head].readyTime < next)
+      next = device.queue[device.head].readyTime;
+
+    if (device.packetInterval && device.enabled && device.nextPacketTime < next)
+      next = device.nextPacketTime;
+  }
+
+#if FLIGHT_RECORDER_SUPPORT
+  //
+  // The next device byte in the trace, unless a write the controller has not
+  // made yet stands in front of it; then only the controller can move on.
+  //
+
+  for (UInt32 index = _replayNext; _replayRecords && index < _replayCount; index++)
+  {
+    const PS2TraceRecord * record = &_replayRecords[index];
+
+    if (record->flags & kTF_Write)
+    {
+      if (index >= _replayWriteCursor)  break;
+    }
+    else if (!(record->flags & (kTF_CommandPort | kTF_Redacted)))
+    {
+      UInt64 time = replayTime(record);
+      if (time < next)  next = time;
+      break;
+    }
+  }
+#endif
+
+  return next;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::getStatistics(PS2SimulatorStatistics * statistics) const
+{
+  *statistics = _statistics;
+}
+
+void ApplePS2PortSimulator::resetStatistics()
+{
+  bzero(&_statistics, sizeof(_statistics));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+UInt8 ApplePS2PortSimulator::portRead(UInt16 port)
+{
+  _statistics.portReads++;
+  tick(_accessNanoseconds);
+
+  if (port == kCommandPort)
+  {
+    //
+    // Status register.  Bit 4 reads as one while the keyboard is not
+    // inhibited, which is always the case here.
+    //
+
+    UInt8 status = kKeyboardInhibited;
+
+    if (_outputFull)
+    {
+      status |= kOutputReady;
+      if (_outputSource == kDT_Mouse)  status |= kMouseData;
+    }
+    if (_now < _inputBusyUntil)          status |= kInputBusy;
+    if (_commandByte & kCB_SystemFlag)   status |= kSystemFlag;
+    if (_commandLastSent)                status |= kCommandLastSent;
+
+    return status;
+  }
+
+  //
+  // Data port.  Reading an empty output buffer returns the stale byte, just
+  // as the hardware does.
+  //
+
+  UInt8 data = _outputData;
+
+  if (_outputFull)
+  {
+    UInt64 latency = _now - _outputReadyTime;
+
+    _statistics.bytesDelivered[_outputSource]++;
+    _statistics.latencyTotal[_outputSource] += latency;
+    if (latency > _statistics.latencyMaximum[_outputSource])
+      _statistics.latencyMaximum[_outputSource] = latency;
+
+    _outputFull = false;
+    latchOutput();
+  }
+
+  return data;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::portWrite(UInt16 port, UInt8 byte)
+{
+  _statistics.portWrites++;
+  tick(_accessNanoseconds);
+
+#if FLIGHT_RECORDER_SUPPORT
+  if (_replayRecords)  replayWrite(port, byte);
+#endif
+
+  //
+  // A write while the input buffer is still full is lost on real hardware.
+  //
+
+  if (_now < _inputBusyUntil)
+  {
+    _statistics.writesWhileBusy++;
+    return;
+  }
+
+  _inputBusyUntil = _now + _inputNanoseconds;
+
+  if (port == kCommandPort)
+  {
+    _commandLastSent = true;
+    controllerCommand(byte);
+    return;
+  }
+
+  _commandLastSent = false;
+
+  UInt8 pendingCommand = _pendingCommand;
+  _pendingCommand = 0;
+
+  switch (pendingCommand)
+  {
+    case kCP_SetCommandByte:
+      _commandByte = byte;
+      break;
+
+    case kCP_TransmitToMouse:
+      deviceCommand(kDT_Mouse, byte);
+      break;
+
+    case kCP_WriteKeyboardOutputBuffer:
+      deviceSend(kDT_Keyboard, byte, _now);
+      break;
+
+    case kCP_WriteMouseOutputBuffer:
+      deviceSend(kDT_Mouse, byte, _now);
+      break;
+
+    case kCP_WriteOutputPort:
+      break;
+
+    default:
+      deviceCommand(kDT_Keyboard, byte);
+      break;
+  }
+
+  latchOutput();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::tick(UInt64 nanoseconds)
+{
+  _now += nanoseconds;
+
+  //
+  // Generate any streamed packets that fell due.  A device that is disabled
+  // or has its clock held low simply skips the packets it would have sent.
+  //
+
+  for (int deviceType = kDT_Keyboard; deviceType <= kDT_Mouse; deviceType++)
+  {
+    Device & device = _devices[deviceType];
+
+    if (device.packetInterval == 0 || device.nextPacketTime > _now)  continue;
+
+    if (device.enabled && clockEnabled((PS2DeviceType) deviceType))
+    {
+      while (device.nextPacketTime <= _now)
+      {
+        for (UInt32 index = 0; index < device.packetSize; index++)
+          deviceSend((PS2DeviceType) deviceType, device.packet[index],
+                     device.nextPacketTime);
+        device.nextPacketTime += device.packetInterval;
+      }
+    }
+    else
+    {
+      device.nextPacketTime += ((_now - device.nextPacketTime) /
+                                device.packetInterval + 1) * device.packetInterval;
+    }
+  }
+
+#if FLIGHT_RECORDER_SUPPORT
+  if (_replayRecords)  replayFeed();
+#endif
+
+  latchOutput();
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::latchOutput()
+{
+  //
+  // Move the oldest ready byte into the output buffer, if it is empty.
+  // Controller replies compete with device bytes on equal terms.
+  //
+
+  if (_outputFull)  return;
+
+  QueuedByte *  oldest     = 0;
+  PS2DeviceType source     = kDT_Keyboard;
+  bool          controller = false;
+
+  if (_controllerCount && _controllerQueue[0].readyTime <= _now)
+  {
+    oldest     = &_controllerQueue[0];
+    controller = true;
+  }
+
+  for (int deviceType = kDT_Keyboard; deviceType <= kDT_Mouse; deviceType++)
+  {
+    Device & device = _devices[deviceType];
+
+    if (device.count == 0 || !clockEnabled((PS2DeviceType) deviceType))
+      continue;
+
+    QueuedByte * head = &device.queue[device.head];
+
+    if (head->readyTime <= _now && (!oldest || head->readyTime < oldest->readyTime))
+    {
+      oldest     = head;
+      source     = (PS2DeviceType) deviceType;
+      controller = false;
+    }
+  }
+
+  if (!oldest)  return;
+
+  _outputFull      = true;
+  _outputData      = oldest->data;
+  _outputSource    = source;
+  _outputReadyTime = oldest->readyTime;
+
+  if (controller)
+  {
+    _controllerCount--;
+    for (UInt32 index = 0; index < _controllerCount; index++)
+      _controllerQueue[index] = _controllerQueue[index + 1];
+  }
+  else
+  {
+    Device & device = _devices[source];
+    device.head = (device.head + 1) % kSimulatorQueueSize;
+    device.count--;
+  }
+
+  //
+  // Raise the interrupt line for the port, if it is enabled.
+  //
+
+  UInt8 irqBit = (source == kDT_Mouse) ? kCB_EnableMouseIRQ : kCB_EnableKeyboardIRQ;
+
+  if ((_commandByte & irqBit) && _interruptAction)
+    (*_interruptAction)(_interruptTarget, source);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2PortSimulator::clockEnabled(PS2DeviceType deviceType) const
+{
+  UInt8 clockBit = (deviceType == kDT_Mouse) ? kCB_DisableMouseClock :
+                                               kCB_DisableKeyboardClock;
+  return (_commandByte & clockBit) == 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::controllerCommand(UInt8 command)
+{
+  switch (command)
+  {
+    case kCP_GetCommandByte:
+      controllerReply(_commandByte);
+      break;
+
+    case kCP_SetCommandByte:
+    case kCP_TransmitToMouse:
+    case kCP_WriteKeyboardOutputBuffer:
+    case kCP_WriteMouseOutputBuffer:
+    case kCP_WriteOutputPort:
+      _pendingCommand = command;        // next data port write is the operand
+      break;
+
+    case kCP_DisableKeyboardClock:
+      _commandByte |= kCB_DisableKeyboardClock;
+      break;
+
+    case kCP_EnableKeyboardClock:
+      _commandByte &= ~kCB_DisableKeyboardClock;
+      break;
+
+    case kCP_DisableMouseClock:
+      _commandByte |= kCB_DisableMouseClock;
+      break;
+
+    case kCP_EnableMouseClock:
+      _commandByte &= ~kCB_DisableMouseClock;
+      break;
+
+    case kCP_TestController:
+      controllerReply(0x55);
+      break;
+
+    case kCP_TestKeyboardPort:
+    case kCP_TestMousePort:
+      controllerReply(0x00);
+      break;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::controllerReply(UInt8 data)
+{
+  if (_controllerCount == sizeof(_controllerQueue) / sizeof(_controllerQueue[0]))
+    return;
+
+  _controllerQueue[_controllerCount].readyTime = _now + _inputNanoseconds;
+  _controllerQueue[_controllerCount].data      = data;
+  _controllerCount++;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2PortSimulator::deviceCommand(PS2DeviceType deviceType, UInt8 command)
+{
+  Device & device = _devices[deviceType];
+
+  //
+  // The byte itself has to be clocked out to the device first.
+  //
+
+  if (device.lineFreeTime < _now)  device.lineFreeTime = _now;
+  device.lineFreeTime += device.byteNanoseconds;
+
+  if (device.refusalAfter)
+  {
+    device.refusalAfter--;
+  }
+  else if (device.refusalCount)
+  {
+    device.refusalCount--;
+    if (device.refusalAnswer)
+      deviceSend(deviceType, device.refusalAnswer, _now);
+    return;
+  }
+
+  bcopy(&device.history[1], &device.history[0], kSimulatorCommandSize - 1);
+  device.history[kSimulatorCommandSize - 1] = command;
+
+  //
+  // Operand of a previous two-byte command.
+  //
+
+  if (device.pendingCommand)
+  {
+    device.pendingCommand = 0;
+    deviceSend(deviceType, kSC_Acknowledge, _now);
+    return;
+  }
+
+  if (deviceType == kDT_Keyboard && command == kDP_TestKeyboardEcho)
+  {
+    deviceSend(deviceType, kDP_TestKeyboardEcho, _now);
+    return;
+  }
+
+  if (deviceReply(deviceType))  return;
+
+  deviceSend(deviceType, kSC_Acknowledge, _now);
+
+  switch (command)
+  {
+    case kDP_SetKeyboardLEDs:           // (keyboard)
+      if (deviceType == kDT_Keyboard)  device.pendingCommand = command;
+      break;
+
+    case kDP_SetMouseResolution:        // (mouse)
+      if (deviceType == kDT_Mouse)  device.pendingCommand = command;
+      break;
+
+    case kDP_GetSetKeyboardASCs:        // (mouse: kDP_SetMousePoll, no operand)
+      if (deviceType == kDT_Keyboard)  device.pendingCommand = command;
+      break;
+
+    case kDP_SetMouseSampleRate:        // (keyboard: kDP_SetKeyboardTypematic)
+      device.pendingCommand = command;
+      break;
+
+    case kDP_GetId:
+      if (deviceType == kDT_Keyboard)
+      {
+        deviceSend(deviceType, 0xAB, _now);
+        deviceSend(deviceType, 0x83, _now);
+      }
+      else
+      {
+        deviceSend(deviceType, 0x00, _now);
+      }
+      break;
+
+    case kDP_GetMouseInformation:
+      if (deviceType == kDT_Mouse)
+      {
+        deviceSend(deviceType, device.enabled ? 0x20 : 0x00, _now);
+        deviceSend(deviceType, 0x02, _now);   // 4 counts/mm
+        deviceSend(deviceType, 0x64, _now);   // 100 samples/s
+      }
+      break;
+
+    case kDP_MousePoll:
+      if (deviceType == kDT_Mouse)
+      {
+        for (UInt32 index = 0; index < device.packetSize; index++)
+          deviceSend(deviceType, device.packet[index], _now);
+      }
+      break;
+
+    case kDP_Enable:
+      device.enabled        = true;
+      device.nextPacketTime = _now + device.packetInterval;
+      break;
+
+    case kDP_SetDefaultsAndDisable:
+      device.enabled = false;
+      break;
+
+    case kDP_Reset:
+      deviceSend(deviceType, kSC_Reset, _now);
+      if (deviceType == kDT_Mouse)  deviceSend(deviceType, 0x00, _now);
+      device.enabled = (deviceType == kDT_Keyboard);
+      break;
+  }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2PortSimulator::deviceReply(PS2DeviceType deviceType)
+{
+  //
+  // Answer the command just sent from the device's personality, if the bytes
+  // sent last match one of its replies.  Returns false if none does.
+  //
+
+  Device & device = _devices[deviceType];
+
+  for (UInt32 index = 0; index < device.replyCount; index++)
+  {
+    const PS2SimulatorReply * reply = &device.replies[index];
+
+    if (reply->commandCount == 0 || reply->commandCount > kSimulatorCommandSize ||
+        bcmp(reply->command,
+             &device.history[kSimulatorCommandSize - reply->commandCount],
+             reply->commandCount) != 0)
+      continue;
+
+    deviceSend(deviceType, kSC_Acknowledge, _now);
+    for (UInt32 byte = 0; byte < reply->replyCount; byte++)
+      deviceSend(deviceType, reply->reply[byte], _now);
+    return true;
+  }
+
+  return false;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2PortSimulator::deviceSend(PS2DeviceType deviceType,
+                                       UInt8         data,
+                                       UInt64        sendTime)
+{
+  //
+  // A byte the device model itself decided to send.  While a trace is being
+  // played back, the trace speaks for the mouse instead.
+  //
+
+#if FLIGHT_RECORDER_SUPPORT
+  if (_replayRecords && deviceType == kDT_Mouse)  return true;
+#endif
+
+  return deviceQueue(deviceType, data, sendTime);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2PortSimulator::deviceQueue(PS2DeviceType deviceType,
+                                        UInt8         data,
+                                        UInt64        sendTime)
+{
+  //
+  // Clock a byte in from the device.  It becomes visible to the controller
+  // once the wire has been free for a full byte time.
+  //
+
+  Device & device = _devices[deviceType];
+
+  if (device.count == kSimulatorQueueSize)
+  {
+    _statistics.bytesDropped[deviceType]++;
+    return false;
+  }
+
+  if (device.lineFreeTime < sendTime)  device.lineFreeTime = sendTime;
+  device.lineFreeTime += device.byteNanoseconds;
+
+  QueuedByte & slot = device.queue[(device.head + device.count) % kSimulatorQueueSize];
+  slot.readyTime = device.lineFreeTime;
+  slot.data      = data;
+  device.count++;
+
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// PS2PortBackend actions.
+//
+
+UInt8 ApplePS2PortSimulator::readAction(void * target, UInt16 port)
+{
+  return ((ApplePS2PortSimulator *) target)->portRead(port);
+}
+
+void ApplePS2PortSimulator::writeAction(void * target, UInt16 port, UInt8 byte)
+{
+  ((ApplePS2PortSimulator *) target)->portWrite(port, byte);
+}
+
+void ApplePS2PortSimulator::delayAction(void * target, UInt32 microseconds)
+{
+  ApplePS2PortSimulator * me = (ApplePS2PortSimulator *) target;
+
+  me->_statistics.delayNanoseconds += (UInt64) microseconds * 1000;
+  me->tick((UInt64) microseconds * 1000);
+}
+
+#endif //PORT_IO_BACKEND_SUPPORT
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 1998-2000 Apple Computer, Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * The contents of this file constitute Original Code as defined in and
+ * are subject to the Apple Public Source License Version 1.1 (the
+ * "License").  You may not use this file except in compliance with the
+ * License.  Please obtain a copy of the License at
+ * http://www.apple.com/publicsource and read it before using this file.
+ *
+ * This Original Code and all software distributed under the License are
+ * distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE OR NON-INFRINGEMENT.  Please see the
+ * License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef _APPLEPS2PORTSIMULATOR_H
+#define _APPLEPS2PORTSIMULATOR_H
+
+#include "VoodooPS2Controller.h"
+
+#if PORT_IO_BACKEND_SUPPORT
+
+//
+// This is a software model of an i8042 with a keyboard on the primary port
+// and a mouse on the auxiliary port, meant to be plugged into the controller
+// through setPortBackend.
+//
+// The model keeps its own clock in nanoseconds.  The clock only advances when
+// the controller touches a port (accessNanoseconds per inb/outb, roughly an
+// ISA I/O cycle) or asks for a delay, so a run is deterministic and executes
+// as fast as the host can go, while the time the controller "would have"
+// spent is still accounted for exactly.
+//
+// o  Status register: kOutputReady is set while a byte is latched in the
+//    output buffer, and kMouseData tells which port it came from.  Only one
+//    byte is latched at a time; the next one is picked when the data port
+//    is read, oldest ready byte first, so keyboard and mouse traffic come out
+//    interleaved in arrival order.  kInputBusy is held for inputNanoseconds
+//    after every write.
+//
+// o  Devices: every byte a device sends takes deviceByteNanoseconds to be
+//    clocked in (about 1.1 ms for 11 bits at 10 kHz).  Commands are
+//    acknowledged, with the usual extra bytes for kDP_GetId, kDP_Reset and
+//    kDP_GetMouseInformation.  A disabled clock (kCB_Disable*Clock) holds the
+//    device's bytes back until it is enabled again.
+//
+// o  Personalities: setReplies teaches a device the identification
+//    sequences of a particular pad.  When the bytes last sent to it end
+//    with a reply's command bytes, parameters included, the device
+//    acknowledges and answers with the reply instead of what the plain
+//    model would have said.  This is what gets a trackpad driver's probe
+//    and start through.
+//
+// o  Refusals: setRefusals has a device turn down a few of the bytes sent
+//    to it next, answering each with the given byte (kSC_Resend, say) and
+//    otherwise ignoring it, or not answering at all, so the controller's
+//    retry, deadline and cancel paths can be driven on purpose.
+//
+// o  Load: injectData queues arbitrary stream bytes from a device, and
+//    setStreamPacket makes an enabled device repeat a packet on its own at
+//    a fixed interval, so keyboard typing and trackpad motion can both run
+//    underneath a command sequence.
+//
+// o  Interrupts: when a byte is latched and its IRQ is enabled in the
+//    command byte, the interrupt action is called, which is where a harness
+//    hooks the controller's interrupt event sources.
+//
+// o  Idle time: nextEventTime says when the model next has something to
+//    show for itself, so a harness whose own clock follows ours can skip
+//    straight there instead of stepping through the gap.
+//
+// o  Replay: loadTrace takes a flight recorder capture (copyTrace) and
+//    plays the mouse bytes the controller read from the data port back as
+//    device data, so a session captured in the field runs through the
+//    controller and the real drivers again, as fast as the host can go.
+//    While a trace is loaded the mouse model is silent; every mouse byte
+//    comes from the trace.  Keyboard bytes are redacted in captures, so the
+//    keyboard model keeps answering commands and types nothing.
+//    Asynchronous bytes keep their original spacing, and a byte that
+//    followed a write in the trace is held back until the controller makes
+//    that write, so command responses stay in step.  Writes that differ from
+//    the trace are counted as mismatches, which is what a regression shows
+//    up as.
+//
+
+typedef void (*PS2SimulatorInterruptAction)(void * target,
+                                            PS2DeviceType deviceType);
+
+#define kSimulatorQueueSize     64      // bytes buffered per device
+#define kSimulatorPacketSize    8       // longest streamed packet
+#define kSimulatorCommandSize   10      // longest command sequence matched
+#define kSimulatorReplySize     4       // longest reply, after the ACK
+
+struct PS2SimulatorReply
+{
+  UInt8 commandCount;
+  UInt8 command[kSimulatorCommandSize]; // last bytes sent, oldest first
+  UInt8 replyCount;
+  UInt8 reply[kSimulatorReplySize];
+};
+typedef struct PS2SimulatorReply PS2SimulatorReply;
+
+struct PS2SimulatorStatistics
+{
+  UInt64 portReads;
+  UInt64 portWrites;
+  UInt64 delayNanoseconds;              // time the controller spent waiting
+  UInt64 bytesDelivered[2];             // per PS2DeviceType
+  UInt64 latencyTotal[2];               // ready-to-read, nanoseconds
+  UInt64 latencyMaximum[2];
+  UInt64 bytesDropped[2];               // device queue overflowed
+  UInt64 writesWhileBusy;               // written with kInputBusy still set
+  UInt64 replayBytes;                   // device bytes played from a trace
+  UInt64 replayMismatches;              // writes that differ from the trace
+};
+typedef struct PS2SimulatorStatistics PS2SimulatorStatistics;
+
+class ApplePS2PortSimulator
+{
+public:
+  void   init();
+  void   setTiming(UInt32 accessNanoseconds,
+                   UInt32 inputNanoseconds,
+                   UInt32 keyboardByteNanoseconds,
+                   UInt32 mouseByteNanoseconds);
+  void   getBackend(PS2PortBackend * backend);
+  void   setInterruptAction(void * target, PS2SimulatorInterruptAction action);
+
+  bool   injectData(PS2DeviceType deviceType, const UInt8 * bytes, UInt32 count);
+  void   setStreamPacket(PS2DeviceType deviceType,
+                         const UInt8 * packet,
+                         UInt32        packetSize,
+                         UInt64        intervalNanoseconds);
+  void   setReplies(PS2DeviceType             deviceType,
+                    const PS2SimulatorReply * replies,
+                    UInt32                    replyCount);
+  void   setRefusals(PS2DeviceType deviceType, UInt8 answer, UInt32 count,
+                     UInt32 after = 0);
+
+#if FLIGHT_RECORDER_SUPPORT
+  bool   loadTrace(const void * trace, UInt32 length);
+  bool   replayDone() const { return _replayNext == _replayCount; }
+#endif
+
+  void   advance(UInt64 nanoseconds);
+  UInt64 now() const { return _now; }
+  UInt64 nextEventTime() const;
+  UInt8  getCommandByte() const { return _commandByte; }
+
+  void   getStatistics(PS2SimulatorStatistics * statistics) const;
+  void   resetStatistics();
+
+private:
+  struct QueuedByte
+  {
+    UInt64 readyTime;
+    UInt8  data;
+  };
+
+  struct Device
+  {
+    QueuedByte queue[kSimulatorQueueSize];
+    UInt32     head;
+    UInt32     count;
+    UInt64     lineFreeTime;            // when the wire is free again
+    UInt32     byteNanoseconds;
+    UInt8      pendingCommand;          // command awaiting its parameter
+    bool       enabled;                 // data reporting on (kDP_Enable)
+    UInt8      packet[kSimulatorPacketSize];
+    UInt32     packetSize;
+    UInt64     packetInterval;
+    UInt64     nextPacketTime;
+    UInt8      history[kSimulatorCommandSize];  // last bytes sent, newest last
+    const PS2SimulatorReply * replies;
+    UInt32     replyCount;
+    UInt8      refusalAnswer;           // 0: refused bytes go unanswered
+    UInt32     refusalCount;            // bytes still to be refused
+    UInt32     refusalAfter;            // bytes to take before refusing
+  };
+
+  UInt64                      _now;
+  UInt32                      _accessNanoseconds;
+  UInt32                      _inputNanoseconds;
+  UInt64                      _inputBusyUntil;
+  UInt8                       _commandByte;
+  UInt8                       _pendingCommand;    // command port, awaiting data
+  bool                        _commandLastSent;
+
+  bool                        _outputFull;
+  UInt8                       _outputData;
+  PS2DeviceType               _outputSource;
+  UInt64                      _outputReadyTime;
+
+  Device                      _devices[2];        // per PS2DeviceType
+  QueuedByte                  _controllerQueue[4];
+  UInt32                      _controllerCount;
+
+  void *                      _interruptTarget;
+  PS2SimulatorInterruptAction _interruptAction;
+
+  PS2SimulatorStatistics      _statistics;
+
+#if FLIGHT_RECORDER_SUPPORT
+  const PS2TraceRecord *      _replayRecords;     // trace being played back
+  UInt32                      _replayCount;
+  UInt32                      _replayNext;        // next record to play
+  UInt32                      _replayWriteCursor; // past last matched write
+  UInt64                      _replayTicksPerSecond;
+  UInt64                      _replayFirstTime;   // trace time of record 0
+  UInt64                      _replayBase;        // our time of record 0
+  bool                        _replaySkipReply;   // next read was a reply
+
+  void   replayFeed();
+  void   replayWrite(UInt16 port, UInt8 byte);
+  UInt64 replayTime(const PS2TraceRecord * record) const;
+#endif
+
+  UInt8 portRead(UInt16 port);
+  void  portWrite(UInt16 port, UInt8 byte);
+  void  tick(UInt64 nanoseconds);
+  void  latchOutput();
+  bool  clockEnabled(PS2DeviceType deviceType) const;
+
+  void  controllerCommand(UInt8 command);
+  void  controllerReply(UInt8 data);
+  void  deviceCommand(PS2DeviceType deviceType, UInt8 command);
+  bool  deviceReply(PS2DeviceType deviceType);
+  bool  deviceSend(PS2DeviceType deviceType, UInt8 data, UInt64 sendTime);
+  bool  deviceQueue(PS2DeviceType deviceType, UInt8 data, UInt64 sendTime);
+
+  static UInt8 readAction(void * target, UInt16 port);
+  static void  writeAction(void * target, UInt16 port, UInt8 byte);
+  static void  delayAction(void * target, UInt32 microseconds);
+};
+
+#endif //PORT_IO_BACKEND_SUPPORT
+
+#endif /* _APPLEPS2PORTSIMULATOR_H */